@@ -0,0 +1,390 @@
+#include <PGUPV.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <normalGenerator.h>
+#include <threadPool.h>
+#include <animationNode.h>
+#include <matrixStack.h>
+
+#include <limits>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+using namespace PGUPV;
+
+/*
+Medidas de rendimiento de algunos algoritmos de la librería. Cada prueba compara la
+implementación actual con la que había antes (reproducida aquí), sobre datos del tamaño
+de los casos que motivaron el cambio. Los resultados se escriben en la salida estándar
+y la aplicación termina.
+
+Se puede ejecutar sólo una de las pruebas pasando su nombre como primer argumento:
+
+  Benchmarks normales
+*/
+
+namespace {
+
+	// Ejecuta f varias veces y devuelve el mejor tiempo, en milisegundos
+	double bestOf(uint repetitions, const std::function<void()> &f) {
+		double best = std::numeric_limits<double>::max();
+		for (uint i = 0; i < repetitions; i++) {
+			auto start = std::chrono::steady_clock::now();
+			f();
+			best = std::min(best, std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+
+	void report(const std::string &what, double ms, double referenceMs = 0.0) {
+		std::cout << "  " << std::left << std::setw(48) << what << std::right << std::fixed
+			<< std::setprecision(2) << std::setw(10) << ms << " ms";
+		if (referenceMs > 0.0)
+			std::cout << "  (x" << std::setprecision(1) << referenceMs / ms << ")";
+		std::cout << "\n";
+	}
+
+	/*
+	Normales y tangentes
+	*/
+
+	// Normales suaves tal y como las calculaba Mesh::computeSmoothNormals antes de usar
+	// NormalGenerator: un hilo, seis normalizaciones y tres acosf por triángulo, y
+	// soldadura de vértices ordenándolos
+	std::vector<glm::vec3> referenceSmoothNormals(const std::vector<glm::vec3> &vs,
+		const std::vector<uint> &tris, float epsilon) {
+		std::vector<glm::vec3> smoothNormals(vs.size(), glm::vec3(0.0f));
+
+		for (size_t t = 0; t + 2 < tris.size(); t += 3) {
+			const uint idx[3] = { tris[t], tris[t + 1], tris[t + 2] };
+			auto a = vs[idx[0]], b = vs[idx[1]], c = vs[idx[2]];
+
+			glm::vec3 un = glm::cross(b - a, c - a);
+			float module = glm::length(un);
+			if (module < 1e-5)
+				continue;
+			auto n = un / module;
+
+			float ang[3] = {
+				acosf(glm::dot(glm::normalize(b - a), glm::normalize(c - a))),
+				acosf(glm::dot(glm::normalize(c - b), glm::normalize(a - b))),
+				acosf(glm::dot(glm::normalize(a - c), glm::normalize(b - c))) };
+
+			for (int i = 0; i < 3; i++)
+				smoothNormals[idx[i]] += n * ang[i];
+		}
+
+		std::vector<uint> findDups(vs.size());
+		for (uint i = 0; i < findDups.size(); i++)
+			findDups[i] = i;
+		std::sort(findDups.begin(), findDups.end(), [&vs](uint a, uint b) {
+			for (int i = 0; i < 3; i++) {
+				if (vs[a][i] < vs[b][i]) return true;
+				if (vs[a][i] > vs[b][i]) return false;
+			}
+			return false;
+		});
+
+		float epsilonSquared = epsilon * epsilon;
+		uint firstInRun = 0;
+		for (uint i = 1; i < findDups.size(); i++) {
+			uint lastInRun = firstInRun;
+			while (i < findDups.size() &&
+				glm::dot(vs[findDups[i - 1]] - vs[findDups[i]], vs[findDups[i - 1]] - vs[findDups[i]]) < epsilonSquared) {
+				lastInRun = i;
+				i++;
+			}
+			if (lastInRun > firstInRun) {
+				glm::vec3 normalSum(0.0f);
+				for (uint j = firstInRun; j <= lastInRun; j++)
+					normalSum += smoothNormals[findDups[j]];
+				for (uint j = firstInRun; j <= lastInRun; j++)
+					smoothNormals[findDups[j]] = normalSum;
+			}
+			firstInRun = i;
+		}
+
+		for (auto &n : smoothNormals)
+			n = glm::normalize(n);
+		return smoothNormals;
+	}
+
+	void benchmarkNormals(const std::string &name, Mesh &mesh) {
+		auto vertices = mesh.getVertices();
+		auto tris = mesh.getTriangleList();
+		auto uvs = mesh.getTexCoords();
+
+		std::cout << name << ": " << vertices.size() << " vértices, " << tris.size() / 3
+			<< " triángulos\n";
+
+		std::vector<glm::vec3> before, after;
+		double tBefore = bestOf(3, [&]() { before = referenceSmoothNormals(vertices, tris, 1e-3f); });
+		report("normales (implementación anterior)", tBefore);
+		double tAfter = bestOf(3, [&]() { after = Mesh::smoothNormals(vertices, tris, 1e-3f); });
+		report(std::string("normales (NormalGenerator") +
+			(NormalGenerator::isVectorized() ? ", SIMD)" : ")"), tAfter, tBefore);
+
+		float worst = 1.0f;
+		for (size_t i = 0; i < before.size(); i++)
+			if (glm::dot(before[i], before[i]) > 0.5f && glm::dot(after[i], after[i]) > 0.5f)
+				worst = std::min(worst, glm::dot(before[i], after[i]));
+		std::cout << "  máxima diferencia entre ambas: " << std::setprecision(3)
+			<< glm::degrees(acosf(glm::clamp(worst, -1.0f, 1.0f))) << " grados\n";
+
+		if (uvs.size() == vertices.size()) {
+			std::vector<float> x(vertices.size()), y(x.size()), z(x.size()), nx(x.size()),
+				ny(x.size()), nz(x.size()), u(x.size()), v(x.size());
+			for (size_t i = 0; i < x.size(); i++) {
+				x[i] = vertices[i].x; y[i] = vertices[i].y; z[i] = vertices[i].z;
+				nx[i] = after[i].x; ny[i] = after[i].y; nz[i] = after[i].z;
+				u[i] = uvs[i].s; v[i] = uvs[i].t;
+			}
+			std::vector<float> tx(x.size()), ty(x.size()), tz(x.size()), tw(x.size());
+			NormalGenerator generator(x.data(), y.data(), z.data(), x.size(), tris.data(), tris.size() / 3);
+			report("tangentes con orientación (NormalGenerator)", bestOf(3, [&]() {
+				generator.computeTangents(nx.data(), ny.data(), nz.data(), u.data(), v.data(),
+					tx.data(), ty.data(), tz.data(), tw.data());
+			}));
+		}
+	}
+
+	void normals() {
+		// Modelos de stockModels teselados hasta superar el millón de triángulos
+		Sphere sphere(1.0f, 710, 710);
+		benchmarkNormals("Esfera", sphere.getMesh(0));
+		Cylinder cylinder(0.5f, 0.5f, 1.0f, 500, 1000);
+		benchmarkNormals("Cilindro", cylinder.getMesh(0));
+	}
+
+	/*
+	Búsqueda de fotogramas clave
+	*/
+
+	// Interpolación tal y como la hacía AnimationChannel antes de usar búsqueda binaria y
+	// cursores: recorrido lineal desde el primer fotograma y un std::function por llamada
+	template <typename T>
+	T referenceInterpolation(const std::vector<KeyFrameValue<T>> &keyframes,
+		float t, std::function<T(const T &x, const T &y, float a)> lerpFunc) {
+		if (t <= keyframes[0].tick)
+			return keyframes[0].value;
+		else if (t >= keyframes.back().tick)
+			return keyframes.back().value;
+		uint32_t i = 0;
+		while (t > keyframes[i].tick)
+			i++;
+		auto start = keyframes[i - 1];
+		auto end = keyframes[i];
+		return lerpFunc(start.value, end.value, (t - start.tick) / static_cast<float>(end.tick - start.tick));
+	}
+
+	void keyframes() {
+		const uint nkeys = 10000;
+		const uint nsamples = 20000;
+
+		// Un canal de captura de movimiento con 10000 fotogramas de cada tipo
+		AnimationChannel channel("hueso");
+		std::vector<KeyFrameValue<glm::vec3>> positions(nkeys), scalings(nkeys);
+		std::vector<KeyFrameValue<glm::quat>> rotations(nkeys);
+		for (uint i = 0; i < nkeys; i++) {
+			float tick = static_cast<float>(i);
+			positions[i] = { tick, glm::vec3(sinf(tick * 0.01f), cosf(tick * 0.013f), tick * 1e-3f) };
+			rotations[i] = { tick, glm::angleAxis(tick * 0.02f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f))) };
+			scalings[i] = { tick, glm::vec3(1.0f + 0.1f * sinf(tick * 0.005f)) };
+			channel.addPositionKeyFrame(positions[i]);
+			channel.addRotationKeyFrame(rotations[i]);
+			channel.addScalingKeyFrame(scalings[i]);
+		}
+		std::cout << "Canal con " << nkeys << " fotogramas clave por pista, " << nsamples
+			<< " evaluaciones\n";
+
+		// Instantes de reproducción continua y de acceso aleatorio
+		std::vector<float> playback(nsamples), random(nsamples);
+		uint seed = 12345;
+		for (uint i = 0; i < nsamples; i++) {
+			playback[i] = (nkeys - 1) * static_cast<float>(i) / nsamples;
+			seed = seed * 1664525u + 1013904223u;
+			random[i] = (nkeys - 1) * static_cast<float>(seed >> 8) / (1u << 24);
+		}
+
+		auto mix = [](const glm::vec3 &x, const glm::vec3 &y, float a) { return glm::mix(x, y, a); };
+		auto slerp = [](const glm::quat &x, const glm::quat &y, float a) { return glm::slerp(x, y, a); };
+		auto reference = [&](float t) {
+			return glm::translate(glm::mat4(1.0f), referenceInterpolation<glm::vec3>(positions, t, mix)) *
+				glm::mat4_cast(referenceInterpolation<glm::quat>(rotations, t, slerp)) *
+				glm::scale(glm::mat4(1.0f), referenceInterpolation<glm::vec3>(scalings, t, mix));
+		};
+
+		for (auto &test : { std::make_pair("reproducción", &playback), std::make_pair("acceso aleatorio", &random) }) {
+			const auto &times = *test.second;
+			float checkBefore = 0.0f, checkAfter = 0.0f, checkCursor = 0.0f;
+			double tBefore = bestOf(3, [&]() {
+				checkBefore = 0.0f;
+				for (auto t : times)
+					checkBefore += reference(t)[3][0];
+			});
+			report(std::string(test.first) + " (recorrido lineal)", tBefore);
+			report(std::string(test.first) + " (búsqueda binaria)", bestOf(3, [&]() {
+				checkAfter = 0.0f;
+				for (auto t : times)
+					checkAfter += channel.interpolate(t)[3][0];
+			}), tBefore);
+			report(std::string(test.first) + " (con cursor)", bestOf(3, [&]() {
+				AnimationChannel::Cursor cursor;
+				checkCursor = 0.0f;
+				for (auto t : times)
+					checkCursor += channel.interpolate(t, &cursor)[3][0];
+			}), tBefore);
+			float tolerance = 1e-3f * fabsf(checkBefore) + 1e-3f;
+			if (fabsf(checkBefore - checkAfter) > tolerance || fabsf(checkBefore - checkCursor) > tolerance)
+				std::cout << "  ¡los resultados no coinciden!\n";
+		}
+	}
+
+	/*
+	Pose de personajes con varias mallas
+	*/
+
+	// Paleta de huesos tal y como la calculaba AnimationNode::render antes de evaluar la
+	// pose una vez por frame: un recorrido completo de la jerarquía por cada malla
+	class ReferenceBoneMatricesUpdater : public NodeVisitor {
+	public:
+		ReferenceBoneMatricesUpdater(std::vector<glm::mat4> &boneMatrices, Skeleton &skeleton) :
+			boneMats(boneMatrices), skel(skeleton) {}
+		void apply(Transform &transform) override {
+			matstack.pushMatrix();
+			matstack.multMatrix(transform.getTransform());
+			auto b = skel.getBoneIndex(transform.getName());
+			if (b != Skeleton::NOBONE)
+				boneMats[b] = matstack.getMatrix() * skel.getBone(b)->getMatrix();
+			traverse(transform);
+			matstack.popMatrix();
+		}
+	private:
+		MatrixStack matstack;
+		std::vector<glm::mat4> &boneMats;
+		Skeleton &skel;
+	};
+
+	void skinning() {
+		const uint nBones = 64, nMeshes = 16, nFrames = 100;
+
+		auto mats = GLMatrices::build();
+		mats->bind();
+		ConstantIllumProgram::use();
+
+		// Un personaje con una cadena de huesos y varias mallas que comparten el esqueleto
+		auto root = Group::build();
+		auto skeleton = std::make_shared<Skeleton>();
+		std::shared_ptr<Group> parent = root;
+		glm::mat4 boneToModel(1.0f);
+		for (uint i = 0; i < nBones; i++) {
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.1f, 0.0f)) *
+				glm::rotate(glm::mat4(1.0f), 0.05f, glm::vec3(0.0f, 0.0f, 1.0f));
+			auto t = Transform::build(local);
+			t->setName("hueso" + std::to_string(i));
+			parent->addChild(t);
+			parent = t;
+			boneToModel = boneToModel * local;
+			auto bone = std::make_shared<Bone>(t->getName());
+			bone->setMatrix(glm::inverse(boneToModel));
+			skeleton->addBone(bone);
+		}
+		for (uint m = 0; m < nMeshes; m++) {
+			auto box = std::make_shared<Box>(0.1f);
+			if (m == 0)
+				for (uint v = 0; v < box->getMesh(0).getNVertices(); v++)
+					skeleton->getBone(v % nBones)->addWeight(v, 1.0f);
+			box->getMesh(0).setSkeleton(skeleton);
+			root->addChild(Geode::build(box));
+		}
+		AnimationNode character(root);
+
+		std::cout << "Personaje con " << nBones << " huesos y " << nMeshes << " mallas, "
+			<< nFrames << " frames\n";
+
+		std::vector<glm::mat4> palette;
+		double tBefore = bestOf(3, [&]() {
+			for (uint f = 0; f < nFrames; f++) {
+				for (uint m = 0; m < nMeshes; m++) {
+					palette.assign(UBOBones::MAX_BONES, glm::mat4(1.0f));
+					ReferenceBoneMatricesUpdater updater(palette, *skeleton);
+					root->accept(updater);
+				}
+			}
+		}) / nFrames;
+		report("pose por frame (un recorrido por malla)", tBefore);
+
+		// Contador de AnimationNode: tiempo dedicado a la pose y las paletas en cada render
+		int64_t poseUs = 0;
+		for (uint f = 0; f < nFrames; f++) {
+			// Todos los render son del mismo frame de la aplicación: se fuerza el cálculo
+			character.invalidatePose();
+			character.render();
+			poseUs += character.getPoseEvaluationTime();
+		}
+		report("pose por frame (AnimationNode)", poseUs / 1000.0 / nFrames, tBefore);
+	}
+
+	struct Benchmark {
+		std::string name;
+		std::function<void()> run;
+	};
+
+	const std::vector<Benchmark> benchmarks{
+		{ "normales", normals },
+		{ "fotogramas", keyframes },
+		{ "esqueleto", skinning },
+	};
+};
+
+class MyRender : public Renderer {
+public:
+	explicit MyRender(const std::string &only) : only(only) {}
+	void setup(void) override;
+	void render(void) override;
+	void reshape(uint w, uint h) override;
+
+private:
+	std::string only;
+};
+
+void MyRender::setup() {
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+	std::cout << ThreadPool::getInstance().getNThreads() << " hilos\n";
+	for (auto &b : benchmarks) {
+		if (!only.empty() && only != b.name)
+			continue;
+		std::cout << "\n[" << b.name << "]\n";
+		b.run();
+	}
+	std::cout.flush();
+	App::getInstance().done();
+}
+
+void MyRender::render() {
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void MyRender::reshape(uint w, uint h) {
+	glViewport(0, 0, w, h);
+}
+
+int main(int argc, char* argv[]) {
+	// El nombre de la prueba, si lo hay, va antes de las opciones de la aplicación
+	std::string only;
+	if (argc > 1 && argv[1][0] != '-') {
+		only = argv[1];
+		argv[1] = argv[0];
+		argc--;
+		argv++;
+	}
+
+	App& myApp = App::getInstance();
+	myApp.initApp(argc, argv, PGUPV::DOUBLE_BUFFER);
+	myApp.getWindow().setRenderer(std::make_shared<MyRender>(only));
+	return myApp.run();
+}
@@ -93,11 +93,10 @@ void MyRender::setup() {
 	phong.connectUniformBlock(UBOMaterial::build(), UBO_MATERIALS_BINDING_INDEX);
 
 	// Este shader se encarga de calcular la iluminación, usando
-	// el algoritmo de Gouraud 
+	// el algoritmo de Gouraud. No hace falta compilar los programas aquí: App los
+	// compila todos a la vez (ShaderLibrary::compileAll) antes del primer frame
 	gouraud.loadFiles("../Lighting/gouraud");
-	gouraud.compile();
 	phong.loadFiles("../Lighting/phong");
-	phong.compile();
 
 	// Definimos la posición y atributos de las fuentes
 	configureLights();
@@ -108,7 +107,6 @@ void MyRender::setup() {
 
 	constant.connectUniformBlock(mats, UBO_GL_MATRICES_BINDING_INDEX);
 	constant.loadFiles("../recursos/shaders/constantshadinguniform");
-	constant.compile();
 
 	setCameraHandler(std::make_shared<OrbitCameraHandler>());
 
@@ -9,7 +9,7 @@ using PGUPV::AnimationChannel;
 using PGUPV::KeyFrameValue;
 
 AnimationChannel::AnimationChannel(const std::string &name)
-	: nodeName(name)
+	: nodeName(name), compressed(false)
 {
 }
 
@@ -19,76 +19,437 @@ std::string AnimationChannel::getNodeName() const {
 
 void AnimationChannel::addPositionKeyFrame(const KeyFrameValue<glm::vec3>& pos)
 {
+	if (compressed)
+		ERRT("No se pueden añadir fotogramas clave a un canal comprimido");
 	positions.push_back(pos);
 }
 
 void AnimationChannel::addRotationKeyFrame(const KeyFrameValue<glm::quat>& rot)
 {
+	if (compressed)
+		ERRT("No se pueden añadir fotogramas clave a un canal comprimido");
 	rotations.push_back(rot);
 }
 
 void AnimationChannel::addScalingKeyFrame(const KeyFrameValue<glm::vec3>& sca)
 {
+	if (compressed)
+		ERRT("No se pueden añadir fotogramas clave a un canal comprimido");
 	scalings.push_back(sca);
 }
 
 uint32_t AnimationChannel::getNumFrames() const
 {
+	if (compressed)
+		return static_cast<uint32_t>(std::max({ compressedPositions.size(), compressedScalings.size(), compressedRotations.size() }));
 	return static_cast<uint32_t>(std::max({ positions.size(), scalings.size(), rotations.size() }));
 }
 
+/**
+Read-only view of an uncompressed track
+*/
 template <typename T>
-T linearInterpolation(const std::vector<KeyFrameValue<T>> &keyframes, 
-	float t, std::function<T (const T &x, const T &y, float a)> lerpFunc, 
-	const T &identity) {
-	if (keyframes.empty()) {
-		return identity;
+struct RawTrack {
+	const std::vector<KeyFrameValue<T>> &keyframes;
+	size_t size() const { return keyframes.size(); }
+	float tick(size_t i) const { return keyframes[i].tick; }
+	T value(size_t i) const { return keyframes[i].value; }
+};
+
+/**
+Read-only view of a compressed track (the values are decompressed when requested)
+*/
+template <typename Track>
+struct CompressedTrack {
+	const Track &track;
+	size_t size() const { return track.size(); }
+	float tick(size_t i) const { return track.ticks[i]; }
+	auto value(size_t i) const -> decltype(track.value(i)) { return track.value(i); }
+};
+
+/**
+Returns the index i of the keyframe such that track.tick(i-1) < t <= track.tick(i).
+The caller guarantees that track.tick(0) < t < track.tick(track.size() - 1).
+\param hint if not null, the index returned by the previous call (it is updated)
+*/
+template <typename Track>
+uint32_t findKeyFrame(const Track &track, float t, uint32_t *hint) {
+	size_t first = 1;
+	size_t last = track.size();
+	if (hint) {
+		size_t i = *hint;
+		if (i > 0 && i < track.size()) {
+			if (track.tick(i - 1) < t) {
+				// Forward playback: usually t is in the same segment or in one of the next ones
+				const uint32_t MAX_STEPS = 4;
+				for (uint32_t steps = 0; steps < MAX_STEPS && i < track.size(); steps++, i++) {
+					if (t <= track.tick(i)) {
+						*hint = static_cast<uint32_t>(i);
+						return static_cast<uint32_t>(i);
+					}
+				}
+				first = i;
+			}
+			else {
+				// We have gone back (e.g., the animation has looped)
+				last = i;
+			}
+		}
 	}
 
-	if (t <= keyframes[0].tick) {
-		return keyframes[0].value;
+	// Binary search of the first keyframe with tick >= t
+	while (first < last) {
+		size_t mid = first + (last - first) / 2;
+		if (track.tick(mid) < t)
+			first = mid + 1;
+		else
+			last = mid;
 	}
-	else if (t >= keyframes.back().tick) {
-		return keyframes.back().value;
+	uint32_t i = static_cast<uint32_t>(first);
+	if (hint) *hint = i;
+	return i;
+}
+
+template <typename Track, typename T, typename Lerp>
+T linearInterpolation(const Track &track, float t, Lerp lerpFunc, const T &identity, uint32_t *hint) {
+	if (track.size() == 0) {
+		return identity;
+	}
+
+	if (t <= track.tick(0)) {
+		return track.value(0);
 	}
-	uint32_t i = 0;
-	while (t > keyframes[i].tick) {
-		i++;
+	else if (t >= track.tick(track.size() - 1)) {
+		return track.value(track.size() - 1);
 	}
+	uint32_t i = findKeyFrame(track, t, hint);
 
-	// keyframes[i-1].tick < t <= keyframes[i].tick 
-	auto start = keyframes[i - 1];
-	auto end = keyframes[i];
+	// track.tick(i-1) < t <= track.tick(i)
+	const float startTick = track.tick(i - 1);
+	const float endTick = track.tick(i);
 
-//	return (t - start.tick)*(end.value - start.value) / static_cast<float>(end.tick - start.tick) + start.value;
-	return lerpFunc(start.value, end.value, (t - start.tick) / static_cast<float>(end.tick - start.tick));
+	return lerpFunc(track.value(i - 1), track.value(i), (t - startTick) / (endTick - startTick));
 }
 
-glm::vec3 AnimationChannel::interpolatePosition(float t) const
-{
-	return linearInterpolation<glm::vec3>(positions, t, [](const glm::vec3 &x, const glm::vec3 &y, float t) {
+struct MixLerp {
+	glm::vec3 operator()(const glm::vec3 &x, const glm::vec3 &y, float t) const {
 		return glm::mix(x, y, t);
-	}, glm::vec3(0.0f));
+	}
+};
+
+struct SlerpLerp {
+	glm::quat operator()(const glm::quat &x, const glm::quat &y, float t) const {
+		return glm::slerp(x, y, t);
+	}
+};
+
+glm::vec3 AnimationChannel::interpolatePosition(float t, Cursor *cursor) const
+{
+	uint32_t *hint = cursor ? &cursor->position : nullptr;
+	if (compressed)
+		return linearInterpolation(CompressedTrack<CompressedVec3Track>{ compressedPositions }, t, MixLerp(), glm::vec3(0.0f), hint);
+	return linearInterpolation(RawTrack<glm::vec3>{ positions }, t, MixLerp(), glm::vec3(0.0f), hint);
 }
 
-glm::quat AnimationChannel::interpolateRotation(float t) const 
+glm::quat AnimationChannel::interpolateRotation(float t, Cursor *cursor) const 
 {
-	return linearInterpolation<glm::quat>(rotations, t, [](const glm::quat &x, const glm::quat &y, float t) {
-		return glm::slerp(x, y, t);
-	}, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	uint32_t *hint = cursor ? &cursor->rotation : nullptr;
+	if (compressed)
+		return linearInterpolation(CompressedTrack<CompressedQuatTrack>{ compressedRotations }, t, SlerpLerp(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), hint);
+	return linearInterpolation(RawTrack<glm::quat>{ rotations }, t, SlerpLerp(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), hint);
 }
 
-glm::vec3 AnimationChannel::interpolateScaling(float t) const 
+glm::vec3 AnimationChannel::interpolateScaling(float t, Cursor *cursor) const 
 {
-	return linearInterpolation<glm::vec3>(scalings, t, [](const glm::vec3 &x, const glm::vec3 &y, float t) {
-		return glm::mix(x, y, t);
-	}, glm::vec3(1.0f));
+	uint32_t *hint = cursor ? &cursor->scaling : nullptr;
+	if (compressed)
+		return linearInterpolation(CompressedTrack<CompressedVec3Track>{ compressedScalings }, t, MixLerp(), glm::vec3(1.0f), hint);
+	return linearInterpolation(RawTrack<glm::vec3>{ scalings }, t, MixLerp(), glm::vec3(1.0f), hint);
 }
 
-glm::mat4 AnimationChannel::interpolate(float t) const
+glm::mat4 AnimationChannel::interpolate(float t, Cursor *cursor) const
 {
 	return 
-		glm::translate(glm::mat4(1.0f), interpolatePosition(t)) *
-		glm::mat4_cast(interpolateRotation(t)) *
-		glm::scale(glm::mat4(1.0f), interpolateScaling(t));
+		glm::translate(glm::mat4(1.0f), interpolatePosition(t, cursor)) *
+		glm::mat4_cast(interpolateRotation(t, cursor)) *
+		glm::scale(glm::mat4(1.0f), interpolateScaling(t, cursor));
+}
+
+/*
+Keyframe compression
+*/
+
+namespace {
+	const float SQRT1_2 = 0.70710678f;
+	const uint32_t QUAT_BITS = 15;
+	const float QUAT_MAX = static_cast<float>((1u << QUAT_BITS) - 1);
+	const float VEC3_MAX = 65535.0f;
+	// Longest run of keyframes replaced by a single segment (it bounds the cost of the fit)
+	const size_t MAX_SEGMENT_KEYS = 256;
+
+	float vec3Error(const glm::vec3 &a, const glm::vec3 &b) {
+		return glm::length(a - b);
+	}
+
+	// Angle of the rotation between a and b (atan2 is more precise than acos for small angles)
+	float quatError(const glm::quat &a, const glm::quat &b) {
+		glm::quat d = a * glm::inverse(b);
+		return 2.0f * std::atan2(glm::length(glm::vec3(d.x, d.y, d.z)), std::abs(d.w));
+	}
+
+	void encodeQuat(glm::quat q, uint16_t *out) {
+		q = glm::normalize(q);
+		float c[4] = { q.x, q.y, q.z, q.w };
+		uint32_t largest = 0;
+		for (uint32_t i = 1; i < 4; i++) {
+			if (std::abs(c[i]) > std::abs(c[largest]))
+				largest = i;
+		}
+		// q and -q are the same rotation: the dropped component is always positive
+		float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+		uint64_t bits = largest;
+		for (uint32_t i = 0; i < 4; i++) {
+			if (i == largest) continue;
+			float v = glm::clamp(sign * c[i], -SQRT1_2, SQRT1_2);
+			uint64_t qv = static_cast<uint64_t>(std::lround((v + SQRT1_2) / (2.0f * SQRT1_2) * QUAT_MAX));
+			bits = (bits << QUAT_BITS) | qv;
+		}
+		out[0] = static_cast<uint16_t>(bits >> 32);
+		out[1] = static_cast<uint16_t>(bits >> 16);
+		out[2] = static_cast<uint16_t>(bits);
+	}
+
+	glm::quat decodeQuat(const uint16_t *in) {
+		uint64_t bits = (static_cast<uint64_t>(in[0]) << 32) | (static_cast<uint64_t>(in[1]) << 16) | in[2];
+		const uint64_t mask = (1u << QUAT_BITS) - 1;
+		uint32_t largest = static_cast<uint32_t>(bits >> (3 * QUAT_BITS)) & 3;
+		float c[4];
+		float sum = 0.0f;
+		int shift = 2 * QUAT_BITS;
+		for (uint32_t i = 0; i < 4; i++) {
+			if (i == largest) continue;
+			float v = static_cast<float>((bits >> shift) & mask) / QUAT_MAX * (2.0f * SQRT1_2) - SQRT1_2;
+			c[i] = v;
+			sum += v * v;
+			shift -= QUAT_BITS;
+		}
+		c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+		return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+	}
+
+	/*
+	Selects the keyframes to keep: starting from a kept keyframe, the next one is the
+	farthest keyframe such that interpolating between both (with the quantised values)
+	reproduces all the keyframes in between within the tolerance
+	*/
+	template <typename T, typename Lerp, typename Error>
+	std::vector<size_t> reduceKeys(const std::vector<KeyFrameValue<T>> &keys, const std::vector<T> &decoded,
+		float tolerance, Lerp lerp, Error error) {
+		const size_t n = keys.size();
+		std::vector<size_t> kept;
+		if (n == 0)
+			return kept;
+		kept.push_back(0);
+
+		// A constant track only needs one keyframe
+		bool constant = true;
+		for (size_t k = 1; k < n && constant; k++)
+			constant = error(decoded[0], keys[k].value) <= tolerance;
+		if (constant)
+			return kept;
+
+		auto fits = [&](size_t i, size_t j) {
+			const float span = keys[j].tick - keys[i].tick;
+			for (size_t k = i + 1; k < j; k++) {
+				float f = span > 0.0f ? (keys[k].tick - keys[i].tick) / span : 0.0f;
+				if (error(lerp(decoded[i], decoded[j], f), keys[k].value) > tolerance)
+					return false;
+			}
+			return true;
+		};
+
+		size_t i = 0;
+		while (i < n - 1) {
+			size_t j = i + 1;
+			while (j + 1 < n && j + 1 - i <= MAX_SEGMENT_KEYS && fits(i, j + 1))
+				j++;
+			kept.push_back(j);
+			i = j;
+		}
+		return kept;
+	}
+
+	/*
+	Quantises the values of the track to 16 bits per component. If the quantisation error
+	alone exceeds the tolerance, the values are kept as they are (quantised is false)
+	*/
+	std::vector<glm::vec3> quantize(const std::vector<KeyFrameValue<glm::vec3>> &keys, float tolerance,
+		PGUPV::CompressedVec3Track &track, bool &quantized) {
+		glm::vec3 lo(0.0f), hi(0.0f);
+		if (!keys.empty()) {
+			lo = hi = keys[0].value;
+			for (const auto &k : keys) {
+				lo = glm::min(lo, k.value);
+				hi = glm::max(hi, k.value);
+			}
+		}
+		track.offset = lo;
+		track.step = (hi - lo) / VEC3_MAX;
+
+		std::vector<glm::vec3> decoded(keys.size());
+		quantized = true;
+		for (size_t k = 0; k < keys.size(); k++) {
+			for (int c = 0; c < 3; c++) {
+				float q = track.step[c] > 0.0f ? std::round((keys[k].value[c] - lo[c]) / track.step[c]) : 0.0f;
+				decoded[k][c] = lo[c] + q * track.step[c];
+			}
+			if (vec3Error(decoded[k], keys[k].value) > tolerance)
+				quantized = false;
+		}
+		if (!quantized) {
+			for (size_t k = 0; k < keys.size(); k++)
+				decoded[k] = keys[k].value;
+		}
+		return decoded;
+	}
+
+	void buildTrack(const std::vector<KeyFrameValue<glm::vec3>> &keys, const std::vector<glm::vec3> &decoded,
+		const std::vector<size_t> &kept, bool quantized, PGUPV::CompressedVec3Track &track) {
+		track.ticks.clear();
+		track.values.clear();
+		track.raw.clear();
+		for (size_t k : kept) {
+			track.ticks.push_back(keys[k].tick);
+			if (!quantized) {
+				track.raw.push_back(decoded[k]);
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				float q = track.step[c] > 0.0f ? (decoded[k][c] - track.offset[c]) / track.step[c] : 0.0f;
+				track.values.push_back(static_cast<uint16_t>(glm::clamp(std::lround(q), 0L, 65535L)));
+			}
+		}
+	}
+
+	/*
+	Quantises the rotations with the smallest three encoding. As with the vec3 tracks, if the
+	quantisation error alone exceeds the tolerance, the values are kept as they are
+	*/
+	std::vector<glm::quat> quantize(const std::vector<KeyFrameValue<glm::quat>> &keys, float tolerance,
+		bool &quantized) {
+		std::vector<glm::quat> decoded(keys.size());
+		quantized = true;
+		for (size_t k = 0; k < keys.size(); k++) {
+			uint16_t encoded[3];
+			encodeQuat(keys[k].value, encoded);
+			decoded[k] = decodeQuat(encoded);
+			if (quatError(decoded[k], keys[k].value) > tolerance)
+				quantized = false;
+		}
+		if (!quantized) {
+			for (size_t k = 0; k < keys.size(); k++)
+				decoded[k] = keys[k].value;
+		}
+		return decoded;
+	}
+
+	void buildTrack(const std::vector<KeyFrameValue<glm::quat>> &keys, const std::vector<size_t> &kept,
+		bool quantized, PGUPV::CompressedQuatTrack &track) {
+		track.ticks.clear();
+		track.values.clear();
+		track.raw.clear();
+		if (quantized)
+			track.values.assign(3 * kept.size(), 0);
+		for (size_t i = 0; i < kept.size(); i++) {
+			track.ticks.push_back(keys[kept[i]].tick);
+			if (quantized)
+				encodeQuat(keys[kept[i]].value, &track.values[3 * i]);
+			else
+				track.raw.push_back(keys[kept[i]].value);
+		}
+	}
+
+	template <typename Track, typename T, typename Lerp, typename Error>
+	float maxError(const Track &track, const std::vector<KeyFrameValue<T>> &keys, Lerp lerp, const T &identity, Error error) {
+		float result = 0.0f;
+		uint32_t hint = 0;
+		for (const auto &k : keys)
+			result = std::max(result, error(linearInterpolation(CompressedTrack<Track>{ track }, k.tick, lerp, identity, &hint), k.value));
+		return result;
+	}
+
+	template <typename Track>
+	size_t trackBytes(const Track &track) {
+		return sizeof(Track) + track.ticks.size() * sizeof(float) + track.values.size() * sizeof(uint16_t);
+	}
+
+	size_t trackBytes(const PGUPV::CompressedVec3Track &track) {
+		return trackBytes<PGUPV::CompressedVec3Track>(track) + track.raw.size() * sizeof(glm::vec3);
+	}
+
+	size_t trackBytes(const PGUPV::CompressedQuatTrack &track) {
+		return trackBytes<PGUPV::CompressedQuatTrack>(track) + track.raw.size() * sizeof(glm::quat);
+	}
+};
+
+glm::quat PGUPV::CompressedQuatTrack::value(size_t i) const {
+	if (!raw.empty())
+		return raw[i];
+	return decodeQuat(&values[3 * i]);
+}
+
+void AnimationChannel::CompressionStats::accumulate(const CompressionStats &other)
+{
+	originalBytes += other.originalBytes;
+	compressedBytes += other.compressedBytes;
+	originalKeys += other.originalKeys;
+	compressedKeys += other.compressedKeys;
+	maxPositionError = std::max(maxPositionError, other.maxPositionError);
+	maxRotationError = std::max(maxRotationError, other.maxRotationError);
+	maxScalingError = std::max(maxScalingError, other.maxScalingError);
+}
+
+size_t AnimationChannel::getMemoryUsage() const
+{
+	if (compressed)
+		return trackBytes(compressedPositions) + trackBytes(compressedRotations) + trackBytes(compressedScalings);
+	return positions.size() * sizeof(KeyFrameValue<glm::vec3>) + rotations.size() * sizeof(KeyFrameValue<glm::quat>) +
+		scalings.size() * sizeof(KeyFrameValue<glm::vec3>);
+}
+
+AnimationChannel::CompressionStats AnimationChannel::compress(const CompressionSettings &settings)
+{
+	CompressionStats stats;
+	if (compressed)
+		return stats;
+
+	stats.originalBytes = getMemoryUsage();
+	stats.originalKeys = static_cast<uint32_t>(positions.size() + rotations.size() + scalings.size());
+
+	bool quantized;
+	auto posDecoded = quantize(positions, settings.positionTolerance, compressedPositions, quantized);
+	auto posKept = reduceKeys(positions, posDecoded, settings.positionTolerance, MixLerp(), vec3Error);
+	buildTrack(positions, posDecoded, posKept, quantized, compressedPositions);
+
+	auto scaDecoded = quantize(scalings, settings.scalingTolerance, compressedScalings, quantized);
+	auto scaKept = reduceKeys(scalings, scaDecoded, settings.scalingTolerance, MixLerp(), vec3Error);
+	buildTrack(scalings, scaDecoded, scaKept, quantized, compressedScalings);
+
+	auto rotDecoded = quantize(rotations, settings.rotationTolerance, quantized);
+	auto rotKept = reduceKeys(rotations, rotDecoded, settings.rotationTolerance, SlerpLerp(), quatError);
+	buildTrack(rotations, rotKept, quantized, compressedRotations);
+
+	stats.maxPositionError = maxError(compressedPositions, positions, MixLerp(), glm::vec3(0.0f), vec3Error);
+	stats.maxScalingError = maxError(compressedScalings, scalings, MixLerp(), glm::vec3(1.0f), vec3Error);
+	stats.maxRotationError = maxError(compressedRotations, rotations, SlerpLerp(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), quatError);
+
+	// From now on, the keyframes are read from the compressed tracks
+	std::vector<KeyFrameValue<glm::vec3>>().swap(positions);
+	std::vector<KeyFrameValue<glm::quat>>().swap(rotations);
+	std::vector<KeyFrameValue<glm::vec3>>().swap(scalings);
+	compressed = true;
+
+	stats.compressedBytes = getMemoryUsage();
+	stats.compressedKeys = static_cast<uint32_t>(posKept.size() + rotKept.size() + scaKept.size());
+	return stats;
 }
@@ -3,6 +3,7 @@
 #include "utils.h"
 
 #include <cmath>
+#include <sstream>
 
 using PGUPV::AnimationClip;
 using PGUPV::AnimationChannel;
@@ -87,12 +88,18 @@ float wrapAnimationTime(float t, AnimationClip::WrapMode wrapMode, float duratio
 }
 
 
-bool AnimationClip::interpolate(const float t, const std::string & boneId, glm::mat4 & mat) const
+float AnimationClip::toTicks(float t) const
 {
-	float theTime = wrapAnimationTime(t * ticksPerSec, wrapMode, getDurationInTicks());
-	auto ac = getAnimationChannel(boneId);
-	if (ac) {
-		mat = ac->interpolate(theTime);
+	return wrapAnimationTime(t * ticksPerSec, wrapMode, getDurationInTicks());
+}
+
+bool AnimationClip::interpolate(const float t, const std::string & boneId, glm::mat4 & mat, CursorCache *cursors) const
+{
+	float theTime = toTicks(t);
+	const auto it = channels.find(boneId);
+	if (it != channels.end()) {
+		const AnimationChannel *ac = it->second.get();
+		mat = ac->interpolate(theTime, cursors ? &(*cursors)[ac] : nullptr);
 		return true;
 	}
 	return false;
@@ -106,4 +113,24 @@ const std::shared_ptr<AnimationChannel> AnimationClip::getAnimationChannel(const
 	return std::shared_ptr<AnimationChannel>();
 }
 
+AnimationChannel::CompressionStats AnimationClip::compress(const AnimationChannel::CompressionSettings &settings)
+{
+	AnimationChannel::CompressionStats stats;
+	for (auto &c : channels)
+		stats.accumulate(c.second->compress(settings));
+
+	std::ostringstream os;
+	os << "Clip " << id << " comprimido: " << stats.originalBytes << " -> " << stats.compressedBytes << " bytes, "
+		<< stats.originalKeys << " -> " << stats.compressedKeys << " fotogramas clave. Error mximo: posicin "
+		<< stats.maxPositionError << ", rotacin " << stats.maxRotationError << " rad, escala " << stats.maxScalingError;
+	INFO(os.str());
+	return stats;
+}
 
+size_t AnimationClip::getMemoryUsage() const
+{
+	size_t bytes = 0;
+	for (auto &c : channels)
+		bytes += c.second->getMemoryUsage();
+	return bytes;
+}
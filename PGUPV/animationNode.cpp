@@ -7,21 +7,31 @@
 #include "uboBones.h"
 #include "indexedBindingPoint.h"
 #include "glMatrices.h"
+#include "uniformStream.h"
 #include "skeleton.h"
 #include "bone.h"
 #include "nodeCallback.h"
 #include "app.h"
+#include "stopWatch.h"
+#include "threadPool.h"
 
 #include <glm/gtc/matrix_inverse.hpp>
 
 using PGUPV::AnimationNode;
 using PGUPV::AnimatorController;
 using PGUPV::AnimatorState;
+using PGUPV::AnimatorLayer;
+using PGUPV::AnimationMask;
 using PGUPV::Node;
 using PGUPV::NodeVisitor;
 using PGUPV::Mesh;
 using PGUPV::Skeleton;
 using PGUPV::Bone;
+using PGUPV::AnimationClip;
+using PGUPV::CompiledAnimationClip;
+using PGUPV::TRS;
+using PGUPV::UniformStream;
+using PGUPV::Program;
 
 class Updater : public PGUPV::NodeCallback {
 public:
@@ -33,6 +43,7 @@ void Updater::operator()(Node & node, NodeVisitor & nv)
 {
 	auto &an = static_cast<AnimationNode &>(node);
 	an.getAnimatorController()->update(PGUPV::App::getDeltaTime());
+	an.invalidatePose();
 	traverse(node, nv);
 }
 
@@ -52,67 +63,265 @@ class AnimatedMeshRenderer : public NodeVisitor {
 };
 
 
-class BoneMatricesUpdater : public PGUPV::NodeVisitor {
+/*
+Aplana la jerarquía de Transforms de la subescena: nombre, padre y nodo de cada uno, en preorden
+*/
+class FlattenHierarchy : public PGUPV::NodeVisitor {
 public:
-	BoneMatricesUpdater(
-		const glm::mat4 &currentWCS,
-		std::shared_ptr<AnimatorState> anim,
-		std::vector<glm::mat4> &boneMatrices,
-		PGUPV::Skeleton &skeleton
-	) : animation(anim), boneMats(boneMatrices), skel(skeleton) {
-		matstack.setMatrix(currentWCS);
+	FlattenHierarchy(std::vector<std::string> &names, std::vector<uint32_t> &parents,
+		std::vector<std::shared_ptr<PGUPV::Transform>> &transforms, uint32_t noParent) :
+		names(names), parents(parents), transforms(transforms), current(noParent) {
+		names.clear();
+		parents.clear();
+		transforms.clear();
 	};
 
 	void apply(PGUPV::Transform &transform) override {
-		matstack.pushMatrix();
-		glm::mat4 mat;
-		if (animation && animation->interpolate(transform.getName(), mat))
-			matstack.multMatrix(mat);
-		else
-			matstack.multMatrix(transform.getTransform());
+		uint32_t index = static_cast<uint32_t>(names.size());
+		names.push_back(transform.getName());
+		parents.push_back(current);
+		// El nodo se podría quitar de la subescena mientras se usa la tabla
+		transforms.push_back(std::static_pointer_cast<PGUPV::Transform>(transform.shared_from_this()));
+
+		uint32_t parent = current;
+		current = index;
+		traverse(transform);
+		current = parent;
+	}
+private:
+	std::vector<std::string> &names;
+	std::vector<uint32_t> &parents;
+	std::vector<std::shared_ptr<PGUPV::Transform>> &transforms;
+	uint32_t current;
+};
 
-		auto b = skel.getBoneIndex(transform.getName());
-		if (b != PGUPV::Skeleton::NOBONE) {
-			boneMats[b] = matstack.getMatrix() * skel.getBone(b)->getMatrix();
+AnimationNode::StateBinding *AnimationNode::sampleState(const AnimatorState &state)
+{
+	std::shared_ptr<AnimationClip> clip = state.getAnimationClip();
+	if (!clip)
+		return nullptr;
+
+	StateBinding &binding = stateBindings[&state];
+	if (!binding.compiled || binding.compiled->getClip() != clip) {
+		binding.compiled = std::make_shared<CompiledAnimationClip>(clip, nodeNames);
+		binding.cursors.clear();
+		binding.pose = bindPose;
+		binding.reference = bindPose;
+		binding.compiled->sample(0.0f, binding.reference);
+	}
+	binding.compiled->sample(state.getAnimationTime(), binding.pose, &binding.cursors);
+	return &binding;
+}
 
+const float *AnimationNode::getMaskWeights(const AnimationMask *mask)
+{
+	if (!mask)
+		return nullptr;
+
+	MaskBinding &binding = maskBindings[mask];
+	if (binding.weights.size() == nodeNames.size() && binding.version == mask->getVersion())
+		return binding.weights.data();
+
+	// Los pesos recursivos se heredan de padres a hijos (los padres van antes en preorden)
+	const size_t n = nodeNames.size();
+	binding.version = mask->getVersion();
+	binding.weights.resize(n);
+	std::vector<float> inherited(n);
+	std::vector<bool> inherits(n);
+	for (size_t i = 0; i < n; i++) {
+		uint32_t parent = nodeParents[i];
+		bool parentInherits = parent != NOPARENT && inherits[parent];
+		float w;
+		bool recursive;
+		if (mask->getWeight(nodeNames[i], w, recursive)) {
+			binding.weights[i] = w;
+			inherits[i] = recursive || parentInherits;
+			inherited[i] = recursive ? w : (parentInherits ? inherited[parent] : 0.0f);
 		}
-		traverse(transform);
+		else {
+			binding.weights[i] = parentInherits ? inherited[parent] : mask->getDefaultWeight();
+			inherits[i] = parentInherits;
+			inherited[i] = parentInherits ? inherited[parent] : 0.0f;
+		}
+	}
+	return binding.weights.data();
+}
+
+void AnimationNode::evaluatePose()
+{
+	const size_t n = nodeNames.size();
+	pose = bindPose;
+	animated.assign(n, false);
+
+	const std::vector<std::shared_ptr<AnimatorLayer>> noLayers;
+	const auto &layers = animController ? animController->getLayers() : noLayers;
+
+	for (auto &layer : layers) {
+		std::shared_ptr<AnimatorState> cur = layer->currentState();
+		if (!cur || layer->getWeight() <= 0.0f)
+			continue;
+		StateBinding *c = sampleState(*cur);
+		if (!c)
+			continue;
+		std::shared_ptr<AnimatorState> prev = layer->previousState();
+		StateBinding *p = prev ? sampleState(*prev) : nullptr;
+		const float fade = p ? layer->getFadeWeight() : 1.0f;
+		const float *mask = getMaskWeights(layer->getMask().get());
+		const bool additive = layer->getBlendMode() == AnimatorLayer::BlendMode::ADDITIVE;
+
+		for (size_t i = 0; i < n; i++) {
+			bool bc = c->compiled->isBound(i);
+			bool bp = p && p->compiled->isBound(i);
+			if (!bc && !bp)
+				continue;
+			float w = layer->getWeight() * (mask ? mask[i] : 1.0f);
+			if (w <= 0.0f)
+				continue;
+
+			if (additive) {
+				TRS delta = bc ? TRS::difference(c->pose[i], c->reference[i]) : TRS();
+				if (p)
+					delta = TRS::blend(bp ? TRS::difference(p->pose[i], p->reference[i]) : TRS(), delta, fade);
+				pose[i] = TRS::add(pose[i], delta, w);
+			}
+			else {
+				TRS layerPose = bc ? c->pose[i] : pose[i];
+				if (p)
+					layerPose = TRS::blend(bp ? p->pose[i] : pose[i], layerPose, fade);
+				pose[i] = TRS::blend(pose[i], layerPose, w);
+			}
+			animated[i] = true;
+		}
+	}
+
+	// Olvidamos los estados que ya no usa ninguna capa
+	for (auto it = stateBindings.begin(); it != stateBindings.end(); ) {
+		bool used = false;
+		for (auto &layer : layers)
+			used = used || layer->currentState().get() == it->first || layer->previousState().get() == it->first;
+		if (used) ++it;
+		else it = stateBindings.erase(it);
+	}
+
+	nodeWorld.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		glm::mat4 local = animated[i] ? pose[i].toMatrix() : nodeTransforms[i]->getTransform();
+		nodeWorld[i] = nodeParents[i] == NOPARENT ? local : nodeWorld[nodeParents[i]] * local;
+	}
+	poseUpToDate = true;
+	poseFrame = PGUPV::App::getInstance().getCurrentFrame();
+}
+
+bool AnimationNode::isPoseUpToDate() const
+{
+	// Si el controlador se actualiza sin pasar por el callback, al menos se recalcula en
+	// cada frame
+	return poseUpToDate && poseFrame == PGUPV::App::getInstance().getCurrentFrame();
+}
 
-		matstack.popMatrix();
+class CollectAnimationNodes : public PGUPV::NodeVisitor {
+public:
+	explicit CollectAnimationNodes(std::vector<AnimationNode *> &nodes) : nodes(nodes) {};
+	void apply(AnimationNode &node) override {
+		nodes.push_back(&node);
+		traverse(node);
 	}
 private:
-	PGUPV::MatrixStack matstack;
-	std::shared_ptr<AnimatorState> animation;
-	std::vector<glm::mat4> &boneMats;
-	PGUPV::Skeleton &skel;
+	std::vector<AnimationNode *> &nodes;
 };
 
-void AnimationNode::render()
+void AnimationNode::evaluatePoses(const std::vector<AnimationNode *> &nodes)
+{
+	// Cada nodo sólo modifica sus propios datos, y los clips compartidos sólo se leen
+	// Las subescenas que han cambiado se vuelven a aplanar aquí: pueden compartir nodos
+	for (auto n : nodes)
+		n->refreshHierarchy();
+	PGUPV::ThreadPool::getInstance().parallelFor(0, nodes.size(), [&nodes](size_t b, size_t e) {
+		for (size_t i = b; i < e; i++) {
+			if (!nodes[i]->isPoseUpToDate())
+				nodes[i]->evaluatePose();
+		}
+	}, 1);
+}
+
+void AnimationNode::evaluatePoses(Node &root)
 {
-	std::vector<glm::mat4> boneMatrices(UBOBones::MAX_BONES, glm::mat4(1.0f));
+	std::vector<AnimationNode *> nodes;
+	CollectAnimationNodes collector(nodes);
+	root.accept(collector);
+	evaluatePoses(nodes);
+}
 
+const AnimationNode::BoneRemap &AnimationNode::getBoneRemap(const std::shared_ptr<Skeleton> &skeleton)
+{
+	auto &remap = boneRemaps[skeleton.get()];
+	const uint32_t nBones = skeleton->getNBones();
+	// Si el esqueleto que estaba en esa dirección se ha destruido, la tabla es de otro
+	if (remap.skeleton.lock() == skeleton && remap.nodes.size() == nBones)
+		return remap;
+
+	// Los nombres sólo se buscan la primera vez. Si varios nodos tienen el nombre de un
+	// hueso, se queda el último en preorden
+	remap.skeleton = skeleton;
+	remap.nodes.assign(nBones, NOPARENT);
+	remap.offsets.resize(nBones);
+	for (size_t i = 0; i < nodeNames.size(); i++) {
+		uint32_t b = skeleton->getBoneIndex(nodeNames[i]);
+		if (b != Skeleton::NOBONE)
+			remap.nodes[b] = static_cast<uint32_t>(i);
+	}
+	for (uint32_t b = 0; b < nBones; b++)
+		remap.offsets[b] = skeleton->getBone(b)->getMatrix();
+	return remap;
+}
+
+void AnimationNode::render()
+{
 	auto mats = std::dynamic_pointer_cast<GLMatrices>(gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX));
 
+	PGUPV::MicroSecStopWatch stopWatch;
+	int64_t poseTime = 0;
+	bool poseEvaluated = false;
+	Program *previous = useProgram();
+	refreshHierarchy();
+
 	for (auto m : meshes) {
 		std::shared_ptr<Skeleton> skeleton = m->getSkeleton();
 		if (!skeleton)
 			continue;
 
-		BoneMatricesUpdater updater(
-			//mats->getMatrix(GLMatrices::MODEL_MATRIX), 
-			glm::mat4(1.0f),
-			animController->currentState(), 
-			boneMatrices, 
-			*skeleton);
-		subScene->accept(updater);
-
 		auto nBones = skeleton->getNBones();
 		std::shared_ptr<UBOBones> ubobones = m->getBones();
 		if (nBones == 0 || !ubobones) {
 			continue;
 		}
-		gl_uniform_buffer.bindBufferBase(ubobones, UBO_BONES_BINDING_INDEX);
-		gl_uniform_buffer.write((void *)&boneMatrices[0], nBones * sizeof(glm::mat4), 0);
+
+		// La pose es la misma para todas las mallas: se calcula una vez por frame, y cada
+		// malla sólo construye su paleta de huesos
+		stopWatch.restart();
+		if (!poseEvaluated) {
+			if (!isPoseUpToDate())
+				evaluatePose();
+			poseEvaluated = true;
+		}
+		const BoneRemap &remap = getBoneRemap(skeleton);
+		if (boneMatrices.size() < nBones)
+			boneMatrices.resize(nBones);
+		for (uint32_t b = 0; b < nBones; b++) {
+			uint32_t node = remap.nodes[b];
+			boneMatrices[b] = node == NOPARENT ? glm::mat4(1.0f) : nodeWorld[node] * remap.offsets[b];
+		}
+		poseTime += stopWatch.getElapsed();
+
+		// La paleta cambia con cada malla: con un UniformStream no hay que esperar a que
+		// la GPU termine de usar la anterior
+		if (UniformStream *stream = UniformStream::getCurrent()) {
+			stream->bind(ubobones, UBO_BONES_BINDING_INDEX, &boneMatrices[0], nBones * sizeof(glm::mat4));
+		}
+		else {
+			gl_uniform_buffer.bindBufferBase(ubobones, UBO_BONES_BINDING_INDEX);
+			gl_uniform_buffer.write((void *)&boneMatrices[0], nBones * sizeof(glm::mat4), 0);
+		}
 
 		mats->pushMatrix(GLMatrices::MODEL_MATRIX);
 		auto itWCS = worldMatrix.find(m);
@@ -127,6 +336,8 @@ void AnimationNode::render()
 		m->render();
 		mats->popMatrix(GLMatrices::MODEL_MATRIX);
 	};
+	restoreProgram(previous);
+	poseEvaluationTime = poseTime;
 }
 
 void AnimationNode::accept(NodeVisitor & dispatcher)
@@ -195,6 +406,7 @@ private:
 
 void AnimationNode::setAnimatorController(std::shared_ptr<AnimatorController> animatorController) {
 	animController = animatorController;
+	invalidatePose();
 }
 
 void AnimationNode::build()
@@ -202,5 +414,31 @@ void AnimationNode::build()
 	// Calcular inversas
 	ComputeWorldMatrices ci(meshes, worldMatrix, inverseWorldMatrix);
 	subScene->accept(ci);
+
+	std::vector<std::string> oldNames;
+	std::vector<uint32_t> oldParents;
+	oldNames.swap(nodeNames);
+	oldParents.swap(nodeParents);
+	FlattenHierarchy fh(nodeNames, nodeParents, nodeTransforms, NOPARENT);
+	subScene->accept(fh);
+	// Las tablas de huesos, clips y máscaras dependen de los nombres de los nodos y de su
+	// orden: sólo se descartan si ha cambiado la jerarquía
+	if (nodeNames != oldNames || nodeParents != oldParents) {
+		boneRemaps.clear();
+		stateBindings.clear();
+		maskBindings.clear();
+	}
+	poseUpToDate = false;
+	bindPose.resize(nodeTransforms.size());
+	for (size_t i = 0; i < nodeTransforms.size(); i++)
+		bindPose[i] = TRS::fromMatrix(nodeTransforms[i]->getTransform());
+	builtVersion = subScene->getVersion();
+}
+
+void AnimationNode::refreshHierarchy()
+{
+	// Se han añadido o quitado nodos, o han cambiado sus transformaciones
+	if (subScene->getVersion() != builtVersion)
+		build();
 }
 
@@ -5,15 +5,21 @@
 #include "animationClip.h"
 #include "skeleton.h"
 #include "bone.h"
+#include "log.h"
+
+#include <algorithm>
 
 using PGUPV::AnimatorState;
 using PGUPV::AnimatorController;
+using PGUPV::AnimatorLayer;
+using PGUPV::AnimationMask;
 using PGUPV::AnimationClip;
 using PGUPV::Group;
 
 
 void AnimatorState::setAnimationClip(std::shared_ptr<AnimationClip> clip) {
 	animationClip = clip;
+	cursors.clear();
 }
 
 void AnimatorState::setSpeed(float speed) {
@@ -29,7 +35,7 @@ void AnimatorState::update(uint32_t ms)
 bool AnimatorState::interpolate(const std::string & boneId, glm::mat4 & mat) const
 {
 	if (animationClip) {
-		return animationClip->interpolate(animationTime / 1000.f, boneId, mat);
+		return animationClip->interpolate(getAnimationTime(), boneId, mat, &cursors);
 	}
 	return false;
 }
@@ -39,9 +45,78 @@ void AnimatorState::reset()
 	animationTime = 0;
 }
 
+void AnimationMask::setWeight(const std::string &nodeName, float weight, bool recursive)
+{
+	weights[nodeName] = std::make_pair(weight, recursive);
+	version++;
+}
+
+bool AnimationMask::getWeight(const std::string &nodeName, float &weight, bool &recursive) const
+{
+	auto it = weights.find(nodeName);
+	if (it == weights.end())
+		return false;
+	weight = it->second.first;
+	recursive = it->second.second;
+	return true;
+}
+
+void AnimatorLayer::play(std::shared_ptr<AnimatorState> state)
+{
+	current = state;
+	previous.reset();
+	fadeDuration = fadeTime = 0.0f;
+}
+
+void AnimatorLayer::crossFade(std::shared_ptr<AnimatorState> state, float seconds)
+{
+	if (!state || state == current)
+		return;
+	if (!current || seconds <= 0.0f) {
+		play(state);
+		return;
+	}
+	// Si había otra transición en curso, el estado del que se salía deja de verse
+	previous = current;
+	current = state;
+	current->reset();
+	fadeDuration = seconds;
+	fadeTime = 0.0f;
+}
+
+float AnimatorLayer::getFadeWeight() const
+{
+	if (!previous)
+		return 1.0f;
+	return std::min(1.0f, fadeTime / fadeDuration);
+}
+
+void AnimatorLayer::update(uint32_t ms)
+{
+	if (current)
+		current->update(ms);
+	if (previous) {
+		previous->update(ms);
+		fadeTime += ms / 1000.0f;
+		if (fadeTime >= fadeDuration) {
+			previous.reset();
+			fadeDuration = fadeTime = 0.0f;
+		}
+	}
+}
+
+void AnimatorLayer::reset()
+{
+	if (current)
+		current->reset();
+	previous.reset();
+	fadeDuration = fadeTime = 0.0f;
+}
+
 AnimatorController::AnimatorController(const std::string & name) : 
 	animationControllerId(name), status(Status::Stopped)
 {
+	layers.push_back(std::make_shared<AnimatorLayer>("Base Layer"));
 }
 
 void AnimatorController::setSubScene(std::shared_ptr<Group> root)
@@ -51,24 +126,51 @@ void AnimatorController::setSubScene(std::shared_ptr<Group> root)
 
 void AnimatorController::addState(std::shared_ptr<AnimatorState> state)
 {
-	currentAnimationState = state;
+	states[state->getName()] = state;
+	layers[0]->play(state);
+}
+
+std::shared_ptr<AnimatorState> AnimatorController::getState(const std::string &name) const
+{
+	auto it = states.find(name);
+	if (it != states.end())
+		return it->second;
+	return std::shared_ptr<AnimatorState>();
+}
+
+void AnimatorController::crossFade(const std::string &stateName, float seconds)
+{
+	auto state = getState(stateName);
+	if (!state)
+		ERRT("No existe el estado " + stateName + " en el controlador " + animationControllerId);
+	layers[0]->crossFade(state, seconds);
+}
+
+void AnimatorController::addLayer(std::shared_ptr<AnimatorLayer> layer)
+{
+	layers.push_back(layer);
 }
 
 void AnimatorController::update(uint32_t ms) {
-	if (status == Status::Playing)
-		currentAnimationState->update(ms);
+	if (status == Status::Playing) {
+		for (auto &l : layers)
+			l->update(ms);
+	}
 }
 
 void AnimatorController::start()
 {
-	if (status != Status::Paused)
-		currentAnimationState->reset();
+	if (status != Status::Paused) {
+		for (auto &l : layers)
+			l->reset();
+	}
 	status = Status::Playing;
 }
 
 void PGUPV::AnimatorController::stop()
 {
-	currentAnimationState->reset();
+	for (auto &l : layers)
+		l->reset();
 	status = Status::Stopped;
 }
 
@@ -79,7 +79,7 @@ App::App()
 	minimumGLVer(DEFAULT_MINIMUM_MINOR_GL_VERSION), stats(std::make_shared<StatsClass>()),
 	eventSource(std::unique_ptr<EventSource>(new EventSourceHW())),
 	eventProcessor(std::unique_ptr<EventProcessor>(new AppEventProcessor(*this))),
-	ignoreCameras(false), ignoreGUIState(false)
+	ignoreCameras(false), ignoreGUIState(false), nextCallbackId(1)
 {
 	// Con esto nos aseguramos que Log sea el primer objeto estático en crearse (después de App), y
 	// que sea el penúltimo en destruírse
@@ -526,6 +526,8 @@ int App::getWindowIndex(const Window * w) const
 
 void App::processEvents() {
 	auto sw = stats->makeStopWatch();
+	// Los mensajes del log escritos desde otros hilos llegan a la consola aquí
+	Log::getInstance().deliverNotifications();
 	eventProcessor->dispatchPendingEvents();
 	stats->pushValue(std::to_string(sw->getElapsed()));
 }
@@ -543,13 +545,18 @@ void App::update(uint elapsedMs) {
 
 void App::render() {
 	auto sw = stats->makeStopWatch();
-	for (auto p : preRenderCallbacks) {
+	// Los shaders recargados se instalan antes de empezar a dibujar el frame
+	shaderLib.update();
+	// Se recorre una copia, porque una callback puede quitarse a sí misma (o a otras)
+	auto preRender = preRenderCallbacks;
+	for (auto p : preRender) {
 		p.second();
 	}
 	// TODO: si hay varias ventanas, habría que cambiar el contexto aquí y dibujar cada una en orden
 	m_windows[0]->draw();
 	stats->pushValue(std::to_string(sw->getElapsedAndRestart()));
-	for (auto p : postRenderCallbacks) {
+	auto postRender = postRenderCallbacks;
+	for (auto p : postRender) {
 		p.second();
 	}
 	m_windows[0]->swapBuffers();
@@ -566,6 +573,8 @@ int App::run() {
 		stats->pushValue("Frame #").pushValue("Events (us)").pushValue("Update (us)").pushValue("Client Render (us)")
 			.pushValue("GUI Render (us)").pushValue("Swap buffers (us)").pushValue("Total (us)").endFrame();
 		auto frameStopWatch = stats->makeStopWatch();
+		// Los programas que se han cargado en setup y aún no se han compilado, todos a la vez
+		shaderLib.compileAll();
 		while (!_appDone) {
 			FRAME("Empezando a dibujar el frame " + std::to_string(_current_frame));
 			stats->pushValue(std::to_string(_current_frame));
@@ -584,10 +593,11 @@ int App::run() {
 			}
 			if (snapshots.popValue(_current_frame)) {
 				// TODO ¿qué pasa cuando hay varias ventanas?
-				m_windows[0]->saveColorBuffer(buildFrameName("frame", _current_frame));
+				m_windows[0]->captureColorBuffer(buildFrameName("frame", _current_frame));
 			}
 			stats->pushValue(std::to_string(frameStopWatch->getElapsed())).endFrame();
 			if (ftl == static_cast<int64_t>(_current_frame)) {
+				m_windows[0]->flushCaptures();
 				return 0;
 			}
 			_current_frame++;
@@ -610,13 +620,13 @@ void App::takeSnapshot() {
 	// TODO: ¿Qué pasa cuando hay varias ventanas?
 	switch (m_windows[0]->getShownBuffer()) {
 	case Window::COLOR_BUFFER:
-		m_windows[0]->saveColorBuffer("color" + getTimeStamp() + ".png");
+		m_windows[0]->captureColorBuffer("color" + getTimeStamp() + ".png");
 		break;
 	case Window::DEPTH_BUFFER:
-		m_windows[0]->saveColorBuffer("depth" + getTimeStamp() + ".png");
+		m_windows[0]->captureColorBuffer("depth" + getTimeStamp() + ".png");
 		break;
 	case Window::STENCIL_BUFFER:
-		m_windows[0]->saveColorBuffer("stencil" + getTimeStamp() + ".png");
+		m_windows[0]->captureColorBuffer("stencil" + getTimeStamp() + ".png");
 		break;
 	}
 }
@@ -701,7 +711,7 @@ void App::setEventSource(std::unique_ptr<EventSource> evSource) {
 }
 
 size_t App::addPreRender(std::function<void()> callback) {
-	size_t id = preRenderCallbacks.size() + 1;
+	size_t id = nextCallbackId++;
 	preRenderCallbacks[id] = callback;
 	INFO("Callback preRender instalada: " + std::to_string(id));
 	return id;
@@ -713,7 +723,7 @@ void App::removePreRender(int id) {
 }
 
 size_t App::addPostRender(std::function<void()> callback) {
-	size_t id = postRenderCallbacks.size() + 1;
+	size_t id = nextCallbackId++;
 	postRenderCallbacks[id] = callback;
 	INFO("Callback postRender instalada: " + std::to_string(id));
 	return id;
@@ -13,10 +13,14 @@
 #include "assimpWrapper.h"
 #include "uboBones.h"
 #include "textureGenerator.h"
+#include "textureCache.h"
+#include "imageLoader.h"
 #include "transform.h"
 #include "utils.h"
 #include "drawCommand.h"
 #include "geode.h"
+#include "model.h"
+#include "threadPool.h"
 #include "material.h"
 #include "scene.h"
 #include "animationClip.h"
@@ -40,23 +44,100 @@ using PGUPV::AnimationClip;
 using PGUPV::AnimationChannel;
 using PGUPV::Skeleton;
 using PGUPV::Bone;
+using PGUPV::ImageLoader;
+using PGUPV::Model;
+using PGUPV::BoundingBox;
+using PGUPV::ThreadPool;
 
 using std::string;
 using std::endl;
 
 
-Assimp::Importer AssimpWrapper::importer;
+namespace {
+	// Una malla de la escena convertida en memoria principal, lista para subirla a la GPU
+	struct MeshData {
+		std::string name;
+		GLenum primitive;
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> positions, normals, tangents;
+		std::vector<std::vector<glm::vec2>> texCoords;
+		unsigned int materialIndex;
+		BoundingBox bb;
+		std::shared_ptr<Skeleton> skeleton;
+	};
+
+	// Malla de líneas con las aristas de la caja, que se dibuja mientras la malla no está en la GPU.
+	// Si la caja no es válida, no hay nada que dibujar (nullptr)
+	std::shared_ptr<Mesh> buildPlaceholder(const BoundingBox &bb) {
+		if (!bb.isValid())
+			return nullptr;
+		auto mesh = std::make_shared<Mesh>();
+		std::vector<glm::vec3> vertices;
+		for (int i = 0; i < 8; i++)
+			vertices.push_back(glm::vec3(i & 1 ? bb.max.x : bb.min.x, i & 2 ? bb.max.y : bb.min.y,
+				i & 4 ? bb.max.z : bb.min.z));
+		std::vector<GLuint> indices;
+		for (GLuint i = 0; i < 8; i++) {
+			for (GLuint axis = 1; axis < 8; axis <<= 1) {
+				if (!(i & axis)) {
+					indices.push_back(i);
+					indices.push_back(i | axis);
+				}
+			}
+		}
+		mesh->setName("placeholder");
+		mesh->addVertices(vertices);
+		mesh->addIndices(indices);
+		mesh->setColor(glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
+		mesh->addDrawCommand(new PGUPV::DrawElements(GL_LINES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0));
+		return mesh;
+	}
+
+	// Un Geode que todavía dibuja alguna caja en lugar de su malla
+	struct PendingGeode {
+		std::shared_ptr<Geode> geode;
+		std::vector<unsigned int> meshes;	// todas sus mallas
+		size_t missing;						// las que aún no están en la GPU
+	};
+};
+
+struct AssimpWrapper::Pending {
+	ImageLoader images;
+	std::vector<MeshData> meshes;
+	bool placeholders = false;
+	bool graphBuilt = false;
+	std::vector<std::shared_ptr<Mesh>> placeholderMeshes;
+	std::vector<PendingGeode> geodes;
+	std::vector<std::vector<size_t>> geodesOfMesh;	// índices en geodes
+	size_t nextMesh = 0;
+	unsigned int nextMaterial = 0;
+};
 
 static std::string printMaterialInfo(const aiMaterial* mat);
 static std::string printMeshInfo(const aiScene* scene, size_t n);
 static std::string printMetadataInfo(const aiNode* nd);
+bool isPBR(const struct aiMaterial* mtl);
+std::shared_ptr<Material> loadRegularMaterial(const struct aiMaterial* mtl);
+std::shared_ptr<PBRMaterial> loadPBRMaterial(const struct aiMaterial* mtl);
 
 AssimpWrapper::AssimpWrapper() :
 	scene(nullptr) {
 }
 
+AssimpWrapper::~AssimpWrapper() {
+}
+
 std::shared_ptr<Scene> AssimpWrapper::load(const string& filename, LoadOptions options) {
-	result = std::make_shared<Scene>();
+	parse(filename, options);
+	beginBuild();
+	while (buildStep())
+		;
+	return endBuild();
+}
+
+void AssimpWrapper::parse(const string& filename, LoadOptions options, bool checkTextureCache) {
+	pending.reset();
+	tempMeshes.clear();
 
 	unsigned int flags = aiProcess_TransformUVCoords;
 	switch (options) {
@@ -70,8 +151,10 @@ std::shared_ptr<Scene> AssimpWrapper::load(const string& filename, LoadOptions o
 		flags |= aiProcessPreset_TargetRealtime_MaxQuality;
 		break;
 	case LoadOptions::NONE:
+	case LoadOptions::NONE_SMOOTH_NORMALS:
 		break;
 	}
+	bool smoothNormals = options == LoadOptions::NONE_SMOOTH_NORMALS;
 
 	importer.SetPropertyBool(AI_CONFIG_IMPORT_MD5_NO_ANIM_AUTOLOAD, true);
 
@@ -95,15 +178,195 @@ std::shared_ptr<Scene> AssimpWrapper::load(const string& filename, LoadOptions o
 		INFO("El modelo " + filename + " no tiene animaciones");
 	}
 
-	loadMaterials();
-	loadMeshes();
+	std::unique_ptr<Pending> p(new Pending());
+	decodeTextures(p->images, checkTextureCache);
+
+	// printMeshInfo también comprueba que las primitivas están soportadas
+	for (unsigned int n = 0; n < scene->mNumMeshes; ++n)
+		INFO(printMeshInfo(scene, n));
+
+	p->meshes.resize(scene->mNumMeshes);
+	ThreadPool::getInstance().parallelFor(0, scene->mNumMeshes, [&](size_t b, size_t e) {
+		for (size_t n = b; n < e; n++) {
+			const struct aiMesh* mesh = scene->mMeshes[n];
+			MeshData& d = p->meshes[n];
+			d.name = mesh->mName.C_Str();
+			d.materialIndex = mesh->mMaterialIndex;
+
+			size_t numVertPerFace;
+			switch (mesh->mPrimitiveTypes) {
+			case aiPrimitiveType_TRIANGLE:
+				numVertPerFace = 3;
+				d.primitive = GL_TRIANGLES;
+				break;
+			case aiPrimitiveType_LINE:
+				numVertPerFace = 2;
+				d.primitive = GL_LINES;
+				break;
+			default:
+				numVertPerFace = 1;
+				d.primitive = GL_POINTS;
+			}
+
+			if (numVertPerFace > 1) {
+				// have to convert from Assimp format to array
+				d.indices.resize(mesh->mNumFaces * numVertPerFace);
+				size_t faceIndex = 0;
+				for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
+					memcpy(&d.indices[faceIndex], mesh->mFaces[t].mIndices, numVertPerFace * sizeof(unsigned int));
+					faceIndex += numVertPerFace;
+				}
+			}
+
+			if (mesh->HasPositions()) {
+				const glm::vec3* v = reinterpret_cast<const glm::vec3*>(mesh->mVertices);
+				d.positions.assign(v, v + mesh->mNumVertices);
+				for (const auto& pos : d.positions)
+					d.bb.grow(BoundingBox(pos, pos));
+			}
+
+			if (mesh->HasNormals()) {
+				const glm::vec3* v = reinterpret_cast<const glm::vec3*>(mesh->mNormals);
+				d.normals.assign(v, v + mesh->mNumVertices);
+			}
+			else if (smoothNormals && numVertPerFace == 3 && mesh->HasPositions()) {
+				// Sin postprocesado Assimp no genera las normales: se calculan soldando los
+				// vértices que comparten posición
+				d.normals = Mesh::smoothNormals(d.positions, d.indices, 1e-3f);
+			}
+
+			if (mesh->HasTangentsAndBitangents()) {
+				const glm::vec3* v = reinterpret_cast<const glm::vec3*>(mesh->mTangents);
+				d.tangents.assign(v, v + mesh->mNumVertices);
+			}
+
+			if (mesh->HasBones())
+				d.skeleton = buildSkeleton(mesh);
+
+			for (unsigned int idx = 0; idx < NUM_TEX_COORD && mesh->HasTextureCoords(idx); ++idx) {
+				std::vector<glm::vec2> texCoords(mesh->mNumVertices);
+				for (unsigned int k = 0; k < mesh->mNumVertices; ++k) {
+					texCoords[k].s = mesh->mTextureCoords[idx][k].x;
+					texCoords[k].t = mesh->mTextureCoords[idx][k].y;
+				}
+				d.texCoords.push_back(std::move(texCoords));
+			}
+		}
+	}, 1);
+
+	pending = std::move(p);
+}
+
+std::shared_ptr<Scene> AssimpWrapper::beginBuild(bool placeholders) {
+	if (!pending) {
+		ERRT("Llama a AssimpWrapper::parse antes que a AssimpWrapper::beginBuild");
+	}
+	result = std::make_shared<Scene>();
+
+	// Los materiales se crean ya, para que las mallas los puedan usar, pero sus texturas se
+	// cargan en buildStep
+	for (unsigned int i = 0; i < scene->mNumMaterials; ++i) {
+		const struct aiMaterial* mtl = scene->mMaterials[i];
+		if (isPBR(mtl))
+			result->addMaterial(loadPBRMaterial(mtl));
+		else
+			result->addMaterial(loadRegularMaterial(mtl));
+	}
+
+	tempMeshes.assign(scene->mNumMeshes, nullptr);
+	pending->placeholders = placeholders;
+	if (placeholders) {
+		for (const auto& d : pending->meshes)
+			pending->placeholderMeshes.push_back(buildPlaceholder(d.bb));
+		pending->geodesOfMesh.resize(scene->mNumMeshes);
+		result->setRoot(recursive_load(scene->mRootNode));
+		pending->graphBuilt = true;
+	}
+	return result;
+}
+
+bool AssimpWrapper::buildStep() {
+	if (!pending)
+		return false;
+	// Primero las mallas, para que se vea la geometría cuanto antes
+	if (pending->nextMesh < pending->meshes.size()) {
+		uploadMesh(pending->nextMesh++);
+		return true;
+	}
+	if (pending->nextMaterial < scene->mNumMaterials) {
+		loadMaterialTextures(pending->nextMaterial++);
+		return true;
+	}
+	return false;
+}
+
+std::shared_ptr<Scene> AssimpWrapper::endBuild() {
+	while (buildStep())
+		;
+	if (!pending->graphBuilt)
+		result->setRoot(recursive_load(scene->mRootNode));
 	loadAnimations();
 
-	result->setRoot(recursive_load(scene->mRootNode));
+	pending.reset();
 	tempMeshes.clear();
+	importer.FreeScene();
+	scene = nullptr;
 	return result;
 }
 
+size_t AssimpWrapper::getNBuildSteps() const {
+	return pending ? pending->meshes.size() + scene->mNumMaterials : 0;
+}
+
+size_t AssimpWrapper::getNBuildStepsDone() const {
+	return pending ? pending->nextMesh + pending->nextMaterial : 0;
+}
+
+void AssimpWrapper::uploadMesh(size_t n) {
+	MeshData& d = pending->meshes[n];
+	auto mymesh = std::make_shared<Mesh>();
+	mymesh->setName(d.name);
+
+	if (d.primitive == GL_POINTS)
+		mymesh->addDrawCommand(new DrawArrays(GL_POINTS, 0, static_cast<GLsizei>(d.positions.size())));
+	else
+		mymesh->addDrawCommand(new DrawElements(d.primitive, static_cast<GLsizei>(d.indices.size()), GL_UNSIGNED_INT, 0));
+
+	if (!d.indices.empty())
+		mymesh->addIndices(d.indices);
+	if (!d.positions.empty())
+		mymesh->addVertices(d.positions);
+	if (!d.normals.empty())
+		mymesh->addNormals(d.normals);
+	if (!d.tangents.empty())
+		mymesh->addTangents(d.tangents);
+	if (d.skeleton) {
+		INFO("La malla " + std::to_string(n) + " tiene " + std::to_string(d.skeleton->getNBones()) + " huesos");
+		mymesh->setSkeleton(d.skeleton);
+	}
+	for (unsigned int idx = 0; idx < d.texCoords.size(); ++idx)
+		mymesh->addTexCoord(idx, d.texCoords[idx]);
+
+	mymesh->setMaterial(result->getMaterial(d.materialIndex));
+	tempMeshes[n] = mymesh;
+	// Ya no hace falta la copia en memoria principal
+	d = MeshData();
+
+	// Los Geodes que ya tienen todas sus mallas dejan de dibujar las cajas
+	if (pending->placeholders) {
+		for (auto g : pending->geodesOfMesh[n]) {
+			PendingGeode& pg = pending->geodes[g];
+			if (--pg.missing == 0) {
+				auto model = std::make_shared<Model>();
+				for (auto m : pg.meshes)
+					model->addMesh(tempMeshes[m]);
+				pg.geode->setModel(model);
+				pg.geode.reset();
+			}
+		}
+	}
+}
+
 Assimp::Exporter& AssimpWrapper::getExporter() {
 	if (!exporter) {
 		exporter = std::make_unique<Assimp::Exporter>();
@@ -136,8 +399,22 @@ std::shared_ptr<Node> AssimpWrapper::recursive_load(const struct aiNode* nd) {
 		geode = Geode::build();
 		geode->setName(nd->mName.C_Str());
 		// draw all meshes assigned to this node
-		for (unsigned int n = 0; n < nd->mNumMeshes; ++n)
-			geode->addMesh(tempMeshes[nd->mMeshes[n]]);
+		PendingGeode pg{ geode, {}, 0 };
+		for (unsigned int n = 0; n < nd->mNumMeshes; ++n) {
+			unsigned int m = nd->mMeshes[n];
+			pg.meshes.push_back(m);
+			if (tempMeshes[m])
+				geode->addMesh(tempMeshes[m]);
+			else {
+				// Todavía no está en la GPU: se dibuja su caja (si tiene)
+				if (pending->placeholderMeshes[m])
+					geode->addMesh(pending->placeholderMeshes[m]);
+				pending->geodesOfMesh[m].push_back(pending->geodes.size());
+				pg.missing++;
+			}
+		}
+		if (pg.missing > 0)
+			pending->geodes.push_back(pg);
 	}
 
 	if (nd->mMetaData) {
@@ -184,86 +461,6 @@ std::map<aiTextureType, std::string> aiTextureTypes{
 };
 #undef P
 
-void AssimpWrapper::loadMeshes() {
-	for (unsigned int n = 0; n < scene->mNumMeshes; ++n) {
-		auto mymesh = std::make_shared<Mesh>();
-
-		const struct aiMesh* mesh = scene->mMeshes[n];
-
-		mymesh->setName(mesh->mName.C_Str());
-
-		INFO(printMeshInfo(scene, n));
-
-		size_t numVertPerFace;
-
-		switch (mesh->mPrimitiveTypes) {
-		case aiPrimitiveType_TRIANGLE:
-			numVertPerFace = 3;
-			mymesh->addDrawCommand(
-				new DrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh->mNumFaces * numVertPerFace), GL_UNSIGNED_INT, 0));
-			break;
-		case aiPrimitiveType_LINE:
-			numVertPerFace = 2;
-			mymesh->addDrawCommand(
-				new DrawElements(GL_LINES, static_cast<GLsizei>(mesh->mNumFaces * numVertPerFace), GL_UNSIGNED_INT, 0));
-			break;
-		case aiPrimitiveType_POINT:
-			numVertPerFace = 1;
-			mymesh->addDrawCommand(new DrawArrays(GL_POINTS, 0, mesh->mNumVertices));
-			break;
-		default:
-			ERRT("Tipo de primitiva no soportada (" + std::to_string(mesh->mPrimitiveTypes) + ")");
-		}
-
-		if (numVertPerFace > 1) {
-			// create array with indices
-			// have to convert from Assimp format to array
-			std::vector<unsigned int> faceArray(mesh->mNumFaces * numVertPerFace);
-			size_t faceIndex = 0;
-			for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
-				const struct aiFace* face = &mesh->mFaces[t];
-				memcpy(&faceArray[faceIndex], face->mIndices, numVertPerFace * sizeof(unsigned int));
-				faceIndex += numVertPerFace;
-			}
-			mymesh->addIndices(faceArray);
-		}
-		// buffer for vertex positions
-		if (mesh->HasPositions())
-			mymesh->addVertices((GLfloat*)mesh->mVertices, 3, mesh->mNumVertices);
-
-		// buffer for vertex normals
-		if (mesh->HasNormals())
-			mymesh->addNormals((GLfloat*)mesh->mNormals, mesh->mNumVertices);
-
-		if (mesh->HasTangentsAndBitangents()) {
-			mymesh->addTangents((GLfloat*)mesh->mTangents, mesh->mNumVertices);
-		}
-
-		if (mesh->HasBones()) {
-			INFO("La malla " + std::to_string(n) + " tiene " + std::to_string(mesh->mNumBones) + " huesos");
-			auto skeleton = buildSkeleton(mesh);
-			mymesh->setSkeleton(skeleton);
-		}
-
-		// buffer for vertex texture coordinates
-		for (unsigned int idx = 0; idx < NUM_TEX_COORD; ++idx) {
-			if (mesh->HasTextureCoords(idx)) {
-				std::vector<glm::vec2> texCoords(mesh->mNumVertices);
-				for (unsigned int k = 0; k < mesh->mNumVertices; ++k) {
-					texCoords[k].s = mesh->mTextureCoords[0][k].x;
-					texCoords[k].t = mesh->mTextureCoords[0][k].y;
-				}
-				mymesh->addTexCoord(idx, texCoords);
-			}
-			else
-				break;
-		}
-
-		mymesh->setMaterial(result->getMaterial(mesh->mMaterialIndex));
-		tempMeshes.push_back(mymesh);
-	}
-}
-
 std::shared_ptr<Skeleton> AssimpWrapper::buildSkeleton(const struct aiMesh* mesh)
 {
 	auto skeleton = std::make_shared<Skeleton>();
@@ -337,16 +534,17 @@ std::string findTexture(const std::string& filename, const std::string& modelfil
 	return filename;
 }
 
-uint acceptTexture(const std::string& modelFileName, aiTextureType type, const uint textureUnitBase, const aiMaterial* mtl, PGUPV::Material& mat) {
+uint acceptTexture(const std::string& modelFileName, aiTextureType type, const uint textureUnitBase, const aiMaterial* mtl, PGUPV::Material& mat,
+	const PGUPV::ImageLoader& images) {
 	aiString path;
 	unsigned int c = MIN(mtl->GetTextureCount(type), 4U); // Soportamos hasta 4 texturas de cada tipo
 	for (uint i = 0; i < c; i++) {
 		mtl->GetTexture(type, i, &path);
 		// This function will throw if we can't find the texture
 		try {
-			auto t = std::make_shared<Texture2D>(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-			t->loadImage(findTexture(path.C_Str(), modelFileName));
-			t->generateMipmap();
+			// Los materiales que usan el mismo fichero comparten la textura
+			auto t = PGUPV::TextureCache::getTexture2D(findTexture(path.C_Str(), modelFileName),
+				GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT, true, GL_RGB, &images);
 			mat.setTexture(textureUnitBase + i, t);
 		}
 		catch (std::runtime_error&) {
@@ -357,16 +555,17 @@ uint acceptTexture(const std::string& modelFileName, aiTextureType type, const u
 	return c;
 }
 
-uint acceptTexture(const std::string& modelFileName, aiTextureType type, const uint textureUnitBase, const aiMaterial* mtl, PGUPV::PBRMaterial& mat) {
+uint acceptTexture(const std::string& modelFileName, aiTextureType type, const uint textureUnitBase, const aiMaterial* mtl, PGUPV::PBRMaterial& mat,
+	const PGUPV::ImageLoader& images) {
 	aiString path;
 	unsigned int c = MIN(mtl->GetTextureCount(type), 4U); // Soportamos hasta 4 texturas de cada tipo
 	for (uint i = 0; i < c; i++) {
 		mtl->GetTexture(type, i, &path);
 		// This function will throw if we can't find the texture
 		try {
-			auto t = std::make_shared<Texture2D>(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-			t->loadImage(findTexture(path.C_Str(), modelFileName));
-			t->generateMipmap();
+			// Los materiales que usan el mismo fichero comparten la textura
+			auto t = PGUPV::TextureCache::getTexture2D(findTexture(path.C_Str(), modelFileName),
+				GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT, true, GL_RGB, &images);
 			mat.setTexture(textureUnitBase + i, t);
 		}
 		catch (std::runtime_error&) {
@@ -386,13 +585,13 @@ void rejectTexture(aiTextureType type, const aiMaterial* mtl) {
 	}
 }
 
-void AssimpWrapper::loadTextures(const aiMaterial* aimat, Material& pgmat) {
-	/*uint nDiff = */acceptTexture(_filename, aiTextureType_DIFFUSE, Material::DIFFUSE_TUNIT, aimat, pgmat);
-	/*uint nSpec = */acceptTexture(_filename, aiTextureType_SPECULAR, Material::SPECULAR_TUNIT, aimat, pgmat);
-	/*uint nNor = */acceptTexture(_filename, aiTextureType_NORMALS, Material::NORMALMAP_TUNIT, aimat, pgmat);
-	/*uint nHei = */acceptTexture(_filename, aiTextureType_HEIGHT, Material::HEIGHTMAP_TUNIT, aimat, pgmat);
-	/*uint nOpac = */acceptTexture(_filename, aiTextureType_OPACITY, Material::OPACITYMAP_TUNIT, aimat, pgmat);
-	/*uint nAmb = */acceptTexture(_filename, aiTextureType_AMBIENT, Material::AMBIENT_TUNIT, aimat, pgmat);
+void AssimpWrapper::loadTextures(const aiMaterial* aimat, Material& pgmat, const ImageLoader& images) {
+	/*uint nDiff = */acceptTexture(_filename, aiTextureType_DIFFUSE, Material::DIFFUSE_TUNIT, aimat, pgmat, images);
+	/*uint nSpec = */acceptTexture(_filename, aiTextureType_SPECULAR, Material::SPECULAR_TUNIT, aimat, pgmat, images);
+	/*uint nNor = */acceptTexture(_filename, aiTextureType_NORMALS, Material::NORMALMAP_TUNIT, aimat, pgmat, images);
+	/*uint nHei = */acceptTexture(_filename, aiTextureType_HEIGHT, Material::HEIGHTMAP_TUNIT, aimat, pgmat, images);
+	/*uint nOpac = */acceptTexture(_filename, aiTextureType_OPACITY, Material::OPACITYMAP_TUNIT, aimat, pgmat, images);
+	/*uint nAmb = */acceptTexture(_filename, aiTextureType_AMBIENT, Material::AMBIENT_TUNIT, aimat, pgmat, images);
 
 	rejectTexture(aiTextureType_DISPLACEMENT, aimat);
 	rejectTexture(aiTextureType_EMISSIVE, aimat);
@@ -403,14 +602,14 @@ void AssimpWrapper::loadTextures(const aiMaterial* aimat, Material& pgmat) {
 	rejectTexture(aiTextureType_UNKNOWN, aimat);
 }
 
-void PGUPV::AssimpWrapper::loadPBRTextures(const aiMaterial* aimat, PBRMaterial& pgmat)
+void PGUPV::AssimpWrapper::loadPBRTextures(const aiMaterial* aimat, PBRMaterial& pgmat, const ImageLoader& images)
 {
-	/*uint nDiff = */acceptTexture(_filename, aiTextureType_BASE_COLOR, PBRMaterial::BASECOLOR_TUNIT, aimat, pgmat);
-	/*uint nSpec = */acceptTexture(_filename, aiTextureType_NORMAL_CAMERA, PBRMaterial::NORMAL_TUNIT, aimat, pgmat);
-	/*uint nNor = */acceptTexture(_filename, aiTextureType_EMISSION_COLOR, PBRMaterial::EMISSION_TUNIT, aimat, pgmat);
-	/*uint nHei = */acceptTexture(_filename, aiTextureType_METALNESS, PBRMaterial::METALNESS_TUNIT, aimat, pgmat);
-	/*uint nOpac = */acceptTexture(_filename, aiTextureType_DIFFUSE_ROUGHNESS, PBRMaterial::ROUGHNESS_TUNIT, aimat, pgmat);
-	/*uint nAmb = */acceptTexture(_filename, aiTextureType_AMBIENT_OCCLUSION, PBRMaterial::AMBIENTOCLUSSION_TUNIT, aimat, pgmat);
+	/*uint nDiff = */acceptTexture(_filename, aiTextureType_BASE_COLOR, PBRMaterial::BASECOLOR_TUNIT, aimat, pgmat, images);
+	/*uint nSpec = */acceptTexture(_filename, aiTextureType_NORMAL_CAMERA, PBRMaterial::NORMAL_TUNIT, aimat, pgmat, images);
+	/*uint nNor = */acceptTexture(_filename, aiTextureType_EMISSION_COLOR, PBRMaterial::EMISSION_TUNIT, aimat, pgmat, images);
+	/*uint nHei = */acceptTexture(_filename, aiTextureType_METALNESS, PBRMaterial::METALNESS_TUNIT, aimat, pgmat, images);
+	/*uint nOpac = */acceptTexture(_filename, aiTextureType_DIFFUSE_ROUGHNESS, PBRMaterial::ROUGHNESS_TUNIT, aimat, pgmat, images);
+	/*uint nAmb = */acceptTexture(_filename, aiTextureType_AMBIENT_OCCLUSION, PBRMaterial::AMBIENTOCLUSSION_TUNIT, aimat, pgmat, images);
 
 	rejectTexture(aiTextureType_DIFFUSE, aimat);
 	rejectTexture(aiTextureType_SPECULAR, aimat);
@@ -473,23 +672,44 @@ std::shared_ptr<PBRMaterial> loadPBRMaterial(const struct aiMaterial* mtl) {
 }
 
 
-void AssimpWrapper::loadMaterials() {
-	/* scan scene's materials for textures */
+// Tipos de textura que se cargan de los materiales (ver loadTextures y loadPBRTextures)
+static const std::vector<aiTextureType> regularTextureTypes{ aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+	aiTextureType_NORMALS, aiTextureType_HEIGHT, aiTextureType_OPACITY, aiTextureType_AMBIENT };
+static const std::vector<aiTextureType> pbrTextureTypes{ aiTextureType_BASE_COLOR, aiTextureType_NORMAL_CAMERA,
+	aiTextureType_EMISSION_COLOR, aiTextureType_METALNESS, aiTextureType_DIFFUSE_ROUGHNESS, aiTextureType_AMBIENT_OCCLUSION };
+
+void AssimpWrapper::decodeTextures(ImageLoader& images, bool checkTextureCache) {
+	aiString path;
 	for (unsigned int i = 0; i < scene->mNumMaterials; ++i) {
-		struct aiMaterial* mtl = scene->mMaterials[i];
-		if (isPBR(mtl)) {
-			auto mat = loadPBRMaterial(mtl);
-			loadPBRTextures(mtl, *mat);
-			result->addMaterial(mat);
-			INFO(printMaterialInfo(mtl) + " TextureCount: " + std::bitset<32>(mat->getTextureCounters()).to_string());
-		}
-		else {
-			auto mat = loadRegularMaterial(mtl);
-			loadTextures(mtl, *mat);
-			result->addMaterial(mat);
-			INFO(printMaterialInfo(mtl) + " TextureCount: " + std::bitset<32>(mat->getTextureCounters()).to_string());
+		const aiMaterial* mtl = scene->mMaterials[i];
+		for (auto type : isPBR(mtl) ? pbrTextureTypes : regularTextureTypes) {
+			unsigned int c = MIN(mtl->GetTextureCount(type), 4U);
+			for (uint j = 0; j < c; j++) {
+				mtl->GetTexture(type, j, &path);
+				auto file = findTexture(path.C_Str(), _filename);
+				// Las que ya están cargadas no hace falta decodificarlas
+				if (!checkTextureCache || !PGUPV::TextureCache::contains({ file }, GL_TEXTURE_2D, GL_RGB, false))
+					images.add(file);
+			}
 		}
 	}
+	images.decode();
+}
+
+void AssimpWrapper::loadMaterialTextures(unsigned int n) {
+	// Las imágenes ya están decodificadas (ver parse): sólo queda crear las texturas
+	const struct aiMaterial* mtl = scene->mMaterials[n];
+	auto mat = result->getMaterial(n);
+	if (isPBR(mtl)) {
+		auto pbr = std::static_pointer_cast<PBRMaterial>(mat);
+		loadPBRTextures(mtl, *pbr, pending->images);
+		INFO(printMaterialInfo(mtl) + " TextureCount: " + std::bitset<32>(pbr->getTextureCounters()).to_string());
+	}
+	else {
+		auto regular = std::static_pointer_cast<Material>(mat);
+		loadTextures(mtl, *regular, pending->images);
+		INFO(printMaterialInfo(mtl) + " TextureCount: " + std::bitset<32>(regular->getTextureCounters()).to_string());
+	}
 }
 
 static std::string printMetadataInfo(const aiNode* nd) {
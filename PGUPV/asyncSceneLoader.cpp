@@ -0,0 +1,111 @@
+#include "asyncSceneLoader.h"
+#include "app.h"
+#include "scene.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::AsyncSceneLoader;
+using PGUPV::AssimpWrapper;
+using PGUPV::Scene;
+using PGUPV::App;
+
+namespace {
+	float elapsedMs(std::chrono::steady_clock::time_point since) {
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - since).count();
+	}
+};
+
+AsyncSceneLoader::AsyncSceneLoader(const std::string &filename, AssimpWrapper::LoadOptions options,
+	std::function<void(std::shared_ptr<Scene>)> onLoaded, bool placeholders) :
+	filename(filename), options(options), onLoaded(onLoaded), placeholders(placeholders),
+	budgetMs(4.0f), state(State::PARSING), future(promise.get_future().share()), callbackId(0),
+	startTime(std::chrono::steady_clock::now()) {
+}
+
+AsyncSceneLoader::~AsyncSceneLoader() {
+}
+
+std::shared_ptr<AsyncSceneLoader> AsyncSceneLoader::start(const std::string &filename,
+	AssimpWrapper::LoadOptions options, std::function<void(std::shared_ptr<Scene>)> onLoaded,
+	bool placeholders) {
+	std::shared_ptr<AsyncSceneLoader> l(new AsyncSceneLoader(filename, options, onLoaded, placeholders));
+
+	// Un hilo propio, y no uno del ThreadPool, para que la decodificación de las texturas y
+	// la conversión de las mallas puedan repartirse entre los trabajadores del pool
+	AsyncSceneLoader *self = l.get();
+	l->parsing = std::async(std::launch::async, [self]() {
+		self->loader.parse(self->filename, self->options, false);
+	});
+
+	// La callback mantiene vivo el cargador hasta que termina
+	l->callbackId = App::getInstance().addPreRender([l]() { l->update(l->budgetMs); });
+	INFO("Cargando la escena " + filename + " en segundo plano");
+	return l;
+}
+
+float AsyncSceneLoader::getProgress() const {
+	switch (state) {
+	case State::PARSING:
+	case State::FAILED:
+		return 0.0f;
+	case State::STREAMING:
+	{
+		size_t total = loader.getNBuildSteps();
+		return total == 0 ? 1.0f : static_cast<float>(loader.getNBuildStepsDone()) / total;
+	}
+	default:
+		return 1.0f;
+	}
+}
+
+bool AsyncSceneLoader::update(float ms) {
+	if (isDone())
+		return true;
+
+	auto frameStart = std::chrono::steady_clock::now();
+	try {
+		if (state == State::PARSING) {
+			if (parsing.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return false;
+			// Relanza las excepciones del hilo
+			parsing.get();
+			INFO("Escena " + filename + " leída en " + PGUPV::to_string(elapsedMs(startTime) / 1000.0f, 3) + " s");
+			auto s = loader.beginBuild(placeholders);
+			if (placeholders)
+				scene = s;
+			state = State::STREAMING;
+		}
+		// Al menos un paso por frame, para que la carga avance aunque el presupuesto sea pequeño
+		do {
+			if (!loader.buildStep()) {
+				finish();
+				return true;
+			}
+		} while (elapsedMs(frameStart) < ms);
+	}
+	catch (std::exception &e) {
+		fail(e.what());
+		return true;
+	}
+	return false;
+}
+
+void AsyncSceneLoader::finish() {
+	auto s = loader.endBuild();
+	if (onLoaded)
+		onLoaded(s);
+	scene = s;
+	state = State::DONE;
+	promise.set_value(scene);
+	App::getInstance().removePreRender(static_cast<int>(callbackId));
+	INFO("Escena " + filename + " cargada en " + PGUPV::to_string(elapsedMs(startTime) / 1000.0f, 3) + " s");
+}
+
+void AsyncSceneLoader::fail(const std::string &msg) {
+	error = msg;
+	scene.reset();
+	state = State::FAILED;
+	promise.set_exception(std::make_exception_ptr(std::runtime_error(msg)));
+	App::getInstance().removePreRender(static_cast<int>(callbackId));
+	ERR("Error cargando la escena " + filename + ": " + msg);
+}
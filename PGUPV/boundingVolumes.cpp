@@ -13,6 +13,7 @@
 
 using PGUPV::BoundingBox;
 using PGUPV::BoundingSphere;
+using PGUPV::Frustum;
 using glm::vec3;
 
 BoundingBox PGUPV::computeBoundingBox(const float *v, uint ncomponents, size_t n) {
@@ -188,3 +189,70 @@ void BoundingSphere::transform(const glm::mat4 &xform) {
 	float const largestScale = std::sqrt(maxScaleSq);
 	radius *= largestScale;
 }
+
+const uint Frustum::ALL_PLANES;
+
+void Frustum::set(const glm::mat4 &m) {
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+	// Normalizados, para poder comparar la distancia al plano con el radio de una esfera
+	for (auto &p : planes) {
+		float l = glm::length(glm::vec3(p));
+		if (l > 0.0f)
+			p /= l;
+	}
+}
+
+bool Frustum::intersects(const BoundingBox &bb) const {
+	for (const auto &p : planes) {
+		// La esquina de la caja más avanzada en la dirección de la normal
+		vec3 v(p.x >= 0.0f ? bb.max.x : bb.min.x,
+			p.y >= 0.0f ? bb.max.y : bb.min.y,
+			p.z >= 0.0f ? bb.max.z : bb.min.z);
+		if (glm::dot(vec3(p), v) + p.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+Frustum::Result Frustum::classify(const BoundingBox &bb, const BoundingSphere &bs, uint &mask,
+	uint &firstPlane, size_t *planeTests) const {
+	uint intersecting = 0;
+	for (uint i = 0; i < 6; i++) {
+		uint p = (firstPlane + i) % 6;
+		uint bit = 1u << p;
+		if (!(mask & bit))
+			continue;
+		if (planeTests)
+			(*planeTests)++;
+		const glm::vec4 &plane = planes[p];
+		vec3 n(plane);
+		if (bs.isValid()) {
+			float d = glm::dot(n, bs.center) + plane.w;
+			if (d < -bs.radius) {
+				firstPlane = p;
+				return Result::OUTSIDE;
+			}
+			if (d >= bs.radius)
+				continue;
+		}
+		// Esquinas de la caja más avanzada y más retrasada en la dirección de la normal
+		vec3 pv(n.x >= 0.0f ? bb.max.x : bb.min.x, n.y >= 0.0f ? bb.max.y : bb.min.y, n.z >= 0.0f ? bb.max.z : bb.min.z);
+		if (glm::dot(n, pv) + plane.w < 0.0f) {
+			firstPlane = p;
+			return Result::OUTSIDE;
+		}
+		vec3 nv(n.x >= 0.0f ? bb.min.x : bb.max.x, n.y >= 0.0f ? bb.min.y : bb.max.y, n.z >= 0.0f ? bb.min.z : bb.max.z);
+		if (glm::dot(n, nv) + plane.w < 0.0f)
+			intersecting |= bit;
+	}
+	mask = intersecting;
+	return intersecting ? Result::INTERSECTS : Result::INSIDE;
+}
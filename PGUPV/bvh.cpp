@@ -0,0 +1,148 @@
+#include <limits>
+
+#include "bvh.h"
+#include "log.h"
+
+using PGUPV::BVH;
+using PGUPV::BoundingBox;
+
+namespace {
+	const int NBINS = 16;
+
+	float halfArea(const glm::vec3 &min, const glm::vec3 &max) {
+		glm::vec3 d = max - min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	struct Bin {
+		BoundingBox bb;
+		uint32_t count = 0;
+	};
+};
+
+void BVH::build(const std::vector<BoundingBox> &boxes, uint32_t maxLeafSize)
+{
+	nodes.clear();
+	primitives.clear();
+	if (boxes.empty())
+		return;
+	if (boxes.size() >= std::numeric_limits<uint32_t>::max() / 2)
+		ERRT("BVH: demasiados primitivos");
+	maxLeafSize = std::max(maxLeafSize, 1u);
+
+	const uint32_t n = static_cast<uint32_t>(boxes.size());
+	std::vector<glm::vec3> centroids(n);
+	primitives.resize(n);
+	for (uint32_t i = 0; i < n; i++) {
+		centroids[i] = boxes[i].getCenter();
+		primitives[i] = i;
+	}
+	nodes.reserve(2 * n);
+	nodes.push_back(Node());
+
+	struct Task {
+		uint32_t node, begin, end, depth;
+	};
+	std::vector<Task> tasks{ { 0, 0, n, 0 } };
+	while (!tasks.empty()) {
+		Task task = tasks.back();
+		tasks.pop_back();
+
+		BoundingBox bb, cb;
+		for (uint32_t i = task.begin; i < task.end; i++) {
+			bb.grow(boxes[primitives[i]]);
+			cb.min = glm::min(cb.min, centroids[primitives[i]]);
+			cb.max = glm::max(cb.max, centroids[primitives[i]]);
+		}
+		Node &node = nodes[task.node];
+		node.min = bb.min;
+		node.max = bb.max;
+
+		const uint32_t count = task.end - task.begin;
+		auto makeLeaf = [&]() {
+			nodes[task.node].first = task.begin;
+			nodes[task.node].count = count;
+		};
+		if (count <= maxLeafSize || task.depth >= MAX_DEPTH - 2) {
+			makeLeaf();
+			continue;
+		}
+
+		// Buscamos el mejor corte (según SAH) entre los intervalos de los tres ejes
+		int bestAxis = -1, bestBin = 0;
+		float bestCost = std::numeric_limits<float>::max();
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = cb.max[axis] - cb.min[axis];
+			if (extent <= 0.0f)
+				continue;
+			Bin bins[NBINS];
+			float scale = NBINS / extent;
+			for (uint32_t i = task.begin; i < task.end; i++) {
+				int b = std::min(NBINS - 1, static_cast<int>((centroids[primitives[i]][axis] - cb.min[axis]) * scale));
+				bins[b].count++;
+				bins[b].bb.grow(boxes[primitives[i]]);
+			}
+			// Coste de los cortes barriendo desde la derecha, y luego desde la izquierda
+			float rightCost[NBINS];
+			BoundingBox acc;
+			uint32_t accCount = 0;
+			for (int b = NBINS - 1; b > 0; b--) {
+				acc.grow(bins[b].bb);
+				accCount += bins[b].count;
+				rightCost[b] = accCount ? accCount * halfArea(acc.min, acc.max) : 0.0f;
+			}
+			acc.reset();
+			accCount = 0;
+			for (int b = 0; b < NBINS - 1; b++) {
+				acc.grow(bins[b].bb);
+				accCount += bins[b].count;
+				if (accCount == 0 || accCount == count)
+					continue;
+				float cost = accCount * halfArea(acc.min, acc.max) + rightCost[b + 1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		uint32_t mid;
+		if (bestAxis < 0) {
+			// Todos los centros coinciden: partimos por la mitad
+			mid = task.begin + count / 2;
+		}
+		else {
+			// Si no compensa partir, nos quedamos con una hoja
+			if (count <= 4 * maxLeafSize && bestCost >= count * halfArea(bb.min, bb.max)) {
+				makeLeaf();
+				continue;
+			}
+			float scale = NBINS / (cb.max[bestAxis] - cb.min[bestAxis]);
+			auto it = std::partition(primitives.begin() + task.begin, primitives.begin() + task.end,
+				[&](uint32_t p) {
+				int b = std::min(NBINS - 1, static_cast<int>((centroids[p][bestAxis] - cb.min[bestAxis]) * scale));
+				return b <= bestBin;
+			});
+			mid = static_cast<uint32_t>(it - primitives.begin());
+		}
+
+		uint32_t left = static_cast<uint32_t>(nodes.size());
+		nodes[task.node].first = left;
+		nodes[task.node].count = 0;
+		nodes.push_back(Node());
+		nodes.push_back(Node());
+		tasks.push_back({ left, task.begin, mid, task.depth + 1 });
+		tasks.push_back({ left + 1, mid, task.end, task.depth + 1 });
+	}
+}
+
+BoundingBox BVH::getBB() const
+{
+	BoundingBox bb;
+	if (!nodes.empty()) {
+		bb.min = nodes[0].min;
+		bb.max = nodes[0].max;
+	}
+	return bb;
+}
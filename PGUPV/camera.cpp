@@ -143,7 +143,7 @@ void Camera::updateVerticesInFrustum() const {
 	};
 
 	auto& mesh = frustum->getMesh(0);
-	auto bo = mesh.getBufferObject(Mesh::BufferObjectType::VERTICES);
+	auto bo = mesh.getMutableBufferObject(Mesh::BufferObjectType::VERTICES);
 	gl_copy_write_buffer.bind(bo);
 	gl_copy_write_buffer.write(&vertices[0].x, static_cast<unsigned int>(sizeof(glm::vec4) * vertices.size()), 0);
 }
@@ -141,6 +141,12 @@ static void processPauseApplication(std::list<std::string> &args,
 	instance.pause();
 }
 
+static void processHotReload(std::list<std::string> &args,
+	PGUPV::App &/*instance*/) {
+	args.pop_front();
+	PGUPV::App::getShaderLibrary().setHotReload(true);
+}
+
 static void processChangeWorkingDirectory(std::list<std::string> &args,
 	const PGUPV::App &/*instance*/) {
 	if (args.size() < 2)
@@ -283,6 +289,7 @@ std::string CommandLineProcessor::getHelp() {
   o << "  -nocameras actúa como si no hubiera cámaras conectadas en el sistema\n";
   o << "  -noguistate no guarda ni carga el estado anterior del GUI\n";
   o << "  -libs muestra las versiones de las librerías utilizadas y termina\n";
+  o << "  -hotreload recompila los programas cuando cambian los ficheros de sus shaders\n";
 
 	return o.str();
 }
@@ -363,6 +370,8 @@ bool CommandLineProcessor::process(App & instance) {
       processNoGuiState(targs, instance);
     else if (arg == "-libs") // Mostrar versiones librerías
       processShowLibs(targs, instance);
+    else if (arg == "-hotreload") // Recargar los shaders modificados
+      processHotReload(targs, instance);
     else if (arg == "-ignore") // Ignorar las opciones de aquí en adelante
       break;
 		else
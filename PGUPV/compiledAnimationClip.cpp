@@ -0,0 +1,105 @@
+#include <limits>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "compiledAnimationClip.h"
+#include "animationClip.h"
+#include "log.h"
+
+using PGUPV::CompiledAnimationClip;
+using PGUPV::AnimationChannel;
+using PGUPV::AnimationClip;
+using PGUPV::TRS;
+
+glm::mat4 TRS::toMatrix() const {
+	// Equivale a translate(T) * mat4_cast(R) * scale(S), sin multiplicar matrices
+	glm::mat3 r = glm::mat3_cast(rotation);
+	glm::mat4 m;
+	m[0] = glm::vec4(r[0] * scale.x, 0.0f);
+	m[1] = glm::vec4(r[1] * scale.y, 0.0f);
+	m[2] = glm::vec4(r[2] * scale.z, 0.0f);
+	m[3] = glm::vec4(translation, 1.0f);
+	return m;
+}
+
+TRS TRS::fromMatrix(const glm::mat4 &m) {
+	TRS result;
+	result.translation = glm::vec3(m[3]);
+	glm::mat3 r(m);
+	result.scale = glm::vec3(glm::length(r[0]), glm::length(r[1]), glm::length(r[2]));
+	for (int i = 0; i < 3; i++) {
+		if (result.scale[i] != 0.0f)
+			r[i] /= result.scale[i];
+	}
+	// Una matriz con reflexión no es una rotación: la pasamos a la escala
+	if (glm::determinant(r) < 0.0f) {
+		result.scale.x = -result.scale.x;
+		r[0] = -r[0];
+	}
+	result.rotation = glm::quat_cast(r);
+	return result;
+}
+
+TRS TRS::blend(const TRS &a, const TRS &b, float w) {
+	if (w <= 0.0f) return a;
+	if (w >= 1.0f) return b;
+	TRS result;
+	result.translation = glm::mix(a.translation, b.translation, w);
+	result.rotation = glm::slerp(a.rotation, b.rotation, w);
+	result.scale = glm::mix(a.scale, b.scale, w);
+	return result;
+}
+
+TRS TRS::difference(const TRS &pose, const TRS &reference) {
+	TRS result;
+	result.translation = pose.translation - reference.translation;
+	result.rotation = pose.rotation * glm::inverse(reference.rotation);
+	result.scale = pose.scale / reference.scale;
+	return result;
+}
+
+TRS TRS::add(const TRS &base, const TRS &delta, float w) {
+	TRS d = blend(TRS(), delta, w);
+	TRS result;
+	result.translation = base.translation + d.translation;
+	result.rotation = d.rotation * base.rotation;
+	result.scale = base.scale * d.scale;
+	return result;
+}
+
+CompiledAnimationClip::CompiledAnimationClip(std::shared_ptr<AnimationClip> clip, const std::vector<std::string> &targetNames)
+	: clip(clip), bound(targetNames.size(), false)
+{
+	if (!clip)
+		ERRT("CompiledAnimationClip: no se ha indicado el clip");
+	if (targetNames.size() >= std::numeric_limits<uint32_t>::max())
+		ERRT("CompiledAnimationClip: demasiados destinos");
+
+	// Ésta es la única búsqueda por nombre: a partir de aquí todo son índices
+	for (size_t i = 0; i < targetNames.size(); i++) {
+		auto channel = clip->getAnimationChannel(targetNames[i]);
+		if (!channel)
+			continue;
+		bindings.push_back(Binding{ channel.get(), static_cast<uint32_t>(i) });
+		bound[i] = true;
+	}
+}
+
+void CompiledAnimationClip::sample(float t, std::vector<TRS> &pose, std::vector<AnimationChannel::Cursor> *cursors) const
+{
+	if (pose.size() < bound.size())
+		ERRT("CompiledAnimationClip: la pose tiene menos elementos que destinos");
+	if (cursors && cursors->size() != bindings.size())
+		cursors->assign(bindings.size(), AnimationChannel::Cursor());
+
+	const float ticks = clip->toTicks(t);
+	AnimationChannel::Cursor *cursor = cursors ? cursors->data() : nullptr;
+	for (size_t i = 0; i < bindings.size(); i++) {
+		const Binding &b = bindings[i];
+		AnimationChannel::Cursor *c = cursor ? cursor + i : nullptr;
+		TRS &trs = pose[b.target];
+		trs.translation = b.channel->interpolatePosition(ticks, c);
+		trs.rotation = b.channel->interpolateRotation(ticks, c);
+		trs.scale = b.channel->interpolateScaling(ticks, c);
+	}
+}
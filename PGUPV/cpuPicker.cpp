@@ -0,0 +1,108 @@
+#include <cfloat>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "cpuPicker.h"
+#include "meshBVH.h"
+#include "model.h"
+#include "mesh.h"
+
+using PGUPV::CPUPicker;
+using PGUPV::MeshBVH;
+using PGUPV::Picker;
+using PGUPV::Ray;
+using PGUPV::Mesh;
+using PGUPV::BoundingBox;
+
+Ray CPUPicker::computeRay(const Picker::PickData &pick, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix)
+{
+	// Centro del píxel en coordenadas normalizadas (el origen del clic es la esquina superior izquierda)
+	float x = 2.0f * (pick.x + 0.5f) / pick.width - 1.0f;
+	float y = 1.0f - 2.0f * (pick.y + 0.5f) / pick.height;
+
+	glm::mat4 inv = glm::inverse(projMatrix * viewMatrix);
+	glm::vec4 nearPoint = inv * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inv * glm::vec4(x, y, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 end = glm::vec3(farPoint) / farPoint.w;
+	return Ray(origin, glm::normalize(end - origin));
+}
+
+bool CPUPicker::pick(const Picker::PickData &pick, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix,
+	const std::vector<Picker::ModelId> &objects, Hit &hit)
+{
+	return this->pick(computeRay(pick, viewMatrix, projMatrix), objects, hit);
+}
+
+bool CPUPicker::pick(const Ray &ray, const std::vector<Picker::ModelId> &objects, Hit &hit)
+{
+	// Las BVH de las mallas que ya no existen no se van a volver a usar
+	for (auto it = meshBVHs.begin(); it != meshBVHs.end();) {
+		if (it->second.mesh.expired())
+			it = meshBVHs.erase(it);
+		else
+			++it;
+	}
+
+	// BVH de las cajas (en el sistema del mundo) de todas las mallas de los objetos
+	instances.clear();
+	std::vector<BoundingBox> boxes;
+	for (size_t o = 0; o < objects.size(); o++) {
+		for (size_t i = 0; i < objects[o].m->getNMeshes(); i++) {
+			auto mesh = objects[o].m->getSharedMesh(i);
+			if (mesh->getNVertices() == 0 || !mesh->drawsOnlyTriangles())
+				continue;
+			BoundingBox bb = mesh->getBB();
+			if (!bb.isValid())
+				continue;
+			bb.transform(objects[o].modelMatrix);
+			instances.push_back(Instance{ o, mesh });
+			boxes.push_back(bb);
+		}
+	}
+	topLevel.build(boxes, 1);
+
+	const float rayLength = glm::length(ray.direction);
+	float tmax = FLT_MAX;
+	bool found = topLevel.intersect(ray, tmax, [&](uint32_t i, float &tcur) {
+		const Instance &inst = instances[i];
+		const Picker::ModelId &obj = objects[inst.object];
+		// El rayo en el sistema del objeto tiene el mismo parámetro t que en el del mundo
+		glm::mat4 inv = glm::inverse(obj.modelMatrix);
+		Ray local(glm::vec3(inv * glm::vec4(ray.origin, 1.0f)), glm::vec3(inv * glm::vec4(ray.direction, 0.0f)));
+		MeshBVH::Hit meshHit;
+		if (!getMeshBVH(inst.mesh)->intersect(local, tcur, meshHit))
+			return false;
+		tcur = meshHit.t;
+		hit.node = obj.node;
+		hit.id = obj.id;
+		hit.model = obj.m;
+		hit.mesh = inst.mesh.get();
+		hit.triangle = meshHit.triangle;
+		hit.barycentrics = meshHit.barycentrics;
+		hit.position = ray.at(meshHit.t);
+		hit.distance = meshHit.t * rayLength;
+		return true;
+	});
+	return found;
+}
+
+std::shared_ptr<MeshBVH> CPUPicker::getMeshBVH(const std::shared_ptr<Mesh> &mesh)
+{
+	auto &cached = meshBVHs[mesh.get()];
+	if (!cached.bvh || cached.mesh.lock() != mesh || cached.version != mesh->getVersion()) {
+		cached.mesh = mesh;
+		cached.version = mesh->getVersion();
+		cached.bvh = std::make_shared<MeshBVH>(*mesh);
+	}
+	return cached.bvh;
+}
+
+void CPUPicker::invalidate(const Mesh *mesh)
+{
+	meshBVHs.erase(mesh);
+}
+
+void CPUPicker::clearCache()
+{
+	meshBVHs.clear();
+}
@@ -0,0 +1,150 @@
+#include "cullVisitor.h"
+#include "glMatrices.h"
+#include "indexedBindingPoint.h"
+#include "program.h"
+#include "log.h"
+
+using PGUPV::CullVisitor;
+using PGUPV::Frustum;
+using PGUPV::Node;
+using PGUPV::Group;
+using PGUPV::Transform;
+using PGUPV::Geode;
+using PGUPV::AnimationNode;
+using PGUPV::GLMatrices;
+using PGUPV::Program;
+
+CullVisitor::CullVisitor() : projView(1.0f) {
+}
+
+void CullVisitor::cull(Node &root, const glm::mat4 &pv, const glm::mat4 &modelMatrix) {
+	projView = pv;
+	counters = Counters();
+	visible.clear();
+	spaces.clear();
+	spaces.push_back(Space{ modelMatrix, Frustum(projView * modelMatrix) });
+	masks.clear();
+	masks.push_back(Frustum::ALL_PLANES);
+	programs.clear();
+	programs.push_back(nullptr);
+	nextPlane.clear();
+	root.accept(*this);
+	lastPlane.swap(nextPlane);
+}
+
+void CullVisitor::cull(Node &root, const GLMatrices &mats) {
+	cull(root, mats.getMatrix(GLMatrices::PROJ_MATRIX) * mats.getMatrix(GLMatrices::VIEW_MATRIX),
+		mats.getMatrix(GLMatrices::MODEL_MATRIX));
+}
+
+bool CullVisitor::enter(Node &node) {
+	counters.visited++;
+	if (!node.isVisible()) {
+		counters.invisible++;
+		return false;
+	}
+	BoundingBox bb = node.getBB();
+	if (!bb.isValid())
+		return false;
+
+	uint mask = masks.back();
+	if (mask == 0) {
+		counters.accepted++;
+	}
+	else {
+		auto it = lastPlane.find(&node);
+		uint plane = it != lastPlane.end() ? it->second : 0;
+		if (spaces.back().frustum.classify(bb, node.getBS(), mask, plane, &counters.planeTests) == Frustum::Result::OUTSIDE) {
+			counters.culled++;
+			nextPlane[&node] = plane;
+			return false;
+		}
+	}
+	if (!acceptNode(node))
+		return false;
+	masks.push_back(mask);
+	Program *p = node.getProgram().get();
+	programs.push_back(p ? p : programs.back());
+	return true;
+}
+
+void CullVisitor::leave(Node &node) {
+	masks.pop_back();
+	programs.pop_back();
+	leaveNode(node);
+}
+
+void CullVisitor::addVisible(Node &node) {
+	counters.visible++;
+	visible.push_back(Visible{ &node, spaces.back().modelMatrix, programs.back() });
+}
+
+void CullVisitor::apply(Group &group) {
+	if (!enter(group))
+		return;
+	traverse(group);
+	leave(group);
+}
+
+void CullVisitor::apply(Transform &transform) {
+	// La caja del Transform ya incluye su transformación: se comprueba en el sistema del padre
+	if (!enter(transform))
+		return;
+	Space space;
+	space.modelMatrix = spaces.back().modelMatrix * transform.getTransform();
+	// Si el Transform está completamente dentro, sus descendientes no usarán los planos
+	if (masks.back())
+		space.frustum.set(projView * space.modelMatrix);
+	spaces.push_back(space);
+	traverse(transform);
+	spaces.pop_back();
+	leave(transform);
+}
+
+void CullVisitor::apply(Geode &geode) {
+	if (!enter(geode))
+		return;
+	addVisible(geode);
+	leave(geode);
+}
+
+void CullVisitor::apply(AnimationNode &node) {
+	if (!enter(node))
+		return;
+	addVisible(node);
+	leave(node);
+}
+
+void CullVisitor::render() {
+	auto mats = std::dynamic_pointer_cast<GLMatrices>(gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX));
+	if (!mats)
+		ERRT("CullVisitor: no hay un GLMatrices vinculado");
+	Program *initial = Program::getCurrentProgram();
+	mats->pushMatrix(GLMatrices::MODEL_MATRIX);
+	for (const auto &v : visible) {
+		mats->setMatrix(GLMatrices::MODEL_MATRIX, v.modelMatrix);
+		drawVisible(v, initial);
+	}
+	mats->popMatrix(GLMatrices::MODEL_MATRIX);
+	restoreProgram(initial);
+}
+
+void CullVisitor::drawVisible(const Visible &v, Program *initial) {
+	// Las hojas seguidas con el mismo programa no lo vuelven a activar
+	Program *p = v.program ? v.program : initial;
+	if (p)
+		p->use();
+	else if (Program::getCurrentProgram())
+		Program::getCurrentProgram()->unUse();
+	v.node->render();
+}
+
+void CullVisitor::restoreProgram(Program *initial) {
+	Program *current = Program::getCurrentProgram();
+	if (current == initial)
+		return;
+	if (initial)
+		initial->use();
+	else
+		current->unUse();
+}
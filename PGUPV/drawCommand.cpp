@@ -2,6 +2,7 @@
 #include <string>
 #include <cstring>
 #include "drawCommand.h"
+#include "glMatrices.h"
 #include "log.h"
 
 using PGUPV::DrawCommand;
@@ -11,9 +12,12 @@ using PGUPV::MultiDrawArrays;
 using PGUPV::MultiDrawElements;
 using PGUPV::MultiDrawElementsBaseVertex;
 using PGUPV::TriangleIndices;
+using PGUPV::GLMatrices;
 
 
-void DrawCommand::render() {
+void DrawCommand::beginDraw() {
+  // Las matrices se escriben en el UBO sólo cuando se va a dibujar
+  GLMatrices::flushPending();
   if (mode == GL_PATCHES) {
     glPatchParameteri(GL_PATCH_VERTICES, verticesPerPatch);
   }
@@ -21,14 +25,30 @@ void DrawCommand::render() {
     glEnable(GL_PRIMITIVE_RESTART);
     glPrimitiveRestartIndex(restartIndex);
   }
+}
 
-  renderFunc();
-
+void DrawCommand::endDraw() {
   if (restartPrimitive) {
     glDisable(GL_PRIMITIVE_RESTART);
   }
 }
 
+void DrawCommand::render() {
+  beginDraw();
+  renderFunc();
+  endDraw();
+}
+
+void DrawCommand::renderInstanced(GLsizei instances) {
+  beginDraw();
+  renderInstancedFunc(instances);
+  endDraw();
+}
+
+void DrawCommand::renderInstancedFunc(GLsizei /*instances*/) {
+  ERRT("Esta orden de dibujo no tiene versión instanciada");
+}
+
 
 // Activa/desactiva el reinicio de primitivas
 void DrawCommand::setPrimitiveRestart(bool restart) {
@@ -2,6 +2,7 @@
 
 #include "fileLoader.h"
 #include "assimpWrapper.h"
+#include "asyncSceneLoader.h"
 #include "scene.h"
 #include "log.h"
 #include "utils.h"
@@ -18,6 +19,7 @@
 using PGUPV::Scene;
 using PGUPV::AssimpWrapper;
 using PGUPV::FileLoader;
+using PGUPV::AsyncSceneLoader;
 using PGUPV::Properties;
 using PGUPV::FindNodeByName;
 using PGUPV::Material;
@@ -409,13 +411,8 @@ static void loadPGMAT(const std::string& path, std::shared_ptr<Scene> scene) {
 }
 
 
-std::shared_ptr<Scene> FileLoader::load(const std::string& path, AssimpWrapper::LoadOptions options) {
-	AssimpWrapper loader;
-	auto scene = loader.load(path, options);
-	if (!scene) {
-		ERRT("Error cargando el fichero " + path);
-	}
-
+// Lo que se hace con la escena recién cargada, tanto en load como en loadAsync
+static void afterLoad(const std::string& path, std::shared_ptr<Scene> scene) {
 	std::ostringstream os;
 	PGUPV::DescribeScenegraph describer(os);
 	scene->getRoot()->accept(describer);
@@ -423,7 +420,7 @@ std::shared_ptr<Scene> FileLoader::load(const std::string& path, AssimpWrapper::
 
 
 	auto extraMaterialProps = PGUPV::removeExtension(path) + ".pgmat";
-	if (!fileExists(extraMaterialProps)) {
+	if (!PGUPV::fileExists(extraMaterialProps)) {
 		// No hay un fichero extra de materiales: crear una plantilla
 		createTemplatePGMAT(extraMaterialProps, scene);
 	}
@@ -431,10 +428,27 @@ std::shared_ptr<Scene> FileLoader::load(const std::string& path, AssimpWrapper::
 		// Hay un fichero extra de materiales: cargarlo
 		loadPGMAT(extraMaterialProps, scene);
 	}
+}
 
+std::shared_ptr<Scene> FileLoader::load(const std::string& path, AssimpWrapper::LoadOptions options) {
+	AssimpWrapper loader;
+	auto scene = loader.load(path, options);
+	if (!scene) {
+		ERRT("Error cargando el fichero " + path);
+	}
+	afterLoad(path, scene);
 	return scene;
 }
 
+std::shared_ptr<AsyncSceneLoader> FileLoader::loadAsync(const std::string& path, AssimpWrapper::LoadOptions options,
+	std::function<void(std::shared_ptr<Scene>)> onLoaded) {
+	return AsyncSceneLoader::start(path, options, [path, onLoaded](std::shared_ptr<Scene> scene) {
+		afterLoad(path, scene);
+		if (onLoaded)
+			onLoaded(scene);
+	});
+}
+
 std::vector<PGUPV::ExportFileFormat> FileLoader::getSupportedExportFileFormats()
 {
 	AssimpWrapper assimp;
@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "fileWatcher.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::FileWatcher;
+
+namespace {
+	// Con segundos, no se verían dos cambios en el mismo segundo
+	PGUPV::FileStamp stampOf(const std::string &filename) {
+		PGUPV::FileStamp stamp;
+		PGUPV::getFileStamp(filename, stamp);
+		return stamp;
+	}
+};
+
+FileWatcher::FileWatcher() : pollInterval(500), notifyFd(-1) {
+#ifdef __linux__
+	notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notifyFd < 0)
+		WARN("No se puede usar inotify: se comprobarán las fechas de modificación de los ficheros");
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (notifyFd >= 0)
+		close(notifyFd);
+#endif
+}
+
+void FileWatcher::watch(const std::string &filename) {
+	auto path = PGUPV::getCanonicalPath(filename);
+	if (files.find(path) != files.end())
+		return;
+	files[path] = stampOf(path);
+
+#ifdef __linux__
+	if (notifyFd < 0)
+		return;
+	auto dir = PGUPV::getDirectory(path);
+	if (dirs.find(dir) != dirs.end())
+		return;
+	int wd = inotify_add_watch(notifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd < 0)
+		WARN("No se puede vigilar el directorio " + dir);
+	else
+		dirs[dir] = wd;
+#endif
+}
+
+void FileWatcher::unwatch(const std::string &filename) {
+	files.erase(PGUPV::getCanonicalPath(filename));
+	// Los directorios se siguen vigilando: los cambios en ficheros no vigilados se ignoran
+}
+
+void FileWatcher::clear() {
+	files.clear();
+#ifdef __linux__
+	for (const auto &d : dirs)
+		inotify_rm_watch(notifyFd, d.second);
+#endif
+	dirs.clear();
+}
+
+std::vector<std::string> FileWatcher::getWatchedFiles() const {
+	std::vector<std::string> result;
+	for (const auto &f : files)
+		result.push_back(f.first);
+	return result;
+}
+
+bool FileWatcher::usesNotifications() const {
+	return notifyFd >= 0;
+}
+
+std::vector<std::string> FileWatcher::poll() {
+	if (!usesNotifications())
+		return pollModificationTimes();
+
+	std::vector<std::string> changed;
+#ifdef __linux__
+	// Cada evento ocupa sizeof(inotify_event) más el nombre del fichero
+	alignas(inotify_event) char buffer[4096];
+	for (;;) {
+		ssize_t len = read(notifyFd, buffer, sizeof(buffer));
+		if (len <= 0)
+			break;
+		for (char *p = buffer; p < buffer + len; ) {
+			auto ev = reinterpret_cast<inotify_event *>(p);
+			p += sizeof(inotify_event) + ev->len;
+			if (ev->len == 0)
+				continue;
+			auto dir = std::find_if(dirs.begin(), dirs.end(),
+				[ev](const std::pair<const std::string, int> &d) { return d.second == ev->wd; });
+			if (dir == dirs.end())
+				continue;
+			auto path = dir->first + "/" + ev->name;
+			if (files.find(path) != files.end() &&
+				std::find(changed.begin(), changed.end(), path) == changed.end())
+				changed.push_back(path);
+		}
+	}
+#endif
+	for (const auto &f : changed)
+		files[f] = stampOf(f);
+	return changed;
+}
+
+std::vector<std::string> FileWatcher::pollModificationTimes() {
+	std::vector<std::string> changed;
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastPoll < std::chrono::milliseconds(pollInterval))
+		return changed;
+	lastPoll = now;
+
+	for (auto &f : files) {
+		auto t = stampOf(f.first);
+		if (t != f.second) {
+			f.second = t;
+			// Mientras se está guardando, el fichero puede no existir
+			if (t.size >= 0)
+				changed.push_back(f.first);
+		}
+	}
+	return changed;
+}
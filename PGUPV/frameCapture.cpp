@@ -0,0 +1,186 @@
+#include <cstring>
+#include <algorithm>
+
+#include "frameCapture.h"
+#include "bufferObject.h"
+#include "bindingPoint.h"
+#include "glStateCache.h"
+#include "image.h"
+#include "log.h"
+
+using PGUPV::FrameCapture;
+using PGUPV::BufferObject;
+using PGUPV::Image;
+
+namespace {
+	// Tiempo máximo de cada espera a la GPU (en nanosegundos)
+	const GLuint64 FENCE_TIMEOUT = 100000000;
+
+	bool isSignaled(GLsync fence) {
+		GLenum r = glClientWaitSync(fence, 0, 0);
+		return r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED;
+	}
+};
+
+FrameCapture::FrameCapture(uint nBuffers, uint nThreads) :
+	slots(nBuffers > 0 ? nBuffers : 1), next(0), maxPendingWrites(8), backPressure(BackPressure::WAIT),
+	pool(nThreads > 0 ? nThreads : 1) {
+}
+
+FrameCapture::~FrameCapture() {
+	try {
+		flush();
+	}
+	catch (std::exception &e) {
+		ERR(std::string("Error guardando las capturas pendientes: ") + e.what());
+	}
+	for (auto &s : slots) {
+		if (s.fence)
+			glDeleteSync(s.fence);
+	}
+}
+
+size_t FrameCapture::getNPending() const {
+	size_t n = writes.size();
+	for (const auto &s : slots)
+		if (s.fence)
+			n++;
+	return n;
+}
+
+bool FrameCapture::capture(const std::string &filename, GLint x, GLint y, GLsizei width,
+	GLsizei height, GLenum readBuffer) {
+	reapWrites(false);
+	// Si se llega al límite, la lectura que saldría del anillo no tendría sitio
+	if (writes.size() >= maxPendingWrites) {
+		if (backPressure == BackPressure::DROP) {
+			stats.dropped++;
+			WARN("Captura descartada (hay demasiadas imágenes esperando a escribirse): " + filename);
+			return false;
+		}
+		while (writes.size() >= maxPendingWrites)
+			waitOldestWrite();
+	}
+
+	// Se reutiliza el buffer más antiguo del anillo: si la GPU aún no ha terminado de
+	// escribir en él, hay que esperar
+	Slot &slot = slots[next];
+	if (slot.fence)
+		readBack(slot);
+
+	size_t size = static_cast<size_t>(width) * height * 3;
+	if (!slot.pbo || slot.pbo->getSize() < size) {
+		slot.pbo = BufferObject::build(size, GL_STREAM_READ);
+		slot.pbo->setGlDebugLabel("FrameCapture");
+	}
+	slot.filename = filename;
+	slot.width = width;
+	slot.height = height;
+
+	GLint oldRead;
+	glGetIntegerv(GL_READ_BUFFER, &oldRead);
+	glReadBuffer(readBuffer);
+	{
+		GLStateCapturer<PixelPackState> packState;
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		auto prev = gl_pixel_pack_buffer.bind(slot.pbo);
+		// Con un buffer vinculado a GL_PIXEL_PACK_BUFFER, glReadPixels no espera a la GPU
+		glReadPixels(x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+		if (prev)
+			gl_pixel_pack_buffer.bind(prev);
+		else
+			gl_pixel_pack_buffer.unbind();
+	}
+	glReadBuffer(oldRead);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	next = (next + 1) % slots.size();
+	stats.captured++;
+	return true;
+}
+
+void FrameCapture::update() {
+	// Del más antiguo al más nuevo, para que las imágenes se escriban en orden
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot &slot = slots[(next + i) % slots.size()];
+		if (!slot.fence)
+			continue;
+		if (!isSignaled(slot.fence))
+			break;
+		readBack(slot);
+	}
+	reapWrites(false);
+}
+
+void FrameCapture::flush() {
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot &slot = slots[(next + i) % slots.size()];
+		if (slot.fence)
+			readBack(slot);
+	}
+	reapWrites(true);
+}
+
+void FrameCapture::readBack(Slot &slot) {
+	GLenum r = glClientWaitSync(slot.fence, 0, 0);
+	if (r == GL_TIMEOUT_EXPIRED) {
+		stats.stalls++;
+		do {
+			r = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+		} while (r == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	if (r == GL_WAIT_FAILED) {
+		stats.failed++;
+		ERR("Error esperando a la GPU para guardar " + slot.filename);
+		return;
+	}
+
+	// Se copia la imagen a memoria aquí, porque el buffer sólo se puede mapear desde este hilo
+	auto image = std::make_shared<Image>(slot.width, slot.height, 24);
+	size_t size = static_cast<size_t>(slot.width) * slot.height * 3;
+	auto prev = gl_pixel_pack_buffer.bind(slot.pbo);
+	void *pixels = gl_pixel_pack_buffer.map(0, size, GL_MAP_READ_BIT);
+	if (pixels)
+		memcpy(image->getPixels(), pixels, size);
+	gl_pixel_pack_buffer.unmap();
+	if (prev)
+		gl_pixel_pack_buffer.bind(prev);
+	else
+		gl_pixel_pack_buffer.unbind();
+	if (!pixels) {
+		stats.failed++;
+		ERR("No se ha podido leer la captura " + slot.filename);
+		return;
+	}
+
+	std::string filename = slot.filename;
+	writes.push_back(Write{ pool.submit([image, filename]() { image->save(filename); }), filename });
+}
+
+void FrameCapture::reapWrites(bool wait) {
+	while (!writes.empty()) {
+		if (!wait && writes.front().done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			break;
+		try {
+			writes.front().done.get();
+			stats.written++;
+			// Se informa desde aquí, en el hilo de la aplicación, y no desde el hilo que la ha guardado
+			INFO("Imagen guardada a " + writes.front().filename);
+		}
+		catch (std::exception &) {
+			// Image::save ya ha escrito el error en el log
+			stats.failed++;
+		}
+		writes.pop_front();
+	}
+}
+
+void FrameCapture::waitOldestWrite() {
+	if (writes.empty())
+		return;
+	if (writes.front().done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		stats.stalls++;
+	writes.front().done.wait();
+	reapWrites(false);
+}
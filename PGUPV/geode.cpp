@@ -5,6 +5,7 @@ using PGUPV::Geode;
 using PGUPV::NodeVisitor;
 using PGUPV::Model;
 using PGUPV::Mesh;
+using PGUPV::Program;
 
 
 
@@ -20,8 +21,11 @@ std::shared_ptr<Geode> PGUPV::Geode::build(std::shared_ptr<Model> m)
 }
 
 void Geode::render() {
-  if (visible)
-    model->render();
+  if (!visible)
+    return;
+  Program *previous = useProgram();
+  model->render();
+  restoreProgram(previous);
 }
 
 void Geode::recomputeBoundingBox() {
@@ -35,7 +39,7 @@ void Geode::recomputeBoundingSphere() {
 
 void Geode::setModel(std::shared_ptr<Model> m) {
   model = m;
-  bb.reset();
+  invalidateBoundingVolumes();
 }
 
 std::shared_ptr<Geode> Geode::shared_from_this()
@@ -1,19 +1,38 @@
+#include <algorithm>
 #include <glm/glm.hpp>
 
 #include "glMatrices.h"
+#include "uniformStream.h"
 #include "log.h"
 #include "indexedBindingPoint.h"
 #include "utils.h"
 
 using PGUPV::GLMatrices;
 using PGUPV::BufferObject;
+using PGUPV::UniformStream;
 
-GLMatrices::GLMatrices() : UniformBufferObject(size()) {
+std::vector<GLMatrices *> GLMatrices::pending;
+GLMatrices *GLMatrices::lastBound = nullptr;
+const void *GLMatrices::lastStream = nullptr;
+GLMatrices::Counters GLMatrices::counters;
+GLMatrices::Counters GLMatrices::frameCounters;
+
+GLMatrices::GLMatrices() : UniformBufferObject(size()),
+  modelviewDirty(false), modelviewprojDirty(false), uploadMask(0),
+  streamGeneration(0), bufferStale(false) {
 	derivedMatrices.modelview = glm::mat4(1.0f);
 	derivedMatrices.modelviewprojection = glm::mat4(1.0f);
 	derivedMatrices.normal = glm::mat3x4(1.0f);
 }
 
+GLMatrices::~GLMatrices() {
+  if (lastBound == this)
+    lastBound = nullptr;
+  auto it = std::find(pending.begin(), pending.end(), this);
+  if (it != pending.end())
+    pending.erase(it);
+}
+
 const std::string GLMatrices::blockName{ "GLMatrices" };
 
 const std::string &GLMatrices::getBlockName() const { 
@@ -37,41 +56,177 @@ const Strings &GLMatrices::getDefinition() const {
 	return GLMatrices::definition;
 }
 
-void GLMatrices::writeMatrix(Matrix mat) {
-  gl_uniform_buffer.bindBufferBase(this->shared_from_this(),
-    UBO_GL_MATRICES_BINDING_INDEX);
-  gl_uniform_buffer.write((void *)&mats[mat].getMatrix(), sizeof(glm::mat4),
-    mat * sizeof(glm::mat4));
-  if (mat == MODEL_MATRIX || mat == VIEW_MATRIX) {
-    // Compute MODELVIEW matrix
-    derivedMatrices.modelview =
-      mats[VIEW_MATRIX].getMatrix() * mats[MODEL_MATRIX].getMatrix();
+void GLMatrices::touch(Matrix mat) {
+  counters.operations++;
+  if (mat == PROJ_MATRIX)
+    modelviewprojDirty = true;
+  else
+    modelviewDirty = modelviewprojDirty = true;
+  setPending(true);
+  uploadMask |= (1 << mat) | DERIVED_BIT;
+}
 
-    // Compute MODELVIEWPROJ matrix
-    derivedMatrices.modelviewprojection =
-      mats[PROJ_MATRIX].getMatrix() * derivedMatrices.modelview;
+void GLMatrices::setPending(bool moveToBack) {
+  // Ya es el último de la lista. Con un UniformStream, puede tener cambios sin estar en
+  // ella (ver flushPending), así que no basta con mirar uploadMask
+  if (!pending.empty() && pending.back() == this)
+    return;
+  auto it = std::find(pending.begin(), pending.end(), this);
+  if (it != pending.end()) {
+    if (!moveToBack)
+      return;
+    pending.erase(it);
+  }
+  if (moveToBack)
+    pending.push_back(this);
+  else
+    pending.insert(pending.begin(), this);
+}
 
-    // Compute NORMAL matrix
+void GLMatrices::updateDerived() const {
+  if (modelviewDirty) {
+    derivedMatrices.modelview =
+      mats[VIEW_MATRIX].getMatrix() * mats[MODEL_MATRIX].getMatrix();
     glm::mat3 nm(derivedMatrices.modelview);
     derivedMatrices.normal = glm::mat3x4(glm::transpose(glm::inverse(nm)));
-
-    // Write both into the UBO
-    gl_uniform_buffer.write((void *)&derivedMatrices, sizeof(derivedMatrices),
-      sizeof(glm::mat4) * 3);
+    counters.inversions++;
+    modelviewDirty = false;
   }
-  else if (mat == PROJ_MATRIX) {
-    // Compute MODELVIEWPROJ matrix
+  if (modelviewprojDirty) {
     derivedMatrices.modelviewprojection =
       mats[PROJ_MATRIX].getMatrix() * derivedMatrices.modelview;
-    // Write both into the UBO
-    gl_uniform_buffer.write((void *)&derivedMatrices, sizeof(derivedMatrices),
-      sizeof(glm::mat4) * 3);
+    modelviewprojDirty = false;
   }
 }
 
+void GLMatrices::flush() {
+  if (uploadMask == 0)
+    return;
+  upload(true);
+}
+
+void GLMatrices::upload(bool bindAfter) {
+  updateDerived();
+  UniformStream *stream = UniformStream::getCurrent();
+  if (stream) {
+    // Cada flush copia el bloque completo en una zona nueva del stream
+    struct {
+      glm::mat4 m[PROJ_MATRIX + 1];
+      glm::mat4 modelview;
+      glm::mat4 modelviewprojection;
+      glm::mat3x4 normal;
+    } block;
+    static_assert(sizeof(block) == 5 * sizeof(glm::mat4) + sizeof(glm::mat3x4), "GLMatrices: bloque con relleno");
+    for (uint i = 0; i <= PROJ_MATRIX; i++)
+      block.m[i] = mats[i].getMatrix();
+    block.modelview = derivedMatrices.modelview;
+    block.modelviewprojection = derivedMatrices.modelviewprojection;
+    block.normal = derivedMatrices.normal;
+    stream->bind(this->shared_from_this(), UBO_GL_MATRICES_BINDING_INDEX, &block, sizeof(block));
+    streamGeneration = stream->getGeneration();
+    bufferStale = true;
+    counters.uploads++;
+    counters.bytesUploaded += sizeof(block);
+  }
+  else {
+    if (bufferStale) {
+      uploadMask = ALL_BITS;
+      bufferStale = false;
+    }
+    // Si no hay que vincularlo, se escribe a través del punto de vinculación genérico,
+    // sin tocar el que usan los shaders
+    if (bindAfter)
+      gl_uniform_buffer.bindBufferBase(this->shared_from_this(),
+        UBO_GL_MATRICES_BINDING_INDEX);
+    else
+      gl_uniform_buffer.bind(this->shared_from_this());
+    for (uint i = 0; i <= PROJ_MATRIX; i++) {
+      if (uploadMask & (1 << i)) {
+        gl_uniform_buffer.write((void *)&mats[i].getMatrix(), sizeof(glm::mat4),
+          i * sizeof(glm::mat4));
+        counters.uploads++;
+        counters.bytesUploaded += sizeof(glm::mat4);
+      }
+    }
+    if (uploadMask & DERIVED_BIT) {
+      gl_uniform_buffer.write((void *)&derivedMatrices, sizeof(derivedMatrices),
+        sizeof(glm::mat4) * 3);
+      counters.uploads++;
+      counters.bytesUploaded += sizeof(derivedMatrices);
+    }
+  }
+  if (bindAfter) {
+    lastBound = this;
+    lastStream = stream;
+  }
+  counters.flushes++;
+  uploadMask = 0;
+  auto it = std::find(pending.begin(), pending.end(), this);
+  if (it != pending.end())
+    pending.erase(it);
+}
+
+void GLMatrices::bind() {
+  // Los cambios anteriores de los demás objetos se escriben sin vincularlos: este es el
+  // que tiene que quedar vinculado, como si se hubiesen escrito al hacerlos
+  uploadUnbound(this);
+  // Con un stream, o si el UBO propio no está al día, hay que volver a escribir el bloque
+  if (UniformStream::getCurrent() || bufferStale) {
+    setPending(false);
+    uploadMask |= DERIVED_BIT;
+  }
+  if (uploadMask != 0) {
+    flush();
+  }
+  else {
+    gl_uniform_buffer.bindBufferBase(this->shared_from_this(),
+      UBO_GL_MATRICES_BINDING_INDEX);
+    lastBound = this;
+    lastStream = nullptr;
+  }
+}
+
+void GLMatrices::flushPending() {
+  // Los datos de las matrices vinculadas pueden haberse quedado en una región del stream
+  // que se va a reutilizar, o en un stream que ya no se usa
+  UniformStream *stream = UniformStream::getCurrent();
+  if (lastBound && (stream != lastStream ||
+    (stream && lastBound->streamGeneration != stream->getGeneration()))) {
+    lastBound->setPending(false);
+    lastBound->uploadMask |= DERIVED_BIT;
+  }
+  // Como si cada cambio se hubiese escrito al hacerlo, el último objeto modificado es el
+  // que queda vinculado. Los demás sólo se escriben
+  if (pending.empty())
+    return;
+  GLMatrices *last = pending.back();
+  uploadUnbound(last);
+  last->upload(true);
+}
+
+void GLMatrices::uploadUnbound(GLMatrices *keep) {
+  // Con un stream, los datos de los objetos no vinculados se copiarán cuando se vinculen
+  UniformStream *stream = UniformStream::getCurrent();
+  size_t i = 0;
+  while (i < pending.size()) {
+    GLMatrices *m = pending[i];
+    if (m == keep)
+      i++;
+    else if (stream)
+      pending.erase(pending.begin() + i);
+    else
+      m->upload(false);
+  }
+}
+
+void GLMatrices::endFrame() {
+  frameCounters = counters;
+  counters = Counters();
+}
+
 void GLMatrices::loadIdentity(Matrix mat) {
   mats[mat].loadIdentity();
-  writeMatrix(mat);
+  touch(mat);
 }
 
 void GLMatrices::pushMatrix(Matrix mat) {
@@ -81,7 +236,7 @@ void GLMatrices::pushMatrix(Matrix mat) {
 
 void GLMatrices::popMatrix(Matrix mat) {
   mats[mat].popMatrix();
-  writeMatrix(mat);
+  touch(mat);
 }
 
 void GLMatrices::translate(Matrix mat, float x, float y, float z) {
@@ -90,7 +245,7 @@ void GLMatrices::translate(Matrix mat, float x, float y, float z) {
 
 void GLMatrices::translate(Matrix mat, const glm::vec3 &t) {
   mats[mat].translate(t);
-  writeMatrix(mat);
+  touch(mat);
 }
 
 void GLMatrices::rotate(Matrix mat, float radians, float axis_x, float axis_y,
@@ -100,7 +255,7 @@ void GLMatrices::rotate(Matrix mat, float radians, float axis_x, float axis_y,
 
 void GLMatrices::rotate(Matrix mat, float radians, const glm::vec3 &axis) {
   mats[mat].rotate(radians, axis);
-  writeMatrix(mat);
+  touch(mat);
 }
 
 
@@ -114,17 +269,17 @@ void GLMatrices::scale(Matrix mat, float sx, float sy, float sz) {
 
 void GLMatrices::scale(Matrix mat, const glm::vec3 &s) {
   mats[mat].scale(s);
-  writeMatrix(mat);
+  touch(mat);
 }
 
 void GLMatrices::multMatrix(Matrix mat, const glm::mat4 &m) {
   mats[mat].multMatrix(m);
-  writeMatrix(mat);
+  touch(mat);
 }
 
 void GLMatrices::setMatrix(Matrix mat, const glm::mat4 &m) {
   mats[mat].setMatrix(m);
-  writeMatrix(mat);
+  touch(mat);
 }
 
 const glm::mat4 &GLMatrices::getMatrix(Matrix mat) const {
@@ -132,6 +287,7 @@ const glm::mat4 &GLMatrices::getMatrix(Matrix mat) const {
     ERRT("No puedes usar getMatrix para conseguir la matriz normal. Usa "
     "getNormalMatrix");
 
+  updateDerived();
   if (mat == MODELVIEW_MATRIX)
     return derivedMatrices.modelview;
   else if (mat == MODELVIEWPROJ_MATRIX)
@@ -141,13 +297,14 @@ const glm::mat4 &GLMatrices::getMatrix(Matrix mat) const {
 }
 
 const glm::mat3 GLMatrices::getNormalMatrix() const {
+  updateDerived();
   return glm::mat3(derivedMatrices.normal);
 }
 
 void GLMatrices::reset() {
   for (uint i = 0; i <= PROJ_MATRIX; i++) {
     mats[i].reset();
-    writeMatrix((Matrix)i);
+    touch((Matrix)i);
   }
 }
 
@@ -157,11 +314,13 @@ std::shared_ptr<GLMatrices> GLMatrices::build() {
   allocate(ubo);
   ubo->setGlDebugLabel(ubo->getBlockName());
   ubo->reset();
+  ubo->flush();
   INFO("UBO GLMatrices creado");
   return ubo;
 }
 
 std::ostream &PGUPV::operator<<(std::ostream &os, const GLMatrices &m) {
+  m.updateDerived();
   os << "Model matrix:\n";
   os << m.mats[GLMatrices::MODEL_MATRIX];
   os << "View matrix:\n";
@@ -7,6 +7,7 @@
 using PGUPV::Group;
 using PGUPV::NodeVisitor;
 using PGUPV::Node;
+using PGUPV::Program;
 
 std::shared_ptr<Group> Group::build()
 {
@@ -15,8 +16,10 @@ std::shared_ptr<Group> Group::build()
 
 void Group::render() {
   if (!visible || !getBB().isValid()) return;
+  Program *previous = useProgram();
   for (auto &c : children)
     c->render();
+  restoreProgram(previous);
 }
 
 void Group::recomputeBoundingBox() {
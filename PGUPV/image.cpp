@@ -2,6 +2,7 @@
 #include <sstream>
 #include <iomanip>
 #include <memory.h>
+#include <mutex>
 
 
 #include "image.h"
@@ -38,6 +39,19 @@ freeimageImage(nullptr), freeimageMultiImage(nullptr) {
 		ERRT(std::string("No se ha podido cargar la imagen ") + filename);
 }
 
+Image::Image() : _width(0), _height(0), _data(nullptr), _bpp(0), _nfaces(0), _nAnimationFrames(0),
+_stride(0), freeimageImage(nullptr), freeimageMultiImage(nullptr) {
+	initLib();
+}
+
+std::unique_ptr<Image> Image::tryLoad(const std::string &filename) {
+	std::unique_ptr<Image> image(new Image());
+	image->_filename = filename;
+	if (!image->load(filename))
+		return std::unique_ptr<Image>();
+	return image;
+}
+
 Image::Image(Image &&other) : _width(other._width), _height(other._height),
 _data(other._data), _bpp(other._bpp), _nfaces(other._nfaces),
 _nAnimationFrames(other._nAnimationFrames), _stride(other._stride),
@@ -252,15 +266,20 @@ void Image::releaseMemory() {
 
 	if (freeimageImage != nullptr) {
 		FreeImage_Unload(freeimageImage);
+		freeimageImage = nullptr;
 		delete[]_data;
+		_data = nullptr;
 	}
 	else if (freeimageMultiImage != nullptr) {
-		for (uint i = 0; i < this->_nAnimationFrames; i++) {
-			FreeImage_UnlockPage(freeimageMultiImage, lockedPages[i], FALSE);
+		for (uint i = 0; i < lockedPages.size(); i++) {
+			if (lockedPages[i] != nullptr)
+				FreeImage_UnlockPage(freeimageMultiImage, lockedPages[i], FALSE);
 		}
 		FreeImage_CloseMultiBitmap(freeimageMultiImage);
+		freeimageMultiImage = nullptr;
 		lockedPages.clear();
 		delete[]_data;
+		_data = nullptr;
 	}
 	else {
 		if (_data != nullptr) {
@@ -274,7 +293,8 @@ void Image::releaseMemory() {
 	}
 }
 
-static std::string FreeImageErrorMsg;
+// FreeImage llama al manejador en el hilo que produce el error (ver ImageLoader)
+static thread_local std::string FreeImageErrorMsg;
 
 void FreeImageErrorHandler(FREE_IMAGE_FORMAT fif, const char *message) {
 	if (fif != FIF_UNKNOWN) {
@@ -286,13 +306,15 @@ void FreeImageErrorHandler(FREE_IMAGE_FORMAT fif, const char *message) {
 }
 
 void Image::initLib() {
-	if (!_freeImageInitialized) {
+	// Se pueden cargar imágenes desde varios hilos a la vez
+	static std::once_flag initialized;
+	std::call_once(initialized, []() {
 #ifndef _WIN32
 		FreeImage_Initialise();
 #endif
 		FreeImage_SetOutputMessage(FreeImageErrorHandler);
 		_freeImageInitialized = true;
-}
+	});
 }
 
 bool Image::loadDDS(const std::string &/*filename*/) {
@@ -346,12 +368,14 @@ bool Image::loadMulti(const std::string &filename, const FREE_IMAGE_FORMAT fileT
 		freeimageMultiImage = FreeImage_OpenMultiBitmap(fileType, filename.c_str(), false, true, true);
 
 	if (freeimageMultiImage == nullptr) {
-		ERRT("No se ha podido cargar la imagen " + filename + "Error: " + FreeImageErrorMsg);
+		ERR("No se ha podido cargar la imagen " + filename + "Error: " + FreeImageErrorMsg);
+		return false;
 	}
 
 	auto pageCount = FreeImage_GetPageCount(freeimageMultiImage);
 	if (pageCount == 1) {
 		FreeImage_CloseMultiBitmap(freeimageMultiImage);
+		freeimageMultiImage = nullptr;
 		return loadSimple(filename, fileType);
 	}
 
@@ -372,8 +396,10 @@ bool Image::loadMulti(const std::string &filename, const FREE_IMAGE_FORMAT fileT
 		_stride = FreeImage_GetPitch(dib);
 		FreeImage_UnlockPage(freeimageMultiImage, dib, false);
 	}
-	else
-		ERRT("No se ha podido leer el primer frame de " + filename);
+	else {
+		ERR("No se ha podido leer el primer frame de " + filename);
+		return false;
+	}
 
 	// Siempre cargamos el primer frame
 	loadFrameFromMulti(0);
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "imageLoader.h"
+#include "image.h"
+#include "threadPool.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::ImageLoader;
+using PGUPV::Image;
+using PGUPV::ThreadPool;
+
+ImageLoader::ImageLoader() : firstPending(0) {
+}
+
+ImageLoader::~ImageLoader() {
+}
+
+void ImageLoader::add(const std::string &filename, bool flipV, bool mipmaps) {
+	auto key = std::make_pair(filename, flipV);
+	auto it = index.find(key);
+	if (it != index.end()) {
+		// Si ya se ha decodificado sin mipmaps, se quedará sin ellos
+		requests[it->second]->mipmaps |= mipmaps;
+		return;
+	}
+	std::unique_ptr<Decoded> d(new Decoded());
+	d->filename = filename;
+	d->flipV = flipV;
+	d->mipmaps = mipmaps;
+	index[key] = requests.size();
+	requests.push_back(std::move(d));
+}
+
+void ImageLoader::decode(Decoded &d) {
+	d.image = Image::tryLoad(d.filename);
+	if (!d.image) {
+		d.error = "No se ha podido cargar la imagen " + d.filename;
+		return;
+	}
+	if (d.flipV)
+		d.image->flipV();
+	if (d.mipmaps)
+		d.mipmapLevels = buildMipmaps(*d.image);
+}
+
+void ImageLoader::decode() {
+	size_t end = requests.size();
+	if (firstPending == end)
+		return;
+
+	auto start = std::chrono::steady_clock::now();
+	// Cada trozo va cogiendo la siguiente imagen pendiente hasta que no quedan, para repartir
+	// bien el trabajo aunque los ficheros sean de tamaños muy distintos
+	auto &pool = ThreadPool::getInstance();
+	std::atomic<size_t> next(firstPending);
+	size_t nchunks = std::min<size_t>(end - firstPending, pool.getNThreads() + 1);
+	pool.parallelFor(0, nchunks, [&](size_t, size_t) {
+		for (size_t i = next++; i < end; i = next++)
+			decode(*requests[i]);
+	}, 1);
+
+	for (size_t i = firstPending; i < end; i++) {
+		const Decoded &d = *requests[i];
+		if (d.image) {
+			stats.decoded++;
+			stats.mipmapLevels += d.mipmapLevels.size();
+		}
+		else {
+			stats.failed++;
+			WARN(d.error);
+		}
+	}
+	firstPending = end;
+	stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	INFO(std::to_string(stats.decoded) + " imágenes decodificadas con " +
+		std::to_string(pool.getNThreads()) + " hilos en " + PGUPV::to_string(static_cast<float>(stats.seconds), 3) + " s");
+}
+
+const ImageLoader::Decoded *ImageLoader::get(const std::string &filename, bool flipV) const {
+	auto it = index.find(std::make_pair(filename, flipV));
+	if (it == index.end() || it->second >= firstPending)
+		return nullptr;
+	return requests[it->second].get();
+}
+
+void ImageLoader::clear() {
+	requests.clear();
+	index.clear();
+	firstPending = 0;
+}
+
+std::vector<std::unique_ptr<Image>> ImageLoader::buildMipmaps(const Image &image) {
+	std::vector<std::unique_ptr<Image>> levels;
+	uint bpp = image.getBPP();
+	if ((bpp != 8 && bpp != 24 && bpp != 32) || image.getGLPixelBaseType() != GL_UNSIGNED_BYTE)
+		return levels;
+
+	uint channels = bpp / 8;
+	// Texels de origen de cada texel de destino en una dimensión: 2x y 2x+1. Si la dimensión
+	// es impar, el último también incluye el texel sobrante, para no perderlo ni desplazar
+	// el nivel
+	auto footprint = [](uint i, uint n, uint srcSize, uint *out) -> uint {
+		out[0] = 2 * i;
+		out[1] = std::min(2 * i + 1, srcSize - 1);
+		if (i == n - 1 && 2 * i + 2 < srcSize) {
+			out[2] = 2 * i + 2;
+			return 3;
+		}
+		return 2;
+	};
+	const Image *src = &image;
+	while (src->getWidth() > 1 || src->getHeight() > 1) {
+		uint sw = src->getWidth(), sh = src->getHeight();
+		uint w = std::max(1u, sw / 2), h = std::max(1u, sh / 2);
+		std::unique_ptr<Image> dst(new Image(w, h, bpp));
+		for (uint y = 0; y < h; y++) {
+			uint rows[3];
+			uint nrows = footprint(y, h, sh, rows);
+			const uchar *r[3];
+			for (uint i = 0; i < nrows; i++)
+				r[i] = static_cast<const uchar *>(src->getPixels(0, rows[i]));
+			uchar *out = static_cast<uchar *>(dst->getPixels(0, y));
+			for (uint x = 0; x < w; x++) {
+				uint cols[3];
+				uint ncols = footprint(x, w, sw, cols);
+				uint n = nrows * ncols;
+				for (uint c = 0; c < channels; c++) {
+					uint sum = 0;
+					for (uint i = 0; i < nrows; i++)
+						for (uint j = 0; j < ncols; j++)
+							sum += r[i][cols[j] * channels + c];
+					*out++ = static_cast<uchar>((sum + n / 2) / n);
+				}
+			}
+		}
+		levels.push_back(std::move(dst));
+		src = levels.back().get();
+	}
+	return levels;
+}
@@ -11,8 +11,10 @@
 #include "stockMaterials.h"
 #include "stockPrograms.h"
 #include "fileLoader.h"
+#include "asyncSceneLoader.h"
 #include "program.h"
 #include "window.h"
+#include "frameCapture.h"
 #include "fbo.h"
 #include "texture1D.h"
 #include "texture2D.h"
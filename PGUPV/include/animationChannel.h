@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include <glm/vec3.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include "value.h"
@@ -14,9 +16,74 @@ namespace PGUPV {
 		T value;
 	};
 
+	/**
+	Compressed track of 3D vectors (positions or scalings). Each component is quantised
+	to 16 bits in the range [offset, offset + 65535 * step]. If the range is too large
+	for the tolerance with 16 bits, the values are stored without quantisation (in raw).
+	*/
+	struct CompressedVec3Track {
+		std::vector<float> ticks;
+		std::vector<uint16_t> values; // 3 per key
+		std::vector<glm::vec3> raw; // 1 per key, only if not quantised
+		glm::vec3 offset, step;
+		size_t size() const { return ticks.size(); }
+		glm::vec3 value(size_t i) const {
+			if (!raw.empty())
+				return raw[i];
+			return offset + step * glm::vec3(values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+		}
+	};
+
+	/**
+	Compressed track of rotations. Each quaternion is stored with the "smallest three"
+	encoding: the index of the component with the largest magnitude (which is dropped, and
+	recovered from the unit length) and the other three components, quantised to 15 bits.
+	That is 48 bits (3 uint16_t) per key. If the quantisation error exceeds the tolerance,
+	the quaternions are stored without quantisation (in raw).
+	*/
+	struct CompressedQuatTrack {
+		std::vector<float> ticks;
+		std::vector<uint16_t> values; // 3 per key
+		std::vector<glm::quat> raw; // 1 per key, only if not quantised
+		size_t size() const { return ticks.size(); }
+		glm::quat value(size_t i) const;
+	};
+
 
 	class AnimationChannel {
 	public:
+		/**
+		Remembers the last keyframe segment used in each track of the channel. Keeping one
+		cursor per evaluator (e.g., per AnimatorState), monotonic playback finds the next
+		keyframe in amortised O(1). Without cursor, the keyframe is found with a binary
+		search, in O(log n).
+		*/
+		struct Cursor {
+			uint32_t position = 0, rotation = 0, scaling = 0;
+		};
+
+		/**
+		Maximum error allowed when compressing a channel. The position and scaling
+		tolerances are distances, and the rotation tolerance is an angle in radians.
+		*/
+		struct CompressionSettings {
+			CompressionSettings() : positionTolerance(1e-3f), rotationTolerance(1e-3f), scalingTolerance(1e-3f) {};
+			float positionTolerance;
+			float rotationTolerance;
+			float scalingTolerance;
+		};
+
+		/**
+		Result of compressing one or more channels. The errors are the maximum difference
+		between the original and the compressed keyframes.
+		*/
+		struct CompressionStats {
+			size_t originalBytes = 0, compressedBytes = 0;
+			uint32_t originalKeys = 0, compressedKeys = 0;
+			float maxPositionError = 0.0f, maxRotationError = 0.0f, maxScalingError = 0.0f;
+			void accumulate(const CompressionStats &other);
+		};
+
 		AnimationChannel(const std::string &name);
 		std::string getNodeName() const;
 		void addPositionKeyFrame(const KeyFrameValue<glm::vec3> &pos);
@@ -25,34 +92,53 @@ namespace PGUPV {
 
 		uint32_t getNumFrames() const;
 
+		/**
+		Replaces the keyframes of the channel with a compressed version: the keyframes that
+		can be interpolated from their neighbours within the tolerance are removed, and the
+		values are quantised. The keyframes are decompressed on the fly when interpolating.
+		No keyframes can be added to a compressed channel.
+		\return the memory used and the error introduced
+		*/
+		CompressionStats compress(const CompressionSettings &settings = CompressionSettings());
+		bool isCompressed() const { return compressed; }
+		//! \return the memory used by the keyframes, in bytes
+		size_t getMemoryUsage() const;
+
 		/**
 		Return the interpolated position at t 
 		\param t time point to interpolate (in ticks)
+		\param cursor optional cursor to speed up the search of the keyframes
 		\return the interpolated position
 		*/
-		glm::vec3 interpolatePosition(float t) const;
+		glm::vec3 interpolatePosition(float t, Cursor *cursor = nullptr) const;
 		/**
 		Return the interpolated rotation at t 
 		\param t time point to interpolate (in ticks)
+		\param cursor optional cursor to speed up the search of the keyframes
 		\return the interpolated rotation
 		*/
-		glm::quat interpolateRotation(float t) const;
+		glm::quat interpolateRotation(float t, Cursor *cursor = nullptr) const;
 		/**
 		Return the interpolated scaling at t
 		\param t time point to interpolate (in ticks)
+		\param cursor optional cursor to speed up the search of the keyframes
 		\return the interpolated scaling
 		*/
-		glm::vec3 interpolateScaling(float t) const;
+		glm::vec3 interpolateScaling(float t, Cursor *cursor = nullptr) const;
 		/**
 		Return the interpolated transformation at t 
 		\param t time point to interpolate (in ticks)
+		\param cursor optional cursor to speed up the search of the keyframes
 		\return the interpolated traformation
 		*/
-		glm::mat4 interpolate(float t) const;
+		glm::mat4 interpolate(float t, Cursor *cursor = nullptr) const;
 	private:
 		std::string nodeName;
 		std::vector<KeyFrameValue<glm::vec3>> positions;
 		std::vector<KeyFrameValue<glm::quat>> rotations;
 		std::vector<KeyFrameValue<glm::vec3>> scalings;
+		bool compressed;
+		CompressedVec3Track compressedPositions, compressedScalings;
+		CompressedQuatTrack compressedRotations;
 	};
 };
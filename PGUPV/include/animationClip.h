@@ -4,10 +4,12 @@
 #include <map>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <glm/fwd.hpp>
 
+#include "animationChannel.h"
+
 namespace PGUPV {
-	class AnimationChannel;
 
 	class AnimationClip {
 	public:
@@ -32,15 +34,39 @@ namespace PGUPV {
 		enum class WrapMode {ONCE, LOOP, PING_PONG, CLAMP_FOREVER};
 		void setWrapMode(WrapMode mode);
 		WrapMode getWrapMode() const { return wrapMode; }
+
+		/**
+		Convierte un instante de la animacin al tick correspondiente del clip
+		\param t instante de la animacin, en segundos. Se tiene en cuenta wrapMode
+		\return el tick del clip (entre 0 y getDurationInTicks())
+		*/
+		float toTicks(float t) const;
+
+		/**
+		Cursores de bsqueda de fotogramas clave de cada canal (ver AnimationChannel::Cursor).
+		Cada evaluador del clip (p.e., cada AnimatorState) debera tener los suyos.
+		*/
+		typedef std::unordered_map<const AnimationChannel *, AnimationChannel::Cursor> CursorCache;
 		
 		/**
 		Calcula la transformacin interpolada en el instante dado para el hueso indicado
 		\param t instante de la animacin que se desea interpolar, en segundos. Se tiene en cuenta wrapMode
 		\param boneId hueso del que se desea calcular la interpolacin
 		\param mat [out] matriz donde escribir la interpolacin, si existe el hueso
+		\param cursors [in/out] opcional, cursores para acelerar la bsqueda de los fotogramas clave
 		\return true si el clip de animacin tiene datos para el hueso indicado, o false en otro caso
 		*/
-		bool interpolate(const float t, const std::string &boneId, glm::mat4 &mat) const;
+		bool interpolate(const float t, const std::string &boneId, glm::mat4 &mat, CursorCache *cursors = nullptr) const;
+
+		/**
+		Comprime todos los canales del clip (ver AnimationChannel::compress), y escribe en el
+		log la memoria ahorrada y el error mximo introducido
+		\param settings error mximo permitido
+		\return la memoria usada y el error mximo de todos los canales
+		*/
+		AnimationChannel::CompressionStats compress(const AnimationChannel::CompressionSettings &settings = AnimationChannel::CompressionSettings());
+		//! \return la memoria usada por los fotogramas clave de todos los canales, en bytes
+		size_t getMemoryUsage() const;
 
 		const std::shared_ptr<AnimationChannel> getAnimationChannel(const std::string &name) const;
 		const std::vector<std::shared_ptr<AnimationChannel>> getAnimationChannels() const;
@@ -1,12 +1,18 @@
 #pragma once
 
 #include "group.h"
+#include "compiledAnimationClip.h"
 #include <glm/mat4x4.hpp>
+#include <limits>
 
 namespace PGUPV {
 	class AnimatorController;
+	class AnimatorState;
+	class AnimationMask;
 	class NodeVisitor;
 	class Mesh;
+	class Transform;
+	class Skeleton;
 
 	class AnimationNode : public Node {
 	public:
@@ -16,6 +22,27 @@ namespace PGUPV {
 			return animController;
 		}
 		void render() override;
+		/**
+		\return el tiempo (en microsegundos) que se ha dedicado en el último render a
+		  calcular la pose del esqueleto y las paletas de huesos de las mallas
+		*/
+		int64_t getPoseEvaluationTime() const { return poseEvaluationTime; }
+		/**
+		Marca la pose como no calculada. El callback de actualización del nodo la llama al
+		avanzar el controlador; llámala si actualizas el controlador de otra forma
+		*/
+		void invalidatePose() { poseUpToDate = false; }
+		/**
+		Calcula la pose de los nodos indicados repartiendo el trabajo entre los hilos del
+		ThreadPool. Se debe llamar después de actualizar la escena y antes de dibujarla: el
+		render de cada nodo usará la pose ya calculada (Scene::update la llama). Si no se
+		llama, cada nodo calcula su pose al dibujarse.
+		*/
+		static void evaluatePoses(const std::vector<AnimationNode *> &nodes);
+		/**
+		Calcula en paralelo la pose de todos los AnimationNode que cuelgan de root
+		*/
+		static void evaluatePoses(Node &root);
 		void accept(NodeVisitor &dispatcher) override;
 		void ascend(NodeVisitor &visitor) override;
 		void traverse(NodeVisitor &) override;
@@ -24,9 +51,59 @@ namespace PGUPV {
 		void recomputeBoundingSphere() override;
 	private:
 		void build();
+		// Vuelve a construir las tablas si la subescena ha cambiado desde la última vez
+		void refreshHierarchy();
+		// Para cada hueso de un esqueleto, el nodo que lo anima y su matriz. Las mallas que
+		// comparten esqueleto comparten la tabla
+		struct BoneRemap {
+			std::weak_ptr<Skeleton> skeleton;
+			std::vector<uint32_t> nodes;
+			std::vector<glm::mat4> offsets;
+		};
+		// Clip de un estado enlazado con los nodos, y su última muestra
+		struct StateBinding {
+			std::shared_ptr<CompiledAnimationClip> compiled;
+			std::vector<AnimationChannel::Cursor> cursors;
+			// Pose muestreada y primer fotograma del clip (referencia de las capas aditivas)
+			std::vector<TRS> pose, reference;
+		};
+		// Peso de cada nodo según una máscara
+		struct MaskBinding {
+			uint32_t version;
+			std::vector<float> weights;
+		};
+		void evaluatePose();
+		StateBinding *sampleState(const AnimatorState &state);
+		const float *getMaskWeights(const AnimationMask *mask);
+		const BoneRemap &getBoneRemap(const std::shared_ptr<Skeleton> &skeleton);
 		std::shared_ptr<Node> subScene;
 		std::shared_ptr<AnimatorController> animController;
 		std::map<Mesh *, glm::mat4> worldMatrix, inverseWorldMatrix;
 		std::vector<Mesh *> meshes;
+		// Jerarquía de transformaciones de la subescena, aplanada en preorden (el padre
+		// de un nodo siempre tiene un índice menor que él)
+		static constexpr uint32_t NOPARENT = std::numeric_limits<uint32_t>::max();
+		std::vector<std::string> nodeNames;
+		std::vector<uint32_t> nodeParents;
+		std::vector<std::shared_ptr<Transform>> nodeTransforms;
+		// Versión de la subescena cuando se aplanó (ver Node::getVersion). Si cambia, se
+		// vuelve a aplanar antes de calcular la pose
+		uint64_t builtVersion = 0;
+		std::map<const Skeleton *, BoneRemap> boneRemaps;
+		std::map<const AnimatorState *, StateBinding> stateBindings;
+		std::map<const AnimationMask *, MaskBinding> maskBindings;
+		// Transformación local de cada nodo descompuesta, sobre la que se combinan las capas
+		std::vector<TRS> bindPose;
+		// Pose actual (transformación local y en el sistema de la subescena de cada nodo)
+		// y paleta de huesos. Se reutilizan de un frame a otro
+		std::vector<TRS> pose;
+		std::vector<bool> animated;
+		std::vector<glm::mat4> nodeWorld, boneMatrices;
+		// true si se ha calculado la pose en el frame poseFrame y el controlador no ha avanzado
+		// desde entonces (aunque el nodo no se haya dibujado)
+		bool isPoseUpToDate() const;
+		bool poseUpToDate = false;
+		unsigned long poseFrame = 0;
+		int64_t poseEvaluationTime = 0;
 	};
 };
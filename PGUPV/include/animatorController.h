@@ -2,18 +2,24 @@
 
 #include <string>
 #include <memory>
+#include <map>
+#include <vector>
 #include <glm/fwd.hpp>
 
+#include "animationClip.h"
+
 namespace PGUPV {
-	class AnimationClip;
 	class AnimatorState {
 	public:
 		AnimatorState(const std::string &name) : stateName(name), animationSpeed(1.0f), animationTime(0) {};
+		const std::string &getName() const { return stateName; }
 		void setAnimationClip(std::shared_ptr<AnimationClip> clip);
 		std::shared_ptr<AnimationClip> getAnimationClip() const { return animationClip; }
 		float getSpeed() const { return animationSpeed; }
 		void setSpeed(float speed);
 		void update(uint32_t ms);
+		//! \return el instante actual de la animacin, en segundos
+		float getAnimationTime() const { return animationTime / 1000.f; }
 
 		/**
 		Calcula la transformacin interpolada en el instante dado para el hueso indicado
@@ -28,6 +34,96 @@ namespace PGUPV {
 		std::shared_ptr<AnimationClip> animationClip;
 		float animationSpeed;
 		uint64_t animationTime;
+		// Cursores de bsqueda de fotogramas clave de este estado
+		mutable AnimationClip::CursorCache cursors;
+	};
+
+	/**
+	\class AnimationMask
+
+	Peso de cada nodo (hueso) en una capa de animacin. Por ejemplo, una capa que slo
+	anima la parte superior del cuerpo:
+
+	auto mask = std::make_shared<AnimationMask>(0.0f);
+	mask->setWeight("Spine", 1.0f, true);
+	layer->setMask(mask);
+	*/
+	class AnimationMask {
+	public:
+		/**
+		\param defaultWeight peso de los nodos que no se han indicado explcitamente
+		*/
+		explicit AnimationMask(float defaultWeight = 0.0f) : defaultWeight(defaultWeight), version(0) {};
+		/**
+		Establece el peso de un nodo
+		\param nodeName nombre del nodo
+		\param weight peso, entre 0 (la capa no afecta al nodo) y 1
+		\param recursive si true, el peso se aplica tambin a sus descendientes (salvo a los
+		  que tengan su propio peso)
+		*/
+		void setWeight(const std::string &nodeName, float weight, bool recursive = false);
+		float getDefaultWeight() const { return defaultWeight; }
+		/**
+		\param weight [out] peso del nodo, si se ha establecido
+		\param recursive [out] si el peso se aplica a los descendientes
+		\return true si se ha establecido el peso del nodo indicado
+		*/
+		bool getWeight(const std::string &nodeName, float &weight, bool &recursive) const;
+		//! \return un nmero que cambia cada vez que se modifica la mscara
+		uint32_t getVersion() const { return version; }
+	private:
+		float defaultWeight;
+		std::map<std::string, std::pair<float, bool>> weights;
+		uint32_t version;
+	};
+
+	/**
+	\class AnimatorLayer
+
+	Capa de animacin. Reproduce un estado (y, durante una transicin, el estado anterior)
+	y se combina con el resultado de las capas anteriores:
+	- OVERRIDE: interpola entre la pose de las capas anteriores y la de esta capa
+	- ADDITIVE: suma a la pose de las capas anteriores la diferencia entre la pose de esta
+	  capa y el primer fotograma de su clip
+
+	La combinacin se hace sobre las transformaciones descompuestas (TRS), con el peso de la
+	capa multiplicado por el de la mscara en cada nodo.
+	*/
+	class AnimatorLayer {
+	public:
+		enum class BlendMode { OVERRIDE, ADDITIVE };
+		AnimatorLayer(const std::string &name, BlendMode mode = BlendMode::OVERRIDE) :
+			layerName(name), blendMode(mode), weight(1.0f), fadeDuration(0.0f), fadeTime(0.0f) {};
+		const std::string &getName() const { return layerName; }
+		BlendMode getBlendMode() const { return blendMode; }
+		void setWeight(float w) { weight = w; }
+		float getWeight() const { return weight; }
+		void setMask(std::shared_ptr<AnimationMask> m) { mask = m; }
+		std::shared_ptr<AnimationMask> getMask() const { return mask; }
+
+		//! Empieza a reproducir el estado indicado inmediatamente
+		void play(std::shared_ptr<AnimatorState> state);
+		/**
+		Empieza a reproducir el estado indicado desde el principio, con una transicin
+		desde el estado actual
+		\param seconds duracin de la transicin, en segundos
+		*/
+		void crossFade(std::shared_ptr<AnimatorState> state, float seconds);
+		std::shared_ptr<AnimatorState> currentState() const { return current; }
+		//! \return el estado del que se est saliendo, si hay una transicin en curso
+		std::shared_ptr<AnimatorState> previousState() const { return previous; }
+		//! \return el peso del estado actual en la transicin (1 si no hay transicin)
+		float getFadeWeight() const;
+
+		void update(uint32_t ms);
+		void reset();
+	private:
+		std::string layerName;
+		BlendMode blendMode;
+		float weight;
+		std::shared_ptr<AnimationMask> mask;
+		std::shared_ptr<AnimatorState> current, previous;
+		float fadeDuration, fadeTime;
 	};
 
 	class Group;
@@ -36,10 +132,26 @@ namespace PGUPV {
 	public:
 		AnimatorController(const std::string &name);
 		void setSubScene(std::shared_ptr<Group> root);
+		/**
+		Aade un estado al controlador, y lo reproduce en la capa base
+		*/
 		void addState(std::shared_ptr<AnimatorState> state);
+		std::shared_ptr<AnimatorState> getState(const std::string &name) const;
+		//! \return el estado actual de la capa base
 		std::shared_ptr<AnimatorState> currentState() const {
-			return currentAnimationState;
+			return layers[0]->currentState();
 		}
+		/**
+		Transicin en la capa base desde el estado actual al indicado
+		\param stateName nombre de un estado aadido con addState
+		\param seconds duracin de la transicin, en segundos
+		*/
+		void crossFade(const std::string &stateName, float seconds);
+		/**
+		Aade una capa que se combinar con las anteriores. La capa base (la 0) existe siempre
+		*/
+		void addLayer(std::shared_ptr<AnimatorLayer> layer);
+		const std::vector<std::shared_ptr<AnimatorLayer>> &getLayers() const { return layers; }
 		void update(uint32_t ms);
 		void start();
 		void stop();
@@ -48,7 +160,8 @@ namespace PGUPV {
 		Status getStatus() const { return status; }
 	private:
 		std::string animationControllerId;
-		std::shared_ptr<AnimatorState> currentAnimationState;
+		std::map<std::string, std::shared_ptr<AnimatorState>> states;
+		std::vector<std::shared_ptr<AnimatorLayer>> layers;
 		Status status;
 		std::shared_ptr<Group> scene;
 	};
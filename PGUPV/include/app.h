@@ -408,6 +408,8 @@ namespace PGUPV {
     std::unique_ptr<EventProcessor> eventProcessor;
     bool ignoreCameras, ignoreGUIState;
     std::map<size_t, std::function<void()>> preRenderCallbacks, postRenderCallbacks;
+    // Los identificadores no se reutilizan, aunque se quiten callbacks
+    size_t nextCallbackId;
   };
 
 };
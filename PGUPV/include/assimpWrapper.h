@@ -24,10 +24,12 @@ namespace PGUPV {
   class Node;
   class Mesh;
   class Skeleton;
+  class ImageLoader;
 
   class AssimpWrapper {
   public:
     AssimpWrapper();
+    ~AssimpWrapper();
     /**
       Opciones de postprocesado de una escena:
       NONE: no se aplica ningún postprocesado a la escena
@@ -35,9 +37,12 @@ namespace PGUPV {
       MEDIUM: igual que el anterior, pero intentando reducir memoria
           reutilizando materiales
       HIGHEST_QUALITY: igual que el anterior, pero buscando instancias
+      NONE_SMOOTH_NORMALS: como NONE, pero calcula normales suavizadas para las mallas de
+          triángulos que no tienen normales, soldando los vértices que comparten posición
+          (ver Mesh::smoothNormals)
     */
     enum class LoadOptions {
-      NONE, FAST, MEDIUM, HIGHEST_QUALITY
+      NONE, FAST, MEDIUM, HIGHEST_QUALITY, NONE_SMOOTH_NORMALS
     };
 
     /**
@@ -48,6 +53,30 @@ namespace PGUPV {
     */
     std::shared_ptr<Scene> load(const std::string &filename, LoadOptions options = LoadOptions::MEDIUM);
 
+    /**
+    La carga se puede hacer por fases (es lo que hace load, y AsyncSceneLoader repartiéndola
+    entre varios frames):
+      -# parse: lee el fichero, decodifica las texturas y convierte las mallas en memoria
+         principal. No usa OpenGL, así que se puede llamar desde otro hilo
+      -# beginBuild: crea la escena y los materiales (sin texturas). Con placeholders, también
+         el grafo de escena, en el que cada malla se dibuja como su caja de inclusión hasta que
+         se sube a la GPU
+      -# buildStep: sube a la GPU una malla, o las texturas de un material. Devuelve false
+         cuando no queda nada por subir
+      -# endBuild: termina lo que falte, carga las animaciones y libera los datos temporales
+    Salvo parse, todas se tienen que llamar desde el hilo con el contexto OpenGL.
+    \param checkTextureCache si es true, no se decodifican las texturas que ya están en la
+      TextureCache. Pásale false si no llamas a parse desde el hilo de OpenGL
+    */
+    void parse(const std::string &filename, LoadOptions options = LoadOptions::MEDIUM,
+      bool checkTextureCache = true);
+    std::shared_ptr<Scene> beginBuild(bool placeholders = false);
+    bool buildStep();
+    std::shared_ptr<Scene> endBuild();
+    //! \return el número de pasos de buildStep de la carga en curso, y los que ya se han hecho
+    size_t getNBuildSteps() const;
+    size_t getNBuildStepsDone() const;
+
 	std::vector<ExportFileFormat> listSupportedExportFormat();
 
 	/**
@@ -59,12 +88,15 @@ namespace PGUPV {
 	bool save(const std::string &path, const std::string &id, std::shared_ptr<Scene> scene);
 
   private:
-    void loadMaterials();
-	void loadMeshes();
+    struct Pending;
+    void uploadMesh(size_t n);
+    void loadMaterialTextures(unsigned int n);
 	void saveMeshes(aiScene *assScene, Scene &scene);
 	void loadAnimations();
-    void loadTextures(const aiMaterial *aimat, Material &pgmat);
-    void loadPBRTextures(const aiMaterial *aimat, PBRMaterial &pgmat);
+    // Decodifica en paralelo las imágenes de las texturas de todos los materiales
+    void decodeTextures(ImageLoader &images, bool checkTextureCache);
+    void loadTextures(const aiMaterial *aimat, Material &pgmat, const ImageLoader &images);
+    void loadPBRTextures(const aiMaterial *aimat, PBRMaterial &pgmat, const ImageLoader &images);
 
 	Assimp::Exporter &getExporter();
 	std::shared_ptr<Skeleton> buildSkeleton(const struct aiMesh *mesh);
@@ -73,9 +105,13 @@ namespace PGUPV {
     const aiScene* scene;
     std::shared_ptr<Scene> result;
     std::string _filename;
-    static Assimp::Importer importer;
+    // Cada cargador tiene el suyo, para poder cargar varias escenas a la vez
+    Assimp::Importer importer;
 	std::unique_ptr<Assimp::Exporter> exporter;
+    // Las mallas ya subidas a la GPU (nullptr las que faltan)
     std::vector<std::shared_ptr<Mesh>> tempMeshes;
+    // Los datos de la carga en curso, entre parse y endBuild
+    std::unique_ptr<Pending> pending;
   };
 };
 
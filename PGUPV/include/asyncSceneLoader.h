@@ -0,0 +1,119 @@
+#ifndef _ASYNC_SCENE_LOADER_H
+#define _ASYNC_SCENE_LOADER_H 2022
+
+#include <string>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <functional>
+
+#include "assimpWrapper.h"
+
+namespace PGUPV {
+	class Scene;
+
+	/**
+	\class AsyncSceneLoader
+
+	Carga una escena sin bloquear la aplicación. Un hilo aparte lee el fichero con Assimp,
+	decodifica las texturas y convierte las mallas (AssimpWrapper::parse). Cuando termina, en
+	cada frame (desde una callback de App::addPreRender) se sube a la GPU una parte de la
+	escena, sin pasar del tiempo indicado con setBudget.
+
+	La escena se publica en cuanto se ha leído el fichero: getScene devuelve el grafo completo,
+	pero las mallas que aún no están en la GPU se dibujan como su caja de inclusión (en gris).
+	Cuando un Geode tiene todas sus mallas, se sustituyen las cajas por ellas.
+
+	Ejemplo:
+
+	auto loader = FileLoader::loadAsync("../recursos/modelos/sponza.obj");
+	...
+	// en render
+	if (loader->getScene())
+	  loader->getScene()->render();
+	if (loader->getState() == AsyncSceneLoader::State::STREAMING)
+	  INFO(std::to_string(loader->getProgress() * 100) + "%");
+
+	El objeto se mantiene vivo hasta que termina la carga, aunque se pierda el puntero.
+	\warning No esperes al futuro (getFuture) desde el hilo de OpenGL en mitad de un frame: la
+	carga avanza entre frames, así que se bloquearía para siempre. Usa isDone o onLoaded.
+	*/
+	class AsyncSceneLoader {
+	public:
+		enum class State {
+			PARSING,	// leyendo el fichero en otro hilo
+			STREAMING,	// subiendo la escena a la GPU, poco a poco
+			DONE,		// escena cargada
+			FAILED		// no se ha podido cargar (ver getError)
+		};
+
+		/**
+		Empieza a cargar la escena, y vuelve inmediatamente. Se tiene que llamar desde el hilo
+		con el contexto OpenGL, con la App ya creada
+		\param filename ruta del fichero a cargar
+		\param options postprocesado a realizar sobre la escena (ver AssimpWrapper::load)
+		\param onLoaded si no es nulo, se llama (desde el hilo de OpenGL) al terminar la carga
+		\param placeholders si es true, la escena se publica con cajas en lugar de las mallas que
+		  aún no están en la GPU. Si es false, getScene devuelve nullptr hasta que termina
+		*/
+		static std::shared_ptr<AsyncSceneLoader> start(const std::string &filename,
+			AssimpWrapper::LoadOptions options = AssimpWrapper::LoadOptions::MEDIUM,
+			std::function<void(std::shared_ptr<Scene>)> onLoaded = nullptr, bool placeholders = true);
+		~AsyncSceneLoader();
+
+		State getState() const { return state; }
+		bool isDone() const { return state == State::DONE || state == State::FAILED; }
+		/**
+		\return la escena (con cajas en lugar de las mallas que faltan, mientras se está
+		subiendo), o nullptr si aún no se ha leído el fichero o la carga ha fallado
+		*/
+		std::shared_ptr<Scene> getScene() const { return scene; }
+		//! \return la fracción de la escena que ya está en la GPU (de 0 a 1)
+		float getProgress() const;
+		//! \return el mensaje de error, si la carga ha fallado
+		const std::string &getError() const { return error; }
+		//! \return un futuro con la escena, que está listo cuando la carga termina (o falla)
+		std::shared_future<std::shared_ptr<Scene>> getFuture() const { return future; }
+		const std::string &getFilename() const { return filename; }
+
+		/**
+		Tiempo máximo que se dedica en cada frame a subir la escena a la GPU (por defecto, 4 ms).
+		En cada frame se hace al menos un paso, aunque tarde más
+		*/
+		void setBudget(float ms) { budgetMs = ms; }
+		float getBudget() const { return budgetMs; }
+
+		/**
+		Avanza la carga, sin pasar del tiempo indicado (la llama la callback de preRender, no
+		hace falta llamarla a mano)
+		\return true si la carga ha terminado
+		*/
+		bool update(float ms);
+	private:
+		AsyncSceneLoader(const std::string &filename, AssimpWrapper::LoadOptions options,
+			std::function<void(std::shared_ptr<Scene>)> onLoaded, bool placeholders);
+		AsyncSceneLoader(const AsyncSceneLoader &) = delete;
+		AsyncSceneLoader &operator=(const AsyncSceneLoader &) = delete;
+		void finish();
+		void fail(const std::string &msg);
+
+		std::string filename;
+		AssimpWrapper::LoadOptions options;
+		std::function<void(std::shared_ptr<Scene>)> onLoaded;
+		bool placeholders;
+		float budgetMs;
+		State state;
+		std::shared_ptr<Scene> scene;
+		std::string error;
+		std::promise<std::shared_ptr<Scene>> promise;
+		std::shared_future<std::shared_ptr<Scene>> future;
+		size_t callbackId;
+		std::chrono::steady_clock::time_point startTime;
+		AssimpWrapper loader;
+		// Se declara después del cargador, para que se destruya antes (su destructor espera a
+		// que termine el hilo, que usa el cargador)
+		std::future<void> parsing;
+	};
+};
+
+#endif
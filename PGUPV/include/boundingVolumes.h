@@ -94,6 +94,40 @@ namespace PGUPV {
   };
 
 
+  /*
+  Volumen de la vista, definido por seis planos (izquierdo, derecho, inferior, superior, cercano
+  y lejano) normalizados y con la normal hacia dentro. Se extraen de la matriz de proyección
+  multiplicada por la de la vista (y, si se quiere, por la del modelo: entonces los planos están
+  en el sistema de coordenadas del modelo)
+  */
+  struct Frustum {
+    enum class Result { OUTSIDE, INTERSECTS, INSIDE };
+    static const uint ALL_PLANES = 0x3f;
+
+    Frustum() = default;
+    explicit Frustum(const glm::mat4 &m) { set(m); }
+    //! Extrae los planos de la matriz (método de Gribb y Hartmann)
+    void set(const glm::mat4 &m);
+    //! \return true si la caja está total o parcialmente dentro del volumen
+    bool intersects(const BoundingBox &bb) const;
+    /**
+    Clasifica un volumen de inclusión respecto a los planos del volumen de la vista.
+    \param bb caja del volumen
+    \param bs esfera del volumen. Si es válida, se prueba antes que la caja en cada plano
+    \param mask (entrada/salida) planos a comprobar (el bit i es el plano i). A la salida sólo
+      quedan los planos que cortan al volumen: los volúmenes contenidos en éste no tienen que
+      comprobar los demás
+    \param firstPlane (entrada/salida) plano por el que empezar. Si el volumen está fuera, a la
+      salida es el plano que lo ha descartado (probándolo primero en el siguiente frame, lo
+      normal es que se descarte con una sola comprobación)
+    \param planeTests si no es nullptr, se le suma el número de planos comprobados
+    \return OUTSIDE, INTERSECTS o INSIDE (si mask queda a 0)
+    */
+    Result classify(const BoundingBox &bb, const BoundingSphere &bs, uint &mask, uint &firstPlane,
+      size_t *planeTests = nullptr) const;
+    glm::vec4 planes[6];
+  };
+
   std::ostream &operator<<(std::ostream &os, const BoundingBox &s);
   std::ostream &operator<<(std::ostream &os, const BoundingSphere &s);
 
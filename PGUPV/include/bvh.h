@@ -0,0 +1,178 @@
+#ifndef _BVH_H
+#define _BVH_H 2022
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm/vec3.hpp>
+
+#include "boundingVolumes.h"
+
+namespace PGUPV {
+
+	/**
+	Rayo (semirrecta) origin + t * direction, con t >= 0. La dirección no tiene por qué
+	ser unitaria
+	*/
+	struct Ray {
+		Ray() : origin(0.0f), direction(0.0f, 0.0f, -1.0f) {};
+		Ray(const glm::vec3 &origin, const glm::vec3 &direction) : origin(origin), direction(direction) {};
+		glm::vec3 at(float t) const { return origin + t * direction; }
+		glm::vec3 origin, direction;
+	};
+
+	/**
+	\class BVH
+
+	Jerarquía de volúmenes de inclusión (cajas alineadas con los ejes) sobre un conjunto
+	de primitivos cualesquiera (triángulos, objetos de la escena...), de los que sólo
+	conoce su caja. Se construye con la heurística del área de la superficie (SAH),
+	repartiendo los centros de las cajas en intervalos.
+
+	Ejemplo:
+
+	BVH bvh;
+	bvh.build(boxes);
+	float tmax = FLT_MAX;
+	bvh.intersect(ray, tmax, [&](uint32_t prim, float &t) {
+		// calcular la intersección con el primitivo prim, y si está más cerca que t,
+		// actualizar t y devolver true
+	});
+	*/
+	class BVH {
+	public:
+		struct Node {
+			// Hoja: primer primitivo del nodo en getPrimitives(). Interior: hijo izquierdo
+			// (el derecho es first + 1)
+			glm::vec3 min;
+			uint32_t first;
+			// Número de primitivos de la hoja (0 en los nodos interiores)
+			glm::vec3 max;
+			uint32_t count;
+			bool isLeaf() const { return count > 0; }
+		};
+
+		/**
+		Construye la jerarquía
+		\param boxes caja de cada primitivo. Los primitivos se identifican por su posición
+		  en este vector
+		\param maxLeafSize número máximo de primitivos por hoja
+		*/
+		void build(const std::vector<BoundingBox> &boxes, uint32_t maxLeafSize = 4);
+		bool empty() const { return nodes.empty(); }
+		//! \return la caja que contiene a todos los primitivos
+		BoundingBox getBB() const;
+		//! \return los nodos de la jerarquía (la raíz es el 0)
+		const std::vector<Node> &getNodes() const { return nodes; }
+		//! \return los identificadores de los primitivos, en el orden de las hojas
+		const std::vector<uint32_t> &getPrimitives() const { return primitives; }
+
+		/**
+		Recorre los nodos que atraviesa el rayo, de delante a atrás, y llama a intersect
+		con los primitivos de las hojas
+		\param ray el rayo
+		\param tmax [in/out] distancia máxima a la que buscar (en unidades de
+		  ray.direction). intersect la reduce al encontrar un primitivo más cercano
+		\param intersect función bool(uint32_t primitive, float &tmax), que devuelve true
+		  si el rayo corta al primitivo antes de tmax (y actualiza tmax)
+		\return true si se ha cortado algún primitivo
+		*/
+		template <typename F>
+		bool intersect(const Ray &ray, float &tmax, F intersect) const;
+
+		/**
+		Llama a f(uint32_t primitive) con los primitivos de las hojas cuya caja cumple el
+		predicado. No se baja por los nodos cuya caja no lo cumple.
+		\param overlaps función bool(const glm::vec3 &min, const glm::vec3 &max)
+		*/
+		template <typename Overlaps, typename F>
+		void query(Overlaps overlaps, F f) const;
+
+		/**
+		Intersección rayo-caja (método de los planos)
+		\param invDir 1 / ray.direction, componente a componente
+		\param tnear [out] distancia de entrada en la caja
+		\return true si el rayo entra en la caja antes de tmax
+		*/
+		static bool intersectBox(const glm::vec3 &origin, const glm::vec3 &invDir,
+			const glm::vec3 &min, const glm::vec3 &max, float tmax, float &tnear) {
+			glm::vec3 t0 = (min - origin) * invDir;
+			glm::vec3 t1 = (max - origin) * invDir;
+			glm::vec3 tsmall = glm::min(t0, t1), tbig = glm::max(t0, t1);
+			float tn = std::max(std::max(tsmall.x, tsmall.y), std::max(tsmall.z, 0.0f));
+			float tf = std::min(std::min(tbig.x, tbig.y), std::min(tbig.z, tmax));
+			tnear = tn;
+			return tn <= tf;
+		}
+	private:
+		// Profundidad máxima de la pila de recorrido
+		static const int MAX_DEPTH = 64;
+		std::vector<Node> nodes;
+		std::vector<uint32_t> primitives;
+	};
+
+	template <typename F>
+	bool BVH::intersect(const Ray &ray, float &tmax, F intersect) const {
+		if (nodes.empty())
+			return false;
+		const glm::vec3 invDir = 1.0f / ray.direction;
+		bool hit = false;
+		uint32_t stack[MAX_DEPTH];
+		int top = 0;
+		float tnear;
+		if (!intersectBox(ray.origin, invDir, nodes[0].min, nodes[0].max, tmax, tnear))
+			return false;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node &node = nodes[stack[--top]];
+			if (!intersectBox(ray.origin, invDir, node.min, node.max, tmax, tnear))
+				continue;
+			if (node.isLeaf()) {
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+					hit = intersect(primitives[i], tmax) || hit;
+				continue;
+			}
+			// Apilamos primero el hijo más lejano, para visitar antes el más cercano
+			float tl, tr;
+			bool hl = intersectBox(ray.origin, invDir, nodes[node.first].min, nodes[node.first].max, tmax, tl);
+			bool hr = intersectBox(ray.origin, invDir, nodes[node.first + 1].min, nodes[node.first + 1].max, tmax, tr);
+			if (hl && hr) {
+				if (tl <= tr) {
+					stack[top++] = node.first + 1;
+					stack[top++] = node.first;
+				}
+				else {
+					stack[top++] = node.first;
+					stack[top++] = node.first + 1;
+				}
+			}
+			else if (hl) stack[top++] = node.first;
+			else if (hr) stack[top++] = node.first + 1;
+		}
+		return hit;
+	}
+
+	template <typename Overlaps, typename F>
+	void BVH::query(Overlaps overlaps, F f) const {
+		if (nodes.empty())
+			return;
+		uint32_t stack[MAX_DEPTH];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node &node = nodes[stack[--top]];
+			if (!overlaps(node.min, node.max))
+				continue;
+			if (node.isLeaf()) {
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+					f(primitives[i]);
+			}
+			else {
+				stack[top++] = node.first + 1;
+				stack[top++] = node.first;
+			}
+		}
+	}
+};
+
+#endif
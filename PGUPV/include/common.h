@@ -26,6 +26,9 @@
 #define UBO_PBR_MATERIALS_BINDING_INDEX 4
 #define UBO_PBR_LIGHTS_BINDING_INDEX 5
 
+// Puntos de vinculación globales para shader storage buffers
+#define SSBO_STATIC_BATCH_BINDING_INDEX 0
+
 #ifndef uchar
 typedef unsigned char uchar;
 #endif
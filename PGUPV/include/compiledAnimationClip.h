@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "animationChannel.h"
+
+namespace PGUPV {
+	class AnimationClip;
+
+	/**
+	Transformación descompuesta en traslación, rotación y escalado
+	*/
+	struct TRS {
+		TRS() : translation(0.0f), rotation(1.0f, 0.0f, 0.0f, 0.0f), scale(1.0f) {};
+		glm::vec3 translation;
+		glm::quat rotation;
+		glm::vec3 scale;
+		//! \return la matriz T * R * S
+		glm::mat4 toMatrix() const;
+		/**
+		Descompone una matriz afín sin cizalla
+		*/
+		static TRS fromMatrix(const glm::mat4 &m);
+		/**
+		Interpola entre dos transformaciones (linealmente la traslación y la escala, y con
+		slerp la rotación)
+		\param w peso de b (con 0 devuelve a, con 1 devuelve b)
+		*/
+		static TRS blend(const TRS &a, const TRS &b, float w);
+		/**
+		\return la diferencia entre pose y reference, para usarla en una capa aditiva
+		*/
+		static TRS difference(const TRS &pose, const TRS &reference);
+		/**
+		Aplica una diferencia (ver difference) sobre la transformación base
+		\param w peso de la diferencia (con 0 devuelve base)
+		*/
+		static TRS add(const TRS &base, const TRS &delta, float w);
+	};
+
+	/**
+	\class CompiledAnimationClip
+
+	Versión de un AnimationClip preparada para muestrearse cada frame. Al construirla se
+	enlaza cada canal del clip con el índice de su destino (p.e., el nodo o el hueso
+	con el mismo nombre) una única vez. Después, sample() recorre un array contiguo de
+	enlaces y escribe la pose en un array de TRS, sin buscar cadenas ni copiar
+	shared_ptr.
+
+	Ejemplo:
+
+	CompiledAnimationClip compiled(clip, nodeNames);
+	std::vector<TRS> pose(nodeNames.size());
+	std::vector<AnimationChannel::Cursor> cursors(compiled.getNumBindings());
+	...
+	compiled.sample(t, pose, &cursors);
+	*/
+	class CompiledAnimationClip {
+	public:
+		/**
+		\param clip el clip de animación
+		\param targetNames nombres de los destinos. El destino i se anima con el canal
+		  del clip con el mismo nombre (si lo hay)
+		*/
+		CompiledAnimationClip(std::shared_ptr<AnimationClip> clip, const std::vector<std::string> &targetNames);
+
+		/**
+		Muestrea todos los canales enlazados en el instante t.
+		\param t instante en segundos (se tiene en cuenta el WrapMode del clip)
+		\param pose [out] pose[i] recibe la transformación del destino i, si tiene canal.
+		  Los destinos sin canal no se modifican
+		\param cursors [in/out] opcional, un cursor por enlace (ver getNumBindings) para
+		  acelerar la búsqueda de fotogramas clave
+		*/
+		void sample(float t, std::vector<TRS> &pose, std::vector<AnimationChannel::Cursor> *cursors = nullptr) const;
+
+		//! \return true si el destino indicado está animado por el clip
+		bool isBound(size_t target) const { return target < bound.size() && bound[target]; }
+		//! \return el número de canales del clip que se han enlazado a algún destino
+		size_t getNumBindings() const { return bindings.size(); }
+		std::shared_ptr<AnimationClip> getClip() const { return clip; }
+	private:
+		struct Binding {
+			const AnimationChannel *channel;
+			uint32_t target;
+		};
+		std::shared_ptr<AnimationClip> clip;
+		std::vector<Binding> bindings;
+		std::vector<bool> bound;
+	};
+};
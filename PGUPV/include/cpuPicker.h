@@ -0,0 +1,100 @@
+#ifndef _CPU_PICKER_H
+#define _CPU_PICKER_H 2022
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+#include "picker.h"
+#include "bvh.h"
+
+namespace PGUPV {
+	class MeshBVH;
+
+	/**
+	\class CPUPicker
+
+	Alternativa a Picker que calcula el objeto seleccionado en la CPU, lanzando un rayo
+	desde la cámara, sin dibujar nada ni leer de la GPU (así que no provoca una
+	sincronización con la GPU, y funciona sin contexto OpenGL si las mallas conservan
+	la copia de sus datos en memoria principal, ver Mesh::CpuCopyPolicy).
+
+	El rayo se prueba primero contra una BVH de las cajas de las mallas de los objetos, y
+	sólo en las mallas cuya caja corta se usa una BVH de sus triángulos. La BVH de cada
+	malla se construye la primera vez que hace falta, y se guarda para las siguientes
+	llamadas. Si se modifica la geometría de una malla hay que llamar a invalidate.
+
+	Ejemplo de uso:
+
+	CPUPicker picker;
+	Picker::PickData pick{x, y, windowWidth, windowHeight};
+	PickerNodeVisitor rsc{ Picker::adjustProjMatrix(pick, proj) * view};
+	scene->getRoot()->accept(rsc);
+	CPUPicker::Hit hit;
+	if (picker.pick(pick, view, proj, rsc.getResult(), hit)) {
+		// se ha hecho clic en el triángulo hit.triangle de la malla hit.mesh del nodo hit.node
+	}
+
+	\warning Las mallas con esqueleto se prueban en su pose de reposo
+	*/
+	class CPUPicker {
+	public:
+		struct Hit {
+			Node *node;		// nodo seleccionado (ver Picker::ModelId)
+			uint32_t id;	// identificador del objeto seleccionado
+			Model *model;
+			Mesh *mesh;
+			uint triangle;	// índice del triángulo en Mesh::getTriangleList
+			glm::vec3 barycentrics;	// coordenadas baricéntricas del punto en el triángulo
+			glm::vec3 position;	// punto de intersección, en el sistema del mundo
+			float distance;	// distancia desde el origen del rayo
+		};
+
+		/**
+		Calcula el objeto sobre el que ha hecho clic el usuario
+		\param pick información sobre la posición del clic
+		\param viewMatrix la matriz view de la cámara
+		\param projMatrix la matriz projection de la cámara
+		\param objects los objetos candidatos
+		\param hit [out] información del punto seleccionado
+		\return true si se ha hecho clic sobre algún objeto
+		*/
+		bool pick(const Picker::PickData &pick, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix,
+			const std::vector<Picker::ModelId> &objects, Hit &hit);
+		/**
+		Calcula la intersección más cercana del rayo (en el sistema del mundo) con los objetos
+		*/
+		bool pick(const Ray &ray, const std::vector<Picker::ModelId> &objects, Hit &hit);
+
+		/**
+		\return el rayo (en el sistema del mundo) que pasa por el centro del píxel indicado.
+		La dirección del rayo es unitaria
+		*/
+		static Ray computeRay(const Picker::PickData &pick, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix);
+
+		//! Descarta la BVH de la malla indicada (p.e., porque se han cambiado sus vértices)
+		void invalidate(const Mesh *mesh);
+		//! Descarta todas las BVH de las mallas
+		void clearCache();
+	private:
+		std::shared_ptr<MeshBVH> getMeshBVH(const std::shared_ptr<Mesh> &mesh);
+		// La BVH de una malla sólo vale si la malla sigue existiendo (otra malla podría
+		// ocupar su dirección) y no ha cambiado su versión
+		struct CachedBVH {
+			std::weak_ptr<Mesh> mesh;
+			uint64_t version;
+			std::shared_ptr<MeshBVH> bvh;
+		};
+		std::map<const Mesh *, CachedBVH> meshBVHs;
+		// Mallas de los objetos de la última llamada, y su BVH
+		struct Instance {
+			size_t object;
+			std::shared_ptr<Mesh> mesh;
+		};
+		std::vector<Instance> instances;
+		BVH topLevel;
+	};
+};
+
+#endif
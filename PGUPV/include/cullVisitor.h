@@ -0,0 +1,125 @@
+#ifndef _CULL_VISITOR_H
+#define _CULL_VISITOR_H 2022
+
+#include <vector>
+#include <unordered_map>
+#include <glm/mat4x4.hpp>
+
+#include "nodeVisitor.h"
+#include "boundingVolumes.h"
+
+namespace PGUPV {
+	class GLMatrices;
+	class Program;
+
+	/**
+	\class CullVisitor
+
+	Recorre el grafo de escena descartando las ramas que quedan fuera del volumen de la vista
+	(frustum culling jerárquico). Como Group::render, no entra en los nodos ocultos ni en los
+	que no tienen caja de inclusión válida.
+
+	La caja (y la esfera) de cada nodo se comprueba con los planos del volumen de la vista
+	llevados al sistema de coordenadas de su padre, así que no hay que transformar los
+	volúmenes de inclusión. Para no repetir comprobaciones:
+	  - si un nodo está completamente dentro de un plano, sus descendientes no lo comprueban,
+	    y si está completamente dentro del volumen, se aceptan sin comprobar nada
+	  - el plano que descartó a un nodo es el primero que se prueba con él en el siguiente
+	    recorrido (normalmente, lo vuelve a descartar). Sólo se recuerda durante un recorrido
+
+	El resultado son las hojas (Geode, AnimationNode) visibles, con su matriz del modelo y el
+	programa que les toca (el del nodo más cercano que tenga uno, ver Node::setProgram).
+
+	Ejemplo:
+
+	CullVisitor cull;
+	...
+	cull.cull(*scene->getRoot(), *mats);
+	cull.render();
+	INFO(std::to_string(cull.getCounters().culled) + " nodos descartados");
+
+	cull(Node &, const glm::mat4 &, const glm::mat4 &) y getVisible no usan OpenGL.
+	*/
+	class CullVisitor : public NodeVisitor {
+	public:
+		struct Visible {
+			Node *node;
+			glm::mat4 modelMatrix;	// matriz que lleva el nodo al sistema del mundo
+			Program *program;		// programa del nodo o de su antecesor más cercano que tenga uno (o nullptr)
+		};
+		//! Contadores del último recorrido
+		struct Counters {
+			size_t visited = 0;		// nodos visitados
+			size_t invisible = 0;	// nodos ocultos (Node::isVisible)
+			size_t culled = 0;		// nodos descartados por estar fuera de la vista
+			size_t accepted = 0;	// nodos aceptados sin comprobar (su padre estaba completamente dentro)
+			size_t planeTests = 0;	// comprobaciones de un volumen con un plano
+			size_t visible = 0;		// hojas visibles
+		};
+
+		CullVisitor();
+		/**
+		Recorre el grafo desde root
+		\param root raíz del (sub)grafo
+		\param projView producto de las matrices de proyección y de la vista
+		\param modelMatrix matriz del modelo de root
+		*/
+		void cull(Node &root, const glm::mat4 &projView, const glm::mat4 &modelMatrix = glm::mat4(1.0f));
+		//! Recorre el grafo desde root, con las matrices de proyección, vista y modelo indicadas
+		void cull(Node &root, const GLMatrices &mats);
+		/**
+		Dibuja las hojas visibles del último recorrido con el GLMatrices vinculado y su programa
+		(el actual, si ni ellas ni sus antecesores tienen uno)
+		*/
+		void render();
+
+		const std::vector<Visible> &getVisible() const { return visible; }
+		const Counters &getCounters() const { return counters; }
+
+		void apply(Group &group) override;
+		void apply(Transform &transform) override;
+		void apply(Geode &geode) override;
+		void apply(AnimationNode &node) override;
+	protected:
+		/**
+		Se llama con cada nodo que no se ha descartado (está dentro del volumen de la vista),
+		antes de recorrer sus hijos. Si devuelve false, el nodo se descarta
+		*/
+		virtual bool acceptNode(Node &) { return true; }
+		//! Se llama después de recorrer los hijos de un nodo aceptado
+		virtual void leaveNode(Node &) {}
+		//! \return la matriz del modelo del sistema en el que está la caja del nodo actual (la de su padre)
+		const glm::mat4 &getModelMatrix() const { return spaces.back().modelMatrix; }
+		/**
+		Activa el programa de la hoja (o initial, si no tiene) y la dibuja con la matriz del
+		modelo actual
+		\param initial el programa que estaba activo antes de empezar a dibujar las hojas
+		*/
+		static void drawVisible(const Visible &v, Program *initial);
+		//! Vuelve a activar el programa que estaba activo antes de empezar a dibujar las hojas
+		static void restoreProgram(Program *initial);
+	private:
+		// Comprueba el nodo, y si es visible, apila los planos que les quedan por comprobar a sus hijos
+		bool enter(Node &node);
+		void leave(Node &node);
+		void addVisible(Node &node);
+
+		struct Space {
+			glm::mat4 modelMatrix;
+			Frustum frustum;	// en el sistema de coordenadas de modelMatrix
+		};
+		glm::mat4 projView;
+		std::vector<Space> spaces;
+		std::vector<uint> masks;
+		// Programa que les toca a los nodos aceptados en el camino actual (como en CollectDrawPackets)
+		std::vector<Program *> programs;
+		// Plano que descartó a cada nodo en el recorrido anterior (lastPlane) y en el actual
+		// (nextPlane). Al terminar el recorrido se intercambian, así que sólo se guardan los
+		// nodos descartados en el último, y no quedan los que se han quitado del grafo
+		std::unordered_map<const Node *, uint> lastPlane, nextPlane;
+		std::vector<Visible> visible;
+		Counters counters;
+	};
+};
+
+#endif
@@ -29,6 +29,16 @@ namespace PGUPV {
     virtual ~DrawCommand() {};
     void render();
     virtual void renderFunc() = 0;
+    /**
+    Dibuja varias instancias de la primitiva, con la versión instanciada de la orden
+    (glDrawArraysInstanced, glDrawElementsInstanced...)
+    \param instances número de instancias
+    \warning Sólo se puede usar si supportsInstancing devuelve true
+    */
+    void renderInstanced(GLsizei instances);
+    //! \return true si la orden tiene versión instanciada (ver renderInstanced)
+    virtual bool supportsInstancing() const { return false; }
+    virtual void renderInstancedFunc(GLsizei instances);
     void setVerticesPerPatch(GLint nvertices) { verticesPerPatch = nvertices; };
     GLint getVerticesPerPatch() const { return verticesPerPatch; };
     /**
@@ -54,6 +64,9 @@ namespace PGUPV {
 	*/
 	GLenum getGLPrimitiveType() const { return mode; }
   protected:
+    // Estado que hay que establecer antes de dibujar, y restaurar después
+    void beginDraw();
+    void endDraw();
     GLenum mode;
     GLint verticesPerPatch;
     bool restartPrimitive;
@@ -86,6 +99,10 @@ namespace PGUPV {
     virtual void renderFunc() override {
       glDrawArrays(mode, first, count);
     }
+    bool supportsInstancing() const override { return true; }
+    void renderInstancedFunc(GLsizei instances) override {
+      glDrawArraysInstanced(mode, first, count, instances);
+    }
     std::vector<TriangleIndices> getTrianglesIndices(void *indicesBuffer) override;
   private:
     GLint first; GLsizei count;
@@ -112,6 +129,10 @@ namespace PGUPV {
     void renderFunc() override {
       glDrawElements(mode, count, type, offset);
     }
+    bool supportsInstancing() const override { return true; }
+    void renderInstancedFunc(GLsizei instances) override {
+      glDrawElementsInstanced(mode, count, type, offset, instances);
+    }
     std::vector<TriangleIndices> getTrianglesIndices(void *indicesBuffer) override;
   private:
     GLsizei count; GLenum type; const void *offset;
@@ -141,6 +162,10 @@ namespace PGUPV {
     virtual void renderFunc() override {
       glDrawElementsBaseVertex(mode, count, type, offset, basevertex);
     }
+    bool supportsInstancing() const override { return true; }
+    void renderInstancedFunc(GLsizei instances) override {
+      glDrawElementsInstancedBaseVertex(mode, count, type, offset, instances, basevertex);
+    }
   private:
     GLsizei count; GLenum type; GLvoid *offset; GLint basevertex;
   };
@@ -348,6 +373,33 @@ namespace PGUPV {
     GLsizei count; GLenum type; const void *offset; GLsizei primcount;
   };
 
+  /**
+  \class MultiDrawElementsIndirect
+
+  Clase envoltorio de glMultiDrawElementsIndirect. Los parámetros de cada dibujo (count,
+  instanceCount, firstIndex, baseVertex y baseInstance) se leen del buffer vinculado a
+  GL_DRAW_INDIRECT_BUFFER (GL 4.3)
+  */
+  class MultiDrawElementsIndirect : public DrawCommand {
+  public:
+    /**
+      \param mode: tipo de primitivas (GL_TRIANGLES, GL_POINTS...)
+      \param type: tipo de los índices (GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT o GL_UNSIGNED_INT)
+      \param offset: posición (en bytes desde el comienzo del buffer vinculado a
+      GL_DRAW_INDIRECT_BUFFER) de la primera orden
+      \param drawcount: número de órdenes a ejecutar
+      \param stride: distancia en bytes entre órdenes consecutivas (0: están seguidas)
+      */
+    MultiDrawElementsIndirect(GLenum mode, GLenum type, const void *offset, GLsizei drawcount,
+      GLsizei stride = 0) :
+      DrawCommand(mode), type(type), offset(offset), drawcount(drawcount), stride(stride) {};
+    virtual void renderFunc() override {
+      glMultiDrawElementsIndirect(mode, type, offset, drawcount, stride);
+    }
+  private:
+    GLenum type; const void *offset; GLsizei drawcount, stride;
+  };
+
 
 };
 #endif
@@ -1,15 +1,26 @@
 #pragma once
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "assimpWrapper.h"
 
 namespace PGUPV {
 	class Scene;
+	class AsyncSceneLoader;
 
 	class FileLoader {
 	public:
 		static std::shared_ptr<Scene> load(const std::string &path, AssimpWrapper::LoadOptions options = AssimpWrapper::LoadOptions::MEDIUM);
+		/**
+			Empieza a cargar la escena en segundo plano, y vuelve inmediatamente (ver
+			AsyncSceneLoader). Al terminar, se hace lo mismo que en load con el fichero .pgmat
+			\param onLoaded si no es nulo, se llama al terminar la carga
+			\return el objeto que representa la carga en curso
+		*/
+		static std::shared_ptr<AsyncSceneLoader> loadAsync(const std::string &path,
+			AssimpWrapper::LoadOptions options = AssimpWrapper::LoadOptions::MEDIUM,
+			std::function<void(std::shared_ptr<Scene>)> onLoaded = nullptr);
 		/**
 			\return la lista de formatos de fichero soportados para escritura
 		*/
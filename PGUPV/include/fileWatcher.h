@@ -0,0 +1,64 @@
+#ifndef _FILE_WATCHER_H
+#define _FILE_WATCHER_H 2022
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+
+#include "utils.h"
+
+namespace PGUPV {
+
+	/**
+	\class FileWatcher
+
+	Vigila un conjunto de ficheros y avisa cuando cambian. En Linux usa inotify (vigilando los
+	directorios, para detectar también los editores que guardan en un fichero nuevo y lo
+	renombran). En el resto de sistemas, comprueba la fecha de modificación (con la resolución
+	del sistema) y el tamaño de los ficheros, como mucho una vez cada getPollInterval
+	milisegundos.
+
+	No crea ningún hilo: hay que llamar a poll periódicamente (por ejemplo, una vez por frame).
+	*/
+	class FileWatcher {
+	public:
+		FileWatcher();
+		~FileWatcher();
+		/**
+		Empieza a vigilar el fichero indicado (no hace nada si ya se vigilaba)
+		\param filename ruta del fichero, que se guarda como ruta canónica (ver getCanonicalPath)
+		*/
+		void watch(const std::string &filename);
+		//! Deja de vigilar el fichero
+		void unwatch(const std::string &filename);
+		//! Deja de vigilar todos los ficheros
+		void clear();
+		//! \return las rutas canónicas de los ficheros vigilados
+		std::vector<std::string> getWatchedFiles() const;
+		/**
+		\return las rutas canónicas de los ficheros vigilados que han cambiado desde la última
+		llamada (sin repetir)
+		*/
+		std::vector<std::string> poll();
+		//! \return true si el sistema operativo avisa de los cambios (inotify), y false si se comprueban las fechas
+		bool usesNotifications() const;
+		//! Tiempo mínimo entre dos comprobaciones de las fechas (por defecto, 500 ms)
+		void setPollInterval(unsigned int ms) { pollInterval = ms; }
+		unsigned int getPollInterval() const { return pollInterval; }
+	private:
+		FileWatcher(const FileWatcher &) = delete;
+		FileWatcher &operator=(const FileWatcher &) = delete;
+		std::vector<std::string> pollModificationTimes();
+
+		// Ruta canónica -> sello del fichero (con tamaño -1 si no existe)
+		std::map<std::string, FileStamp> files;
+		unsigned int pollInterval;
+		std::chrono::steady_clock::time_point lastPoll;
+		// Descriptor de inotify (-1 si no se usa) y directorios vigilados (descriptor de cada uno)
+		int notifyFd;
+		std::map<std::string, int> dirs;
+	};
+};
+
+#endif
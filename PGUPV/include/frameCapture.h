@@ -0,0 +1,115 @@
+#ifndef _FRAME_CAPTURE_H
+#define _FRAME_CAPTURE_H 2022
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <GL/glew.h>
+
+#include "common.h"
+#include "threadPool.h"
+
+namespace PGUPV {
+	class BufferObject;
+
+	/**
+	\class FrameCapture
+
+	Guarda en ficheros el contenido del framebuffer sin detener la aplicación. Cada captura se
+	lee (glReadPixels) en un pixel pack buffer de un anillo de varios buffers, y se pone una
+	valla (glFenceSync) detrás. Unos frames después, cuando la GPU ha terminado de copiar, se
+	copian los píxeles a memoria y unos hilos propios codifican la imagen y la escriben en
+	disco, mientras la aplicación sigue dibujando.
+
+	Si la aplicación captura más deprisa de lo que se escriben los ficheros, las imágenes se van
+	acumulando en memoria. Con setMaxPendingWrites se limita cuántas puede haber a la vez, y con
+	setBackPressure se decide qué pasa al llegar al límite: esperar a que se escriba la más
+	antigua (por defecto, no se pierde ninguna captura) o descartar la nueva.
+
+	Window::captureColorBuffer usa una instancia por ventana (ver Window::getFrameCapture), y
+	App la usa para las capturas de la opción -snap.
+
+	\warning Todas las funciones se tienen que llamar desde el hilo con el contexto OpenGL
+	*/
+	class FrameCapture {
+	public:
+		enum class BackPressure {
+			WAIT,	// espera a que se escriba la imagen más antigua
+			DROP	// descarta la captura nueva
+		};
+
+		/**
+		\param nBuffers número de pixel pack buffers (frames que la lectura puede ir por detrás)
+		\param nThreads número de hilos que codifican y escriben las imágenes
+		*/
+		explicit FrameCapture(uint nBuffers = 3, uint nThreads = 2);
+		//! Espera a que se escriban todas las capturas pendientes
+		~FrameCapture();
+
+		/**
+		Empieza a leer la zona indicada del buffer de color, y vuelve sin esperar a la GPU
+		\param filename fichero donde se guardará la imagen (el formato depende de la extensión)
+		\param readBuffer buffer a leer (GL_FRONT, GL_BACK, GL_COLOR_ATTACHMENT0...)
+		\return false si se ha descartado la captura (ver setBackPressure)
+		*/
+		bool capture(const std::string &filename, GLint x, GLint y, GLsizei width, GLsizei height,
+			GLenum readBuffer = GL_FRONT);
+		/**
+		Pasa a los hilos las lecturas que ya ha terminado la GPU, sin esperar. Window la llama
+		después de cada swapBuffers
+		*/
+		void update();
+		//! Espera a que se lean y se escriban todas las capturas pendientes
+		void flush();
+
+		//! Número máximo de imágenes leídas que pueden estar esperando a escribirse (por defecto, 8)
+		void setMaxPendingWrites(uint n) { maxPendingWrites = n > 0 ? n : 1; }
+		uint getMaxPendingWrites() const { return maxPendingWrites; }
+		void setBackPressure(BackPressure bp) { backPressure = bp; }
+		BackPressure getBackPressure() const { return backPressure; }
+		//! \return el número de capturas que aún no se han escrito en disco
+		size_t getNPending() const;
+
+		struct Stats {
+			size_t captured = 0;	// capturas empezadas
+			size_t dropped = 0;		// capturas descartadas (BackPressure::DROP)
+			size_t written = 0;		// imágenes escritas
+			size_t failed = 0;		// imágenes que no se han podido escribir
+			size_t stalls = 0;		// veces que se ha tenido que esperar a la GPU o a los hilos
+		};
+		const Stats &getStats() const { return stats; }
+		void resetStats() { stats = Stats(); }
+	private:
+		FrameCapture(const FrameCapture &) = delete;
+		FrameCapture &operator=(const FrameCapture &) = delete;
+
+		struct Slot {
+			std::shared_ptr<BufferObject> pbo;
+			GLsync fence = nullptr;
+			std::string filename;
+			GLsizei width = 0, height = 0;
+		};
+		// Imagen que se está guardando en un hilo del pool
+		struct Write {
+			std::future<void> done;
+			std::string filename;
+		};
+		// Espera a que la GPU termine de escribir en el buffer, y pasa la imagen a los hilos
+		void readBack(Slot &slot);
+		// Recoge las escrituras terminadas (todas, si wait)
+		void reapWrites(bool wait);
+		void waitOldestWrite();
+
+		std::vector<Slot> slots;
+		uint next;
+		uint maxPendingWrites;
+		BackPressure backPressure;
+		std::deque<Write> writes;
+		Stats stats;
+		ThreadPool pool;
+	};
+};
+
+#endif
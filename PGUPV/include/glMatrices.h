@@ -3,6 +3,7 @@
 #define _GL_MATRICES_H 2011
 
 #include <GL/glew.h>
+#include <vector>
 #include "matrixStack.h"
 #include "uniformBufferObject.h"
 
@@ -28,6 +29,22 @@ mat4 modelviewprojMatrix;
 mat3 normalMatrix;
 };
 
+Las operaciones sobre las matrices no escriben inmediatamente en el UBO: se marcan como
+modificadas, y las matrices derivadas (modelview, modelviewproj y normal) se calculan y se
+suben en una sola vez justo antes de dibujar (DrawCommand::render llama a flushPending).
+Por ejemplo, un Transform que no dibuja nada entre el pushMatrix y el popMatrix no
+provoca ninguna escritura. Si dibujas sin pasar por DrawCommand, llama a flush antes.
+
+Como cuando las escrituras eran inmediatas, el último objeto GLMatrices modificado (o
+vinculado con bind) es el que usan los shaders: flushPending lo vincula a
+UBO_GL_MATRICES_BINDING_INDEX. Los cambios pendientes de los demás sólo se escriben.
+
+Si hay un UniformStream activo (UniformStream::setCurrent), las matrices se copian en él
+en cada flush, en vez de escribirse en el UBO propio.
+
+Los contadores (getCounters) permiten medir cuántas escrituras e inversas se hacen por
+frame sin necesidad de consultar a OpenGL.
+
 */
 
 namespace PGUPV {
@@ -62,17 +79,79 @@ namespace PGUPV {
     const glm::mat4 &getMatrix(Matrix mat) const;
     const glm::mat3 getNormalMatrix() const;
     void reset();
+    ~GLMatrices();
+
+    /**
+    Calcula las matrices derivadas y escribe en el UBO las matrices modificadas desde
+    la última llamada (si no hay ninguna, no hace nada). Deja el UBO vinculado a
+    UBO_GL_MATRICES_BINDING_INDEX
+    */
+    void flush();
+    //! \return true si hay cambios que todavía no se han escrito en el UBO
+    bool isDirty() const { return uploadMask != 0; }
+    /**
+    Escribe los cambios pendientes de todos los objetos GLMatrices y vincula a
+    UBO_GL_MATRICES_BINDING_INDEX el último que se ha modificado. Con un UniformStream
+    activo, sólo escribe ése (el resto se escribirá al vincularlo)
+    */
+    static void flushPending();
+    /**
+    Vincula estas matrices a UBO_GL_MATRICES_BINDING_INDEX, escribiendo antes los cambios
+    pendientes. Usa esta función en vez de gl_uniform_buffer.bindBufferBase, que no
+    funciona si hay un UniformStream activo
+    */
+    void bind();
+
+    // Contadores de actividad (de todos los objetos GLMatrices), sólo en la CPU
+    struct Counters {
+      uint64_t operations = 0;  // operaciones sobre las matrices (translate, popMatrix...)
+      uint64_t flushes = 0;     // llamadas a flush que escribieron algo
+      uint64_t uploads = 0;     // escrituras en el UBO (glBufferSubData)
+      uint64_t bytesUploaded = 0;
+      uint64_t inversions = 0;  // matrices normales calculadas (glm::inverse)
+    };
+    //! \return los contadores acumulados desde la última llamada a endFrame
+    static const Counters &getCounters() { return counters; }
+    //! \return los contadores del último frame terminado
+    static const Counters &getFrameCounters() { return frameCounters; }
+    //! Guarda los contadores actuales como los del último frame, y los pone a cero
+    static void endFrame();
   private:
     GLMatrices();
     GLMatrices(const GLMatrices&);
 
-    void writeMatrix(Matrix mat);
+    // Marca la matriz como modificada
+    void touch(Matrix mat);
+    // Pone el objeto en la lista de pendientes (si no lo estaba ya)
+    void setPending(bool moveToBack);
+    // Recalcula las matrices derivadas, si es necesario
+    void updateDerived() const;
+    // Escribe los cambios pendientes y, si bindAfter, vincula el objeto
+    void upload(bool bindAfter);
+    // Escribe, sin vincularlos, los cambios pendientes de los objetos distintos de keep
+    static void uploadUnbound(GLMatrices *keep);
     MatrixStack mats[PROJ_MATRIX + 1];
-    struct {
+    mutable struct {
       glm::mat4 modelview;
       glm::mat4 modelviewprojection;
       glm::mat3x4 normal; // Debido a como se almacenan las matrices con la directiva std140
     } derivedMatrices;
+    // Qué matrices derivadas hay que recalcular
+    mutable bool modelviewDirty, modelviewprojDirty;
+    // Bit i a 1: hay que escribir la matriz i en el UBO (bit DERIVED_BIT: las derivadas)
+    static const unsigned int DERIVED_BIT = 1 << MODELVIEW_MATRIX;
+    unsigned int uploadMask;
+    static const unsigned int ALL_BITS = (1 << (MODELVIEW_MATRIX + 1)) - 1;
+    // Si se escribió en un UniformStream, la generación del stream, y si el UBO propio
+    // tiene valores antiguos
+    uint64_t streamGeneration;
+    bool bufferStale;
+
+    static std::vector<GLMatrices *> pending;
+    // El último objeto GLMatrices vinculado por flush o bind, y el stream que usó
+    static GLMatrices *lastBound;
+    static const void *lastStream;
+    static Counters counters, frameCounters;
 
     friend std::ostream& operator<<(std::ostream &os, const GLMatrices& m);
   };
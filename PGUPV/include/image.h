@@ -2,6 +2,7 @@
 #define _IMAGE_H
 
 #include <string>
+#include <memory>
 #include <GL/glew.h>
 #include <FreeImage.h>
 
@@ -24,6 +25,12 @@ namespace PGUPV {
     Image(Image &&other);
 		// Carga la imagen desde el fichero indicado
 		explicit Image(std::string filename);
+		/**
+		Carga la imagen desde el fichero indicado, sin lanzar excepciones ni mostrar diálogos,
+		así que se puede llamar desde cualquier hilo (ver ImageLoader)
+		\return la imagen, o nullptr si no se ha podido cargar
+		*/
+		static std::unique_ptr<Image> tryLoad(const std::string &filename);
 		// Crea una imagen con el tamaño indicado. Opcionalmente, copia la información
 		// apuntada por data
 		Image(uint width, uint height, uint bpp, void *data = NULL);
@@ -131,6 +138,7 @@ namespace PGUPV {
 		*/
 		static const std::string getLibraryInfo();
 	private:
+		Image();
 		Image(const Image &);
 		Image &operator=(const Image &);
 		bool loadDDS(const std::string &filename);
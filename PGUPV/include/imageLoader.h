@@ -0,0 +1,95 @@
+#ifndef _IMAGE_LOADER_H
+#define _IMAGE_LOADER_H 2022
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace PGUPV {
+	class Image;
+
+	/**
+	\class ImageLoader
+
+	Decodifica en paralelo, con los hilos del ThreadPool, un conjunto de ficheros de imagen. Los
+	trabajadores leen y decodifican el fichero, intercambian los canales rojo y azul (ver
+	Image), invierten la imagen verticalmente y, si se pide, generan sus mipmaps en la CPU. Al
+	hilo con el contexto OpenGL sólo le queda subir las imágenes a las texturas.
+
+	Ejemplo:
+
+	ImageLoader images;
+	for (auto &f : ficheros)
+	  images.add(f, false, true);
+	images.decode();
+	...
+	auto t = TextureCache::getTexture2D(ficheros[0], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR,
+	  GL_REPEAT, GL_REPEAT, true, GL_RGB, &images);
+
+	ImageLoader no usa OpenGL, así que se puede usar desde cualquier hilo.
+	*/
+	class ImageLoader {
+	public:
+		struct Decoded {
+			std::string filename;
+			bool flipV;
+			bool mipmaps;
+			std::unique_ptr<Image> image;	// nullptr si no se ha podido cargar
+			// Niveles 1, 2... hasta 1x1 (vacío si no se pidieron, o la imagen no es de 8 bits por canal)
+			std::vector<std::unique_ptr<Image>> mipmapLevels;
+			std::string error;				// por qué no se ha podido cargar
+		};
+
+		ImageLoader();
+		~ImageLoader();
+		/**
+		Pide la decodificación de un fichero (si ya se había pedido, no hace nada)
+		\param filename ruta del fichero
+		\param flipV si es true, la imagen se invierte verticalmente
+		\param mipmaps si es true, se generan los mipmaps de la imagen (ver buildMipmaps)
+		*/
+		void add(const std::string &filename, bool flipV = false, bool mipmaps = false);
+		/**
+		Decodifica en paralelo los ficheros pedidos que aún no se han decodificado, y vuelve
+		cuando ha terminado. Los errores no lanzan excepciones: se avisa con WARN y se guardan
+		en el Decoded correspondiente
+		*/
+		void decode();
+		/**
+		\return el resultado de decodificar el fichero indicado, o nullptr si no se ha pedido o
+		no se ha decodificado aún
+		*/
+		const Decoded *get(const std::string &filename, bool flipV = false) const;
+		//! Libera todas las imágenes
+		void clear();
+
+		struct Stats {
+			size_t decoded = 0;			// ficheros decodificados
+			size_t failed = 0;			// ficheros que no se han podido cargar
+			size_t mipmapLevels = 0;	// niveles generados en total
+			double seconds = 0.0;		// tiempo real empleado por decode
+		};
+		const Stats &getStats() const { return stats; }
+
+		/**
+		Genera los mipmaps de la imagen con un filtro de caja de 2x2 píxeles (en las dimensiones
+		impares, el último píxel de cada nivel promedia también el píxel sobrante)
+		\param image una imagen de 8 bits por canal (8, 24 o 32 bpp)
+		\return los niveles 1, 2... hasta 1x1, o nada si la imagen no es de 8 bits por canal
+		*/
+		static std::vector<std::unique_ptr<Image>> buildMipmaps(const Image &image);
+	private:
+		ImageLoader(const ImageLoader &) = delete;
+		ImageLoader &operator=(const ImageLoader &) = delete;
+		static void decode(Decoded &d);
+
+		std::vector<std::unique_ptr<Decoded>> requests;
+		std::map<std::pair<std::string, bool>, size_t> index;	// posición en requests
+		// Las peticiones anteriores a ésta ya se han decodificado
+		size_t firstPending;
+		Stats stats;
+	};
+};
+
+#endif
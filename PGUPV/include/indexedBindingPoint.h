@@ -32,6 +32,20 @@ namespace PGUPV {
     std::shared_ptr<BufferObject>
       bindBufferRange(std::shared_ptr<BufferObject> bo, GLuint index,
       GLintptr offset, GLsizeiptr size);
+    /** Vincula una porción del B.O. storage al índice del punto de vinculación, pero
+    getBound seguirá devolviendo owner (p.e., cuando el contenido del UBO owner se ha
+    copiado en un UniformStream)
+    \param owner: buffer object al que pertenecen los datos
+    \param index: índice del punto de vinculación
+    \param storage: buffer object que contiene los datos
+    \param offset: posición del primer byte a vincular dentro de storage
+    \param size: tamaño de la región a vincular
+    \returns un puntero compartido (que puede estar vacío) al B.O. que estaba
+    previamente vinculado a este punto
+    */
+    std::shared_ptr<BufferObject>
+      bindBufferRange(std::shared_ptr<BufferObject> owner, GLuint index,
+      std::shared_ptr<BufferObject> storage, GLintptr offset, GLsizeiptr size);
 
     /**
     Devuelve una referencia al BufferObject vinculado en el índice indicado. Puede ser
@@ -0,0 +1,89 @@
+#ifndef _INSTANCING_H
+#define _INSTANCING_H 2022
+
+#include <memory>
+#include <string>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+
+#include "common.h"
+
+namespace PGUPV {
+	class Mesh;
+	class Program;
+	class BufferObject;
+
+	/**
+	\class Instancing
+
+	Dibuja varias copias de una malla, cada una con su matriz del modelo, con una sola orden
+	instanciada (glDrawElementsInstanced...). Las matrices se copian a un buffer de
+	instancias, que el shader lee con el atributo instanceMatrix (ver definition).
+
+	El atributo se declara para que el mismo shader sirva para dibujar con y sin instancias:
+	la matriz del modelo de cada vértice es modelMatrix * instanceMatrix. Al dibujar con
+	instancias, modelMatrix es la identidad e instanceMatrix es la matriz de la instancia; al
+	dibujar sin instancias, instanceMatrix toma su valor por defecto (la identidad, ver
+	resetInstanceMatrix).
+
+	Uso en el shader de vértices:
+
+	$GLMatrices
+	$Instancing
+	in vec4 position;
+	in vec3 normal;
+	void main() {
+	  gl_Position = projMatrix * instanceModelviewMatrix() * position;
+	  vec3 n = instanceNormalMatrix() * normal;
+	  ...
+	}
+
+	RenderQueue agrupa automáticamente los paquetes con la misma malla y el mismo material
+	(ver RenderQueue::setInstancing), si el programa declara instanceMatrix.
+
+	\warning El atributo ocupa los índices MATRIX_ATTRIBUTE a MATRIX_ATTRIBUTE + 3 (uno por
+	columna): las mallas no deberían usarlos para sus propios atributos
+	*/
+	class Instancing {
+	public:
+		static const GLuint MATRIX_ATTRIBUTE = 11;
+		static const std::string blockName;
+		//! Declaración GLSL del atributo con la matriz de la instancia, y funciones auxiliares
+		static const Strings definition;
+		/**
+		Sustituye $Instancing por definition en los shaders del programa, y establece el
+		valor por defecto de instanceMatrix
+		*/
+		static void prepareProgram(Program &program);
+		//! Establece la matriz identidad como valor del atributo instanceMatrix cuando no se usa un buffer
+		static void resetInstanceMatrix();
+		//! \return true si el programa (ya enlazado) declara el atributo instanceMatrix
+		static bool isInstancingProgram(const Program &program);
+		//! \return true si todas las órdenes de dibujo de la malla tienen versión instanciada
+		static bool canInstance(const Mesh &mesh);
+
+		Instancing();
+		~Instancing();
+		/**
+		Dibuja n copias de la malla, que tiene que estar vinculada (Mesh::bind), cada una con
+		su matriz. Usa el programa actual, que tiene que declarar instanceMatrix, y el GLMatrices
+		vinculado (normalmente, con la matriz del modelo a la identidad)
+		*/
+		void draw(Mesh &mesh, const glm::mat4 *matrices, size_t n);
+
+		struct Stats {
+			uint64_t draws = 0;		// órdenes instanciadas
+			uint64_t instances = 0;	// copias dibujadas en total
+			uint64_t orphans = 0;	// veces que se ha pedido un buffer nuevo al driver
+		};
+		const Stats &getStats() const { return stats; }
+	private:
+		Instancing(const Instancing &) = delete;
+		Instancing &operator=(const Instancing &) = delete;
+		std::shared_ptr<BufferObject> buffer;
+		size_t head;
+		Stats stats;
+	};
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include <stdexcept>
 #include <observable.h>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
 
 namespace PGUPV {
 
@@ -40,6 +43,14 @@ namespace PGUPV {
     \param logFullFilepath si true, guarda en el log la ruta completa de los ficheros
     */
     void setLogFilepath(bool logFullPath) { logFullFilepath = logFullPath; };
+    /**
+    Avisa a los observadores de los mensajes escritos desde otros hilos (p.e., los del
+    ThreadPool). Los observadores (como la consola de la GUI) sólo reciben mensajes en el hilo
+    principal: los de otros hilos se guardan hasta que se llama a esta función (App lo hace
+    en cada frame) o hasta el siguiente mensaje del hilo principal. Llamar desde el hilo
+    principal
+    */
+    void deliverNotifications();
 	~Log();
   private:
     Log();
@@ -52,6 +63,12 @@ namespace PGUPV {
     NOTIFICATION_LEVEL notification_level;
     bool logFullFilepath;
     std::string logFileFullPathName;
+	// Los hilos del ThreadPool también escriben en el log
+	std::mutex mutex;
+	// Hilo que creó el Log (el principal, ver App::App)
+	std::thread::id mainThread;
+	// Mensajes de otros hilos pendientes de notificar (ver deliverNotifications)
+	std::vector<std::string> pendingNotifications;
 	static Log *theInstance;
   };
 
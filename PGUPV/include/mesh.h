@@ -73,6 +73,16 @@ namespace PGUPV {
 			_LAST_
 		};
 
+		/**
+		Política sobre la copia en memoria principal de los atributos de la malla:
+		  KEEP_CPU_COPY: se conserva una copia de cada array que se sube a un VBO. Las
+		    funciones de consulta (getVertices, getNormals...) y computeSmoothNormals
+		    trabajan sobre esa copia, sin hacer ninguna llamada a OpenGL.
+		  DROP_CPU_COPY: los arrays se descartan tras subirlos a la GPU (ahorra memoria,
+		    pero las consultas tienen que mapear los VBOs y leerlos desde la GPU)
+		*/
+		enum class CpuCopyPolicy { KEEP_CPU_COPY, DROP_CPU_COPY };
+
 #define NUM_TEX_COORD 4
 		// Constructor de una malla
 		Mesh();
@@ -217,6 +227,14 @@ namespace PGUPV {
 		// Define las binormales de cada vértice de la malla. Cada binormal está
 		// definida por 3 floats. Recibe un vector de n binormales.
 		void addTangents(const float *t, size_t n, GLenum usage = GL_STATIC_DRAW);
+		// Define las tangentes de cada vértice con su orientación en la componente w
+		// (+1 ó -1): la bitangente es w * cross(normal, tangente.xyz). Recibe un vector
+		// de n tangentes.
+		void addTangents(const glm::vec4 *t, size_t n, GLenum usage = GL_STATIC_DRAW);
+		void addTangents(const std::vector<glm::vec4> &t,
+			GLenum usage = GL_STATIC_DRAW) {
+			addTangents(&t[0], t.size(), usage);
+		};
 		// Define la binormal que usarán *todos* los vértices
 		void setTangent(const glm::vec3 &t);
 
@@ -292,12 +310,27 @@ namespace PGUPV {
 
 		//! Devuelve el material asociado a la malla
 		std::shared_ptr<BaseMaterial> getMaterial() const;
+		/**
+		\return un número que cambia cada vez que cambia la geometría de la malla (sus buffers o
+		sus comandos de dibujo), su material o sus valores estáticos de los atributos (la malla
+		no conoce sus nodos, ver StaticBatch::isUpToDate y CPUPicker)
+		*/
+		uint64_t getVersion() const { return version; }
 
 		/**
 		Función que dibuja la malla
 		*/
 		void render();
 		/**
+		Vincula el estado de la malla necesario para dibujarla (el VAO, los huesos y los
+		atributos estáticos), pero no su material. render equivale a bind, usar el material y draw
+		*/
+		void bind();
+		/**
+		Ejecuta las órdenes de dibujo de la malla, suponiendo que ya está vinculada (ver bind)
+		*/
+		void draw();
+		/**
 		\return el número de vértices de la malla (cuidado! NO el número de
 		 índices)
 		*/
@@ -336,18 +369,49 @@ namespace PGUPV {
 		*/
 		void computeSmoothNormals();
 		/**
+		Calcula las normales suaves de una malla de triángulos en memoria principal (lo que
+		hace computeSmoothNormals, pero sin OpenGL, así que se puede llamar desde cualquier hilo)
+		\param vertices posiciones de los vértices
+		\param tris índices de los vértices de cada triángulo
+		\param epsilon distancia por debajo de la cual dos vértices se consideran el mismo
+		\return la normal de cada vértice
+		*/
+		static std::vector<glm::vec3> smoothNormals(const std::vector<glm::vec3> &vertices,
+			const std::vector<uint> &tris, float epsilon);
+		/**
+		Calcula la tangente de cada vértice (la dirección en la que crece la coordenada u
+		de textura), a partir de las normales y las coordenadas de textura de la unidad
+		indicada. Sustituye las tangentes que hubieran definidas. Las tangentes son vec4:
+		la componente w (+1 ó -1) indica la orientación, necesaria en las zonas con
+		coordenadas de textura reflejadas (bitangente = w * cross(normal, tangente.xyz)).
+		\param texUnit conjunto de coordenadas de textura a usar
+		\warning Igual que computeSmoothNormals, llámala con la malla completamente
+		configurada (incluidas las normales)
+		*/
+		void computeTangents(uint texUnit = 0);
+		/**
 		Da acceso a los buffer objects que contienen la información de la malla
 		\param which El buffer object deseado (VERTICES, NORMALS, etc)
 		\return una referencia al buffer object
+		\warning Si vas a escribir en el buffer object, usa getMutableBufferObject: si no,
+		la copia en memoria principal del atributo dejaría de coincidir con la GPU
 		*/
-		std::shared_ptr<BufferObject> getBufferObject(BufferObjectType which);
+		std::shared_ptr<BufferObject> getBufferObject(BufferObjectType which) const;
 
 		/**
 		Da acceso a los buffer objects que contienen la información de la malla
 		\param attribute el índice del atributo solicitado
 		\return una referencia al buffer object
+		\warning Sólo para leer (ver getMutableBufferObject)
 		*/
-		std::shared_ptr<BufferObject> getBufferObject(int attribute);
+		std::shared_ptr<BufferObject> getBufferObject(int attribute) const;
+
+		/**
+		Como getBufferObject, pero para modificar el contenido del buffer object: descarta la
+		copia en memoria principal del atributo, que ya no sería fiable
+		*/
+		std::shared_ptr<BufferObject> getMutableBufferObject(BufferObjectType which);
+		std::shared_ptr<BufferObject> getMutableBufferObject(int attribute);
 
 		/**
 		Establece el nombre de la malla
@@ -363,43 +427,90 @@ namespace PGUPV {
 		const std::string to_string() const;
 		/**
 		Devuelve la posición de los vértices de la malla
-		\warning No abusar de estas funciones, puesto que tienen que traer la información
-		desde la GPU
+		\warning Si no hay copia en memoria principal (ver CpuCopyPolicy), la información
+		se trae desde la GPU, así que no hay que abusar de estas funciones
 		*/
 		std::vector<glm::vec3> getVertices() const;
 
+		/**
+		  Devuelve los índices de los vértices de los triángulos que dibujan los
+		  DrawCommands de la malla (3 por triángulo)
+		  \warning Todos los DrawCommands tienen que dibujar triángulos. Si no hay copia en
+		  memoria principal de los índices, se traen desde la GPU
+		  */
+		std::vector<uint> getTriangleList();
+		/**
+		  \return true si todos los DrawCommands de la malla dibujan triángulos
+		  (GL_TRIANGLES, GL_TRIANGLE_STRIP o GL_TRIANGLE_FAN)
+		  */
+		bool drawsOnlyTriangles() const;
+
 		/**
 		Devuelve las normales de los vértices de la malla
-		\warning No abusar de estas funciones, puesto que tienen que traer la información
-		desde la GPU
+		\warning Si no hay copia en memoria principal (ver CpuCopyPolicy), la información
+		se trae desde la GPU, así que no hay que abusar de estas funciones
 		*/
 		std::vector<glm::vec3> getNormals() const;
 		
 		/**
 		Devuelve las coordenadas de textura de los vértices de la malla
-		\warning No abusar de estas funciones, puesto que tienen que traer la información
-		desde la GPU
+		\warning Si no hay copia en memoria principal (ver CpuCopyPolicy), la información
+		se trae desde la GPU, así que no hay que abusar de estas funciones
 		*/
 		std::vector<glm::vec2> getTexCoords(unsigned int texUnit = 0) const;
 
 		/**
 		Devuelve los índices de la malla
-		\warning No abusar de estas funciones, puesto que tienen que traer la información
-		desde la GPU
+		\warning Si no hay copia en memoria principal (ver CpuCopyPolicy), la información
+		se trae desde la GPU, así que no hay que abusar de estas funciones
 		*/
 		std::vector<unsigned int> getIndices() const;
 
+		/**
+		Establece la política por defecto de las mallas que se creen a partir de ahora
+		(inicialmente, DROP_CPU_COPY)
+		*/
+		static void setDefaultCpuCopyPolicy(CpuCopyPolicy p);
+		static CpuCopyPolicy getDefaultCpuCopyPolicy();
+		/**
+		Establece la política de copia en memoria principal de esta malla. Si la nueva
+		política es DROP_CPU_COPY, se liberan las copias existentes.
+		*/
+		void setCpuCopyPolicy(CpuCopyPolicy p);
+		CpuCopyPolicy getCpuCopyPolicy() const { return cpuCopyPolicy; }
+		//! Libera todas las copias en memoria principal de los atributos de la malla
+		void releaseCpuCopy();
+		/**
+		\return true si hay una copia en memoria principal del atributo indicado
+		*/
+		bool hasCpuCopy(uint attribute) const;
+		/**
+		\return la memoria (en bytes) ocupada por las copias en memoria principal
+		*/
+		size_t getCpuCopySize() const;
+		/**
+		Recalcula los volúmenes de inclusión a partir de los vértices actuales de la
+		malla (si hay copia en memoria principal, no accede a la GPU)
+		*/
+		void updateBoundingVolumes();
+
 		const std::vector<DrawCommand *> &getDrawCommands() const { return drawCommands; }
 
 		std::shared_ptr<UBOBones> getBones() const;
 
 	protected:
+		// StaticBatch copia los atributos de la malla (copias en memoria principal y valores estáticos)
+		friend class StaticBatch;
 		std::string name;
 		std::vector<DrawCommand *> drawCommands;
 		BoundingBox bb;
 		BoundingSphere bs;
 		VertexArrayObject vao;
 		std::vector<std::shared_ptr<BufferObject>> vbos;
+		// Copia en memoria principal del contenido de cada VBO (vacía si no hay copia)
+		std::vector<std::vector<unsigned char>> cpuCopies;
+		CpuCopyPolicy cpuCopyPolicy;
+		static CpuCopyPolicy defaultCpuCopyPolicy;
 		GLenum indices_type;
 		size_t n_indices, n_vertices;
 		unsigned int n_components_per_vertex;
@@ -413,11 +524,11 @@ namespace PGUPV {
 		};
 
 		float epsilonSquared; // para determinar si dos vértices son iguales
-		bool sameVertex(float *vs, uint ncomponents, uint a, uint b);
 		std::vector<StaticAttribute> staticAttrValues;
 		std::shared_ptr<BaseMaterial> material;
 		std::shared_ptr<UBOBones> bones;
 		std::shared_ptr<Skeleton> skeleton;
+		uint64_t version = 1;
 
 		/**
 		  Almacena o actualiza un valor para el atributo indicado.
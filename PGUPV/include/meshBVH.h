@@ -0,0 +1,65 @@
+#ifndef _MESH_BVH_H
+#define _MESH_BVH_H 2022
+
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "common.h"
+#include "bvh.h"
+
+namespace PGUPV {
+	class Mesh;
+
+	/**
+	\class MeshBVH
+
+	BVH de los triángulos de una malla, para calcular intersecciones rayo-malla en la CPU
+	(sin OpenGL). Guarda su propia copia de los vértices y de los triángulos.
+
+	Ejemplo:
+
+	MeshBVH bvh(mesh);
+	MeshBVH::Hit hit;
+	if (bvh.intersect(ray, FLT_MAX, hit)) {
+		// el rayo corta al triángulo hit.triangle en ray.at(hit.t)
+	}
+	*/
+	class MeshBVH {
+	public:
+		/**
+		Construye la jerarquía a partir de los triángulos que dibujan los DrawCommands de
+		la malla (ver Mesh::getTriangleList)
+		*/
+		explicit MeshBVH(Mesh &mesh);
+		/**
+		\param vertices posición de los vértices
+		\param triangles índices de los vértices de cada triángulo (3 por triángulo)
+		*/
+		MeshBVH(std::vector<glm::vec3> vertices, std::vector<uint> triangles);
+
+		struct Hit {
+			uint triangle;	// índice del triángulo (en la lista de triángulos de la malla)
+			float t;		// distancia en unidades de la dirección del rayo
+			glm::vec3 barycentrics;	// coordenadas baricéntricas del punto en el triángulo
+		};
+
+		/**
+		Calcula la intersección más cercana del rayo con la malla
+		\param tmax distancia máxima a la que buscar
+		\param hit [out] la intersección encontrada
+		\return true si el rayo corta a algún triángulo antes de tmax
+		*/
+		bool intersect(const Ray &ray, float tmax, Hit &hit) const;
+
+		size_t getNTriangles() const { return triangles.size() / 3; }
+		const std::vector<uint> &getTriangles() const { return triangles; }
+		BoundingBox getBB() const { return bvh.getBB(); }
+	private:
+		void build();
+		std::vector<glm::vec3> vertices;
+		std::vector<uint> triangles;
+		BVH bvh;
+	};
+};
+
+#endif
@@ -35,6 +35,8 @@ namespace PGUPV {
 	void clearMeshes();
     // Devuelve una referencia a la malla i-ésima
     Mesh &getMesh(size_t i);
+    // Devuelve la malla i-ésima, para quien necesite saber si sigue existiendo (weak_ptr)
+    std::shared_ptr<Mesh> getSharedMesh(size_t i);
     /**
     Función de conveniencia para procesar todas las mallas del modelo
     \param op se invocará a la función op en cada una de las mallas del modelo
@@ -21,6 +21,7 @@ namespace PGUPV {
 	class Node;
 	class Group;
 	class NodeCallback;
+	class Program;
 
 	typedef std::vector<std::shared_ptr<Node>> NodePath;
 
@@ -57,9 +58,17 @@ namespace PGUPV {
 		void select(bool select = true) { selected = select; }
 		bool isSelected() const { return selected; }
 
-		void setVisible(bool nodeVisible = true) { visible = nodeVisible; };
+		void setVisible(bool nodeVisible = true);
 		bool isVisible() const { return visible; }
 
+		/**
+		Establece el programa con el que se dibuja el nodo y su subgrafo (salvo los
+		descendientes que tengan otro). Por defecto (nullptr), se usa el del padre o, en la
+		raíz, el programa actual. Lo respetan tanto Node::render como RenderQueue::collect
+		*/
+		void setProgram(std::shared_ptr<Program> nodeProgram);
+		std::shared_ptr<Program> getProgram() const { return program; }
+
 		/**
 		Invalida los volúmenes de inclusión del nodo y de sus predecesores
 		*/
@@ -73,12 +82,29 @@ namespace PGUPV {
 		}
 
 		uint32_t getId() const { return nodeId; }
+		/**
+		\return un número que cambia cada vez que cambia el nodo o cualquier nodo por debajo de
+		él: al invalidar sus volúmenes de inclusión, al cambiar su visibilidad o su programa, o
+		al llamar a markChanged (ver SceneBVH y StaticBatch)
+		*/
+		uint64_t getVersion() const { return version; }
+		/**
+		Cambia la versión del nodo y la de sus predecesores sin invalidar los volúmenes de
+		inclusión
+		*/
+		void markChanged();
 
 	protected:
 		void addParent(Group* parent);
 		void removeParent(Group* parent);
 		virtual void recomputeBoundingBox() = 0;
 		virtual void recomputeBoundingSphere() = 0;
+		/**
+		Activa el programa del nodo, si tiene
+		\return el programa que estaba activo (restoreProgram lo vuelve a activar)
+		*/
+		Program *useProgram();
+		void restoreProgram(Program *previous);
 		std::vector<Group*> parents;
 		std::string name;
 		BoundingBox bb;
@@ -86,7 +112,9 @@ namespace PGUPV {
 		bool selected;
 		bool visible;
 		std::vector<std::shared_ptr<NodeCallback>> updateCallbacks;
+		std::shared_ptr<Program> program;
 		uint32_t nodeId;
+		uint64_t version = 1;
 		friend class Group;
 		friend class AnimationNode;
 		static uint32_t nextNodeId;
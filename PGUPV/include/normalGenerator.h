@@ -0,0 +1,103 @@
+#ifndef _NORMAL_GENERATOR_H
+#define _NORMAL_GENERATOR_H 2022
+
+#include <vector>
+#include <cstddef>
+
+#include "common.h"
+
+namespace PGUPV {
+
+	/**
+	\class NormalGenerator
+
+	Calcula normales suaves y tangentes por vértice de una malla de triángulos, sin
+	usar OpenGL. Los datos se proporcionan como estructura de arrays (un array por
+	componente: x, y, z...), que es el formato que permite procesar varios triángulos
+	a la vez con instrucciones SIMD (SSE).
+
+	- La normal de cada vértice es la suma de las normales de los triángulos que lo
+	  comparten, ponderada por el ángulo del triángulo en ese vértice.
+	- La tangente de cada vértice se obtiene de las derivadas de la posición respecto a
+	  la coordenada u de textura, y se ortogonaliza respecto a la normal. Opcionalmente
+	  calcula también su orientación (+1 ó -1), que indica si la bitangente es
+	  cross(N, T) o -cross(N, T) (es -1 en las zonas con coordenadas de textura reflejadas).
+
+	El trabajo se reparte entre los hilos del ThreadPool en dos pasadas: primero cada
+	triángulo calcula su aportación a cada una de sus esquinas (cada uno escribe en sus
+	propias posiciones) y luego cada vértice suma las aportaciones de sus esquinas. Así
+	ningún hilo escribe en datos de otro y el resultado no depende del número de hilos.
+
+	Ejemplo:
+
+	NormalGenerator gen(x, y, z, nvertices, &indices[0], indices.size() / 3);
+	gen.setVertexGroups(VertexWelder().weld(...)); // opcional
+	gen.computeNormals(nx, ny, nz);
+	gen.computeTangents(nx, ny, nz, u, v, tx, ty, tz, tw);
+
+	\warning El objeto no copia los arrays de entrada: tienen que existir mientras se use
+	*/
+	class NormalGenerator {
+	public:
+		/**
+		\param x, y, z coordenadas de los vértices
+		\param nvertices número de vértices
+		\param triangles índices de los vértices de cada triángulo (3 por triángulo)
+		\param ntriangles número de triángulos
+		*/
+		NormalGenerator(const float *x, const float *y, const float *z, size_t nvertices,
+			const uint *triangles, size_t ntriangles);
+
+		/**
+		Establece los grupos de vértices que comparten posición (ver VertexWelder). Todos
+		los vértices de un grupo recibirán la misma normal. Por defecto, cada vértice
+		forma su propio grupo.
+		\param representatives para cada vértice, el índice del representante de su grupo
+		*/
+		void setVertexGroups(const std::vector<uint> &representatives);
+
+		/**
+		Calcula la normal suave de cada vértice. Los vértices que no pertenecen a ningún
+		triángulo (o sólo a triángulos degenerados) reciben la normal (0, 0, 0).
+		\param nx, ny, nz arrays de nvertices elementos donde escribir el resultado
+		*/
+		void computeNormals(float *nx, float *ny, float *nz) const;
+
+		/**
+		Calcula la tangente de cada vértice (la dirección en la que crece la coordenada u
+		de textura), ortogonal a la normal y unitaria.
+		\param nx, ny, nz normales de los vértices
+		\param u, v coordenadas de textura de los vértices
+		\param tx, ty, tz arrays de nvertices elementos donde escribir el resultado
+		\param tw si no es nullptr, array de nvertices elementos donde escribir la
+		  orientación de cada tangente: la bitangente es tw * cross(N, T)
+		*/
+		void computeTangents(const float *nx, const float *ny, const float *nz,
+			const float *u, const float *v, float *tx, float *ty, float *tz,
+			float *tw = nullptr) const;
+
+		/**
+		\return true si la librería se ha compilado con el camino SIMD para el cálculo
+		  por triángulo
+		*/
+		static bool isVectorized();
+
+	private:
+		const float *x, *y, *z;
+		size_t nvertices;
+		const uint *triangles;
+		size_t ntriangles;
+		std::vector<uint> groups;
+
+		/**
+		Construye la lista de esquinas de cada vértice (en formato CSR): las esquinas del
+		vértice v están en corners[first[v]..first[v+1]). La esquina i del triángulo t
+		se identifica como i * ntriangles + t.
+		\param useGroups si true, las esquinas se asignan al representante del grupo
+		*/
+		void buildIncidence(bool useGroups, std::vector<uint> &first, std::vector<uint> &corners) const;
+		void triangleNormals(size_t begin, size_t end, float *cx, float *cy, float *cz) const;
+	};
+};
+
+#endif
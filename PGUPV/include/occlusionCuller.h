@@ -0,0 +1,96 @@
+#ifndef _OCCLUSION_CULLER_H
+#define _OCCLUSION_CULLER_H 2022
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <glm/mat4x4.hpp>
+
+#include "cullVisitor.h"
+
+namespace PGUPV {
+	class Query;
+	class GLMatrices;
+	class Model;
+
+	/**
+	\class OcclusionCuller
+
+	Dibuja un grafo de escena descartando, además de lo que queda fuera de la vista (ver
+	CullVisitor), los nodos que estaban tapados por otros en el frame anterior.
+
+	Usa consultas de oclusión (Query con GL_ANY_SAMPLES_PASSED) con coherencia temporal:
+	  - cada hoja visible se dibuja dentro de una consulta, que dice si sigue siendo visible
+	  - los nodos (Group, Transform, Geode...) que estaban tapados no se recorren ni se dibujan:
+	    en su lugar se dibuja su caja de inclusión, sin escribir en el color ni en la
+	    profundidad, dentro de una consulta, al final del frame (cuando el buffer de
+	    profundidad ya tiene todo lo visible)
+	  - cuando todos los hijos de un grupo que están dentro de la vista están tapados, se
+	    consulta también su caja; si está tapada, en los siguientes frames sólo se consulta
+	    la caja del grupo (un nodo sólo pasa a estar tapado por el resultado de una consulta)
+	  - si la caja de un nodo tapado vuelve a ser visible, el nodo y sus hijos se dibujan
+	El estado de cada nodo se guarda por instancia (por el camino desde la raíz), así que un
+	nodo compartido por varios padres tiene uno distinto en cada posición del grafo.
+	Los resultados se leen un frame después, y sólo si ya están disponibles, así que nunca
+	se espera a la GPU. A cambio, un objeto que aparece de detrás de otro tarda un frame en
+	dibujarse.
+
+	Ejemplo:
+
+	OcclusionCuller occlusion;
+	...
+	void render() {
+	  ...
+	  occlusion.render(*scene->getRoot());
+	}
+	*/
+	class OcclusionCuller : public CullVisitor {
+	public:
+		OcclusionCuller();
+		~OcclusionCuller();
+		/**
+		Dibuja el grafo con el GLMatrices vinculado y el programa actual
+		\param root raíz del (sub)grafo
+		*/
+		void render(Node &root);
+		//! Olvida la visibilidad de todos los nodos (p.e., después de un salto de la cámara)
+		void reset();
+
+		struct OcclusionCounters {
+			size_t occluded = 0;		// nodos descartados por estar tapados (sin contar sus descendientes)
+			size_t revealed = 0;		// nodos tapados que han vuelto a ser visibles
+			size_t queries = 0;			// consultas lanzadas
+			size_t boxQueries = 0;		// consultas de cajas de nodos tapados
+			size_t pendingResults = 0;	// consultas cuyo resultado no estaba disponible a tiempo
+		};
+		//! \return los contadores del último frame (los de frustum culling están en getCounters)
+		const OcclusionCounters &getOcclusionCounters() const { return occlusionCounters; }
+	protected:
+		bool acceptNode(Node &node) override;
+		void leaveNode(Node &node) override;
+	private:
+		struct NodeState;
+		// \param key identificador de la instancia (ver acceptNode)
+		NodeState &getState(uint64_t key);
+		void readResults();
+		void queryBoxes(GLMatrices &mats);
+
+		std::unordered_map<uint64_t, std::unique_ptr<NodeState>> states;
+		// Estados de los nodos aceptados que se están recorriendo
+		std::vector<NodeState *> path;
+		// Estado de cada hoja visible (en el orden de getVisible)
+		std::vector<NodeState *> leaves;
+		struct OccludedBox {
+			NodeState *state;
+			glm::mat4 modelMatrix;
+			BoundingBox bb;
+		};
+		std::vector<OccludedBox> occludedBoxes;
+		std::shared_ptr<Model> box;
+		glm::vec3 eye;
+		uint64_t frame;
+		OcclusionCounters occlusionCounters;
+	};
+};
+
+#endif
@@ -16,6 +16,8 @@ namespace PGUPV {
 	Esta clase permite implementar la operacin de picking (seleccionar un objeto de la ventana haciendo
 	clic directamente sobre su imagen).
 
+	Para hacer picking sin usar la GPU (por ejemplo, sin contexto OpenGL), ver \sa CPUPicker.
+
 	El picker es independiente de la estructura de la escena, ya que recibe un vector con los modelos que la 
 	componen, junto con un identificador para cada modelo. Es responsabilidad del programador construir dicho
 	vector. En el caso de usar un grafo de escena, se puede usar la clase \sa PickerNodeVisitor para construir 
@@ -53,6 +55,7 @@ namespace PGUPV {
 			glm::mat4 modelMatrix; // matriz del modelo que lleva m al espacio del mundo
 			Model* m;	// geometra a dibujar
 			uint32_t id;  // identificador de este objeto. Cuidado! No usar el id 0 (es el fondo)
+			Node* node = nullptr; // nodo del grafo de escena que contiene el modelo (opcional)
 		};
 		Picker();
 		~Picker();
@@ -101,7 +104,7 @@ namespace PGUPV {
 			mats.popMatrix();
 		};
 		void apply(Geode& geode) override {
-			rendernodes.emplace_back(Picker::ModelId{ mats.getMatrix(), &geode.getModel(), geode.getId() });
+			rendernodes.emplace_back(Picker::ModelId{ mats.getMatrix(), &geode.getModel(), geode.getId(), &geode });
 		};
 		void reset() { mats.reset(); rendernodes.clear(); }
 		const std::vector<Picker::ModelId>& getResult() const {
@@ -198,6 +198,10 @@ namespace PGUPV {
 		(con Program::use), se deinstala el anterior
 		*/
 		void unUse();
+		/**
+		\return el programa instalado con Program::use, o nullptr si no hay ninguno
+		*/
+		static Program *getCurrentProgram() { return prevProgram; }
 
 		/**
 		Devuelve el tamaño del bloque de uniforms, según el driver de OpenGL.
@@ -369,6 +373,50 @@ namespace PGUPV {
 			si se ha modificado algún shader)
 		 */
 		long long getModificationTime();
+		/**
+		 \return los ficheros de los que depende el programa: los de sus shaders y los que éstos
+			incluyen con $include (sin repetir)
+		 */
+		std::vector<std::string> getDependencies() const;
+		/**
+		 \return el grafo de dependencias del programa: un par (fichero que incluye, fichero
+			incluido) por cada $include de sus shaders (ver Shader::getIncludes)
+		 */
+		std::vector<std::pair<std::string, std::string>> getIncludeGraph() const;
+
+		//// Recarga del programa (ver ShaderLibrary::setHotReload)
+
+		enum class ReloadResult {
+			NONE,		// no se está recargando
+			PENDING,	// el driver todavía está compilando o enlazando
+			DONE,		// se ha sustituido el programa por el nuevo
+			FAILED		// no se ha podido compilar: se sigue usando el programa anterior
+		};
+		/**
+		 Empieza a recargar el programa: vuelve a leer (y preprocesar) los ficheros de sus
+		 shaders y los manda a compilar, sin esperar al resultado. El programa actual se sigue
+		 usando hasta que pollReload termina con éxito.
+		 \return false si el programa no está compilado, ya se está recargando o no se ha podido
+		   leer algún fichero
+		 */
+		bool startReload();
+		/**
+		 Avanza la recarga empezada con startReload. Cuando el nuevo programa está enlazado, se
+		 copian en él los valores de los uniforms del bloque por defecto, se vuelven a conectar
+		 los UBO y las subrutinas, y sustituye al anterior. Si algo falla, el programa anterior
+		 no cambia. También falla si algún uniform del bloque por defecto cambia de posición (o
+		 su posición pasa a ser de otro), porque la aplicación puede haberla guardado.
+		 \param errors si no es nulo, recibe los errores de compilación (si ha fallado)
+		 */
+		ReloadResult pollReload(std::string *errors = nullptr);
+		//! \return true si hay una recarga en curso
+		bool isReloading() const { return reload != nullptr; }
+		/**
+		\return todo lo que determina el binario del programa, con lo que se identifica en
+		ProgramCache: el código de los shaders ya preprocesado, las posiciones de los atributos
+		y las variables del transform feedback
+		*/
+		std::string cacheKey() const;
 	private:
 		// Prohibir la copia
 		Program(const Program &);
@@ -385,8 +433,21 @@ namespace PGUPV {
 		void refreshRoutineUniforms();
 
 		bool bindUBOs();
-		void bindAttribs();
-		bool linkProgram(const Uints &shids, std::ostream &error_output);
+		void bindAttribs(GLuint id);
+		// retrievable: si es true, se podrá leer el binario del programa (ver ProgramCache)
+		bool linkProgram(const Uints &shids, std::ostream &error_output, bool retrievable = false);
+		// El enlace en dos partes: startLink crea el programa y pide al driver que lo enlace, y
+		// finishLink comprueba el resultado (si ha fallado, borra el programa y pone id a 0)
+		GLuint startLink(const Uints &shids, bool retrievable);
+		static bool isLinkDone(GLuint id);
+		static bool finishLink(GLuint &id, std::ostream &error_output);
+		// Si se puede usar la caché (cache), calcula la clave del programa (key) y lo busca en
+		// ella. Devuelve true si se ha cargado de la caché
+		bool loadCached(bool &cache, std::string &key);
+		// Guarda el programa recién enlazado en la caché (si cache) y conecta los UBO
+		void afterLink(bool cache, const std::string &key);
+		// Compila los programas por lotes (ver ShaderLibrary::compileAll)
+		friend class ShaderLibrary;
 		std::map<Shader::ShaderType, std::shared_ptr<Shader>> shaders;
 		std::vector<struct Attribute> attribs;
 		GLuint programId;
@@ -400,6 +461,20 @@ namespace PGUPV {
 		std::vector<std::string> transformVaryings;
 		bool transformInterleaved;
 
+		// Las subrutinas elegidas con setRoutine, por nombre
+		struct RoutineSelection {
+			Shader::ShaderType type;
+			std::string uniform, routine;
+		};
+		std::vector<RoutineSelection> routineSelections;
+		// Estado de una recarga en curso
+		struct Reload {
+			std::map<Shader::ShaderType, std::shared_ptr<Shader>> shaders;
+			GLuint programId = 0;
+			bool linking = false;
+		};
+		std::unique_ptr<Reload> reload;
+
 		static Program *prevProgram;
 	};
 
@@ -0,0 +1,75 @@
+#ifndef _PROGRAM_CACHE_H
+#define _PROGRAM_CACHE_H 2022
+
+#include <string>
+#include <GL/glew.h>
+
+namespace PGUPV {
+
+	/**
+	\class ProgramCache
+
+	Caché en disco de los programas ya enlazados (glGetProgramBinary, GL 4.1). Está
+	desactivada por defecto: si se activa con setEnabled, Program::compile busca en ella antes
+	de compilar, así que, a partir de la segunda ejecución, los programas se cargan sin
+	compilar ni enlazar ningún shader.
+
+	Cada programa se identifica por un resumen de (ver Program::cacheKey):
+	  - el código fuente de sus shaders tal y como se compila, es decir, después de procesar
+	    los $include y de sustituir las cadenas de Program::replaceString (incluidas las
+	    definiciones de los bloques, como $GLMatrices)
+	  - las posiciones de los atributos (Program::addAttributeLocation)
+	  - las variables del transform feedback (Program::setTransformFeedbackVaryings)
+	  - el fabricante, el modelo y la versión del driver de OpenGL
+	Si cambia cualquiera de ellos, el programa se vuelve a compilar, y se guarda con otro
+	nombre. Si el driver rechaza un binario, se borra y se compila el programa.
+
+	Los ficheros se guardan en el directorio indicado con setDirectory (por defecto,
+	programCache, dentro del directorio de trabajo). Cuando los binarios ocupan más de
+	setMaxSize (por defecto, 64 MB), al guardar uno se borran los más antiguos. clear vacía
+	la caché.
+
+	\warning Sólo se puede usar desde el hilo con el contexto OpenGL
+	*/
+	class ProgramCache {
+	public:
+		static void setEnabled(bool enable);
+		static bool isEnabled();
+		//! \return true si está activada y el driver permite leer los binarios de los programas
+		static bool isAvailable();
+		static void setDirectory(const std::string &dir);
+		static const std::string &getDirectory();
+		//! Tamaño máximo de los binarios guardados, en bytes
+		static void setMaxSize(size_t bytes);
+		static size_t getMaxSize();
+
+		/**
+		Crea un programa a partir del binario guardado con la clave indicada
+		\param key descripción completa del programa (ver Program::compile)
+		\return el identificador del programa enlazado, o 0 si no está en la caché
+		*/
+		static GLuint load(const std::string &key);
+		/**
+		Guarda el binario del programa, que se acaba de enlazar
+		\param key descripción completa del programa
+		\param programId el programa, creado con GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+		*/
+		static void store(const std::string &key, GLuint programId);
+		//! Borra todos los binarios guardados
+		static void clear();
+
+		struct Stats {
+			size_t hits = 0;		// programas cargados de la caché
+			size_t misses = 0;		// programas que no estaban en la caché
+			size_t rejected = 0;	// binarios que el driver no ha aceptado
+			size_t stored = 0;		// programas guardados
+			size_t evicted = 0;		// binarios borrados para no superar el tamaño máximo
+		};
+		static const Stats &getStats();
+		static void resetStats();
+	private:
+		ProgramCache() = delete;
+	};
+};
+
+#endif
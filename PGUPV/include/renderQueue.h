@@ -0,0 +1,220 @@
+#ifndef _RENDER_QUEUE_H
+#define _RENDER_QUEUE_H 2022
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <glm/mat4x4.hpp>
+
+namespace PGUPV {
+	class Node;
+	class Mesh;
+	class Program;
+	class BaseMaterial;
+	class GLMatrices;
+	class Instancing;
+
+	/**
+	Orden de dibujo de una malla, tal y como la guarda la RenderQueue
+	*/
+	struct DrawPacket {
+		uint64_t sortKey;		// ver RenderQueue
+		Program *program;
+		BaseMaterial *material;	// puede ser nullptr
+		Mesh *mesh;				// su VAO, huesos y órdenes de dibujo
+		Node *node;				// nodo del que viene la malla
+		glm::mat4 modelMatrix;	// matriz del modelo (del sistema de la malla al del mundo)
+	};
+
+	/**
+	\class RenderBackend
+	Destino de las órdenes de una RenderQueue. La cola ya elimina los cambios de estado
+	redundantes: cada llamada set* supone un cambio real
+	*/
+	class RenderBackend {
+	public:
+		virtual ~RenderBackend() = default;
+		virtual void begin() {};
+		virtual void setProgram(Program *program) = 0;
+		virtual void setMaterial(BaseMaterial *material) = 0;
+		//! Vincula el estado de la malla (VAO, huesos...)
+		virtual void setMesh(Mesh *mesh) = 0;
+		virtual void setModelMatrix(const glm::mat4 &modelMatrix) = 0;
+		//! Dibuja la malla vinculada
+		virtual void draw(const DrawPacket &packet) = 0;
+		/**
+		Dibuja la malla vinculada una vez por paquete, con la matriz del modelo de cada uno (los
+		paquetes sólo se diferencian en la matriz y el nodo). Por defecto, establece la
+		matriz y dibuja cada paquete por separado
+		*/
+		virtual void drawInstanced(const DrawPacket *packets, size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				setModelMatrix(packets[i].modelMatrix);
+				draw(packets[i]);
+			}
+		}
+		/**
+		Dibuja un nodo que no se puede descomponer en paquetes (p.e., un AnimationNode), con
+		la matriz del modelo ya establecida
+		*/
+		virtual void renderNode(Node *node) = 0;
+		virtual void end() {};
+	};
+
+	/**
+	\class GLRenderBackend
+	Ejecuta las órdenes de la cola con OpenGL, usando el GLMatrices vinculado. Si el programa
+	declara el atributo instanceMatrix (ver Instancing), drawInstanced dibuja todos los
+	paquetes con una sola orden instanciada
+	*/
+	class GLRenderBackend : public RenderBackend {
+	public:
+		GLRenderBackend();
+		~GLRenderBackend();
+		void begin() override;
+		void setProgram(Program *program) override;
+		void setMaterial(BaseMaterial *material) override;
+		void setMesh(Mesh *mesh) override;
+		void setModelMatrix(const glm::mat4 &modelMatrix) override;
+		void draw(const DrawPacket &packet) override;
+		void drawInstanced(const DrawPacket *packets, size_t n) override;
+		void renderNode(Node *node) override;
+		void end() override;
+		const Instancing &getInstancing() const { return *instancing; }
+	private:
+		std::shared_ptr<GLMatrices> mats;
+		std::unique_ptr<Instancing> instancing;
+		// El programa actual declara instanceMatrix
+		bool programInstancing;
+		std::vector<glm::mat4> instanceMatrices;
+	};
+
+	/**
+	\class RecordingRenderBackend
+	Backend que no dibuja nada: sólo cuenta los cambios de estado y guarda el orden en el
+	que se dibujan las mallas. Sirve para medir la cola sin GPU
+	*/
+	class RecordingRenderBackend : public RenderBackend {
+	public:
+		struct Counters {
+			size_t programChanges = 0;
+			size_t materialChanges = 0;
+			size_t meshChanges = 0;
+			size_t matrixChanges = 0;
+			size_t draws = 0;
+			size_t instancedDraws = 0;	// llamadas a drawInstanced (cuentan como un draw)
+			size_t instances = 0;		// paquetes dibujados con drawInstanced
+			size_t nodes = 0;
+		};
+		void setProgram(Program *) override { counters.programChanges++; }
+		void setMaterial(BaseMaterial *) override { counters.materialChanges++; }
+		void setMesh(Mesh *) override { counters.meshChanges++; }
+		void setModelMatrix(const glm::mat4 &) override { counters.matrixChanges++; }
+		void draw(const DrawPacket &packet) override {
+			counters.draws++;
+			drawn.push_back(packet);
+		}
+		void drawInstanced(const DrawPacket *packets, size_t n) override {
+			counters.draws++;
+			counters.instancedDraws++;
+			counters.instances += n;
+			drawn.insert(drawn.end(), packets, packets + n);
+		}
+		void renderNode(Node *node) override {
+			counters.nodes++;
+			nodes.push_back(node);
+		}
+
+		const Counters &getCounters() const { return counters; }
+		//! \return los paquetes dibujados, en orden
+		const std::vector<DrawPacket> &getDrawn() const { return drawn; }
+		const std::vector<Node *> &getNodes() const { return nodes; }
+		void reset() {
+			counters = Counters();
+			drawn.clear();
+			nodes.clear();
+		}
+	private:
+		Counters counters;
+		std::vector<DrawPacket> drawn;
+		std::vector<Node *> nodes;
+	};
+
+	/**
+	\class RenderQueue
+
+	Alternativa al dibujado inmediato del grafo de escena (Node::render), que dibuja los
+	nodos según se recorren. collect recorre el grafo y guarda un DrawPacket por cada malla
+	visible, con su matriz del modelo; submit los ordena por programa, material y malla, y
+	los envía al backend evitando los cambios de estado redundantes.
+
+	La clave de ordenación (DrawPacket::sortKey) tiene, de más a menos significativo, 16
+	bits para el programa, 24 para el material y 24 para la malla. Cada campo es el orden en
+	el que apareció ese programa, material o malla en la cola, así que el resultado es
+	estable entre frames si el grafo no cambia. Se ordena con radix sort.
+
+	Los nodos que no se pueden descomponer en mallas (AnimationNode) se dibujan después de
+	los paquetes, con Node::render.
+
+	Si está activado el instanciado (setInstancing, por defecto sí), los paquetes seguidos
+	con el mismo programa, material y malla (la misma malla referenciada desde varios nodos)
+	se envían juntos con RenderBackend::drawInstanced.
+
+	Ejemplo:
+
+	RenderQueue queue;
+	GLRenderBackend gl;
+	...
+	queue.clear();
+	program->use();
+	queue.collect(*scene->getRoot());
+	queue.submit(gl);
+	*/
+	class RenderQueue {
+	public:
+		//! Vacía la cola (conserva la memoria reservada)
+		void clear();
+		/**
+		Recorre el grafo desde root añadiendo las mallas de los nodos visibles. Cada malla se
+		dibuja con el programa del nodo más cercano que tenga uno (ver Node::setProgram) o,
+		si no hay ninguno, con program.
+		\param root raíz del (sub)grafo
+		\param program programa por defecto de las mallas (si es nullptr, el programa actual)
+		\param modelMatrix matriz del modelo de root
+		*/
+		void collect(Node &root, Program *program = nullptr, const glm::mat4 &modelMatrix = glm::mat4(1.0f));
+		//! Añade una malla a la cola
+		void add(Program *program, BaseMaterial *material, Mesh *mesh, Node *node, const glm::mat4 &modelMatrix);
+		//! Añade un nodo que se dibujará con Node::render después de los paquetes
+		void addNode(Program *program, Node *node, const glm::mat4 &modelMatrix);
+		/**
+		Ordena la cola y la envía al backend
+		*/
+		void submit(RenderBackend &backend);
+		//! Ordena la cola (submit ya la ordena)
+		void sort();
+		//! Activa o desactiva el envío agrupado de los paquetes con la misma malla (ver drawInstanced)
+		void setInstancing(bool enable) { instancing = enable; }
+		bool getInstancing() const { return instancing; }
+
+		size_t size() const { return packets.size(); }
+		//! \return los paquetes (ordenados, si se ha llamado a sort o submit)
+		const std::vector<DrawPacket> &getPackets() const { return packets; }
+		//! \return los nodos añadidos con addNode (sólo usan los campos program, node y modelMatrix)
+		const std::vector<DrawPacket> &getNodes() const { return nodes; }
+	private:
+		uint32_t rank(std::unordered_map<const void *, uint32_t> &ranks, const void *p);
+		std::vector<DrawPacket> packets, sorted;
+		std::vector<DrawPacket> nodes;
+		bool isSorted = true;
+		bool instancing = true;
+		std::unordered_map<const void *, uint32_t> programRanks, materialRanks, meshRanks;
+		struct SortEntry {
+			uint64_t key;
+			uint32_t index;
+		};
+		std::vector<SortEntry> entries, scratch;
+	};
+};
+
+#endif
@@ -14,6 +14,12 @@ namespace PGUPV {
 	class AnimationClip;
 	class BaseMaterial;
 	class Mesh;
+	class SceneBVH;
+	class RenderQueue;
+	class GLRenderBackend;
+	class StaticBatch;
+	class CullVisitor;
+	class OcclusionCuller;
 
 	/* Una escena es un objeto compuesto por diferentes nodos. Cada nodo contien un modelo, que puede
 	estar compuesto por varios Meshes, y diferentes modelos pueden compartir un mismo
@@ -92,8 +98,59 @@ namespace PGUPV {
 		*/
 		size_t getNumAnimations() const;
 		std::shared_ptr<AnimationClip> getAnimation(size_t index) const;
+
+		/**
+		\return la jerarquía de volúmenes de inclusión de la escena, actualizada con los
+		últimos cambios del grafo (se crea la primera vez que se pide)
+		*/
+		SceneBVH &getBVH();
+
+		/**
+		Cómo se dibuja la escena en render:
+		IMMEDIATE: recorriendo el grafo y dibujando cada nodo al llegar a él (Node::render)
+		RENDER_QUEUE: recogiendo las mallas en una RenderQueue, que las ordena para minimizar
+		  los cambios de estado antes de dibujarlas
+		STATIC_BATCH: agrupando las mallas en un StaticBatch, que las dibuja con unas pocas
+		  llamadas a glMultiDrawElementsIndirect. El lote se reconstruye cuando cambia el grafo
+		  o la matriz del modelo, así que sólo compensa con escenas estáticas
+		*/
+		enum class RenderMode { IMMEDIATE, RENDER_QUEUE, STATIC_BATCH };
+		void setRenderMode(RenderMode mode) { renderMode = mode; }
+		RenderMode getRenderMode() const { return renderMode; }
+		//! \return la cola que se usa en el modo RENDER_QUEUE (con las mallas del último frame)
+		RenderQueue &getRenderQueue();
+		/**
+		\return el lote que se usa en el modo STATIC_BATCH (con setProgram se indica el programa
+		con el que se dibuja, ver StaticBatch::prepareProgram)
+		*/
+		StaticBatch &getStaticBatch();
+		/**
+		Activa el descarte de los nodos que quedan fuera del volumen de la vista en los modos
+		IMMEDIATE y RENDER_QUEUE (ver CullVisitor). Usa las matrices del GLMatrices vinculado
+		*/
+		void setFrustumCulling(bool enable) { frustumCulling = enable; }
+		bool getFrustumCulling() const { return frustumCulling; }
+		//! \return el CullVisitor de la escena, con los contadores del último frame
+		CullVisitor &getCullVisitor();
+		/**
+		Activa el descarte de los nodos tapados por otros en el modo IMMEDIATE, con consultas de
+		oclusión (ver OcclusionCuller). Incluye el descarte de lo que queda fuera de la vista
+		*/
+		void setOcclusionCulling(bool enable) { occlusionCulling = enable; }
+		bool getOcclusionCulling() const { return occlusionCulling; }
+		//! \return el OcclusionCuller de la escena, con los contadores del último frame
+		OcclusionCuller &getOcclusionCuller();
 	private:
 		std::shared_ptr<Node> sceneRoot;
+		std::shared_ptr<SceneBVH> bvh;
+		RenderMode renderMode;
+		std::shared_ptr<RenderQueue> renderQueue;
+		std::shared_ptr<GLRenderBackend> glBackend;
+		std::shared_ptr<StaticBatch> staticBatch;
+		bool frustumCulling;
+		std::shared_ptr<CullVisitor> cullVisitor;
+		bool occlusionCulling;
+		std::shared_ptr<OcclusionCuller> occlusionCuller;
 		std::vector<std::shared_ptr<BaseMaterial>> materials;
 		std::vector<std::shared_ptr<AnimationClip>> animations;
 	};
@@ -0,0 +1,88 @@
+#ifndef _SCENE_BVH_H
+#define _SCENE_BVH_H 2022
+
+#include <memory>
+#include <vector>
+#include <cfloat>
+#include <glm/mat4x4.hpp>
+
+#include "boundingVolumes.h"
+#include "bvh.h"
+
+namespace PGUPV {
+	class Node;
+
+	/**
+	\class SceneBVH
+
+	Jerarquía de volúmenes de inclusión de los nodos hoja (Geode, AnimationNode...) de
+	un grafo de escena, en el sistema de coordenadas del mundo, para hacer consultas
+	espaciales (qué objetos están dentro de una caja, de una esfera, de la vista o
+	atraviesa un rayo) sin recorrer todo el grafo.
+
+	La jerarquía se mantiene con update(), que sólo visita las ramas del grafo que han
+	cambiado desde la llamada anterior (ver Node::getVersion): cambiar un Transform,
+	añadir un hijo con Group::addChild o sacar un nodo con Node::remove sólo actualiza
+	las hojas afectadas. Una hoja que se mueve poco sólo reajusta las cajas de sus
+	antecesores en la jerarquía; si se sale de su caja (que tiene un margen), se vuelve
+	a insertar. Cuando los cambios acumulados empeoran demasiado la jerarquía (su coste
+	SAH crece un 50% respecto a la última construcción), se reconstruye entera.
+
+	Ejemplo:
+
+	SceneBVH bvh(scene->getRoot());
+	...
+	bvh.update();
+	for (auto &item : bvh.queryFrustum(proj * view)) {
+		// item.node es visible, con la matriz del modelo item.modelMatrix
+	}
+
+	\warning Las consultas no tienen en cuenta la visibilidad de los nodos (Node::isVisible)
+	*/
+	class SceneBVH {
+	public:
+		explicit SceneBVH(std::shared_ptr<Node> root = nullptr);
+		~SceneBVH();
+		void setRoot(std::shared_ptr<Node> root);
+		std::shared_ptr<Node> getRoot() const;
+
+		/**
+		Actualiza la jerarquía con los cambios del grafo de escena desde la última llamada
+		*/
+		void update();
+
+		struct Item {
+			Node *node;
+			glm::mat4 modelMatrix;	// matriz que lleva el nodo al sistema del mundo
+			BoundingBox bb;			// caja del nodo en el sistema del mundo
+		};
+		struct RayHit {
+			Item item;
+			float distance;	// distancia (en unidades de ray.direction) a la que el rayo entra en la caja
+		};
+
+		//! \return los nodos cuya caja corta a la caja indicada
+		std::vector<Item> queryBox(const BoundingBox &bb) const;
+		//! \return los nodos cuya caja corta a la esfera indicada
+		std::vector<Item> querySphere(const BoundingSphere &bs) const;
+		/**
+		\param viewProj producto de las matrices de proyección y de la vista
+		\return los nodos cuya caja está (total o parcialmente) dentro del volumen de la vista
+		*/
+		std::vector<Item> queryFrustum(const glm::mat4 &viewProj) const;
+		/**
+		\return los nodos cuya caja atraviesa el rayo, ordenados de más cercano a más lejano
+		*/
+		std::vector<RayHit> queryRay(const Ray &ray, float tmax = FLT_MAX) const;
+
+		//! \return el número de nodos hoja en la jerarquía
+		size_t getNumItems() const;
+		//! \return la caja de toda la escena, en el sistema del mundo
+		BoundingBox getBB() const;
+	private:
+		class SceneBVHImpl;
+		std::unique_ptr<SceneBVHImpl> pimpl;
+	};
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
 #include <GL/glew.h>
 #include "common.h"
 
@@ -70,6 +71,11 @@ namespace PGUPV {
     \return el fichero desde donde se cargó (o la cadena vacía si se cargó desde memoria)
     */
     std::string getFilename()  const { return filename; };
+    /**
+    \return el código fuente tal y como se compila (con los $include y las cadenas de la tabla
+    de traducciones ya sustituidos)
+    */
+    const Strings &getSource() const { return src; }
 
     /**
     Devuelve la extensión de fichero por defecto del tipo de shader indicado.
@@ -90,6 +96,24 @@ namespace PGUPV {
       \return El identificador del shader compilado, o 0 si se produce algún error
       */
     GLuint compile();
+    /**
+      Envía el código fuente al driver y le pide que lo compile, sin esperar al resultado.
+      Con GL_KHR_parallel_shader_compile, el driver compila en sus propios hilos mientras la
+      aplicación sigue trabajando. compile() equivale a startCompile() + finishCompile()
+      */
+    void startCompile();
+    /**
+      \return true si el driver ha terminado de compilar el shader (siempre true si no
+      soporta GL_KHR_parallel_shader_compile: entonces finishCompile espera)
+      */
+    bool isCompileDone() const;
+    /**
+      Termina la compilación empezada con startCompile (esperando si es necesario)
+      \return El identificador del shader compilado, o 0 si se produce algún error
+      */
+    GLuint finishCompile();
+    //! \return si el driver puede compilar los shaders en paralelo (GL_KHR_parallel_shader_compile)
+    static bool isParallelCompileSupported();
     
     /**
     En el caso de que la compilación haya fallado, se puede recuperar el error de compilación mediante esta función.
@@ -113,11 +137,36 @@ namespace PGUPV {
     static std::string toFriendlyName(ShaderType type);
       
     /** 
-     \return La fecha de modificación del shader. Número de segundos desde 1/1/1970. Es 0 si 
-       el shader se cargó desde memoria
+     \return La fecha de modificación del shader (la más reciente entre su fichero y los que
+       incluye). Número de segundos desde 1/1/1970. Es 0 si el shader se cargó desde memoria
      */
       long long getModificationTime() { return modificationTime; }
 
+    /**
+    \return los ficheros de los que se ha leído el código fuente: el del shader (el primero)
+      y los que incluye con $include, directa o indirectamente. Vacío si se cargó desde memoria
+    */
+    const std::vector<std::string> &getSourceFiles() const { return sourceFiles; }
+    /**
+    \return el grafo de dependencias del shader: un par (fichero que incluye, fichero
+      incluido) por cada $include procesado
+    */
+    const std::vector<std::pair<std::string, std::string>> &getIncludes() const { return includes; }
+    /**
+    \return el fichero y la línea de donde procede la línea indicada del código fuente
+      compilado (p.e., "../recursos/shaders/luces.glsl:12")
+    \param line número de línea (empezando en 1) del código fuente del shader
+    */
+    std::string getSourceLocation(unsigned int line) const;
+
+    /**
+    Los ficheros leídos (el del shader y los incluidos) se guardan en memoria, y sólo se
+    vuelven a leer si cambia su fecha de modificación o su tamaño. Esta función vacía esa caché
+    */
+    static void clearFileCache();
+    //! Olvida el fichero indicado, que se volverá a leer la próxima vez que se use
+    static void invalidateCachedFile(const std::string &filename);
+
   private:
     Shader();	// Usar las funciones factoría para crear un shader
     /**
@@ -126,21 +175,29 @@ namespace PGUPV {
     */
     static int check_extension(const std::string &filename);
 
+    // Origen de una línea del código fuente: índice en sourceFiles y número de línea
+    struct SourceLine {
+      unsigned int file;
+      unsigned int line;
+    };
+
     /**
-    Preprocesa el código fuente del shader cuyo código fuente está en src
-    */
-    static Strings preprocessShader(const Strings &src);
-    /**
-    Procesa una directiva $include, abriendo el fichero y escribiendo en contenido
-    al final del vector de cadenas indicado
+    Preprocesa el código fuente del fichero indicado, sustituyendo recursivamente las
+    directivas $include por el contenido del fichero (sólo una vez si el fichero tiene
+    #pragma once), y anotando de dónde procede cada línea y los ficheros incluidos
     */
-    static void processInclude(const std::string &line, Strings &dst);
+    void preprocessShader(const std::string &name, const Strings &src);
+    // Añade a la explicación del error de compilación el fichero y la línea de cada error
+    std::string annotateErrors(const std::string &log) const;
 
     Strings src; // Código fuente
     std::string filename; // Nombre del fichero desde donde se cargó (vacío si se cargó desde memoria)
     ShaderType type; // Tipo de shader
     GLuint shaderId;
     long long modificationTime; // Fecha de modificación del fichero (o 0 si se cargó desde memoria)
+    std::vector<std::string> sourceFiles; // El fichero del shader, y los que incluye
+    std::vector<SourceLine> lineMap; // Origen de cada línea de src (vacío si se cargó desde memoria)
+    std::vector<std::pair<std::string, std::string>> includes; // (fichero que incluye, incluido)
     std::string errorMsg; // Mensajes de error generados durante la compilación
   };
 };
@@ -5,14 +5,18 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <chrono>
+#include <string>
 
 #include "common.h"
 
 namespace PGUPV {
   class Program;
+  class FileWatcher;
   class ShaderLibrary {
   public:
     ShaderLibrary();
+    ~ShaderLibrary();
     void add(Program *shader);
     void remove(Program *shader);
     // Returns the number of registered programs
@@ -25,8 +29,64 @@ namespace PGUPV {
     \param verbose si true, imprime más información, como por ejemplo la lista de extensiones
     */
     void printInfoShaders(std::ostream &os = std::cout, bool verbose = false);
+
+    /**
+    Activa la recarga automática de los programas: cuando cambia el fichero de un shader, o
+    alguno de los que incluye, se vuelve a compilar el programa en segundo plano (en paralelo,
+    si el driver soporta GL_KHR_parallel_shader_compile) y, cuando está listo, sustituye al
+    anterior al principio de un frame. Si no compila, se muestra el error y se sigue usando
+    el programa anterior. También se activa con la opción -hotreload de la línea de comandos
+    */
+    void setHotReload(bool enable);
+    bool isHotReload() const { return hotReload; }
+    /**
+    Comprueba si han cambiado los ficheros de los shaders y avanza las recargas en curso.
+    App la llama al principio de cada frame
+    */
+    void update();
+
+    /**
+    Compila a la vez todos los programas registrados que tienen shaders cargados y aún no están
+    compilados. Primero manda a compilar todos los shaders y, después, enlaza cada programa en
+    cuanto sus shaders están listos, sin esperar a los demás. Si el driver soporta
+    GL_KHR_parallel_shader_compile, compila en varios hilos (ver setCompilerThreads).
+    Los errores se muestran en el log, y los programas que fallan se quedan sin compilar (al
+    usarlos, Program::compile lanzará una excepción con el error).
+    App la llama antes de dibujar el primer frame, así que basta con cargar los programas en
+    setup (loadFiles) sin llamar a compile (ver el ejemplo Lighting). Si setup necesita un
+    programa compilado (p.ej., para pedir la posición de un uniform), se puede llamar desde
+    setup, después de cargar todos los programas.
+    \return el número de programas que no se han podido compilar
+    */
+    size_t compileAll();
+    /**
+    Número de hilos que el driver puede usar para compilar (glMaxShaderCompilerThreadsKHR). Por
+    defecto, 0xFFFFFFFF (lo decide el driver). Con 0, compila en el hilo de la aplicación
+    */
+    void setCompilerThreads(unsigned int n) { compilerThreads = n; }
+    unsigned int getCompilerThreads() const { return compilerThreads; }
+
+    // Tiempos de compilación de un programa en compileAll
+    struct CompileTiming {
+      std::string name;   // fichero del primer shader (o "(memoria)")
+      float compileMs;    // desde que se mandan a compilar todos los shaders hasta que los del programa están listos
+      float linkMs;       // enlace
+      bool cached;        // se ha cargado de ProgramCache
+      bool ok;
+    };
+    //! \return los tiempos de la última llamada a compileAll, por programa
+    const std::vector<CompileTiming> &getCompileTimings() const { return timings; }
   private:
+    void refreshWatchList();
+
     std::vector<Program *> library;
+    bool hotReload;
+    std::unique_ptr<FileWatcher> watcher;
+    // Programas que se están recargando, y programas que han cambiado durante su recarga
+    std::vector<Program *> reloading, dirty;
+    std::chrono::steady_clock::time_point lastWatchRefresh;
+    unsigned int compilerThreads;
+    std::vector<CompileTiming> timings;
   };
 };
 
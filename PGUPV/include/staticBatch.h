@@ -0,0 +1,145 @@
+#ifndef _STATIC_BATCH_H
+#define _STATIC_BATCH_H 2022
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <string>
+#include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+
+#include "common.h"
+#include "renderQueue.h"
+
+namespace PGUPV {
+	class Node;
+	class Mesh;
+	class Program;
+	class BaseMaterial;
+	class BufferObject;
+	class VertexArrayObject;
+	class MultiDrawElementsIndirect;
+
+	/**
+	\class StaticBatch
+
+	Agrupa las mallas estáticas de un grafo de escena en unos pocos buffers compartidos, para
+	dibujarlas con glMultiDrawElementsIndirect en vez de con una llamada por malla.
+
+	build recorre el grafo (como RenderQueue::collect) y reparte las mallas en grupos con el
+	mismo formato de vértice (mismos atributos, con el mismo número de componentes). Cada
+	grupo tiene un VAO con los atributos de todas sus mallas concatenados, un buffer de
+	índices (GL_UNSIGNED_INT, como lista de triángulos) y un buffer de órdenes de dibujo
+	indirectas, ordenadas por material. Las matrices del modelo de cada dibujo, y el índice
+	de su material, se guardan en un shader storage buffer (ver definition), que el shader
+	indexa con el atributo batchDrawId.
+
+	Para cada grupo y material se hace material->use() y un glMultiDrawElementsIndirect.
+
+	Sólo se agrupan las mallas que:
+	  - dibujan únicamente triángulos
+	  - no tienen huesos
+	  - conservan la copia en memoria principal de sus atributos (Mesh::CpuCopyPolicy; por
+	    defecto no se conserva, así que llama a Mesh::setDefaultCpuCopyPolicy antes de cargar)
+	  - sólo usan los atributos estándar (VERTICES...TANGENTS), o valores estáticos de ellos
+	  - no tienen un programa propio (Node::setProgram) distinto del actual al construir
+	El resto (y los AnimationNode) se dibujan con una RenderQueue, con el programa actual o
+	con el suyo propio.
+
+	Las matrices se calculan al construir el lote: si el grafo cambia hay que volver a
+	llamar a build (isUpToDate lo detecta con la versión de la raíz y la de cada malla, ver
+	Node::getVersion y Mesh::getVersion).
+
+	Uso en el shader de vértices (preparado con prepareProgram):
+
+	$GLMatrices
+	$StaticBatch
+	in vec4 position;
+	in uint batchDrawId;
+	void main() {
+	  BatchDraw d = batchDraws[batchDrawId];
+	  gl_Position = projMatrix * viewMatrix * d.modelMatrix * position;
+	  ...
+	}
+
+	\warning Necesita OpenGL 4.3 (glMultiDrawElementsIndirect y shader storage buffers)
+	*/
+	class StaticBatch {
+	public:
+		//! Índice del atributo (entero, uno por dibujo) con la posición del dibujo en batchDraws
+		static const GLuint DRAW_ID_ATTRIBUTE = 15;
+		static const std::string blockName;
+		//! Declaración GLSL del shader storage buffer con los datos de cada dibujo
+		static const Strings definition;
+		/**
+		Sustituye $StaticBatch por definition en los shaders del programa y asocia el
+		atributo batchDrawId a DRAW_ID_ATTRIBUTE. Llamar antes de compilar el programa
+		*/
+		static void prepareProgram(Program &program);
+		//! \return true si la implementación soporta lo necesario para dibujar los lotes
+		static bool isSupported();
+
+		StaticBatch();
+		~StaticBatch();
+		/**
+		Construye los lotes con las mallas del grafo (descarta los anteriores)
+		\param root raíz del (sub)grafo
+		\param modelMatrix matriz del modelo de root
+		*/
+		void build(Node &root, const glm::mat4 &modelMatrix = glm::mat4(1.0f));
+		//! Libera los lotes
+		void clear();
+		//! \return true si el lote se construyó con ese grafo y esa matriz, y no ha cambiado desde entonces
+		bool isUpToDate(const Node &root, const glm::mat4 &modelMatrix) const;
+		/**
+		Dibuja los lotes con el programa establecido con setProgram (o el actual, si no hay),
+		y después, con el programa actual, las mallas que no se han podido agrupar
+		*/
+		void render();
+		/**
+		Establece el programa con el que se dibujarán los lotes (preparado con prepareProgram).
+		Si es nullptr, se usa el programa actual
+		*/
+		void setProgram(std::shared_ptr<Program> program) { batchProgram = program; }
+
+		struct Stats {
+			size_t groups = 0;			// formatos de vértice distintos (un VAO por cada uno)
+			size_t batchedMeshes = 0;	// mallas distintas copiadas a los lotes
+			size_t batchedDraws = 0;	// dibujos en los lotes (una malla puede aparecer varias veces)
+			size_t multiDraws = 0;		// llamadas a glMultiDrawElementsIndirect por frame
+			size_t leftoverDraws = 0;	// mallas que se dibujan con la RenderQueue
+			size_t leftoverNodes = 0;	// nodos que se dibujan con Node::render
+			size_t vertices = 0;
+			size_t indices = 0;
+			size_t bytes = 0;			// memoria de la GPU ocupada por los lotes
+		};
+		const Stats &getStats() const { return stats; }
+		//! \return los materiales de los lotes (BatchDraw::materialIndex es la posición en este vector)
+		const std::vector<BaseMaterial *> &getMaterials() const { return materials; }
+	private:
+		StaticBatch(const StaticBatch &) = delete;
+		StaticBatch &operator=(const StaticBatch &) = delete;
+		// Componentes de cada atributo estándar de los vértices (0: la malla no lo tiene)
+		typedef std::array<uint, 8> VertexFormat;
+		// false si la malla no se puede agrupar
+		static bool getVertexFormat(Mesh &mesh, VertexFormat &format);
+		// Añade a dst los valores del atributo para todos los vértices de la malla
+		static void appendAttribute(const Mesh &mesh, uint attribute, uint ncomponents, std::vector<float> &dst);
+
+		struct Group;
+		std::vector<std::unique_ptr<Group>> groups;
+		std::shared_ptr<BufferObject> drawData;
+		std::vector<BaseMaterial *> materials;
+		RenderQueue leftovers;
+		std::shared_ptr<GLRenderBackend> glBackend;
+		std::shared_ptr<Program> batchProgram;
+		const Node *builtRoot;
+		uint64_t builtVersion;
+		// Versión de cada malla recogida al construir el lote
+		std::vector<std::pair<const Mesh *, uint64_t>> builtMeshes;
+		glm::mat4 builtMatrix;
+		Stats stats;
+	};
+};
+
+#endif
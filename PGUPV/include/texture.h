@@ -19,7 +19,8 @@ public:
           const glm::vec4 &bordercolor = glm::vec4(0.0, 0.0, 0.0, 0.0));
   explicit Texture(Texture &&other) = default;
 
-  virtual ~Texture(){};
+  // Saca la textura de TextureCache, si está
+  virtual ~Texture();
 
   // Establece los filtros de minimización/maximización
   void setMinFilter(GLenum filter);
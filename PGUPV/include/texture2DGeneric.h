@@ -2,6 +2,9 @@
 #ifndef _TEXTURE2DGENERIC_H
 #define _TEXTURE2DGENERIC_H 2014
 
+#include <memory>
+#include <vector>
+
 #include "texture.h"
 #include "common.h"
 
@@ -30,9 +33,27 @@ namespace PGUPV {
      \param filename nombre y ruta (absoluta o relativa) del fichero a cargar
 	 \param internalFormat (opcional) establece el formato de los píxeles (GL_RGB, GL_RGBA...)
      \return true en caso de haber podido cargar la imagen.
+	 Si otra textura viva ya tiene la imagen del fichero, con el mismo formato, la copia en la
+	 GPU en lugar de volver a leer el fichero (ver TextureCache)
      */
     virtual bool loadImage(const std::string &filename, GLenum internalFormat = GL_RGB);
 
+	/**
+	Como loadImage(const std::string &, GLenum), pero si hay que leer el fichero, usa la imagen
+	ya decodificada (p.e., por ImageLoader)
+	\param filename nombre del fichero del que se ha decodificado la imagen
+	\param decoded la imagen del fichero
+	\param internalFormat establece el formato de los píxeles (GL_RGB, GL_RGBA...)
+	*/
+	bool loadImage(const std::string &filename, const Image &decoded, GLenum internalFormat);
+
+	/**
+	Carga los mipmaps de la textura, generados en la CPU (ver ImageLoader::buildMipmaps), en
+	lugar de pedírselos a OpenGL con generateMipmap. Hay que cargar antes el nivel 0
+	\param levels imágenes de los niveles 1, 2...
+	*/
+	void loadMipmaps(const std::vector<std::unique_ptr<Image>> &levels);
+
     /**
      Función para cargar el objeto Image al objeto textura.
      \param image Imagen a cargar
@@ -126,6 +147,7 @@ namespace PGUPV {
 	static void save(const std::string &filename, GLuint texId, unsigned int bpp);
   protected:
     void setParams();
+	bool loadFile(const std::string &filename, GLenum internalFormat, const Image *decoded);
     uint _width, _height;
   };
 
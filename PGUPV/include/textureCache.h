@@ -0,0 +1,126 @@
+#ifndef _TEXTURE_CACHE_H
+#define _TEXTURE_CACHE_H 2022
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+namespace PGUPV {
+	class Texture;
+	class Texture2D;
+	class TextureCubeMap;
+	class ImageLoader;
+
+	/**
+	\class TextureCache
+
+	Caché global de las texturas cargadas desde fichero. Cada entrada se identifica por la ruta
+	canónica del fichero (o ficheros, en los mapas cúbicos), su fecha de modificación y el
+	formato con el que se cargó, y apunta a una textura viva, sin mantenerla en memoria: cuando
+	la textura se destruye, la entrada desaparece. Si el fichero cambia, su fecha cambia, y la
+	siguiente carga lo vuelve a leer.
+
+	La caché se usa de dos formas:
+	  - getTexture2D y getTextureCubeMap devuelven la misma textura a todos los que la piden
+	    con los mismos parámetros (filtros, repetición y mipmaps). Es lo que hace AssimpWrapper
+	    con las texturas de los materiales, así que los materiales que usan el mismo fichero
+	    (p.e., un atlas) comparten la textura, y al volver a cargar el modelo no se vuelve a
+	    leer ni a subir nada
+	  - Texture2DGeneric::loadImage(const std::string &, GLenum) y TextureCubeMap::loadImages
+	    cargan la imagen en su propio objeto textura, pero si otra textura viva ya tiene la
+	    imagen, la copian en la GPU (glCopyImageSubData, GL 4.3) sin leer ni decodificar el
+	    fichero
+
+	Ejemplo:
+
+	auto t = TextureCache::getTexture2D("../recursos/imagenes/atlas.png");
+	...
+	auto s = TextureCache::getStats();
+	INFO(std::to_string(s.hits) + " aciertos, " + std::to_string(s.misses) + " fallos");
+
+	\warning Las texturas compartidas son el mismo objeto: si se modifican los parámetros de una,
+	se modifican los de todos los que la usan. Si se cambia su contenido con los métodos de
+	carga de la textura, la textura sale de la caché, pero no si se dibuja en ella (p.e., con un
+	FBO).
+	\warning Sólo se puede usar desde el hilo con el contexto OpenGL
+	*/
+	class TextureCache {
+	public:
+		/**
+		Devuelve una textura 2D con la imagen del fichero indicado. Si ya existe una con los
+		mismos parámetros, la devuelve sin cargar nada.
+		\param filename ruta del fichero
+		\param minfilter, magfilter, wrap_s, wrap_t parámetros de la textura (ver Texture2D)
+		\param mipmap si es true, se generan los mipmaps de la textura
+		\param internalFormat formato interno de la textura (ver Texture2DGeneric::loadImage)
+		\param images si no es nullptr, y hay que leer el fichero, se usa la imagen (y sus
+		  mipmaps, si tiene) ya decodificada por el ImageLoader
+		*/
+		static std::shared_ptr<Texture2D> getTexture2D(const std::string &filename,
+			GLenum minfilter = GL_LINEAR_MIPMAP_LINEAR, GLenum magfilter = GL_LINEAR,
+			GLenum wrap_s = GL_REPEAT, GLenum wrap_t = GL_REPEAT, bool mipmap = true,
+			GLenum internalFormat = GL_RGB, const ImageLoader *images = nullptr);
+		/**
+		Devuelve un mapa cúbico con las imágenes indicadas (ver TextureCubeMap::loadImages). Si
+		ya existe uno con los mismos parámetros, lo devuelve sin cargar nada.
+		*/
+		static std::shared_ptr<TextureCubeMap> getTextureCubeMap(const std::string &filename,
+			bool flipV = true, GLenum minfilter = GL_LINEAR, GLenum magfilter = GL_LINEAR,
+			GLenum wrap_s = GL_CLAMP_TO_EDGE, GLenum wrap_t = GL_CLAMP_TO_EDGE);
+
+		//! Una textura viva con la imagen buscada, y el tamaño y formato de su nivel 0
+		struct Source {
+			Texture *texture;
+			GLsizei width, height;
+			GLenum internalFormat;
+			// Formato y tipo de los píxeles compatibles con internalFormat, para reservar la
+			// textura de destino antes de copiar
+			GLenum format, type;
+		};
+		/**
+		Busca una textura viva con la imagen de los ficheros indicados, para copiarla en lugar
+		de volver a cargar los ficheros (usado por las clases de textura)
+		\param files ficheros de la imagen (uno, o las seis caras de un mapa cúbico)
+		\param target tipo de textura (GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP...)
+		\param internalFormat formato interno pedido al cargar (0 si se usó el sugerido por la imagen)
+		\param flipV si la imagen se invirtió verticalmente al cargarla
+		\param src la textura encontrada
+		\return true si se ha encontrado, y se puede copiar
+		*/
+		static bool find(const std::vector<std::string> &files, GLenum target, GLenum internalFormat,
+			bool flipV, Source &src);
+		/**
+		\return true si hay una textura viva con la imagen de los ficheros indicados (y por
+		tanto, cargarlos no necesita decodificarlos). Ver find
+		*/
+		static bool contains(const std::vector<std::string> &files, GLenum target, GLenum internalFormat,
+			bool flipV);
+		/**
+		Registra la textura, que se acaba de cargar desde los ficheros indicados (usado por las
+		clases de textura)
+		\param texture la textura, con su nivel 0 completo
+		\param width, height tamaño de la textura
+		\param actualFormat formato interno de la textura
+		*/
+		static void add(Texture &texture, const std::vector<std::string> &files, GLenum internalFormat,
+			bool flipV, GLsizei width, GLsizei height, GLenum actualFormat);
+		//! Saca la textura de la caché (se llama al cambiar su contenido y al destruirla)
+		static void forget(const Texture *texture);
+		//! Vacía la caché (las texturas no se destruyen, pero dejan de compartirse)
+		static void clear();
+
+		struct Stats {
+			size_t hits = 0;	// texturas compartidas devueltas por getTexture2D y getTextureCubeMap
+			size_t copies = 0;	// imágenes copiadas de otra textura, sin leer el fichero
+			size_t misses = 0;	// imágenes leídas del fichero
+			size_t entries = 0;	// texturas vivas en la caché
+		};
+		static Stats getStats();
+		static void resetStats();
+	private:
+		TextureCache() = delete;
+	};
+};
+
+#endif
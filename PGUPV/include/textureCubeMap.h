@@ -3,12 +3,15 @@
 #define _TEXTURECUBEMAP_H 2011
 
 #include <iostream>
+#include <vector>
 #include <GL/glew.h>
 #include "common.h"
 #include "texture.h"
 
 namespace PGUPV {
 
+class Image;
+
 /*
 \class TextureCubeMap
 
@@ -39,6 +42,13 @@ public:
   bool loadImage(GLenum face, std::string filename, bool flipV = true,
                  std::ostream *error_output = &std::cerr);
   /**
+  Carga una imagen ya decodificada en la cara indicada
+  \param face la cara del cubo (GL_TEXTURE_CUBE_MAP_POSITIVE_X...)
+  \param image la imagen (ya invertida verticalmente, si hace falta)
+  \return true si ya se han cargado las seis caras
+  */
+  bool loadImage(GLenum face, const Image &image);
+  /**
   Función para cargar todas las imágenes del mapa cúbico de una vez. Hay que
   proporcionar el nombre base de los ficheros, y debe seguir el siguiente
   formato:
@@ -56,9 +66,18 @@ public:
    \param error_output flujo donde escribir los posibles errores que se
       produzcan
    \return true si ha podido cargar todas las imágenes del mapa cúbico
+   Si otro mapa cúbico vivo ya tiene las mismas imágenes, las copia en la GPU en lugar de
+   volver a leer los ficheros (ver TextureCache). Si no, decodifica las seis imágenes en
+   paralelo (ver ImageLoader)
   */
   bool loadImages(std::string filename, bool flipV = true,
                   std::ostream *error_output = &std::cerr);
+  /**
+  Devuelve los nombres de los ficheros de las seis caras del mapa cúbico, en el orden
+  GL_TEXTURE_CUBE_MAP_POSITIVE_X, NEGATIVE_X, POSITIVE_Y... (ver loadImages)
+  \param filename Nombre base de los ficheros, incluyendo la extensión
+  */
+  static std::vector<std::string> getFaceFilenames(const std::string &filename);
   /* Carga un mapa cúbico almacenado en un fichero dds */
   bool loadDDS(std::string filename, std::ostream *error_output = &std::cerr);
 
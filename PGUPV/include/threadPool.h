@@ -0,0 +1,79 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H 2022
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+namespace PGUPV {
+
+	/**
+	\class ThreadPool
+
+	Conjunto de hilos trabajadores compartido por toda la librería. Se usa para
+	repartir entre los núcleos de la CPU tareas que no necesitan el contexto de
+	OpenGL (cálculo de normales, decodificación de imágenes, etc.).
+
+	Ejemplo:
+
+	auto &pool = ThreadPool::getInstance();
+	auto f = pool.submit([]() { ... });
+	...
+	f.get();
+
+	pool.parallelFor(0, n, [&](size_t begin, size_t end) {
+	  for (size_t i = begin; i < end; i++) ...
+	});
+
+	\warning Las tareas NO pueden hacer llamadas a OpenGL
+	*/
+	class ThreadPool {
+	public:
+		/**
+		\return el pool de hilos de la librería (se crea con tantos hilos como núcleos
+		tenga la máquina)
+		*/
+		static ThreadPool &getInstance();
+
+		/**
+		Crea un pool con el número de hilos indicado (si es 0, tantos como núcleos)
+		*/
+		explicit ThreadPool(unsigned int nthreads = 0);
+		~ThreadPool();
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+
+		//! \return el número de hilos trabajadores
+		unsigned int getNThreads() const { return static_cast<unsigned int>(workers.size()); }
+
+		/**
+		Encola una tarea para que la ejecute uno de los hilos trabajadores
+		\return un futuro para esperar a que termine la tarea (y recoger sus excepciones)
+		*/
+		std::future<void> submit(std::function<void()> task);
+
+		/**
+		Divide el rango [begin, end) en trozos de al menos minChunk elementos y los
+		ejecuta en paralelo. El hilo llamante también trabaja, y no se vuelve hasta que
+		se ha procesado todo el rango. Si la función lanza una excepción, se relanza en
+		el hilo llamante.
+		\param f función que procesa el subrango [b, e)
+		*/
+		void parallelFor(size_t begin, size_t end, const std::function<void(size_t b, size_t e)> &f,
+			size_t minChunk = 4096);
+
+	private:
+		void workerLoop();
+		std::vector<std::thread> workers;
+		std::queue<std::packaged_task<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool stopping;
+	};
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef _UNIFORM_STREAM_H
+#define _UNIFORM_STREAM_H 2022
+
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+
+#include "common.h"
+
+namespace PGUPV {
+	class BufferObject;
+
+	/**
+	\class UniformStream
+
+	Buffer circular para escribir bloques de uniforms que cambian en cada llamada de dibujo
+	(las matrices de GLMatrices, los huesos de un AnimationNode...) sin que el driver tenga
+	que esperar a que la GPU termine de usar el contenido anterior del UBO.
+
+	Es un buffer inmutable (glBufferStorage) mapeado de forma persistente y dividido en
+	varias regiones (tres por defecto). Cada escritura ocupa una zona nueva de la región
+	actual, que se vincula con glBindBufferRange. Al terminar el frame (endFrame) se pone
+	una valla (glFenceSync) en la región, y se pasa a la siguiente, esperando antes a que
+	la GPU haya terminado de leer de ella.
+
+	Para activarlo:
+
+	UniformStream::setCurrent(UniformStream::build());
+
+	A partir de ese momento, GLMatrices y AnimationNode escribirán en él en vez de en sus UBO.
+	Window::draw llama a endFrame al terminar cada frame.
+
+	\warning Necesita OpenGL 4.4 o la extensión GL_ARB_buffer_storage
+	*/
+	class UniformStream {
+	public:
+		/**
+		Construye el buffer.
+		\param bytesPerFrame tamaño de cada región (lo que se puede escribir en un frame sin esperar)
+		\param nFrames número de regiones (frames que la CPU puede ir por delante de la GPU)
+		*/
+		static std::shared_ptr<UniformStream> build(size_t bytesPerFrame = 1 << 20, uint nFrames = 3);
+		//! \return true si la implementación soporta buffers persistentes
+		static bool isSupported();
+		//! Establece el buffer que usará la librería (nullptr para volver a escribir en cada UBO)
+		static void setCurrent(std::shared_ptr<UniformStream> stream);
+		//! \return el buffer que está usando la librería, o nullptr
+		static UniformStream *getCurrent() { return current.get(); }
+
+		~UniformStream();
+
+		/**
+		Copia los datos en el buffer y los vincula al índice indicado del punto de vinculación
+		GL_UNIFORM_BUFFER. Para el resto de la librería (IndexedBindingPoint::getBound), el
+		buffer vinculado en ese índice sigue siendo owner.
+		\param owner el UBO al que corresponden los datos
+		\param index índice del punto de vinculación
+		\param data los datos a copiar
+		\param size número de bytes a copiar
+		\warning los datos sólo son válidos hasta que se reutilice la región (ver getGeneration)
+		*/
+		void bind(std::shared_ptr<BufferObject> owner, GLuint index, const void *data, size_t size);
+		/**
+		Copia los datos en el buffer
+		\return la posición de los datos dentro del buffer (getBuffer)
+		*/
+		GLintptr write(const void *data, size_t size);
+
+		//! Termina el frame: la siguiente escritura se hará en la siguiente región
+		void endFrame();
+		/**
+		\return un número que cambia cada vez que se pasa a una región nueva. Los datos
+		escritos con una generación anterior pueden haber sido sobrescritos
+		*/
+		uint64_t getGeneration() const { return generation; }
+		std::shared_ptr<BufferObject> getBuffer() const { return buffer; }
+
+		struct Stats {
+			uint64_t bytesWritten = 0;
+			uint64_t writes = 0;
+			uint64_t stalls = 0;		// veces que ha habido que esperar a la GPU
+			uint64_t overflows = 0;	// veces que se llenó una región antes de terminar el frame
+		};
+		const Stats &getStats() const { return stats; }
+	private:
+		UniformStream(size_t bytesPerFrame, uint nFrames);
+		UniformStream(const UniformStream &) = delete;
+		UniformStream &operator=(const UniformStream &) = delete;
+		// Pone la valla a la región actual y pasa a la siguiente
+		void nextRegion();
+
+		std::shared_ptr<BufferObject> buffer;
+		unsigned char *mapped;
+		size_t regionSize, head;
+		uint nRegions, region;
+		GLint alignment;
+		std::vector<GLsync> fences;
+		uint64_t generation;
+		Stats stats;
+
+		static std::shared_ptr<UniformStream> current;
+	};
+};
+
+#endif
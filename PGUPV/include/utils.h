@@ -48,6 +48,27 @@ namespace PGUPV {
 	// Devuelve la fecha y hora de modificación del fichero (en segundos desde 1/1/1970)
 	long long getFileModificationTime(const std::string &pathname);
 
+	/**
+	Sello de un fichero para detectar si ha cambiado: la fecha de modificación con la mayor
+	resolución que dé el sistema (nanosegundos en Linux y macOS), y el tamaño. Con sólo los
+	segundos, dos escrituras en el mismo segundo no se distinguirían
+	*/
+	struct FileStamp {
+		long long mtimeNs = 0;	// nanosegundos desde 1/1/1970
+		long long size = -1;
+		bool operator==(const FileStamp &other) const { return mtimeNs == other.mtimeNs && size == other.size; }
+		bool operator!=(const FileStamp &other) const { return !(*this == other); }
+	};
+	//! \return false si no se puede leer la información del fichero (p.e., no existe)
+	bool getFileStamp(const std::string &pathname, FileStamp &stamp);
+
+	/**
+	Devuelve la ruta absoluta del fichero, sin . ni .. (ni enlaces simbólicos, en Linux y
+	macOS). Si el fichero no existe, devuelve la ruta recibida
+	\param pathname Ruta (absoluta o relativa) de un fichero
+	*/
+	std::string getCanonicalPath(const std::string &pathname);
+
 	/**
 	Dada una ruta completa de fichero, devuelve el directorio (la parte de la cadena
 	antes de la última barra)
@@ -350,9 +371,11 @@ namespace PGUPV {
 	conjunto de cadenas asociado al elemento del mapa.
 	\param transTable Tabla de traducciones. Las variables a expandir empiezan por $ y no tienen espacios
 	\param org Texto a expandir
+	\param origin si no es nulo, se escribe en él, para cada línea del resultado, el índice
+	  de la línea de org de la que procede
 	*/
 	Strings expandText(const std::map<std::string, Strings> &transTable,
-		const Strings &org);
+		const Strings &org, std::vector<size_t> *origin = nullptr);
 
 
 	std::string to_string(float f, uint ndecimals = 3);
@@ -0,0 +1,59 @@
+#ifndef _VERTEX_WELDER_H
+#define _VERTEX_WELDER_H 2022
+
+#include <vector>
+#include <cstddef>
+
+#include "common.h"
+
+namespace PGUPV {
+
+	/**
+	\class VertexWelder
+
+	Busca los vértices de una malla que ocupan la misma posición (a una distancia
+	menor que epsilon), aunque sean vértices distintos porque tengan otros atributos
+	diferentes (normales, coordenadas de textura...).
+
+	Los vértices se reparten en una rejilla regular con celdas de lado 2*epsilon, así que
+	dos vértices iguales siempre están en la misma celda o en celdas vecinas. Para cada
+	vértice sólo se comprueban las 8 celdas más cercanas, con lo que el coste es lineal
+	en el número de vértices. La relación "estar a menos de epsilon" se cierra
+	transitivamente (si a~b y b~c, a, b y c acaban en el mismo grupo).
+
+	Ejemplo:
+
+	VertexWelder welder(1e-3f);
+	auto rep = welder.weld(&vertices[0].x, 3, vertices.size());
+	// rep[i] == rep[j] si los vértices i y j están en la misma posición
+	*/
+	class VertexWelder {
+	public:
+		/**
+		\param epsilon distancia máxima entre dos vértices para considerarlos iguales
+		*/
+		explicit VertexWelder(float epsilon = 1e-3f);
+
+		/**
+		Agrupa los vértices que están en la misma posición. Sólo se tienen en cuenta las
+		tres primeras componentes de cada vértice (x, y, z).
+		\param vertices puntero a las coordenadas de los vértices
+		\param ncomponents número de floats de cada vértice (1 a 4)
+		\param n número de vértices
+		\return para cada vértice, el índice del representante de su grupo (el vértice de
+		  menor índice del grupo). Un vértice sin duplicados es su propio representante
+		*/
+		std::vector<uint> weld(const float *vertices, uint ncomponents, size_t n) const;
+
+		/**
+		\return el número de grupos distintos en el resultado de weld
+		*/
+		static size_t countGroups(const std::vector<uint> &representatives);
+
+		float getEpsilon() const { return epsilon; }
+	private:
+		float epsilon;
+	};
+};
+
+#endif
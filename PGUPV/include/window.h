@@ -41,6 +41,7 @@ namespace PGUPV {
 	class LineChartWidget;
 	class Label;
 	class LogConsole;
+	class FrameCapture;
 
 	class Window {
 	public:
@@ -144,6 +145,15 @@ namespace PGUPV {
 		 ventana */
 		bool saveColorBuffer(const std::string &filename,
 			GLint framebuffer = GL_FRONT);
+		/** Como saveColorBuffer, pero sin detener la aplicación: la imagen se lee unos frames
+		 después y se escribe en otro hilo (ver FrameCapture)
+		 \return false si se ha descartado la captura */
+		bool captureColorBuffer(const std::string &filename,
+			GLint framebuffer = GL_FRONT);
+		//! \return el capturador de frames de la ventana, para configurarlo (se crea al pedirlo)
+		FrameCapture &getFrameCapture();
+		//! Espera a que se guarden todas las capturas pendientes
+		void flushCaptures();
 		// Devuelve el número de bits por cada elemento del stencil del framebuffer
 		// asociado a GL_READ_BUFFER
 		uint getStencilSize();
@@ -214,6 +224,7 @@ namespace PGUPV {
 		GLint _redBits, _greenBits, _blueBits, _alphaBits, _depthBits, _stencilBits;
 		uint _width, _height;
 		std::unique_ptr<LogConsole> console;
+		std::unique_ptr<FrameCapture> frameCapture;
 		Observable<std::string>::SubscriptionId consoleSubs;
 
 		// Panel de estadísticas
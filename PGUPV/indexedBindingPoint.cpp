@@ -29,6 +29,21 @@ std::shared_ptr<BufferObject> IndexedBindingPoint::bindBufferRange(std::shared_p
   return prev;
 }
 
+std::shared_ptr<BufferObject> IndexedBindingPoint::bindBufferRange(std::shared_ptr<BufferObject> owner, GLuint index,
+  std::shared_ptr<BufferObject> storage, GLintptr offset, GLsizeiptr size) {
+  assert(owner && storage);
+  if (ulong(offset + size) > storage->getSize())
+    ERRT("Intentando vincular una zona de memoria fuera del buffer");
+  auto prev = getBound(index);
+
+  glBindBufferRange(GL_bindingPoint, index, storage->getId(), offset, size);
+
+  // glBindBufferRange también vincula storage al punto genérico
+  boundBOs[index] = owner;
+  bound = storage;
+  return prev;
+}
+
 std::shared_ptr<BufferObject> IndexedBindingPoint::bindBufferBase(std::shared_ptr<BufferObject> bo, GLuint index) {
   assert(bo);
   auto prev = getBound(index);
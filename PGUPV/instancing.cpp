@@ -0,0 +1,109 @@
+#include <algorithm>
+
+#include "instancing.h"
+#include "mesh.h"
+#include "program.h"
+#include "drawCommand.h"
+#include "bufferObject.h"
+#include "bindingPoint.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::Instancing;
+using PGUPV::Mesh;
+using PGUPV::Program;
+using PGUPV::BufferObject;
+
+namespace {
+	// Tamaño inicial del buffer de instancias (en matrices)
+	const size_t INITIAL_INSTANCES = 1024;
+};
+
+const std::string Instancing::blockName{ "Instancing" };
+
+const Strings Instancing::definition{
+"layout (location=" + std::to_string(MATRIX_ATTRIBUTE) + ") in mat4 instanceMatrix;",
+"mat4 instanceModelMatrix() { return modelMatrix * instanceMatrix; }",
+"mat4 instanceModelviewMatrix() { return viewMatrix * instanceModelMatrix(); }",
+"mat3 instanceNormalMatrix() { return transpose(inverse(mat3(instanceModelviewMatrix()))); }",
+};
+
+void Instancing::prepareProgram(Program &program) {
+	program.replaceString("$" + blockName, definition);
+	resetInstanceMatrix();
+}
+
+void Instancing::resetInstanceMatrix() {
+	for (GLuint i = 0; i < 4; i++) {
+		glm::vec4 column(0.0f);
+		column[i] = 1.0f;
+		glVertexAttrib4fv(MATRIX_ATTRIBUTE + i, &column.x);
+	}
+}
+
+bool Instancing::isInstancingProgram(const Program &program) {
+	if (!program.getId())
+		return false;
+	return glGetAttribLocation(program.getId(), "instanceMatrix") == (GLint)MATRIX_ATTRIBUTE;
+}
+
+bool Instancing::canInstance(const Mesh &mesh) {
+	const auto &commands = mesh.getDrawCommands();
+	if (commands.empty())
+		return false;
+	for (auto d : commands) {
+		if (!d->supportsInstancing())
+			return false;
+	}
+	return true;
+}
+
+Instancing::Instancing() : head(0) {
+}
+
+Instancing::~Instancing() {
+}
+
+void Instancing::draw(Mesh &mesh, const glm::mat4 *matrices, size_t n) {
+	if (n == 0)
+		return;
+	size_t bytes = n * sizeof(glm::mat4);
+	if (!buffer || bytes > buffer->getSize()) {
+		size_t size = std::max(bytes, std::max(2 * (buffer ? buffer->getSize() : 0), INITIAL_INSTANCES * sizeof(glm::mat4)));
+		buffer = BufferObject::build(size, GL_STREAM_DRAW);
+		buffer->setGlDebugLabel("Instancing");
+		head = 0;
+		gl_array_buffer.bind(buffer);
+	}
+	else {
+		gl_array_buffer.bind(buffer);
+		if (head + bytes > buffer->getSize()) {
+			// El driver nos da memoria nueva, sin esperar a que la GPU termine con la anterior
+			glBufferData(GL_ARRAY_BUFFER, buffer->getSize(), nullptr, GL_STREAM_DRAW);
+			head = 0;
+			stats.orphans++;
+		}
+	}
+	gl_array_buffer.write(matrices, bytes, head);
+
+	// Los atributos se conectan en el VAO de la malla, y se desconectan al terminar para
+	// que no afecten a sus otros dibujos
+	for (GLuint i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(MATRIX_ATTRIBUTE + i);
+		glVertexAttribPointer(MATRIX_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+			reinterpret_cast<const void *>(head + i * sizeof(glm::vec4)));
+		glVertexAttribDivisor(MATRIX_ATTRIBUTE + i, 1);
+	}
+	for (auto d : mesh.getDrawCommands())
+		d->renderInstanced(static_cast<GLsizei>(n));
+	for (GLuint i = 0; i < 4; i++) {
+		glVertexAttribDivisor(MATRIX_ATTRIBUTE + i, 0);
+		glDisableVertexAttribArray(MATRIX_ATTRIBUTE + i);
+	}
+	resetInstanceMatrix();
+	CHECK_GL();
+
+	head += bytes;
+	stats.draws++;
+	stats.instances += n;
+}
@@ -31,7 +31,7 @@ Log &Log::getInstance() {
 	return *theInstance;
 }
 
-Log::Log() : logFullFilepath(false) {
+Log::Log() : logFullFilepath(false), mainThread(std::this_thread::get_id()) {
 #ifdef _DEBUG
 	notification_level = INFO_LEVEL;
 #else
@@ -142,19 +142,42 @@ void Log::writeErrorLog(const std::string &str, int level) {
 
 	msg << std::endl;
 
+	std::vector<std::string> pending;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
 #ifdef _DEBUG
 #ifdef _WIN32
-	OutputDebugString(s2ws("   " + msg.str()).c_str());
+		OutputDebugString(s2ws("   " + msg.str()).c_str());
 #else
-	// Si estamos compilando en debug, mostrar por la consola los mensajes
-	std::cerr << msg.str();
+		// Si estamos compilando en debug, mostrar por la consola los mensajes
+		std::cerr << msg.str();
 #endif
 #endif
-	errLog << "[" << PGUPV::getCurrentDateTimeString() << "] " << msg.str();
+		errLog << "[" << PGUPV::getCurrentDateTimeString() << "] " << msg.str();
 
+		// Los observadores no son seguros entre hilos: se les avisa desde el principal
+		if (std::this_thread::get_id() != mainThread) {
+			pendingNotifications.push_back(msg.str());
+			return;
+		}
+		pending.swap(pendingNotifications);
+	}
+	for (const auto &p : pending)
+		notify(p);
 	notify(msg.str());
 }
 
+void Log::deliverNotifications() {
+	std::vector<std::string> pending;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.swap(pendingNotifications);
+	}
+	for (const auto &p : pending)
+		notify(p);
+}
+
 bool Log::openErrorLog() {
 	errLog.open(LOG_FILE_NAME, std::ios_base::app);
 	if (errLog.is_open()) {
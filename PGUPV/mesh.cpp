@@ -11,6 +11,8 @@
 #include "drawCommand.h"
 #include "uboBones.h"
 #include "skeleton.h"
+#include "vertexWelder.h"
+#include "normalGenerator.h"
 
 using PGUPV::Mesh;
 using PGUPV::BoundingBox;
@@ -21,12 +23,16 @@ using PGUPV::DrawCommand;
 using PGUPV::BufferObject;
 using PGUPV::UBOBones;
 using PGUPV::Skeleton;
+using PGUPV::VertexWelder;
+using PGUPV::NormalGenerator;
 
 using glm::vec2;
 using glm::vec3;
 using glm::vec4;
 
-Mesh::Mesh() : vbos(_LAST_), epsilonSquared(1e-6f) {
+Mesh::CpuCopyPolicy Mesh::defaultCpuCopyPolicy = Mesh::CpuCopyPolicy::DROP_CPU_COPY;
+
+Mesh::Mesh() : vbos(_LAST_), cpuCopies(_LAST_), cpuCopyPolicy(defaultCpuCopyPolicy), epsilonSquared(1e-6f) {
 	indices_type = 0;
 	n_indices = 0;
 	n_vertices = 0;
@@ -39,6 +45,7 @@ void Mesh::clearDrawCommands() {
 		SDELETE(drawCommands[i]);
 	}
 	drawCommands.clear();
+	version++;
 };
 
 // Devuelve la posición del centro de la caja de inclusión
@@ -97,6 +104,11 @@ void Mesh::createBufferAndCopy(uint attribIndex, size_t size, GLenum usage,
 		gl_array_buffer.bind(vbos[attribIndex]);
 		gl_array_buffer.write(data);
 	}
+
+	if (cpuCopyPolicy == CpuCopyPolicy::KEEP_CPU_COPY && data != nullptr) {
+		auto p = static_cast<const unsigned char *>(data);
+		cpuCopies[attribIndex].assign(p, p + size);
+	}
 }
 
 void Mesh::addVertices(const glm::vec2 *v, size_t n, GLenum usage) {
@@ -129,22 +141,65 @@ void Mesh::addVertices(const float *v, uint ncomponents, size_t nVertices,
 	bs = computeBoundingSphere(v, ncomponents, nVertices);
 }
 
-static glm::vec3 getVec3FromMemory(float *cs, uint ncomponents, uint which) {
-	ulong off = ncomponents * which;
-	if (ncomponents == 3 || ncomponents == 4) return glm::vec3(cs[off], cs[off + 1], cs[off + 2]);
-	else if (ncomponents == 2) return glm::vec3(cs[off], cs[off + 1], 0.0f);
-	else return glm::vec3(cs[off], 0.0f, 0.0f);
+bool Mesh::drawsOnlyTriangles() const {
+	for (auto drawCommand : drawCommands) {
+		GLenum mode = drawCommand->getGLPrimitiveType();
+		if (mode != GL_TRIANGLES && mode != GL_TRIANGLE_STRIP && mode != GL_TRIANGLE_FAN)
+			return false;
+	}
+	return true;
 }
 
+std::vector<uint> Mesh::getTriangleList() {
+	// Si tenemos copia en memoria principal de los índices, evitamos mapear el VBO (y la
+	// sincronización con la GPU que eso supone)
+	bool mapIndices = n_indices > 0 && !hasCpuCopy(INDICES);
 
+	void *indices;
+	if (n_indices == 0) {
+		indices = nullptr;
+	}
+	else if (!mapIndices) {
+		indices = cpuCopies[INDICES].data();
+	}
+	else {
+		gl_copy_read_buffer.bind(vbos[INDICES]);
+		indices = gl_copy_read_buffer.map(GL_READ_ONLY);
+	}
 
-bool Mesh::sameVertex(float *vs, uint ncomponents, uint a, uint b) {
-	float distance = 0.0;
-	for (uint i = 0; i < ncomponents; i++) {
-		float t = vs[ncomponents*  a + i] - vs[ncomponents*  b + i];
-		distance += t * t;
+	// Recopilamos los triángulos de todos los DrawCommands
+	std::vector<uint> tris;
+	for (auto drawCommand : drawCommands) {
+		auto ids = drawCommand->getTrianglesIndices(indices);
+		tris.reserve(tris.size() + 3 * ids.size());
+		for (auto &t : ids) {
+			assert(t.idx[0] < n_vertices && t.idx[1] < n_vertices && t.idx[2] < n_vertices);
+			tris.insert(tris.end(), t.idx, t.idx + 3);
+		}
+	}
+
+	if (mapIndices) {
+		gl_copy_read_buffer.unmap();
+		gl_copy_read_buffer.unbind();
+	}
+	return tris;
+}
+
+// Separa un array de vec2/vec3 en un array por componente
+template <typename V>
+static void toSoA(const std::vector<V> &v, std::vector<float> *dst) {
+	for (typename V::length_type c = 0; c < V::length(); c++) {
+		dst[c].resize(v.size());
+		for (size_t i = 0; i < v.size(); i++)
+			dst[c][i] = v[i][c];
 	}
-	return distance < epsilonSquared;
+}
+
+static std::vector<glm::vec3> fromSoA(const std::vector<float> *src) {
+	std::vector<glm::vec3> v(src[0].size());
+	for (size_t i = 0; i < v.size(); i++)
+		v[i] = glm::vec3(src[0][i], src[1][i], src[2][i]);
+	return v;
 }
 
 void Mesh::computeSmoothNormals() {
@@ -153,119 +208,57 @@ void Mesh::computeSmoothNormals() {
 		ERRT("Llama a Mesh::computeSmoothNormals *después* de haber definido "
 			"completamente la malla, con sus vértices, índices y drawCommands");
 	}
-	vao.bind();
 
-	void *indices;
-	if (n_indices == 0) {
-		indices = nullptr;
-	}
-	else {
-		auto idx = getBufferObject(INDICES);
-		gl_copy_write_buffer.bind(idx);
-		indices = gl_copy_write_buffer.map(GL_READ_ONLY);
-	}
-
-	// Conseguir los vértices
-	auto vtx = getBufferObject(VERTICES);
-	gl_copy_read_buffer.bind(vtx);
-	GLfloat *vs = static_cast<GLfloat *>(gl_copy_read_buffer.map(GL_READ_ONLY));
-
-	// Preguntar por su formato
-	GLint ncomponents;
-	GLint vtxFormat;
-	glGetVertexAttribiv(VERTICES, GL_VERTEX_ATTRIB_ARRAY_SIZE, &ncomponents);
-	glGetVertexAttribiv(VERTICES, GL_VERTEX_ATTRIB_ARRAY_TYPE, &vtxFormat);
+	addNormals(smoothNormals(getVertices(), getTriangleList(), sqrtf(epsilonSquared)));
+}
 
-	assert(vtxFormat == GL_FLOAT);
+std::vector<glm::vec3> Mesh::smoothNormals(const std::vector<glm::vec3> &vertices,
+	const std::vector<uint> &tris, float epsilon) {
+	std::vector<float> pos[3];
+	toSoA(vertices, pos);
 
-	std::vector<glm::vec3> smoothNormals(n_vertices, glm::vec3(0.0f, 0.0f, 0.0f));
-	std::vector<uint> count(n_vertices, 0);
+	NormalGenerator generator(pos[0].data(), pos[1].data(), pos[2].data(), vertices.size(),
+		tris.data(), tris.size() / 3);
 
-	// Para cada DrawCommand...
-	for (auto drawCommand : drawCommands) {
-		auto ids = drawCommand->getTrianglesIndices(indices);
-		for (auto t : ids) {
-			assert(t.idx[0] < n_vertices && t.idx[1] < n_vertices && t.idx[2] < n_vertices);
-			auto a = getVec3FromMemory(vs, ncomponents, t.idx[0]);
-			auto b = getVec3FromMemory(vs, ncomponents, t.idx[1]);
-			auto c = getVec3FromMemory(vs, ncomponents, t.idx[2]);
-
-			// Normal geométrica al triángulo
-			glm::vec3 un = glm::cross(b - a, c - a);
-			float module = glm::length(un);
-			if (module < 1e-5) {
-				// Triángulo degenerado: descartar
-				continue;
-			}
+	// Los vértices que sean geométricamente iguales, pero no semánticamente, compartirán normal
+	VertexWelder welder(epsilon);
+	generator.setVertexGroups(welder.weld(reinterpret_cast<const float *>(vertices.data()), 3, vertices.size()));
 
-			auto n = un / module;
+	std::vector<float> normals[3];
+	for (auto &c : normals) c.resize(vertices.size());
+	generator.computeNormals(normals[0].data(), normals[1].data(), normals[2].data());
 
-			// Acumulamos la normal a sus vértices, ponderada por el ángulo del vértice en cuestión
-			float ang[3] = {
-				acosf(glm::dot(glm::normalize(b - a), glm::normalize(c - a))),
-				acosf(glm::dot(glm::normalize(c - b), glm::normalize(a - b))),
-				acosf(glm::dot(glm::normalize(a - c), glm::normalize(b - c))) };
+	return fromSoA(normals);
+}
 
-			for (int i = 0; i < 3; i++) {
-				smoothNormals[t.idx[i]] += n * ang[i];
-				count[t.idx[i]]++;
-			}
-		}
+void Mesh::computeTangents(uint texUnit) {
+	if (drawCommands.empty()) {
+		ERRT("Llama a Mesh::computeTangents *después* de haber definido "
+			"completamente la malla, con sus vértices, índices y drawCommands");
 	}
-
-	// Segunda vuelta para buscar vértices que geométricamente sean iguales, pero no semánticamente
-	std::vector<GLuint> findDups(n_vertices);
-	for (uint i = 0; i < n_vertices; i++) {
-		findDups[i] = i;
+	if (getNNormals() == 0 || getNTexCoord(texUnit) == 0) {
+		ERRT("Mesh::computeTangents necesita que la malla tenga normales y coordenadas de textura");
 	}
 
-	std::sort(findDups.begin(), findDups.end(),
-		[vs, ncomponents](GLuint a, GLuint b) {  // ordenar primero por la x, luego por la y, y luego por la z
-		for (int i = 0; i < ncomponents; i++) {
-			float va = vs[ncomponents * a + i];
-			float vb = vs[ncomponents * b + i];
-			if (va < vb) return true;
-			if (va > vb) return false;
-		}
-		// son iguales: los dejamos como están
-		return false;
-	});
-
-	// Ahora buscamos vértices que sean iguales (sus índices estarán correlativos en el vector findDups)
-	uint firstInRun = 0;
-	for (uint i = 1; i < findDups.size(); i++) {
-		uint lastInRun = firstInRun;
-		while (i < findDups.size() && sameVertex(vs, ncomponents, findDups[i - 1], findDups[i])) {
-			lastInRun = i;
-			i++;
-		}
-		if (lastInRun - firstInRun >= 1) {
-			// Sumar todas las normales y asignarle el resultado a todos los vértices
-			glm::vec3 normalSum(0.0f);
-			for (uint j = firstInRun; j <= lastInRun; j++) {
-				normalSum += smoothNormals[findDups[j]];
-			}
-			for (uint j = firstInRun; j <= lastInRun; j++) {
-				smoothNormals[findDups[j]] = normalSum;
-			}
-		}
-		firstInRun = i;
-	}
+	auto tris = getTriangleList();
 
+	std::vector<float> pos[3], nrm[3], tc[2];
+	toSoA(getVertices(), pos);
+	toSoA(getNormals(), nrm);
+	toSoA(getTexCoords(texUnit), tc);
 
-	// Renormalizar
-	for (uint i = 0; i < smoothNormals.size(); i++) {
-		smoothNormals[i] = glm::normalize(smoothNormals[i]);
-	}
+	NormalGenerator generator(pos[0].data(), pos[1].data(), pos[2].data(), n_vertices,
+		tris.data(), tris.size() / 3);
 
-	if (n_indices > 0) {
-		gl_copy_write_buffer.unmap();
-		gl_copy_write_buffer.unbind();
-	}
-	gl_copy_read_buffer.unmap();
-	gl_copy_read_buffer.unbind();
+	std::vector<float> tangents[4];
+	for (auto &c : tangents) c.resize(n_vertices);
+	generator.computeTangents(nrm[0].data(), nrm[1].data(), nrm[2].data(), tc[0].data(), tc[1].data(),
+		tangents[0].data(), tangents[1].data(), tangents[2].data(), tangents[3].data());
 
-	addNormals(smoothNormals);
+	std::vector<glm::vec4> t(n_vertices);
+	for (size_t i = 0; i < n_vertices; i++)
+		t[i] = glm::vec4(tangents[0][i], tangents[1][i], tangents[2][i], tangents[3][i]);
+	addTangents(t);
 }
 
 void Mesh::addIndices(const GLubyte *i, size_t n, GLenum usage) {
@@ -349,6 +342,17 @@ void Mesh::addTangents(const float *t, size_t n, GLenum usage) {
 	glVertexAttribPointer(TANGENTS, 3, GL_FLOAT, GL_FALSE, 0, 0);
 }
 
+void Mesh::addTangents(const glm::vec4 *t, size_t n, GLenum usage) {
+	prepareNewVBO(TANGENTS);
+
+	if (n == 0)
+		return;
+
+	createBufferAndCopy(TANGENTS, sizeof(glm::vec4) * n, usage, t);
+	glEnableVertexAttribArray(TANGENTS);
+	glVertexAttribPointer(TANGENTS, 4, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
 void Mesh::setTangent(const glm::vec3 &t) {
 	setAttribute(TANGENTS, t);
 }
@@ -529,6 +533,7 @@ void Mesh::setAttribute(uint attribute_index, const glm::vec4 &a) {
 	if (attribute_index < vbos.size() && vbos[attribute_index]) {
 		// Había un buffer previamente configurado?
 		vbos[attribute_index].reset();
+		cpuCopies[attribute_index].clear();
 		WARN("Sobreescribiendo el buffer del atributo " +
 			std::to_string(attribute_index) + " con un valor estático");
 		vao.bind();
@@ -541,10 +546,12 @@ void Mesh::addStaticAttributeValue(GLint index, const glm::vec4 &val) {
 	for (uint i = 0; i < staticAttrValues.size(); i++) {
 		if (staticAttrValues[i].attrIndex == index) {
 			staticAttrValues[i].value = val;
+			version++;
 			return;
 		}
 	}
 	staticAttrValues.push_back(StaticAttribute(index, val));
+	version++;
 }
 
 bool Mesh::removeStaticAttributeValue(GLint index) {
@@ -552,6 +559,7 @@ bool Mesh::removeStaticAttributeValue(GLint index) {
 		i != staticAttrValues.end(); ++i) {
 		if (i->attrIndex == index) {
 			staticAttrValues.erase(i);
+			version++;
 			return true;
 		}
 	}
@@ -559,14 +567,21 @@ bool Mesh::removeStaticAttributeValue(GLint index) {
 }
 
 void Mesh::render() {
-	vao.bind();
+	bind();
 	if (material) material->use();
+	draw();
+}
+
+void Mesh::bind() {
+	vao.bind();
 	if (bones) bones->use();
 
 	for (std::vector<StaticAttribute>::iterator i = staticAttrValues.begin();
 		i != staticAttrValues.end(); ++i)
 		glVertexAttrib4fv(i->attrIndex, &i->value.x);
+}
 
+void Mesh::draw() {
 #ifdef _DEBUG
 	if (drawCommands.empty()) {
 		WARN("Intentando dibujar un Mesh sin comandos de dibujo (no se dibujará nada)");
@@ -591,7 +606,11 @@ size_t Mesh::getNTexCoord(int texUnit) const
 	return 0;
 }
 
-void Mesh::setMaterial(std::shared_ptr<BaseMaterial> m) { material = m; }
+void Mesh::setMaterial(std::shared_ptr<BaseMaterial> m) {
+	if (material != m)
+		version++;
+	material = m;
+}
 
 std::shared_ptr<BaseMaterial> Mesh::getMaterial() const {
 	return material;
@@ -632,7 +651,11 @@ void Mesh::prepareNewVBO(uint attribIndex) {
 	vao.bind();
 	if (attribIndex >= vbos.size()) {
 		vbos.resize(attribIndex + 1);
+		cpuCopies.resize(attribIndex + 1);
 	}
+	// La copia en memoria principal (si la hay) ya no se corresponde con el nuevo VBO
+	cpuCopies[attribIndex].clear();
+	version++;
 	if (removeStaticAttributeValue(attribIndex))
 		WARN("Sustituyendo un valor estático asociado al atributo " +
 			std::to_string(attribIndex) +
@@ -640,17 +663,82 @@ void Mesh::prepareNewVBO(uint attribIndex) {
 }
 
 
-void Mesh::addDrawCommand(DrawCommand *d) { drawCommands.push_back(d); }
+void Mesh::addDrawCommand(DrawCommand *d) {
+	drawCommands.push_back(d);
+	version++;
+}
 
-std::shared_ptr<BufferObject> Mesh::getBufferObject(BufferObjectType which) {
-	return vbos[which];
+std::shared_ptr<BufferObject> Mesh::getBufferObject(BufferObjectType which) const {
+	return getBufferObject(static_cast<int>(which));
+}
+
+
+std::shared_ptr<BufferObject> Mesh::getBufferObject(int attribute) const {
+	return vbos[attribute];
 }
 
+std::shared_ptr<BufferObject> Mesh::getMutableBufferObject(BufferObjectType which) {
+	return getMutableBufferObject(static_cast<int>(which));
+}
 
-std::shared_ptr<BufferObject> Mesh::getBufferObject(int attribute) {
+std::shared_ptr<BufferObject> Mesh::getMutableBufferObject(int attribute) {
+	// Quien pide el buffer object va a escribir en él: la copia ya no es fiable
+	cpuCopies[attribute].clear();
+	cpuCopies[attribute].shrink_to_fit();
+	version++;
 	return vbos[attribute];
 }
 
+void Mesh::setDefaultCpuCopyPolicy(CpuCopyPolicy p) {
+	defaultCpuCopyPolicy = p;
+}
+
+Mesh::CpuCopyPolicy Mesh::getDefaultCpuCopyPolicy() {
+	return defaultCpuCopyPolicy;
+}
+
+void Mesh::setCpuCopyPolicy(CpuCopyPolicy p) {
+	cpuCopyPolicy = p;
+	if (cpuCopyPolicy == CpuCopyPolicy::DROP_CPU_COPY)
+		releaseCpuCopy();
+}
+
+void Mesh::releaseCpuCopy() {
+	for (auto &c : cpuCopies) {
+		c.clear();
+		c.shrink_to_fit();
+	}
+}
+
+bool Mesh::hasCpuCopy(uint attribute) const {
+	return attribute < cpuCopies.size() && vbos[attribute] && !cpuCopies[attribute].empty();
+}
+
+size_t Mesh::getCpuCopySize() const {
+	size_t total = 0;
+	for (auto &c : cpuCopies)
+		total += c.size();
+	return total;
+}
+
+void Mesh::updateBoundingVolumes() {
+	if (n_vertices == 0) {
+		bb = BoundingBox();
+		bs = BoundingSphere();
+		return;
+	}
+	if (hasCpuCopy(VERTICES)) {
+		auto v = reinterpret_cast<const float *>(cpuCopies[VERTICES].data());
+		bb = computeBoundingBox(v, n_components_per_vertex, n_vertices);
+		bs = computeBoundingSphere(v, n_components_per_vertex, n_vertices);
+	}
+	else {
+		auto v = getVertices();
+		bb = computeBoundingBox(&v[0].x, 3, n_vertices);
+		bs = computeBoundingSphere(&v[0].x, 3, n_vertices);
+	}
+}
+
 void Mesh::setName(const std::string & n) {
 	name = n;
 }
@@ -666,12 +754,9 @@ const std::string Mesh::to_string() const {
 }
 
 template <typename V>
-std::vector<V> copyFromPFloatToVectorVec(std::shared_ptr<BufferObject> vbo, size_t count, int n_components = 3) {
-	auto prev = PGUPV::gl_copy_read_buffer.bind(vbo);
-	float *vb = static_cast<float *>(PGUPV::gl_copy_read_buffer.map(GL_READ_ONLY));
-	assert(vb != nullptr);
-
+std::vector<V> fromPFloatToVectorVec(const float *vb, size_t count, int n_components) {
 	std::vector<V> dst;
+	dst.reserve(count);
 	for (size_t i = 0; i < count; i++) {
 		V v;
 		for (typename V::length_type c = 0; c < V::length(); c++) {
@@ -685,6 +770,16 @@ std::vector<V> copyFromPFloatToVectorVec(std::shared_ptr<BufferObject> vbo, size
 		dst.push_back(v);
 		vb += n_components;
 	}
+	return dst;
+}
+
+template <typename V>
+std::vector<V> copyFromPFloatToVectorVec(std::shared_ptr<BufferObject> vbo, size_t count, int n_components = 3) {
+	auto prev = PGUPV::gl_copy_read_buffer.bind(vbo);
+	float *vb = static_cast<float *>(PGUPV::gl_copy_read_buffer.map(GL_READ_ONLY));
+	assert(vb != nullptr);
+
+	auto dst = fromPFloatToVectorVec<V>(vb, count, n_components);
 	PGUPV::gl_copy_read_buffer.unmap();
 	PGUPV::gl_copy_read_buffer.bind(prev);
 	return dst;
@@ -692,31 +787,56 @@ std::vector<V> copyFromPFloatToVectorVec(std::shared_ptr<BufferObject> vbo, size
 
 
 std::vector<glm::vec3> Mesh::getVertices() const {
+	if (hasCpuCopy(VERTICES))
+		return fromPFloatToVectorVec<glm::vec3>(reinterpret_cast<const float *>(cpuCopies[VERTICES].data()),
+			n_vertices, n_components_per_vertex);
 	auto dst = copyFromPFloatToVectorVec<glm::vec3>(vbos[VERTICES], n_vertices, n_components_per_vertex);
 	return dst;
 }
 
 std::vector<glm::vec3> Mesh::getNormals() const {
 	if (!vbos[NORMALS]) return std::vector<glm::vec3>();
+	if (hasCpuCopy(NORMALS))
+		return fromPFloatToVectorVec<glm::vec3>(reinterpret_cast<const float *>(cpuCopies[NORMALS].data()),
+			n_vertices, 3);
 	return copyFromPFloatToVectorVec<glm::vec3>(vbos[NORMALS], n_vertices);
 }
 
 std::vector<glm::vec2> Mesh::getTexCoords(unsigned int texCoordSet) const {
 	if (!vbos[TEX_COORD0 + texCoordSet]) return std::vector<glm::vec2>();
+	if (hasCpuCopy(TEX_COORD0 + texCoordSet))
+		return fromPFloatToVectorVec<glm::vec2>(reinterpret_cast<const float *>(cpuCopies[TEX_COORD0 + texCoordSet].data()),
+			n_vertices, 2);
 	return copyFromPFloatToVectorVec<glm::vec2>(vbos[TEX_COORD0 + texCoordSet], n_vertices, 2);
 }
 
 template <typename T>
 std::vector<unsigned int> fromPToTToVectorUint(const T *data, size_t count) {
 	std::vector<unsigned int> res;
+	res.reserve(count);
 	for (size_t i = 0; i < count; i++) {
 		res.push_back(data[i]);
 	}
 	return res;
 }
 
+static std::vector<unsigned int> fromPIndicesToVectorUint(const void *ids, GLenum type, size_t count) {
+	switch (type) {
+	case GL_UNSIGNED_BYTE:
+		return fromPToTToVectorUint(static_cast<const GLubyte *>(ids), count);
+	case GL_UNSIGNED_SHORT:
+		return fromPToTToVectorUint(static_cast<const GLushort *>(ids), count);
+	case GL_UNSIGNED_INT:
+		return fromPToTToVectorUint(static_cast<const GLuint *>(ids), count);
+	}
+	return std::vector<unsigned int>();
+}
+
 std::vector<unsigned int> Mesh::getIndices() const
 {
+	if (hasCpuCopy(INDICES))
+		return fromPIndicesToVectorUint(cpuCopies[INDICES].data(), indices_type, n_indices);
+
 	std::vector<unsigned int> dst;
 	auto prev = PGUPV::gl_copy_read_buffer.bind(vbos[INDICES]);
 
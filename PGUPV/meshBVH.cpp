@@ -0,0 +1,71 @@
+#include <glm/geometric.hpp>
+
+#include "meshBVH.h"
+#include "mesh.h"
+#include "log.h"
+
+using PGUPV::MeshBVH;
+using PGUPV::BoundingBox;
+using PGUPV::Ray;
+
+MeshBVH::MeshBVH(Mesh &mesh)
+{
+	if (!mesh.drawsOnlyTriangles())
+		ERRT("MeshBVH: la malla " + mesh.getName() + " dibuja primitivas que no son triángulos");
+	vertices = mesh.getVertices();
+	triangles = mesh.getTriangleList();
+	build();
+}
+
+MeshBVH::MeshBVH(std::vector<glm::vec3> vertices, std::vector<uint> triangles)
+	: vertices(std::move(vertices)), triangles(std::move(triangles))
+{
+	build();
+}
+
+void MeshBVH::build()
+{
+	if (triangles.size() % 3 != 0)
+		ERRT("MeshBVH: el número de índices tiene que ser múltiplo de 3");
+
+	std::vector<BoundingBox> boxes(triangles.size() / 3);
+	for (size_t t = 0; t < boxes.size(); t++) {
+		const glm::vec3 &a = vertices[triangles[3 * t]];
+		const glm::vec3 &b = vertices[triangles[3 * t + 1]];
+		const glm::vec3 &c = vertices[triangles[3 * t + 2]];
+		boxes[t].min = glm::min(a, glm::min(b, c));
+		boxes[t].max = glm::max(a, glm::max(b, c));
+	}
+	bvh.build(boxes);
+}
+
+bool MeshBVH::intersect(const Ray &ray, float tmax, Hit &hit) const
+{
+	// Möller-Trumbore. Se aceptan los triángulos por las dos caras
+	return bvh.intersect(ray, tmax, [&](uint32_t t, float &tcur) {
+		const glm::vec3 &a = vertices[triangles[3 * t]];
+		const glm::vec3 e1 = vertices[triangles[3 * t + 1]] - a;
+		const glm::vec3 e2 = vertices[triangles[3 * t + 2]] - a;
+		const glm::vec3 p = glm::cross(ray.direction, e2);
+		const float det = glm::dot(e1, p);
+		if (det == 0.0f)
+			return false;
+		const float invDet = 1.0f / det;
+		const glm::vec3 s = ray.origin - a;
+		const float u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		const glm::vec3 q = glm::cross(s, e1);
+		const float v = glm::dot(ray.direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+		const float dist = glm::dot(e2, q) * invDet;
+		if (dist < 0.0f || dist >= tcur)
+			return false;
+		tcur = dist;
+		hit.triangle = t;
+		hit.t = dist;
+		hit.barycentrics = glm::vec3(1.0f - u - v, u, v);
+		return true;
+	});
+}
@@ -7,6 +7,7 @@
 #include "node.h"
 #include "nodeVisitor.h"
 #include "nodeCallback.h"
+#include "program.h"
 
 using PGUPV::Node;
 using PGUPV::GLMatrices;
@@ -16,9 +17,45 @@ using PGUPV::Mesh;
 using PGUPV::NodeVisitor;
 using PGUPV::NodeCallback;
 using PGUPV::Group;
+using PGUPV::Program;
 
 uint32_t Node::nextNodeId{ 1 };
 
+Program *Node::useProgram() {
+  if (!program)
+    return nullptr;
+  return program->use();
+}
+
+void Node::restoreProgram(Program *previous) {
+  if (!program)
+    return;
+  if (previous)
+    previous->use();
+  else
+    program->unUse();
+}
+
+void Node::setVisible(bool nodeVisible) {
+  if (visible == nodeVisible)
+    return;
+  visible = nodeVisible;
+  markChanged();
+}
+
+void Node::setProgram(std::shared_ptr<Program> nodeProgram) {
+  if (program == nodeProgram)
+    return;
+  program = nodeProgram;
+  markChanged();
+}
+
+void Node::markChanged() {
+  version++;
+  for (auto p : parents)
+    p->markChanged();
+}
+
 BoundingBox Node::getBB() {
   if (!bb.isValid())
     recomputeBoundingBox();
@@ -33,6 +70,7 @@ BoundingSphere Node::getBS() {
 
 void Node::resetBB() {
   bb.reset();
+  version++;
 }
 
 void Node::resetBS() {
@@ -0,0 +1,339 @@
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMAL_GENERATOR_SSE
+#include <emmintrin.h>
+#endif
+
+#include "normalGenerator.h"
+#include "threadPool.h"
+#include "log.h"
+
+using PGUPV::NormalGenerator;
+using PGUPV::ThreadPool;
+
+namespace {
+	const float PI = 3.14159265358979f;
+	// Longitud mínima de la normal no normalizada para no considerar degenerado el triángulo
+	const float DEGENERATE = 1e-5f;
+
+	/*
+	Aproximación polinómica del arcocoseno (Abramowitz y Stegun, 4.4.46), con un error
+	máximo de 2e-8 radianes. A diferencia de acosf, se puede evaluar en SIMD.
+	*/
+	inline float acosApprox(float c) {
+		c = std::fmin(1.0f, std::fmax(-1.0f, c));
+		float a = std::fabs(c);
+		float p = -0.0012624911f;
+		p = p * a + 0.0066700901f;
+		p = p * a - 0.0170881256f;
+		p = p * a + 0.0308918810f;
+		p = p * a - 0.0501743046f;
+		p = p * a + 0.0889789874f;
+		p = p * a - 0.2145988016f;
+		p = p * a + 1.5707963050f;
+		float r = std::sqrt(1.0f - a) * p;
+		return c < 0.0f ? PI - r : r;
+	}
+
+#ifdef NORMAL_GENERATOR_SSE
+	inline __m128 acosApprox(__m128 c) {
+		const __m128 one = _mm_set1_ps(1.0f);
+		c = _mm_min_ps(one, _mm_max_ps(_mm_set1_ps(-1.0f), c));
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 a = _mm_andnot_ps(signMask, c);
+		__m128 p = _mm_set1_ps(-0.0012624911f);
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(0.0066700901f));
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.0170881256f));
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(0.0308918810f));
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.0501743046f));
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(0.0889789874f));
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.2145988016f));
+		p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(1.5707963050f));
+		__m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(one, a)), p);
+		// Para c < 0: PI - r
+		__m128 neg = _mm_cmplt_ps(c, _mm_setzero_ps());
+		return _mm_or_ps(_mm_and_ps(neg, _mm_sub_ps(_mm_set1_ps(PI), r)), _mm_andnot_ps(neg, r));
+	}
+
+	inline __m128 gather(const float *base, const uint *tri, size_t t, int corner) {
+		return _mm_setr_ps(base[tri[3 * t + corner]], base[tri[3 * (t + 1) + corner]],
+			base[tri[3 * (t + 2) + corner]], base[tri[3 * (t + 3) + corner]]);
+	}
+#endif
+};
+
+NormalGenerator::NormalGenerator(const float *x, const float *y, const float *z, size_t nvertices,
+	const uint *triangles, size_t ntriangles) :
+	x(x), y(y), z(z), nvertices(nvertices), triangles(triangles), ntriangles(ntriangles) {
+	if (3 * ntriangles >= std::numeric_limits<uint>::max())
+		ERRT("NormalGenerator: demasiados triángulos");
+#ifdef _DEBUG
+	for (size_t i = 0; i < 3 * ntriangles; i++) {
+		if (triangles[i] >= nvertices)
+			ERRT("NormalGenerator: índice de vértice fuera de rango");
+	}
+#endif
+}
+
+void NormalGenerator::setVertexGroups(const std::vector<uint> &representatives) {
+	if (representatives.size() != nvertices)
+		ERRT("NormalGenerator: el número de representantes no coincide con el de vértices");
+	groups = representatives;
+}
+
+bool NormalGenerator::isVectorized() {
+#ifdef NORMAL_GENERATOR_SSE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void NormalGenerator::buildIncidence(bool useGroups, std::vector<uint> &first, std::vector<uint> &corners) const {
+	bool grouped = useGroups && !groups.empty();
+	first.assign(nvertices + 1, 0);
+	for (size_t i = 0; i < 3 * ntriangles; i++) {
+		uint v = triangles[i];
+		first[(grouped ? groups[v] : v) + 1]++;
+	}
+	for (size_t v = 0; v < nvertices; v++)
+		first[v + 1] += first[v];
+
+	corners.resize(3 * ntriangles);
+	std::vector<uint> cursor(first.begin(), first.end() - 1);
+	for (size_t t = 0; t < ntriangles; t++) {
+		for (uint i = 0; i < 3; i++) {
+			uint v = triangles[3 * t + i];
+			corners[cursor[grouped ? groups[v] : v]++] = static_cast<uint>(i * ntriangles + t);
+		}
+	}
+}
+
+/*
+Calcula, para los triángulos [begin, end), la normal del triángulo multiplicada por el
+ángulo en cada una de sus esquinas. Los triángulos degenerados aportan (0, 0, 0).
+*/
+void NormalGenerator::triangleNormals(size_t begin, size_t end, float *cx, float *cy, float *cz) const {
+	size_t t = begin;
+#ifdef NORMAL_GENERATOR_SSE
+	const __m128 zero = _mm_setzero_ps();
+	for (; t + 4 <= end; t += 4) {
+		__m128 ax = gather(x, triangles, t, 0), ay = gather(y, triangles, t, 0), az = gather(z, triangles, t, 0);
+		__m128 bx = gather(x, triangles, t, 1), by = gather(y, triangles, t, 1), bz = gather(z, triangles, t, 1);
+		__m128 qx = gather(x, triangles, t, 2), qy = gather(y, triangles, t, 2), qz = gather(z, triangles, t, 2);
+
+		// Aristas a->b, a->c y b->c
+		__m128 abx = _mm_sub_ps(bx, ax), aby = _mm_sub_ps(by, ay), abz = _mm_sub_ps(bz, az);
+		__m128 acx = _mm_sub_ps(qx, ax), acy = _mm_sub_ps(qy, ay), acz = _mm_sub_ps(qz, az);
+		__m128 bcx = _mm_sub_ps(qx, bx), bcy = _mm_sub_ps(qy, by), bcz = _mm_sub_ps(qz, bz);
+
+		// Normal geométrica: ab x ac
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(aby, acz), _mm_mul_ps(abz, acy));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(abz, acx), _mm_mul_ps(abx, acz));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(abx, acy), _mm_mul_ps(aby, acx));
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+		__m128 degenerate = _mm_cmplt_ps(len, _mm_set1_ps(DEGENERATE));
+		__m128 invLen = _mm_div_ps(_mm_set1_ps(1.0f), len);
+		nx = _mm_mul_ps(nx, invLen);
+		ny = _mm_mul_ps(ny, invLen);
+		nz = _mm_mul_ps(nz, invLen);
+
+		// Longitudes de las aristas (3 raíces en vez de normalizar 6 vectores)
+		__m128 lab = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, abx), _mm_mul_ps(aby, aby)), _mm_mul_ps(abz, abz)));
+		__m128 lac = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, acx), _mm_mul_ps(acy, acy)), _mm_mul_ps(acz, acz)));
+		__m128 lbc = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(bcx, bcx), _mm_mul_ps(bcy, bcy)), _mm_mul_ps(bcz, bcz)));
+
+		// Ángulos en a y en b. El de c es lo que falta hasta PI
+		__m128 dotA = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, acx), _mm_mul_ps(aby, acy)), _mm_mul_ps(abz, acz));
+		__m128 dotB = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, bcx), _mm_mul_ps(aby, bcy)), _mm_mul_ps(abz, bcz));
+		__m128 angA = acosApprox(_mm_div_ps(dotA, _mm_mul_ps(lab, lac)));
+		__m128 angB = acosApprox(_mm_div_ps(_mm_sub_ps(zero, dotB), _mm_mul_ps(lab, lbc)));
+		__m128 angC = _mm_max_ps(zero, _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(PI), angA), angB));
+
+		// Las operaciones de bits eliminan también los NaN de los triángulos degenerados
+		__m128 ang[3] = { angA, angB, angC };
+		for (size_t i = 0; i < 3; i++) {
+			size_t off = i * ntriangles + t;
+			_mm_storeu_ps(cx + off, _mm_andnot_ps(degenerate, _mm_mul_ps(nx, ang[i])));
+			_mm_storeu_ps(cy + off, _mm_andnot_ps(degenerate, _mm_mul_ps(ny, ang[i])));
+			_mm_storeu_ps(cz + off, _mm_andnot_ps(degenerate, _mm_mul_ps(nz, ang[i])));
+		}
+	}
+#endif
+	for (; t < end; t++) {
+		uint ia = triangles[3 * t], ib = triangles[3 * t + 1], ic = triangles[3 * t + 2];
+		float abx = x[ib] - x[ia], aby = y[ib] - y[ia], abz = z[ib] - z[ia];
+		float acx = x[ic] - x[ia], acy = y[ic] - y[ia], acz = z[ic] - z[ia];
+		float bcx = x[ic] - x[ib], bcy = y[ic] - y[ib], bcz = z[ic] - z[ib];
+
+		float nx = aby * acz - abz * acy;
+		float ny = abz * acx - abx * acz;
+		float nz = abx * acy - aby * acx;
+		float len = std::sqrt(nx * nx + ny * ny + nz * nz);
+		if (len < DEGENERATE) {
+			for (size_t i = 0; i < 3; i++) {
+				size_t off = i * ntriangles + t;
+				cx[off] = cy[off] = cz[off] = 0.0f;
+			}
+			continue;
+		}
+		nx /= len;
+		ny /= len;
+		nz /= len;
+
+		float lab = std::sqrt(abx * abx + aby * aby + abz * abz);
+		float lac = std::sqrt(acx * acx + acy * acy + acz * acz);
+		float lbc = std::sqrt(bcx * bcx + bcy * bcy + bcz * bcz);
+		float angA = acosApprox((abx * acx + aby * acy + abz * acz) / (lab * lac));
+		float angB = acosApprox(-(abx * bcx + aby * bcy + abz * bcz) / (lab * lbc));
+		float angC = std::fmax(0.0f, PI - angA - angB);
+
+		float ang[3] = { angA, angB, angC };
+		for (size_t i = 0; i < 3; i++) {
+			size_t off = i * ntriangles + t;
+			cx[off] = nx * ang[i];
+			cy[off] = ny * ang[i];
+			cz[off] = nz * ang[i];
+		}
+	}
+}
+
+void NormalGenerator::computeNormals(float *nx, float *ny, float *nz) const {
+	auto &pool = ThreadPool::getInstance();
+
+	// Primera pasada: aportación de cada triángulo a cada una de sus esquinas
+	std::vector<float> cx(3 * ntriangles), cy(3 * ntriangles), cz(3 * ntriangles);
+	pool.parallelFor(0, ntriangles, [&](size_t begin, size_t end) {
+		triangleNormals(begin, end, cx.data(), cy.data(), cz.data());
+	});
+
+	std::vector<uint> first, corners;
+	buildIncidence(true, first, corners);
+
+	// Segunda pasada: cada vértice (o representante de grupo) suma sus esquinas
+	pool.parallelFor(0, nvertices, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; v++) {
+			if (!groups.empty() && groups[v] != v) continue;
+			float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+			for (uint c = first[v]; c < first[v + 1]; c++) {
+				sx += cx[corners[c]];
+				sy += cy[corners[c]];
+				sz += cz[corners[c]];
+			}
+			float len = std::sqrt(sx * sx + sy * sy + sz * sz);
+			float inv = len > 0.0f ? 1.0f / len : 0.0f;
+			nx[v] = sx * inv;
+			ny[v] = sy * inv;
+			nz[v] = sz * inv;
+		}
+	});
+
+	// Los vértices de un grupo copian la normal de su representante
+	if (!groups.empty()) {
+		pool.parallelFor(0, nvertices, [&](size_t begin, size_t end) {
+			for (size_t v = begin; v < end; v++) {
+				uint r = groups[v];
+				if (r != v) {
+					nx[v] = nx[r];
+					ny[v] = ny[r];
+					nz[v] = nz[r];
+				}
+			}
+		});
+	}
+}
+
+void NormalGenerator::computeTangents(const float *nx, const float *ny, const float *nz,
+	const float *u, const float *v, float *tx, float *ty, float *tz, float *tw) const {
+	auto &pool = ThreadPool::getInstance();
+
+	// Tangente (no normalizada) de cada triángulo: dP/du. Si hace falta la orientación,
+	// también la bitangente: dP/dv
+	std::vector<float> sx(ntriangles), sy(ntriangles), sz(ntriangles);
+	std::vector<float> bx, by, bz;
+	if (tw) {
+		bx.resize(ntriangles);
+		by.resize(ntriangles);
+		bz.resize(ntriangles);
+	}
+	pool.parallelFor(0, ntriangles, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			uint ia = triangles[3 * t], ib = triangles[3 * t + 1], ic = triangles[3 * t + 2];
+			float e1x = x[ib] - x[ia], e1y = y[ib] - y[ia], e1z = z[ib] - z[ia];
+			float e2x = x[ic] - x[ia], e2y = y[ic] - y[ia], e2z = z[ic] - z[ia];
+			float du1 = u[ib] - u[ia], dv1 = v[ib] - v[ia];
+			float du2 = u[ic] - u[ia], dv2 = v[ic] - v[ia];
+			float det = du1 * dv2 - du2 * dv1;
+			if (std::fabs(det) < 1e-12f) {
+				// Coordenadas de textura degeneradas: el triángulo no aporta
+				sx[t] = sy[t] = sz[t] = 0.0f;
+				if (tw) bx[t] = by[t] = bz[t] = 0.0f;
+				continue;
+			}
+			float r = 1.0f / det;
+			sx[t] = (e1x * dv2 - e2x * dv1) * r;
+			sy[t] = (e1y * dv2 - e2y * dv1) * r;
+			sz[t] = (e1z * dv2 - e2z * dv1) * r;
+			if (tw) {
+				bx[t] = (e2x * du1 - e1x * du2) * r;
+				by[t] = (e2y * du1 - e1y * du2) * r;
+				bz[t] = (e2z * du1 - e1z * du2) * r;
+			}
+		}
+	});
+
+	// Las tangentes no se comparten entre vértices del mismo grupo: en las costuras
+	// de la parametrización cambian
+	std::vector<uint> first, corners;
+	buildIncidence(false, first, corners);
+
+	pool.parallelFor(0, nvertices, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			float ax = 0.0f, ay = 0.0f, az = 0.0f;
+			float qx = 0.0f, qy = 0.0f, qz = 0.0f;
+			for (uint c = first[i]; c < first[i + 1]; c++) {
+				size_t t = corners[c] % ntriangles;
+				ax += sx[t];
+				ay += sy[t];
+				az += sz[t];
+				if (tw) {
+					qx += bx[t];
+					qy += by[t];
+					qz += bz[t];
+				}
+			}
+			// Gram-Schmidt: quitamos la componente en la dirección de la normal
+			float d = ax * nx[i] + ay * ny[i] + az * nz[i];
+			ax -= nx[i] * d;
+			ay -= ny[i] * d;
+			az -= nz[i] * d;
+			float len = std::sqrt(ax * ax + ay * ay + az * az);
+			if (len < 1e-12f) {
+				// Cualquier vector perpendicular a la normal
+				if (std::fabs(nx[i]) < 0.9f) {
+					ax = 0.0f; ay = nz[i]; az = -ny[i];
+				}
+				else {
+					ax = -nz[i]; ay = 0.0f; az = nx[i];
+				}
+				len = std::sqrt(ax * ax + ay * ay + az * az);
+				if (len < 1e-12f) {
+					ax = 1.0f; ay = az = 0.0f; len = 1.0f;
+				}
+			}
+			tx[i] = ax / len;
+			ty[i] = ay / len;
+			tz[i] = az / len;
+			if (tw) {
+				// Si la bitangente acumulada apunta en sentido contrario a cross(N, T), la
+				// parametrización está reflejada en este vértice
+				float cx = ny[i] * tz[i] - nz[i] * ty[i];
+				float cy = nz[i] * tx[i] - nx[i] * tz[i];
+				float cz = nx[i] * ty[i] - ny[i] * tx[i];
+				tw[i] = (cx * qx + cy * qy + cz * qz) < 0.0f ? -1.0f : 1.0f;
+			}
+		}
+	});
+}
@@ -0,0 +1,215 @@
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "occlusionCuller.h"
+#include "query.h"
+#include "glMatrices.h"
+#include "indexedBindingPoint.h"
+#include "stockModels.h"
+#include "stockPrograms.h"
+#include "program.h"
+#include "log.h"
+
+using PGUPV::OcclusionCuller;
+using PGUPV::Query;
+using PGUPV::Node;
+using PGUPV::Group;
+using PGUPV::Geode;
+using PGUPV::AnimationNode;
+using PGUPV::GLMatrices;
+using PGUPV::BoundingBox;
+using PGUPV::Program;
+using PGUPV::Box;
+using PGUPV::ConstantUniformColorProgram;
+
+namespace {
+	// Número de frames sin visitar un nodo tras los que se olvida su estado
+	const uint64_t FORGET_AFTER_FRAMES = 120;
+
+	// Identificador de la instancia de un nodo: combina el de su padre con la dirección del nodo
+	uint64_t instanceKey(uint64_t parentKey, const Node *node) {
+		uint64_t h = parentKey ^ (reinterpret_cast<uintptr_t>(node) + 0x9e3779b97f4a7c15ull + (parentKey << 6) + (parentKey >> 2));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return h;
+	}
+};
+
+struct OcclusionCuller::NodeState {
+	NodeState() : query(GL_ANY_SAMPLES_PASSED) {}
+	Query query;
+	bool pending = false;			// la consulta está en marcha
+	bool occluded = false;			// el nodo estaba tapado
+	bool anyChildVisible = false;	// en el recorrido actual
+	bool anyChildOccluded = false;	// en el recorrido actual, algún hijo se descartó por estar tapado
+	uint64_t key = 0;				// identificador de la instancia (ver instanceKey)
+	uint64_t lastVisited = 0;		// último frame en el que se aceptó o se descartó por estar tapado
+	uint64_t revealed = 0;			// último frame en el que volvió a ser visible
+};
+
+OcclusionCuller::OcclusionCuller() : eye(0.0f), frame(0) {
+}
+
+OcclusionCuller::~OcclusionCuller() {
+}
+
+void OcclusionCuller::reset() {
+	states.clear();
+}
+
+OcclusionCuller::NodeState &OcclusionCuller::getState(uint64_t key) {
+	auto &s = states[key];
+	if (!s) {
+		s.reset(new NodeState());
+		s->key = key;
+	}
+	return *s;
+}
+
+void OcclusionCuller::readResults() {
+	for (auto it = states.begin(); it != states.end(); ) {
+		NodeState &s = *it->second;
+		if (s.pending) {
+			// Nunca se espera: si el resultado no está, se mantiene la decisión anterior
+			if (s.query.isResultAvailable()) {
+				s.pending = false;
+				bool visible = s.query.getResult() != 0;
+				if (s.occluded && visible) {
+					s.revealed = frame;
+					occlusionCounters.revealed++;
+				}
+				s.occluded = !visible;
+			}
+			else
+				occlusionCounters.pendingResults++;
+		}
+		// Los nodos que no se visitan desde hace tiempo (fuera de la vista, o eliminados)
+		if (!s.pending && s.lastVisited + FORGET_AFTER_FRAMES < frame)
+			it = states.erase(it);
+		else
+			++it;
+	}
+}
+
+bool OcclusionCuller::acceptNode(Node &node) {
+	NodeState &s = getState(instanceKey(path.empty() ? 0 : path.back()->key, &node));
+	// Si no se visitó en el frame anterior (estaba fuera de la vista), su estado es antiguo
+	bool recent = s.lastVisited + 1 == frame;
+	s.lastVisited = frame;
+	bool parentRevealed = !path.empty() && path.back()->revealed == frame;
+
+	if (s.occluded && recent && !parentRevealed) {
+		BoundingBox bb = node.getBB();
+		// Si la cámara está dentro de la caja, el plano cercano la recorta y no sirve de oclusor
+		glm::vec3 e = glm::vec3(glm::inverse(getModelMatrix()) * glm::vec4(eye, 1.0f));
+		glm::vec3 margin = 0.01f * (bb.max - bb.min) + 1e-3f;
+		bool eyeInside = glm::all(glm::greaterThanEqual(e, bb.min - margin)) && glm::all(glm::lessThanEqual(e, bb.max + margin));
+		if (!eyeInside) {
+			occludedBoxes.push_back(OccludedBox{ &s, getModelMatrix(), bb });
+			occlusionCounters.occluded++;
+			if (!path.empty())
+				path.back()->anyChildOccluded = true;
+			return false;
+		}
+	}
+	if (s.occluded) {
+		// Hasta que llegue el resultado de su consulta, se considera visible
+		s.occluded = false;
+		s.revealed = frame;
+	}
+	if (!path.empty())
+		path.back()->anyChildVisible = true;
+	s.anyChildVisible = false;
+	s.anyChildOccluded = false;
+	path.push_back(&s);
+	// CullVisitor añade a getVisible las hojas que se aceptan
+	if (dynamic_cast<Geode *>(&node) || dynamic_cast<AnimationNode *>(&node))
+		leaves.push_back(&s);
+	return true;
+}
+
+void OcclusionCuller::leaveNode(Node &node) {
+	NodeState &s = *path.back();
+	path.pop_back();
+	// Si no se ha dibujado ningún hijo porque los que están en la vista están tapados, se
+	// consulta la caja del grupo. Si también está tapada (readResults), en los siguientes
+	// frames ya no se recorren sus hijos. Los hijos que sólo están fuera de la vista no
+	// cuentan: el grupo no está tapado por eso
+	if (dynamic_cast<Group *>(&node) && !s.anyChildVisible && s.anyChildOccluded)
+		occludedBoxes.push_back(OccludedBox{ &s, getModelMatrix(), node.getBB() });
+}
+
+void OcclusionCuller::render(Node &root) {
+	auto mats = std::dynamic_pointer_cast<GLMatrices>(gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX));
+	if (!mats)
+		ERRT("OcclusionCuller: no hay un GLMatrices vinculado");
+
+	frame++;
+	occlusionCounters = OcclusionCounters();
+	readResults();
+
+	eye = glm::vec3(glm::inverse(mats->getMatrix(GLMatrices::VIEW_MATRIX))[3]);
+	occludedBoxes.clear();
+	path.clear();
+	leaves.clear();
+	cull(root, *mats);
+
+	// Las hojas visibles, cada una dentro de su consulta y con su programa
+	Program *initial = Program::getCurrentProgram();
+	mats->pushMatrix(GLMatrices::MODEL_MATRIX);
+	const auto &visible = getVisible();
+	for (size_t i = 0; i < visible.size(); i++) {
+		const auto &v = visible[i];
+		NodeState &s = *leaves[i];
+		mats->setMatrix(GLMatrices::MODEL_MATRIX, v.modelMatrix);
+		bool query = !s.pending;
+		if (query) {
+			s.query.begin();
+			occlusionCounters.queries++;
+		}
+		drawVisible(v, initial);
+		if (query) {
+			s.query.end();
+			s.pending = true;
+		}
+	}
+	if (!occludedBoxes.empty())
+		queryBoxes(*mats);
+	mats->popMatrix(GLMatrices::MODEL_MATRIX);
+	restoreProgram(initial);
+}
+
+void OcclusionCuller::queryBoxes(GLMatrices &mats) {
+	if (!box)
+		box = std::make_shared<Box>(1.0f);
+
+	GLboolean colorMask[4], depthMask;
+	glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+	Program *prev = ConstantUniformColorProgram::use();
+
+	for (const auto &b : occludedBoxes) {
+		NodeState &s = *b.state;
+		if (s.pending)
+			continue;
+		glm::mat4 m = glm::translate(b.modelMatrix, b.bb.getCenter());
+		mats.setMatrix(GLMatrices::MODEL_MATRIX, glm::scale(m, glm::max(b.bb.max - b.bb.min, glm::vec3(1e-4f))));
+		s.query.begin();
+		box->render();
+		s.query.end();
+		s.pending = true;
+		occlusionCounters.queries++;
+		occlusionCounters.boxQueries++;
+	}
+
+	if (prev)
+		prev->use();
+	if (cullFace)
+		glEnable(GL_CULL_FACE);
+	glDepthMask(depthMask);
+	glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+}
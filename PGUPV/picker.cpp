@@ -112,10 +112,6 @@ uint32_t Picker::PickerImpl::pick(const Picker::PickData &pick, const glm::mat4&
 		selectionWindowSide * selectionWindowSide * sizeof(GLuint),
 		&ids[0]);
 
-	for (int i = 0; i < selectionWindowSide * selectionWindowSide; i++) {
-		INFO(std::to_string(ids[i]));
-	}
-
 	return ids[selectionWindowSemiWidth * selectionWindowSide + selectionWindowSemiWidth];
 }
 
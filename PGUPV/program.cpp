@@ -15,7 +15,9 @@
 #include "common.h"
 #include "log.h"
 #include "indexedBindingPoint.h"
+#include "glMatrices.h"
 #include "glslInfo.h"
+#include "programCache.h"
 #include "material.h"
 
 using std::cout;
@@ -27,10 +29,12 @@ using std::setw;
 using PGUPV::Program;
 using PGUPV::BufferObject;
 using PGUPV::UniformBufferObject;
+using PGUPV::GLMatrices;
 using PGUPV::ShaderLibrary;
 using PGUPV::Shader;
 using PGUPV::UniformInfo;
 using PGUPV::UniformInfoBlocks;
+using PGUPV::ProgramCache;
 
 Program *Program::prevProgram = nullptr;
 
@@ -60,6 +64,12 @@ void Program::release() {
 		glDeleteProgram(programId);
 		programId = 0;
 	}
+	// Se cancela la recarga en curso
+	if (reload) {
+		if (reload->programId)
+			glDeleteProgram(reload->programId);
+		reload.reset();
+	}
 }
 
 int Program::loadFiles(const std::string &name) {
@@ -196,6 +206,11 @@ bool Program::compile() {
 		programId = 0;
 	}
 
+	bool cache;
+	std::string key;
+	if (loadCached(cache, key))
+		return true;
+
 	for (std::map<Shader::ShaderType, std::shared_ptr<Shader>>::iterator i =
 		shaders.begin();
 		i != shaders.end(); ++i) {
@@ -212,7 +227,7 @@ bool Program::compile() {
 	}
 
 	if (tolink.size() == shaders.size())
-		linkProgram(tolink, compilationResult);
+		linkProgram(tolink, compilationResult, cache);
 
 	if (!programId) {
 		// Ha fallado algo...
@@ -223,10 +238,47 @@ bool Program::compile() {
 		ERRT(compilationResult.str());
 	}
 
-	bindUBOs();
+	afterLink(cache, key);
 	return true;
 }
 
+bool Program::loadCached(bool &cache, std::string &key) {
+	// Si el programa ya se enlazó en otra ejecución, se carga su binario
+	cache = ProgramCache::isAvailable();
+	if (!cache)
+		return false;
+	key = cacheKey();
+	programId = ProgramCache::load(key);
+	if (programId) {
+		bindUBOs();
+		return true;
+	}
+	return false;
+}
+
+void Program::afterLink(bool cache, const std::string &key) {
+	if (cache)
+		ProgramCache::store(key, programId);
+	bindUBOs();
+}
+
+std::string Program::cacheKey() const {
+	std::ostringstream os;
+	for (const auto &s : shaders) {
+		os << "shader " << s.first << "\n";
+		for (const auto &line : s.second->getSource())
+			os << line << "\n";
+	}
+	for (const auto &a : attribs)
+		os << "attrib " << a.loc << " " << a.name << "\n";
+	if (!transformVaryings.empty()) {
+		os << "varyings " << (transformInterleaved ? "interleaved" : "separate") << "\n";
+		for (const auto &v : transformVaryings)
+			os << v << "\n";
+	}
+	return os.str();
+}
+
 int Program::getUniformLocation(const std::string &uniform) {
 	if (programId == 0)
 		ERRT("No se puede pedir la posición de un uniform si el shader no está "
@@ -243,9 +295,9 @@ int Program::getUniformLocation(const std::string &uniform) {
 	return loc;
 }
 
-void Program::bindAttribs() {
+void Program::bindAttribs(GLuint id) {
 	for (uint i = 0; i < attribs.size(); i++)
-		glBindAttribLocation(programId, attribs[i].loc, attribs[i].name.c_str());
+		glBindAttribLocation(id, attribs[i].loc, attribs[i].name.c_str());
 }
 
 void Program::addAttributeLocation(unsigned int loc, const std::string &name) {
@@ -265,41 +317,58 @@ Parámetros de entrada:
 
 */
 bool Program::linkProgram(const PGUPV::Uints &shids,
-	std::ostream &error_output) {
-	GLint linked;
+	std::ostream &error_output, bool retrievable) {
+	programId = startLink(shids, retrievable);
+	return finishLink(programId, error_output);
+}
 
-	programId = glCreateProgram();
+GLuint Program::startLink(const PGUPV::Uints &shids, bool retrievable) {
+	GLuint id = glCreateProgram();
+	if (retrievable)
+		glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	for (unsigned int i = 0; i < shids.size(); i++)
-		glAttachShader(programId, shids[i]);
+		glAttachShader(id, shids[i]);
 
-	bindAttribs();
+	bindAttribs(id);
 
 	if (!transformVaryings.empty()) {
 		const char **vars = new const char *[transformVaryings.size()];
 		for (unsigned int i = 0; i < transformVaryings.size(); i++) {
 			vars[i] = transformVaryings[i].c_str();
 		}
-		glTransformFeedbackVaryings(programId, gsl::narrow<GLsizei>(transformVaryings.size()), vars,
+		glTransformFeedbackVaryings(id, gsl::narrow<GLsizei>(transformVaryings.size()), vars,
 			transformInterleaved ? GL_INTERLEAVED_ATTRIBS : GL_SEPARATE_ATTRIBS);
 		delete[] vars;
 	}
 
-	glLinkProgram(programId);
+	glLinkProgram(id);
 	CHECK_GL();
+	return id;
+}
+
+bool Program::isLinkDone(GLuint id) {
+	if (!Shader::isParallelCompileSupported())
+		return true;
+	GLint done = GL_TRUE;
+	glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
 
-	glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+bool Program::finishLink(GLuint &id, std::ostream &error_output) {
+	GLint linked;
+	glGetProgramiv(id, GL_LINK_STATUS, &linked);
 
 	if (linked == GL_FALSE) {
 		GLint length;
 		GLchar *log;
-		glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &length);
+		glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
 		log = new GLchar[length];
-		glGetProgramInfoLog(programId, length, &length, log);
+		glGetProgramInfoLog(id, length, &length, log);
 		error_output << "Error enlazando el programa:" << endl;
 		error_output << log << endl;
 		delete[] log;
-		glDeleteProgram(programId);
-		programId = 0;
+		glDeleteProgram(id);
+		id = 0;
 		return false;
 	}
 	return true;
@@ -393,7 +462,12 @@ bool Program::bindUBOs() {
 			printSrcs(os);
 			ERRT(os.str());
 		}
-		PGUPV::gl_uniform_buffer.bindBufferBase(pc.bo, pc.bindingPoint);
+		// Las matrices pueden estar en un UniformStream, y no en su propio buffer
+		auto mats = std::dynamic_pointer_cast<GLMatrices>(pc.bo);
+		if (mats && pc.bindingPoint == UBO_GL_MATRICES_BINDING_INDEX)
+			mats->bind();
+		else
+			PGUPV::gl_uniform_buffer.bindBufferBase(pc.bo, pc.bindingPoint);
 	}
 
 	return true;
@@ -1079,6 +1153,15 @@ void Program::setRoutine(Shader::ShaderType type, std::string uniformRoutine,
 	if (subrutinas[type].size() <= uniformId)
 		subrutinas[type].resize(uniformId + 1, GL_INVALID_INDEX);
 	subrutinas[type][uniformId] = routineId;
+
+	// Se guardan los nombres, para volver a buscar los índices si se recarga el programa
+	for (auto &rs : routineSelections) {
+		if (rs.type == type && rs.uniform == uniformRoutine) {
+			rs.routine = routineName;
+			return;
+		}
+	}
+	routineSelections.push_back(RoutineSelection{ type, uniformRoutine, routineName });
 }
 
 void Program::refreshRoutineUniforms() {
@@ -1131,3 +1214,322 @@ long long Program::getModificationTime() {
 	}
 	return newest;
 }
+
+std::vector<std::string> Program::getDependencies() const {
+	std::vector<std::string> files;
+	for (const auto &s : shaders) {
+		for (const auto &f : s.second->getSourceFiles()) {
+			if (std::find(files.begin(), files.end(), f) == files.end())
+				files.push_back(f);
+		}
+	}
+	return files;
+}
+
+std::vector<std::pair<std::string, std::string>> Program::getIncludeGraph() const {
+	std::vector<std::pair<std::string, std::string>> graph;
+	for (const auto &s : shaders) {
+		for (const auto &e : s.second->getIncludes()) {
+			if (std::find(graph.begin(), graph.end(), e) == graph.end())
+				graph.push_back(e);
+		}
+	}
+	return graph;
+}
+
+namespace {
+	// Componentes de los tipos de uniform cuyo valor se conserva al recargar un programa
+	enum class UniformKind { FLOAT, INT, UINT, MATRIX, NONE };
+
+	UniformKind uniformKind(GLenum type, int &n) {
+		switch (type) {
+		case GL_FLOAT: n = 1; return UniformKind::FLOAT;
+		case GL_FLOAT_VEC2: n = 2; return UniformKind::FLOAT;
+		case GL_FLOAT_VEC3: n = 3; return UniformKind::FLOAT;
+		case GL_FLOAT_VEC4: n = 4; return UniformKind::FLOAT;
+		case GL_INT: case GL_BOOL: n = 1; return UniformKind::INT;
+		case GL_INT_VEC2: case GL_BOOL_VEC2: n = 2; return UniformKind::INT;
+		case GL_INT_VEC3: case GL_BOOL_VEC3: n = 3; return UniformKind::INT;
+		case GL_INT_VEC4: case GL_BOOL_VEC4: n = 4; return UniformKind::INT;
+		case GL_UNSIGNED_INT: n = 1; return UniformKind::UINT;
+		case GL_UNSIGNED_INT_VEC2: n = 2; return UniformKind::UINT;
+		case GL_UNSIGNED_INT_VEC3: n = 3; return UniformKind::UINT;
+		case GL_UNSIGNED_INT_VEC4: n = 4; return UniformKind::UINT;
+		case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+		case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT3x2:
+		case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x2: case GL_FLOAT_MAT4x3:
+			n = 1; return UniformKind::MATRIX;
+		case GL_DOUBLE: case GL_DOUBLE_VEC2: case GL_DOUBLE_VEC3: case GL_DOUBLE_VEC4:
+		case GL_DOUBLE_MAT2: case GL_DOUBLE_MAT3: case GL_DOUBLE_MAT4:
+		case GL_DOUBLE_MAT2x3: case GL_DOUBLE_MAT2x4: case GL_DOUBLE_MAT3x2:
+		case GL_DOUBLE_MAT3x4: case GL_DOUBLE_MAT4x2: case GL_DOUBLE_MAT4x3:
+			n = 0; return UniformKind::NONE;
+		default:
+			// Samplers e imágenes: su valor es la unidad de textura
+			n = 1; return UniformKind::INT;
+		}
+	}
+
+	void setMatrix(GLenum type, GLint loc, const GLfloat *v) {
+		switch (type) {
+		case GL_FLOAT_MAT2: glUniformMatrix2fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT3: glUniformMatrix3fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT4: glUniformMatrix4fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT2x3: glUniformMatrix2x3fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT2x4: glUniformMatrix2x4fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT3x2: glUniformMatrix3x2fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT3x4: glUniformMatrix3x4fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT4x2: glUniformMatrix4x2fv(loc, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT4x3: glUniformMatrix4x3fv(loc, 1, GL_FALSE, v); break;
+		}
+	}
+
+	// Nombre sin el último índice: los arrays de tipos básicos aparecen como a[0]. En los
+	// arrays de estructuras (s[1].x), cada miembro de cada elemento tiene su nombre completo
+	std::string arrayBase(const std::string &name) {
+		if (name.empty() || name.back() != ']')
+			return name;
+		return name.substr(0, name.rfind('['));
+	}
+
+	// Copia el valor del uniform con ese nombre (un elemento, si es un array)
+	void copyUniform(GLenum type, const std::string &name, GLuint fromId, GLuint toId) {
+		GLint fromLoc = glGetUniformLocation(fromId, name.c_str());
+		GLint toLoc = glGetUniformLocation(toId, name.c_str());
+		// El array puede ser más corto en el programa nuevo
+		if (fromLoc < 0 || toLoc < 0)
+			return;
+		int ncomps;
+		switch (uniformKind(type, ncomps)) {
+		case UniformKind::FLOAT:
+		case UniformKind::MATRIX:
+		{
+			GLfloat v[16];
+			glGetUniformfv(fromId, fromLoc, v);
+			if (ncomps == 1 && type != GL_FLOAT) setMatrix(type, toLoc, v);
+			else if (ncomps == 1) glUniform1fv(toLoc, 1, v);
+			else if (ncomps == 2) glUniform2fv(toLoc, 1, v);
+			else if (ncomps == 3) glUniform3fv(toLoc, 1, v);
+			else glUniform4fv(toLoc, 1, v);
+			break;
+		}
+		case UniformKind::INT:
+		{
+			GLint v[4];
+			glGetUniformiv(fromId, fromLoc, v);
+			if (ncomps == 1) glUniform1iv(toLoc, 1, v);
+			else if (ncomps == 2) glUniform2iv(toLoc, 1, v);
+			else if (ncomps == 3) glUniform3iv(toLoc, 1, v);
+			else glUniform4iv(toLoc, 1, v);
+			break;
+		}
+		case UniformKind::UINT:
+		{
+			GLuint v[4];
+			glGetUniformuiv(fromId, fromLoc, v);
+			if (ncomps == 1) glUniform1uiv(toLoc, 1, v);
+			else if (ncomps == 2) glUniform2uiv(toLoc, 1, v);
+			else if (ncomps == 3) glUniform3uiv(toLoc, 1, v);
+			else glUniform4uiv(toLoc, 1, v);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	// Posiciones de los uniforms del bloque por defecto del programa (cada elemento de un array,
+	// con su nombre a[i]), por nombre
+	std::map<std::string, GLint> defaultBlockLocations(GLuint id) {
+		std::map<std::string, GLint> locs;
+		GLint n = 0;
+		glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &n);
+		for (GLuint i = 0; i < static_cast<GLuint>(n); i++) {
+			GLchar name[256];
+			GLint size;
+			GLenum type;
+			glGetActiveUniform(id, i, sizeof(name), nullptr, &size, &type, name);
+			// Los miembros de los bloques no tienen posición
+			if (glGetUniformLocation(id, name) < 0)
+				continue;
+			auto base = arrayBase(name);
+			if (size > 1) {
+				for (GLint j = 0; j < size; j++) {
+					auto elem = base + "[" + std::to_string(j) + "]";
+					locs[elem] = glGetUniformLocation(id, elem.c_str());
+				}
+			}
+			else
+				locs[name] = glGetUniformLocation(id, name);
+		}
+		return locs;
+	}
+
+	/*
+	La aplicación puede haber guardado las posiciones de los uniforms (getUniformLocation) del
+	programa from. Escribe en err los uniforms que han cambiado de posición en el programa to,
+	y las posiciones que ahora son de otro uniform
+	*/
+	void checkUniformLocations(GLuint fromId, GLuint toId, std::ostream &err) {
+		auto from = defaultBlockLocations(fromId);
+		auto to = defaultBlockLocations(toId);
+		std::map<GLint, std::string> fromNames;
+		for (const auto &u : from)
+			fromNames[u.second] = u.first;
+		for (const auto &u : to) {
+			auto f = from.find(u.first);
+			if (f != from.end()) {
+				if (f->second != u.second)
+					err << "El uniform " << u.first << " ha cambiado de posición (" << f->second << " -> " << u.second << ")" << std::endl;
+				continue;
+			}
+			auto other = fromNames.find(u.second);
+			if (other != fromNames.end())
+				err << "La posición " << u.second << " era del uniform " << other->second << " y ahora es de " << u.first << std::endl;
+		}
+	}
+
+	/*
+	Copia los valores de los uniforms del bloque por defecto del programa from al programa to
+	(que tiene que estar instalado). Sólo se copian los que existen en los dos programas con
+	el mismo tipo. Cada elemento de un array se copia por separado, con su nombre (a[i])
+	*/
+	void copyDefaultBlockUniforms(const UniformInfoBlocks &from, GLuint fromId, GLuint toId) {
+		std::map<std::string, GLenum> toTypes;
+		GLint n = 0;
+		glGetProgramiv(toId, GL_ACTIVE_UNIFORMS, &n);
+		for (GLuint i = 0; i < static_cast<GLuint>(n); i++) {
+			GLchar name[256];
+			GLint size;
+			GLenum type;
+			glGetActiveUniform(toId, i, sizeof(name), nullptr, &size, &type, name);
+			toTypes[arrayBase(name)] = type;
+		}
+
+		for (const auto &u : from.defaultBlockUniforms) {
+			auto base = arrayBase(u.name);
+			auto t = toTypes.find(base);
+			if (t == toTypes.end() || t->second != static_cast<GLenum>(u.type))
+				continue;
+			if (u.size > 1) {
+				for (GLint i = 0; i < u.size; i++)
+					copyUniform(u.type, base + "[" + std::to_string(i) + "]", fromId, toId);
+			}
+			else
+				copyUniform(u.type, u.name, fromId, toId);
+		}
+	}
+};
+
+bool Program::startReload() {
+	if (programId == 0 || reload)
+		return false;
+
+	// Se vuelven a leer todos los ficheros: la caché de Shader podría no haber visto el cambio
+	// (p.e., si el fichero se ha reescrito sin cambiar su tamaño ni su fecha)
+	for (const auto &f : getDependencies())
+		Shader::invalidateCachedFile(f);
+
+	std::unique_ptr<Reload> r(new Reload());
+	try {
+		for (const auto &s : shaders) {
+			auto f = s.second->getFilename();
+			// Los shaders cargados desde memoria no cambian: se reutilizan
+			r->shaders[s.first] = f.empty() ? s.second : Shader::loadFromFile(f, s.first, subStrings);
+		}
+	}
+	catch (std::exception &e) {
+		ERR(std::string("No se puede recargar el programa: ") + e.what());
+		return false;
+	}
+	for (auto &s : r->shaders)
+		s.second->startCompile();
+	reload = std::move(r);
+	return true;
+}
+
+Program::ReloadResult Program::pollReload(std::string *errors) {
+	if (!reload)
+		return ReloadResult::NONE;
+
+	std::ostringstream err;
+	if (!reload->linking) {
+		for (const auto &s : reload->shaders)
+			if (!s.second->isCompileDone())
+				return ReloadResult::PENDING;
+		Uints tolink;
+		for (const auto &s : reload->shaders) {
+			GLuint sid = s.second->finishCompile();
+			if (sid == 0) {
+				err << s.second->getErrorMessage() << std::endl;
+				break;
+			}
+			tolink.push_back(sid);
+		}
+		if (tolink.size() != reload->shaders.size()) {
+			reload.reset();
+			if (errors) *errors = err.str();
+			return ReloadResult::FAILED;
+		}
+		reload->programId = startLink(tolink, false);
+		reload->linking = true;
+	}
+
+	if (!isLinkDone(reload->programId))
+		return ReloadResult::PENDING;
+
+	std::unique_ptr<Reload> r(std::move(reload));
+	if (!finishLink(r->programId, err)) {
+		if (errors) *errors = err.str();
+		return ReloadResult::FAILED;
+	}
+	// El nuevo programa tiene que tener los bloques y las subrutinas que usa la aplicación
+	for (const auto &pc : pendingConnections) {
+		if (glGetUniformBlockIndex(r->programId, pc.blockName.c_str()) == GL_INVALID_INDEX)
+			err << "El programa nuevo no usa el bloque " << pc.blockName << std::endl;
+	}
+	std::vector<GLuint> newRoutines[Shader::NUM_SHADER_TYPES];
+	for (const auto &rs : routineSelections) {
+		GLenum stage = Shader::toGLType(rs.type);
+		GLint loc = glGetSubroutineUniformLocation(r->programId, stage, rs.uniform.c_str());
+		GLuint idx = glGetSubroutineIndex(r->programId, stage, rs.routine.c_str());
+		if (loc < 0 || idx == GL_INVALID_INDEX) {
+			err << "El programa nuevo no tiene la subrutina " << rs.routine << " (" << rs.uniform << ")" << std::endl;
+			continue;
+		}
+		auto &v = newRoutines[rs.type];
+		if (v.size() <= static_cast<size_t>(loc))
+			v.resize(loc + 1, GL_INVALID_INDEX);
+		v[loc] = idx;
+	}
+	// Las posiciones que ha pedido la aplicación tienen que seguir siendo válidas
+	checkUniformLocations(programId, r->programId, err);
+	if (!err.str().empty()) {
+		glDeleteProgram(r->programId);
+		if (errors) *errors = err.str();
+		return ReloadResult::FAILED;
+	}
+
+	// Se conservan los valores de los uniforms que la aplicación ya había establecido
+	GLint current;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	glUseProgram(r->programId);
+	copyDefaultBlockUniforms(getActiveUniforms(), programId, r->programId);
+
+	bool inUse = prevProgram == this || static_cast<GLuint>(current) == programId;
+	glDeleteProgram(programId);
+	programId = r->programId;
+	shaders.swap(r->shaders);
+	if (!routineSelections.empty()) {
+		for (int i = 0; i < Shader::NUM_SHADER_TYPES; i++)
+			subrutinas[i] = newRoutines[i];
+	}
+	bindUBOs();
+
+	if (inUse)
+		refreshRoutineUniforms();
+	else
+		glUseProgram(current);
+	CHECK_GL();
+	return ReloadResult::DONE;
+}
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+#include "programCache.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::ProgramCache;
+
+namespace {
+	const char MAGIC[8] = { 'P', 'G', 'U', 'P', 'V', 'P', 'B', '1' };
+	const char *EXTENSION = ".pgbin";
+
+	// Cabecera de cada fichero. Para descartar colisiones, se guarda otro resumen de la clave,
+	// calculado de forma distinta al que da nombre al fichero, y su longitud
+	struct Header {
+		char magic[8];
+		uint64_t check;
+		uint64_t keyLength;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	struct State {
+		bool enabled = false;
+		std::string dir = "programCache";
+		size_t maxBytes = 64 * 1024 * 1024;
+		ProgramCache::Stats stats;
+	};
+
+	State &state() {
+		static State s;
+		return s;
+	}
+
+	// FNV-1a de 64 bits
+	uint64_t fnv1a(const std::string &s) {
+		uint64_t h = 14695981039346656037ULL;
+		for (unsigned char c : s) {
+			h ^= c;
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	// djb2 de 64 bits, recorriendo la cadena al revés
+	uint64_t djb2r(const std::string &s) {
+		uint64_t h = 5381;
+		for (auto it = s.rbegin(); it != s.rend(); ++it)
+			h = h * 33 + static_cast<unsigned char>(*it);
+		return h;
+	}
+
+	std::string glString(GLenum name) {
+		auto s = reinterpret_cast<const char *>(glGetString(name));
+		return s ? s : "";
+	}
+
+	// La clave del programa más la identificación del driver: un binario sólo vale para el
+	// driver que lo generó
+	std::string fullKey(const std::string &key) {
+		return glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION) +
+			"\n" + glString(GL_SHADING_LANGUAGE_VERSION) + "\n" + key;
+	}
+
+	std::string pathFor(const std::string &fkey) {
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a(fkey)));
+		return state().dir + "/" + name + EXTENSION;
+	}
+
+	// Borra los binarios más antiguos hasta que el total no supera el tamaño máximo
+	void evictOldest() {
+		struct Entry {
+			long long time;
+			size_t size;
+			std::string path;
+		};
+		std::vector<Entry> entries;
+		size_t total = 0;
+		for (const auto &path : PGUPV::listFiles(state().dir, false, { std::string("*") + EXTENSION })) {
+			std::ifstream f(path, std::ios::binary | std::ios::ate);
+			if (!f)
+				continue;
+			size_t size = static_cast<size_t>(f.tellg());
+			entries.push_back(Entry{ PGUPV::getFileModificationTime(path), size, path });
+			total += size;
+		}
+		if (total <= state().maxBytes)
+			return;
+		std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.time < b.time; });
+		for (const auto &e : entries) {
+			if (total <= state().maxBytes)
+				break;
+			if (PGUPV::deleteFile(e.path)) {
+				total -= e.size;
+				state().stats.evicted++;
+			}
+		}
+	}
+};
+
+void ProgramCache::setEnabled(bool enable) {
+	state().enabled = enable;
+}
+
+bool ProgramCache::isEnabled() {
+	return state().enabled;
+}
+
+bool ProgramCache::isAvailable() {
+	if (!state().enabled || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+void ProgramCache::setDirectory(const std::string &dir) {
+	state().dir = dir;
+}
+
+const std::string &ProgramCache::getDirectory() {
+	return state().dir;
+}
+
+void ProgramCache::setMaxSize(size_t bytes) {
+	state().maxBytes = bytes;
+}
+
+size_t ProgramCache::getMaxSize() {
+	return state().maxBytes;
+}
+
+GLuint ProgramCache::load(const std::string &key) {
+	auto fkey = fullKey(key);
+	auto path = pathFor(fkey);
+	std::ifstream f(path, std::ios::binary);
+	Header h;
+	if (!f || !f.read(reinterpret_cast<char *>(&h), sizeof(h)) ||
+		!std::equal(MAGIC, MAGIC + sizeof(MAGIC), h.magic) ||
+		h.check != djb2r(fkey) || h.keyLength != fkey.size()) {
+		state().stats.misses++;
+		return 0;
+	}
+	std::vector<char> binary(h.length);
+	if (!f.read(binary.data(), h.length)) {
+		state().stats.misses++;
+		return 0;
+	}
+	f.close();
+
+	GLuint programId = glCreateProgram();
+	glProgramBinary(programId, h.format, binary.data(), h.length);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE) {
+		// El driver ha cambiado sin cambiar de versión, o el fichero está mal: se recompila
+		glDeleteProgram(programId);
+		PGUPV::deleteFile(path);
+		state().stats.rejected++;
+		return 0;
+	}
+	state().stats.hits++;
+	return programId;
+}
+
+void ProgramCache::store(const std::string &key, GLuint programId) {
+	GLint length = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format;
+	glGetProgramBinary(programId, length, &length, &format, binary.data());
+	if (length <= 0)
+		return;
+
+	if (!PGUPV::dirExists(state().dir) && !PGUPV::createDir(state().dir)) {
+		WARN("No se ha podido crear el directorio de la caché de programas " + state().dir);
+		return;
+	}
+	auto fkey = fullKey(key);
+	Header h;
+	std::copy(MAGIC, MAGIC + sizeof(MAGIC), h.magic);
+	h.check = djb2r(fkey);
+	h.keyLength = fkey.size();
+	h.format = format;
+	h.length = static_cast<uint32_t>(length);
+
+	// Se escribe en un fichero temporal y se renombra, para que otro proceso que use la misma
+	// caché no lea nunca un fichero a medias
+	auto path = pathFor(fkey);
+	auto tmp = path + ".tmp";
+	{
+		std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+		if (!f.write(reinterpret_cast<const char *>(&h), sizeof(h)) || !f.write(binary.data(), length)) {
+			WARN("No se ha podido escribir el fichero " + tmp);
+			return;
+		}
+	}
+	PGUPV::deleteFile(path);
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+		PGUPV::deleteFile(tmp);
+		return;
+	}
+	state().stats.stored++;
+	evictOldest();
+}
+
+void ProgramCache::clear() {
+	if (!PGUPV::dirExists(state().dir))
+		return;
+	for (const auto &f : PGUPV::listFiles(state().dir, false, { std::string("*") + EXTENSION }))
+		PGUPV::deleteFile(f);
+}
+
+const ProgramCache::Stats &ProgramCache::getStats() {
+	return state().stats;
+}
+
+void ProgramCache::resetStats() {
+	state().stats = Stats();
+}
@@ -87,7 +87,7 @@ void RenderBoundingVolumes::renderBBox(const BoundingBox &bb, bool highlight, co
   if (!box) box = std::unique_ptr<WireBox>(new WireBox());
   Mesh &m = box->getMesh(0);
   m.setColor(color);
-  auto vbo = m.getBufferObject(Mesh::VERTICES);
+  auto vbo = m.getMutableBufferObject(Mesh::VERTICES);
   gl_copy_write_buffer.bind(vbo);
   auto vertices = bb.getVertices();
   gl_copy_write_buffer.write(&vertices[0]);
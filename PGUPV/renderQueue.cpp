@@ -0,0 +1,326 @@
+#include "renderQueue.h"
+#include "nodeVisitor.h"
+#include "indexedBindingPoint.h"
+#include "glMatrices.h"
+#include "program.h"
+#include "instancing.h"
+#include "log.h"
+
+using PGUPV::RenderQueue;
+using PGUPV::RenderBackend;
+using PGUPV::GLRenderBackend;
+using PGUPV::DrawPacket;
+using PGUPV::NodeVisitor;
+using PGUPV::Node;
+using PGUPV::Group;
+using PGUPV::Transform;
+using PGUPV::Geode;
+using PGUPV::AnimationNode;
+using PGUPV::Model;
+using PGUPV::Mesh;
+using PGUPV::Program;
+using PGUPV::BaseMaterial;
+using PGUPV::GLMatrices;
+using PGUPV::Instancing;
+
+namespace {
+	// Bits de cada campo de la clave de ordenación
+	const int PROGRAM_BITS = 16, MATERIAL_BITS = 24, MESH_BITS = 24;
+
+	/*
+	Recorre el grafo como lo haría Node::render, pero en vez de dibujar, añade las mallas
+	a la cola con su matriz del modelo y el programa que les toca (el del nodo más cercano
+	que tenga uno, ver Node::setProgram)
+	*/
+	class CollectDrawPackets : public NodeVisitor {
+	public:
+		CollectDrawPackets(RenderQueue &queue, Program *program, const glm::mat4 &modelMatrix) :
+			queue(queue), programs{ program }, matrices{ modelMatrix } {}
+
+		void apply(Group &group) override {
+			if (!group.isVisible() || !group.getBB().isValid())
+				return;
+			bool pushed = pushProgram(group);
+			traverse(group);
+			popProgram(pushed);
+		}
+
+		void apply(Transform &transform) override {
+			if (!transform.isVisible() || !transform.getBB().isValid())
+				return;
+			bool pushed = pushProgram(transform);
+			matrices.push_back(matrices.back() * transform.getTransform());
+			traverse(transform);
+			matrices.pop_back();
+			popProgram(pushed);
+		}
+
+		void apply(Geode &geode) override {
+			if (!geode.isVisible())
+				return;
+			bool pushed = pushProgram(geode);
+			Model &model = geode.getModel();
+			for (uint i = 0; i < model.getNMeshes(); i++) {
+				Mesh &mesh = model.getMesh(i);
+				queue.add(programs.back(), mesh.getMaterial().get(), &mesh, &geode, matrices.back());
+			}
+			popProgram(pushed);
+		}
+
+		void apply(AnimationNode &node) override {
+			bool pushed = pushProgram(node);
+			queue.addNode(programs.back(), &node, matrices.back());
+			popProgram(pushed);
+		}
+	private:
+		bool pushProgram(Node &node) {
+			Program *p = node.getProgram().get();
+			if (!p)
+				return false;
+			programs.push_back(p);
+			return true;
+		}
+		void popProgram(bool pushed) {
+			if (pushed)
+				programs.pop_back();
+		}
+		RenderQueue &queue;
+		std::vector<Program *> programs;
+		std::vector<glm::mat4> matrices;
+	};
+
+	/*
+	Radix sort (LSD, dígitos de 8 bits) de las entradas por su clave. Se saltan las pasadas
+	en las que todas las claves tienen el mismo dígito, que son la mayoría porque los
+	campos de la clave son pequeños
+	*/
+	template <typename Entry>
+	void radixSort(std::vector<Entry> &entries, std::vector<Entry> &scratch) {
+		const int DIGITS = 8;
+		size_t count[DIGITS][256] = {};
+		for (const auto &e : entries) {
+			for (int d = 0; d < DIGITS; d++)
+				count[d][(e.key >> (8 * d)) & 0xff]++;
+		}
+		scratch.resize(entries.size());
+		for (int d = 0; d < DIGITS; d++) {
+			size_t *c = count[d];
+			if (c[(entries[0].key >> (8 * d)) & 0xff] == entries.size())
+				continue;
+			size_t offset = 0;
+			for (int b = 0; b < 256; b++) {
+				size_t n = c[b];
+				c[b] = offset;
+				offset += n;
+			}
+			for (const auto &e : entries)
+				scratch[c[(e.key >> (8 * d)) & 0xff]++] = e;
+			entries.swap(scratch);
+		}
+	}
+};
+
+void RenderQueue::clear()
+{
+	packets.clear();
+	nodes.clear();
+	programRanks.clear();
+	materialRanks.clear();
+	meshRanks.clear();
+	isSorted = true;
+}
+
+uint32_t RenderQueue::rank(std::unordered_map<const void *, uint32_t> &ranks, const void *p)
+{
+	auto it = ranks.find(p);
+	if (it != ranks.end())
+		return it->second;
+	uint32_t r = static_cast<uint32_t>(ranks.size());
+	ranks[p] = r;
+	return r;
+}
+
+void RenderQueue::add(Program *program, BaseMaterial *material, Mesh *mesh, Node *node, const glm::mat4 &modelMatrix)
+{
+	uint64_t p = rank(programRanks, program), m = rank(materialRanks, material), v = rank(meshRanks, mesh);
+	if (p >> PROGRAM_BITS || m >> MATERIAL_BITS || v >> MESH_BITS)
+		ERRT("RenderQueue: demasiados programas, materiales o mallas distintos en la cola");
+	DrawPacket packet;
+	packet.sortKey = (p << (MATERIAL_BITS + MESH_BITS)) | (m << MESH_BITS) | v;
+	packet.program = program;
+	packet.material = material;
+	packet.mesh = mesh;
+	packet.node = node;
+	packet.modelMatrix = modelMatrix;
+	packets.push_back(packet);
+	isSorted = false;
+}
+
+void RenderQueue::addNode(Program *program, Node *node, const glm::mat4 &modelMatrix)
+{
+	DrawPacket packet;
+	packet.sortKey = 0;
+	packet.program = program;
+	packet.material = nullptr;
+	packet.mesh = nullptr;
+	packet.node = node;
+	packet.modelMatrix = modelMatrix;
+	nodes.push_back(packet);
+}
+
+void RenderQueue::collect(Node &root, Program *program, const glm::mat4 &modelMatrix)
+{
+	if (!program)
+		program = Program::getCurrentProgram();
+	CollectDrawPackets collector(*this, program, modelMatrix);
+	root.accept(collector);
+}
+
+void RenderQueue::sort()
+{
+	if (isSorted)
+		return;
+	isSorted = true;
+	if (packets.size() < 2)
+		return;
+
+	entries.resize(packets.size());
+	for (size_t i = 0; i < packets.size(); i++) {
+		entries[i].key = packets[i].sortKey;
+		entries[i].index = static_cast<uint32_t>(i);
+	}
+	radixSort(entries, scratch);
+	sorted.resize(packets.size());
+	for (size_t i = 0; i < entries.size(); i++)
+		sorted[i] = packets[entries[i].index];
+	packets.swap(sorted);
+}
+
+void RenderQueue::submit(RenderBackend &backend)
+{
+	sort();
+	backend.begin();
+
+	// Estado actual del backend (nullptr: desconocido)
+	Program *program = nullptr;
+	BaseMaterial *material = nullptr;
+	Mesh *mesh = nullptr;
+	const glm::mat4 *modelMatrix = nullptr;
+
+	for (size_t i = 0; i < packets.size(); ) {
+		const DrawPacket &p = packets[i];
+		if (p.program != program && p.program) {
+			backend.setProgram(p.program);
+			program = p.program;
+			// Program::use vuelve a vincular los UBO del programa (incluido el del material)
+			material = nullptr;
+		}
+		if (p.material != material && p.material) {
+			backend.setMaterial(p.material);
+			material = p.material;
+		}
+		if (p.mesh != mesh) {
+			backend.setMesh(p.mesh);
+			mesh = p.mesh;
+		}
+		// Los paquetes que sólo se diferencian en la matriz están seguidos (ver sort)
+		size_t n = 1;
+		if (instancing) {
+			while (i + n < packets.size() && packets[i + n].mesh == p.mesh &&
+				packets[i + n].material == p.material && packets[i + n].program == p.program)
+				n++;
+		}
+		if (n > 1) {
+			backend.drawInstanced(&packets[i], n);
+			modelMatrix = nullptr;
+		}
+		else {
+			if (!modelMatrix || *modelMatrix != p.modelMatrix) {
+				backend.setModelMatrix(p.modelMatrix);
+				modelMatrix = &p.modelMatrix;
+			}
+			backend.draw(p);
+		}
+		i += n;
+	}
+
+	for (const auto &n : nodes) {
+		if (n.program != program && n.program) {
+			backend.setProgram(n.program);
+			program = n.program;
+		}
+		backend.setModelMatrix(n.modelMatrix);
+		backend.renderNode(n.node);
+	}
+	backend.end();
+}
+
+GLRenderBackend::GLRenderBackend() : instancing(new Instancing()), programInstancing(false)
+{
+}
+
+GLRenderBackend::~GLRenderBackend()
+{
+}
+
+void GLRenderBackend::begin()
+{
+	mats = std::dynamic_pointer_cast<GLMatrices>(gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX));
+	if (!mats)
+		ERRT("GLRenderBackend: no hay un GLMatrices vinculado");
+	mats->pushMatrix(GLMatrices::MODEL_MATRIX);
+	Program *current = Program::getCurrentProgram();
+	programInstancing = current && Instancing::isInstancingProgram(*current);
+}
+
+void GLRenderBackend::setProgram(Program *program)
+{
+	program->use();
+	programInstancing = Instancing::isInstancingProgram(*program);
+}
+
+void GLRenderBackend::setMaterial(BaseMaterial *material)
+{
+	material->use();
+}
+
+void GLRenderBackend::setMesh(Mesh *mesh)
+{
+	mesh->bind();
+}
+
+void GLRenderBackend::setModelMatrix(const glm::mat4 &modelMatrix)
+{
+	mats->setMatrix(GLMatrices::MODEL_MATRIX, modelMatrix);
+}
+
+void GLRenderBackend::draw(const DrawPacket &packet)
+{
+	packet.mesh->draw();
+}
+
+void GLRenderBackend::drawInstanced(const DrawPacket *packets, size_t n)
+{
+	Mesh *mesh = packets[0].mesh;
+	if (!programInstancing || !Instancing::canInstance(*mesh)) {
+		RenderBackend::drawInstanced(packets, n);
+		return;
+	}
+	instanceMatrices.resize(n);
+	for (size_t i = 0; i < n; i++)
+		instanceMatrices[i] = packets[i].modelMatrix;
+	// El shader multiplica la matriz del modelo por la de cada instancia
+	mats->setMatrix(GLMatrices::MODEL_MATRIX, glm::mat4(1.0f));
+	instancing->draw(*mesh, instanceMatrices.data(), n);
+}
+
+void GLRenderBackend::renderNode(Node *node)
+{
+	node->render();
+}
+
+void GLRenderBackend::end()
+{
+	mats->popMatrix(GLMatrices::MODEL_MATRIX);
+	mats.reset();
+}
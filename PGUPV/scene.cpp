@@ -4,8 +4,16 @@
 #include "describeScenegraph.h"
 #include "findNodeByName.h"
 #include "animationClip.h"
+#include "animationNode.h"
 #include "updateVisitor.h"
 #include "baseMaterial.h"
+#include "sceneBVH.h"
+#include "renderQueue.h"
+#include "staticBatch.h"
+#include "cullVisitor.h"
+#include "occlusionCuller.h"
+#include "indexedBindingPoint.h"
+#include "glMatrices.h"
 
 using PGUPV::Node;
 using PGUPV::Scene;
@@ -15,18 +23,87 @@ using PGUPV::BoundingSphere;
 using PGUPV::Mesh;
 using PGUPV::AnimationClip;
 using PGUPV::BaseMaterial;
+using PGUPV::SceneBVH;
+using PGUPV::RenderQueue;
+using PGUPV::GLRenderBackend;
+using PGUPV::StaticBatch;
+using PGUPV::CullVisitor;
+using PGUPV::OcclusionCuller;
 
 
-Scene::Scene() {
+Scene::Scene() : renderMode(RenderMode::IMMEDIATE), frustumCulling(false), occlusionCulling(false) {
 }
 
 void Scene::setRoot(std::shared_ptr<Node> root) {
 	sceneRoot = root;
+	if (bvh)
+		bvh->setRoot(root);
+	if (staticBatch)
+		staticBatch->clear();
 }
 
 void Scene::render() {
-	if (sceneRoot)
-		sceneRoot->render();
+	if (!sceneRoot)
+		return;
+	auto mats = std::dynamic_pointer_cast<GLMatrices>(PGUPV::gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX));
+	bool cull = frustumCulling && mats;
+	if (renderMode == RenderMode::IMMEDIATE) {
+		if (occlusionCulling && mats) {
+			getOcclusionCuller().render(*sceneRoot);
+		}
+		else if (cull) {
+			getCullVisitor().cull(*sceneRoot, *mats);
+			getCullVisitor().render();
+		}
+		else
+			sceneRoot->render();
+		return;
+	}
+	glm::mat4 modelMatrix = mats ? mats->getMatrix(GLMatrices::MODEL_MATRIX) : glm::mat4(1.0f);
+	if (renderMode == RenderMode::STATIC_BATCH) {
+		StaticBatch &batch = getStaticBatch();
+		if (!batch.isUpToDate(*sceneRoot, modelMatrix))
+			batch.build(*sceneRoot, modelMatrix);
+		batch.render();
+		return;
+	}
+	RenderQueue &queue = getRenderQueue();
+	queue.clear();
+	if (cull) {
+		// Slo se recogen las mallas de las hojas visibles
+		getCullVisitor().cull(*sceneRoot, *mats);
+		for (const auto &v : getCullVisitor().getVisible())
+			queue.collect(*v.node, v.program, v.modelMatrix);
+	}
+	else
+		queue.collect(*sceneRoot, nullptr, modelMatrix);
+	if (!glBackend)
+		glBackend = std::make_shared<GLRenderBackend>();
+	queue.submit(*glBackend);
+}
+
+RenderQueue &Scene::getRenderQueue() {
+	if (!renderQueue)
+		renderQueue = std::make_shared<RenderQueue>();
+	return *renderQueue;
+}
+
+CullVisitor &Scene::getCullVisitor() {
+	if (!cullVisitor)
+		cullVisitor = std::make_shared<CullVisitor>();
+	return *cullVisitor;
+}
+
+OcclusionCuller &Scene::getOcclusionCuller() {
+	if (!occlusionCuller)
+		occlusionCuller = std::make_shared<OcclusionCuller>();
+	return *occlusionCuller;
+}
+
+StaticBatch &Scene::getStaticBatch() {
+	if (!staticBatch)
+		staticBatch = std::make_shared<StaticBatch>();
+	return *staticBatch;
 }
 
 BoundingBox Scene::getBB() {
@@ -60,8 +137,12 @@ void Scene::print(std::ostream & os) {
 void Scene::update(unsigned int )
 {
 	PGUPV::UpdateVisitor update;
-	if (sceneRoot)
-		sceneRoot->accept(update);
+	if (!sceneRoot)
+		return;
+	sceneRoot->accept(update);
+	// Las poses de los personajes se calculan todas a la vez, repartidas entre los hilos,
+	// aunque luego no se dibujen
+	PGUPV::AnimationNode::evaluatePoses(*sceneRoot);
 }
 
 
@@ -155,3 +236,11 @@ std::shared_ptr<AnimationClip> PGUPV::Scene::getAnimation(size_t index) const
 {
 	return animations[index];
 }
+
+SceneBVH &Scene::getBVH() {
+	if (!bvh)
+		bvh = std::make_shared<SceneBVH>(sceneRoot);
+	else
+		bvh->update();
+	return *bvh;
+}
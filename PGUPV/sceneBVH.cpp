@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "sceneBVH.h"
+#include "node.h"
+#include "group.h"
+#include "transform.h"
+
+using PGUPV::SceneBVH;
+using PGUPV::BoundingBox;
+using PGUPV::BoundingSphere;
+using PGUPV::Frustum;
+using PGUPV::Node;
+using PGUPV::Group;
+using PGUPV::Transform;
+using PGUPV::Ray;
+using PGUPV::BVH;
+
+namespace {
+	const int NONE = -1;
+	// El árbol se reconstruye cuando su coste SAH crece más que este factor respecto al mejor
+	// que ha tenido desde la última reconstrucción
+	const float REBUILD_GROWTH = 1.5f;
+	// Con pocas hojas no merece la pena reconstruir
+	const size_t MIN_LEAVES_TO_REBUILD = 8;
+
+	float perimeter(const BoundingBox &bb) {
+		glm::vec3 d = bb.max - bb.min;
+		return 2.0f * (d.x + d.y + d.z);
+	}
+
+	BoundingBox merge(const BoundingBox &a, const BoundingBox &b) {
+		BoundingBox r = a;
+		r.grow(b);
+		return r;
+	}
+
+	bool contains(const BoundingBox &outer, const BoundingBox &inner) {
+		return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+	}
+
+	bool overlaps(const BoundingBox &a, const glm::vec3 &min, const glm::vec3 &max) {
+		return glm::all(glm::lessThanEqual(a.min, max)) && glm::all(glm::greaterThanEqual(a.max, min));
+	}
+
+	/*
+	Árbol dinámico de cajas (como el de Box2D): las hojas se insertan buscando el hermano
+	que menos aumenta el perímetro de los nodos, y se pueden quitar o mover sin
+	reconstruir el árbol. Como las inserciones y los movimientos van empeorando el árbol,
+	se lleva la cuenta de su coste (la suma de los perímetros de los nodos internos,
+	relativa al de la raíz) para poder reconstruirlo cuando crece demasiado
+	*/
+	class DynamicTree {
+	public:
+		int insert(const BoundingBox &box, int item) {
+			int leaf = allocate();
+			nodes[leaf].box = box;
+			nodes[leaf].item = item;
+			insertLeaf(leaf);
+			nLeaves++;
+			return leaf;
+		}
+
+		void remove(int leaf) {
+			removeLeaf(leaf);
+			release(leaf);
+			nLeaves--;
+		}
+
+		/*
+		\return true si el coste del árbol ha crecido lo suficiente como para reconstruirlo.
+		La referencia es el menor coste visto desde la última reconstrucción (el coste
+		relativo baja solo cuando la escena se extiende)
+		*/
+		bool needsRebuild() {
+			float c = cost();
+			bestCost = std::min(bestCost, c);
+			return nLeaves >= MIN_LEAVES_TO_REBUILD && c > REBUILD_GROWTH * bestCost;
+		}
+
+		/*
+		Reconstruye los nodos internos de arriba a abajo, partiendo cada conjunto de hojas
+		por donde menos suma el área de las dos mitades (SAH). Las hojas conservan su índice
+		*/
+		void rebuild() {
+			std::vector<int> leaves;
+			leaves.reserve(nLeaves);
+			if (root != NONE) {
+				std::vector<int> stack{ root };
+				while (!stack.empty()) {
+					int i = stack.back();
+					stack.pop_back();
+					if (nodes[i].isLeaf()) {
+						leaves.push_back(i);
+					}
+					else {
+						stack.push_back(nodes[i].left);
+						stack.push_back(nodes[i].right);
+						release(i);
+					}
+				}
+			}
+			internalPerimeter = 0.0f;
+			root = leaves.empty() ? NONE : build(leaves, 0, leaves.size());
+			if (root != NONE)
+				nodes[root].parent = NONE;
+			bestCost = cost();
+		}
+
+		/*
+		Cambia la caja de una hoja. Si la nueva caja sigue dentro de la de la hoja (que tiene
+		un margen) no hace nada; si se solapa con ella, sólo reajusta los antecesores; y si
+		no, vuelve a insertar la hoja
+		*/
+		void move(int leaf, const BoundingBox &box) {
+			TreeNode &n = nodes[leaf];
+			if (contains(n.box, box))
+				return;
+			bool overlapping = overlaps(n.box, box.min, box.max);
+			n.box = box;
+			if (overlapping) {
+				refit(n.parent);
+			}
+			else {
+				removeLeaf(leaf);
+				insertLeaf(leaf);
+			}
+		}
+
+		const BoundingBox &getBox(int leaf) const { return nodes[leaf].box; }
+
+		BoundingBox getBB() const {
+			return root == NONE ? BoundingBox() : nodes[root].box;
+		}
+
+		// Llama a visit(item) con las hojas cuya caja cumple el predicado
+		template <typename Pred, typename Visit>
+		void query(Pred pred, Visit visit) const {
+			if (root == NONE)
+				return;
+			std::vector<int> stack{ root };
+			while (!stack.empty()) {
+				const TreeNode &n = nodes[stack.back()];
+				stack.pop_back();
+				if (!pred(n.box))
+					continue;
+				if (n.isLeaf()) {
+					visit(n.item);
+				}
+				else {
+					stack.push_back(n.right);
+					stack.push_back(n.left);
+				}
+			}
+		}
+	private:
+		struct TreeNode {
+			BoundingBox box;
+			int parent = NONE, left = NONE, right = NONE;
+			int item = NONE;
+			bool isLeaf() const { return left == NONE; }
+		};
+		std::vector<TreeNode> nodes;
+		std::vector<int> freeNodes;
+		int root = NONE;
+		size_t nLeaves = 0;
+		// Suma de los perímetros de los nodos internos, y menor coste desde la última reconstrucción
+		float internalPerimeter = 0.0f;
+		float bestCost = 0.0f;
+
+		float cost() const {
+			if (root == NONE || nodes[root].isLeaf())
+				return 0.0f;
+			float p = perimeter(nodes[root].box);
+			return p > 0.0f ? internalPerimeter / p : 0.0f;
+		}
+
+		// Construye el subárbol de las hojas leaves[begin, end) y devuelve su raíz
+		int build(std::vector<int> &leaves, size_t begin, size_t end) {
+			if (end - begin == 1)
+				return leaves[begin];
+
+			// Ordenamos los centros en el eje en el que más se extienden
+			glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+			for (size_t i = begin; i < end; i++) {
+				glm::vec3 c = 0.5f * (nodes[leaves[i]].box.min + nodes[leaves[i]].box.max);
+				lo = glm::min(lo, c);
+				hi = glm::max(hi, c);
+			}
+			glm::vec3 extent = hi - lo;
+			int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+			std::sort(leaves.begin() + begin, leaves.begin() + end, [this, axis](int a, int b) {
+				return nodes[a].box.min[axis] + nodes[a].box.max[axis] < nodes[b].box.min[axis] + nodes[b].box.max[axis];
+			});
+
+			// Coste de cada partición: área de cada mitad por su número de hojas
+			const size_t n = end - begin;
+			std::vector<float> rightCost(n);
+			BoundingBox acc = nodes[leaves[end - 1]].box;
+			for (size_t i = n - 1; i > 0; i--) {
+				acc.grow(nodes[leaves[begin + i]].box);
+				rightCost[i] = perimeter(acc) * (n - i);
+			}
+			std::vector<float> splitCost(n);
+			acc = nodes[leaves[begin]].box;
+			for (size_t i = 1; i < n; i++) {
+				splitCost[i] = perimeter(acc) * i + rightCost[i];
+				acc.grow(nodes[leaves[begin + i]].box);
+			}
+			// En caso de empate, la partición más equilibrada (así el árbol no degenera en
+			// una lista cuando muchas cajas coinciden)
+			size_t split = n / 2;
+			for (size_t i = 1; i < n; i++) {
+				if (splitCost[i] < splitCost[split])
+					split = i;
+			}
+
+			int left = build(leaves, begin, begin + split);
+			int right = build(leaves, begin + split, end);
+			int parent = allocate();
+			nodes[parent].left = left;
+			nodes[parent].right = right;
+			nodes[parent].box = merge(nodes[left].box, nodes[right].box);
+			nodes[left].parent = parent;
+			nodes[right].parent = parent;
+			internalPerimeter += perimeter(nodes[parent].box);
+			return parent;
+		}
+
+		int allocate() {
+			if (!freeNodes.empty()) {
+				int i = freeNodes.back();
+				freeNodes.pop_back();
+				nodes[i] = TreeNode();
+				return i;
+			}
+			nodes.push_back(TreeNode());
+			return static_cast<int>(nodes.size()) - 1;
+		}
+
+		void release(int i) {
+			if (!nodes[i].isLeaf())
+				internalPerimeter -= perimeter(nodes[i].box);
+			freeNodes.push_back(i);
+		}
+
+		void refit(int i) {
+			while (i != NONE) {
+				TreeNode &n = nodes[i];
+				float before = perimeter(n.box);
+				n.box = merge(nodes[n.left].box, nodes[n.right].box);
+				internalPerimeter += perimeter(n.box) - before;
+				i = n.parent;
+			}
+		}
+
+		void insertLeaf(int leaf) {
+			nodes[leaf].parent = NONE;
+			if (root == NONE) {
+				root = leaf;
+				return;
+			}
+
+			// Bajamos por el hijo que menos crece, mientras sea más barato que colgar la
+			// hoja del nodo actual
+			const BoundingBox box = nodes[leaf].box;
+			int i = root;
+			while (!nodes[i].isLeaf()) {
+				const TreeNode &n = nodes[i];
+				float area = perimeter(n.box);
+				float combined = perimeter(merge(n.box, box));
+				float cost = 2.0f * combined;
+				float inheritance = 2.0f * (combined - area);
+				auto childCost = [&](int c) {
+					float grown = perimeter(merge(nodes[c].box, box));
+					return (nodes[c].isLeaf() ? grown : grown - perimeter(nodes[c].box)) + inheritance;
+				};
+				float costLeft = childCost(n.left), costRight = childCost(n.right);
+				if (cost < costLeft && cost < costRight)
+					break;
+				i = costLeft < costRight ? n.left : n.right;
+			}
+
+			int sibling = i;
+			int oldParent = nodes[sibling].parent;
+			int newParent = allocate();
+			nodes[newParent].parent = oldParent;
+			nodes[newParent].left = sibling;
+			nodes[newParent].right = leaf;
+			nodes[newParent].box = merge(nodes[sibling].box, box);
+			internalPerimeter += perimeter(nodes[newParent].box);
+			nodes[sibling].parent = newParent;
+			nodes[leaf].parent = newParent;
+			if (oldParent == NONE) {
+				root = newParent;
+			}
+			else if (nodes[oldParent].left == sibling) {
+				nodes[oldParent].left = newParent;
+			}
+			else {
+				nodes[oldParent].right = newParent;
+			}
+			refit(oldParent);
+		}
+
+		void removeLeaf(int leaf) {
+			if (leaf == root) {
+				root = NONE;
+				return;
+			}
+			int parent = nodes[leaf].parent;
+			int grandParent = nodes[parent].parent;
+			int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+			if (grandParent == NONE) {
+				root = sibling;
+				nodes[sibling].parent = NONE;
+			}
+			else {
+				if (nodes[grandParent].left == parent)
+					nodes[grandParent].left = sibling;
+				else
+					nodes[grandParent].right = sibling;
+				nodes[sibling].parent = grandParent;
+				refit(grandParent);
+			}
+			release(parent);
+			nodes[leaf].parent = NONE;
+		}
+	};
+
+	bool boxSphere(const BoundingBox &bb, const BoundingSphere &bs) {
+		glm::vec3 closest = glm::clamp(bs.center, bb.min, bb.max);
+		glm::vec3 d = closest - bs.center;
+		return glm::dot(d, d) <= bs.radius * bs.radius;
+	}
+};
+
+class SceneBVH::SceneBVHImpl {
+public:
+	// Copia del grafo de escena con lo que se vio en la última actualización
+	struct Entry {
+		std::shared_ptr<Node> node;
+		uint64_t version = 0;
+		glm::mat4 world;
+		std::vector<std::unique_ptr<Entry>> children;
+		int item = NONE;
+	};
+
+	std::shared_ptr<Node> root;
+	std::unique_ptr<Entry> rootEntry;
+	DynamicTree tree;
+	std::vector<Item> items;
+	std::vector<int> itemLeaves;
+	std::vector<int> freeItems;
+	size_t nItems = 0;
+
+	void sync(Entry &e, const glm::mat4 &parentWorld, bool force);
+	void destroy(Entry &e);
+	void setLeaf(Entry &e, const BoundingBox &bb);
+	void removeLeaf(Entry &e);
+
+	template <typename Pred>
+	std::vector<Item> query(Pred pred) const {
+		std::vector<Item> result;
+		tree.query(pred, [&](int i) {
+			if (pred(items[i].bb))
+				result.push_back(items[i]);
+		});
+		return result;
+	}
+};
+
+void SceneBVH::SceneBVHImpl::setLeaf(Entry &e, const BoundingBox &bb)
+{
+	if (!bb.isValid()) {
+		removeLeaf(e);
+		return;
+	}
+	if (e.item == NONE) {
+		if (!freeItems.empty()) {
+			e.item = freeItems.back();
+			freeItems.pop_back();
+		}
+		else {
+			e.item = static_cast<int>(items.size());
+			items.push_back(Item());
+			itemLeaves.push_back(NONE);
+		}
+		nItems++;
+	}
+	Item &item = items[e.item];
+	item.node = e.node.get();
+	item.modelMatrix = e.world;
+	item.bb = bb;
+
+	// Las hojas del árbol tienen un margen para no tener que moverlas con cada cambio pequeño
+	BoundingBox fat = bb;
+	glm::vec3 margin = 0.1f * (bb.max - bb.min);
+	fat.min -= margin;
+	fat.max += margin;
+	if (itemLeaves[e.item] == NONE)
+		itemLeaves[e.item] = tree.insert(fat, e.item);
+	else if (!contains(tree.getBox(itemLeaves[e.item]), bb))
+		tree.move(itemLeaves[e.item], fat);
+}
+
+void SceneBVH::SceneBVHImpl::removeLeaf(Entry &e)
+{
+	if (e.item == NONE)
+		return;
+	tree.remove(itemLeaves[e.item]);
+	itemLeaves[e.item] = NONE;
+	items[e.item].node = nullptr;
+	freeItems.push_back(e.item);
+	nItems--;
+	e.item = NONE;
+}
+
+void SceneBVH::SceneBVHImpl::destroy(Entry &e)
+{
+	removeLeaf(e);
+	for (auto &c : e.children)
+		destroy(*c);
+	e.children.clear();
+}
+
+void SceneBVH::SceneBVHImpl::sync(Entry &e, const glm::mat4 &parentWorld, bool force)
+{
+	Node *n = e.node.get();
+	// Si ni el nodo ni nada por debajo ha cambiado, ni tampoco su posición en el mundo,
+	// no hay nada que hacer en esta rama
+	if (!force && n->getVersion() == e.version)
+		return;
+	e.version = n->getVersion();
+
+	glm::mat4 world = parentWorld;
+	Transform *transform = dynamic_cast<Transform *>(n);
+	if (transform)
+		world = parentWorld * transform->getTransform();
+	bool worldChanged = force || world != e.world;
+	e.world = world;
+
+	Group *group = dynamic_cast<Group *>(n);
+	if (!group) {
+		BoundingBox bb = n->getBB();
+		bb.transform(world);
+		setLeaf(e, bb);
+		return;
+	}
+
+	// Emparejamos los hijos actuales con los que había, por su puntero. Normalmente están
+	// en el mismo orden; si no, se buscan en un índice de los anteriores
+	std::vector<std::unique_ptr<Entry>> old;
+	old.swap(e.children);
+	e.children.reserve(group->getNumChildren());
+	std::unordered_multimap<Node *, size_t> oldIndex;
+	bool indexed = false;
+	for (size_t i = 0; i < group->getNumChildren(); i++) {
+		std::shared_ptr<Node> child = group->getChild(i);
+		size_t found = old.size();
+		if (i < old.size() && old[i] && old[i]->node == child) {
+			found = i;
+		}
+		else {
+			if (!indexed) {
+				for (size_t j = 0; j < old.size(); j++)
+					if (old[j]) oldIndex.emplace(old[j]->node.get(), j);
+				indexed = true;
+			}
+			auto range = oldIndex.equal_range(child.get());
+			for (auto it = range.first; it != range.second; ++it) {
+				if (old[it->second]) {
+					found = it->second;
+					break;
+				}
+			}
+		}
+		bool isNew = found == old.size();
+		if (isNew) {
+			e.children.emplace_back(new Entry());
+			e.children.back()->node = child;
+		}
+		else {
+			e.children.push_back(std::move(old[found]));
+		}
+		sync(*e.children.back(), world, worldChanged || isNew);
+	}
+	// Los hijos que ya no están salen de la jerarquía
+	for (auto &o : old) {
+		if (o) destroy(*o);
+	}
+}
+
+SceneBVH::SceneBVH(std::shared_ptr<Node> root) : pimpl(new SceneBVHImpl())
+{
+	setRoot(root);
+}
+
+SceneBVH::~SceneBVH()
+{
+}
+
+void SceneBVH::setRoot(std::shared_ptr<Node> root)
+{
+	if (pimpl->rootEntry)
+		pimpl->destroy(*pimpl->rootEntry);
+	pimpl->rootEntry.reset();
+	pimpl->root = root;
+	update();
+}
+
+std::shared_ptr<Node> SceneBVH::getRoot() const
+{
+	return pimpl->root;
+}
+
+void SceneBVH::update()
+{
+	if (!pimpl->root)
+		return;
+	bool isNew = !pimpl->rootEntry;
+	if (isNew) {
+		pimpl->rootEntry.reset(new SceneBVHImpl::Entry());
+		pimpl->rootEntry->node = pimpl->root;
+	}
+	pimpl->sync(*pimpl->rootEntry, glm::mat4(1.0f), isNew);
+	if (isNew || pimpl->tree.needsRebuild())
+		pimpl->tree.rebuild();
+}
+
+std::vector<SceneBVH::Item> SceneBVH::queryBox(const BoundingBox &bb) const
+{
+	return pimpl->query([&bb](const BoundingBox &box) { return overlaps(box, bb.min, bb.max); });
+}
+
+std::vector<SceneBVH::Item> SceneBVH::querySphere(const BoundingSphere &bs) const
+{
+	return pimpl->query([&bs](const BoundingBox &box) { return boxSphere(box, bs); });
+}
+
+std::vector<SceneBVH::Item> SceneBVH::queryFrustum(const glm::mat4 &viewProj) const
+{
+	Frustum frustum(viewProj);
+	return pimpl->query([&frustum](const BoundingBox &box) { return frustum.intersects(box); });
+}
+
+std::vector<SceneBVH::RayHit> SceneBVH::queryRay(const Ray &ray, float tmax) const
+{
+	const glm::vec3 invDir = 1.0f / ray.direction;
+	std::vector<RayHit> result;
+	float tnear;
+	pimpl->tree.query([&](const BoundingBox &box) {
+		return BVH::intersectBox(ray.origin, invDir, box.min, box.max, tmax, tnear);
+	}, [&](int i) {
+		const Item &item = pimpl->items[i];
+		if (BVH::intersectBox(ray.origin, invDir, item.bb.min, item.bb.max, tmax, tnear))
+			result.push_back(RayHit{ item, tnear });
+	});
+	std::sort(result.begin(), result.end(), [](const RayHit &a, const RayHit &b) { return a.distance < b.distance; });
+	return result;
+}
+
+size_t SceneBVH::getNumItems() const
+{
+	return pimpl->nItems;
+}
+
+BoundingBox SceneBVH::getBB() const
+{
+	// La caja de la raíz del árbol tiene margen: calculamos la exacta
+	BoundingBox bb;
+	for (const auto &item : pimpl->items) {
+		if (item.node)
+			bb.grow(item.bb);
+	}
+	return bb;
+}
@@ -1,4 +1,10 @@
 #include <iomanip>
+#include <sstream>
+#include <mutex>
+#include <set>
+#include <functional>
+#include <regex>
+#include <algorithm>
 
 #include "shader.h"
 #include "utils.h"
@@ -45,6 +51,62 @@ static const unsigned int glShaderTypeConstants[] = {
 #define INCLUDE_STRING "$include"
 #define MAX_INCLUDE_LEVELS 8
 
+namespace {
+  // Un fichero de código fuente leído, tal y como estaba en disco con el sello indicado
+  struct SourceFile {
+    PGUPV::FileStamp stamp;
+    Strings lines;
+    bool pragmaOnce;
+  };
+
+  std::mutex fileCacheMutex;
+  std::map<std::string, std::shared_ptr<const SourceFile>> &fileCache() {
+    static std::map<std::string, std::shared_ptr<const SourceFile>> cache;
+    return cache;
+  }
+
+  bool isPragmaOnce(const std::string &line) {
+    std::string compact;
+    for (char c : line)
+      if (c != ' ' && c != '\t' && c != '\r')
+        compact.push_back(c);
+    return compact == "#pragmaonce";
+  }
+
+  // Devuelve el fichero indicado, leyéndolo de disco sólo si no se había leído o ha cambiado
+  // (su fecha de modificación, con nanosegundos, o su tamaño)
+  std::shared_ptr<const SourceFile> readSourceFile(const std::string &path) {
+    PGUPV::FileStamp stamp;
+    if (!PGUPV::fileExists(path) || !PGUPV::getFileStamp(path, stamp))
+      return nullptr;
+    auto key = PGUPV::getCanonicalPath(path);
+    {
+      std::lock_guard<std::mutex> lock(fileCacheMutex);
+      auto it = fileCache().find(key);
+      if (it != fileCache().end() && it->second->stamp == stamp)
+        return it->second;
+    }
+    auto f = std::make_shared<SourceFile>();
+    if (!PGUPV::loadTextFile(path, f->lines))
+      return nullptr;
+    f->stamp = stamp;
+    f->pragmaOnce = std::any_of(f->lines.begin(), f->lines.end(), isPragmaOnce);
+    std::lock_guard<std::mutex> lock(fileCacheMutex);
+    fileCache()[key] = f;
+    return f;
+  }
+
+  // line follows the format $include "<nombre de fichero>"
+  std::string includedFilename(const std::string &line) {
+    std::string::size_type spos = line.find_first_of('\"');
+    std::string::size_type epos = line.find_last_of('\"');
+    if (spos == std::string::npos || epos == spos)
+      ERRT("Error en la directiva $include. La sintaxis es: $include "
+           "\"<fichero>\"");
+    return line.substr(spos + 1, epos - spos - 1);
+  }
+};
+
 Shader::Shader() {
 	assert(sizeof(shaderFileExtensions) / sizeof(shaderFileExtensions[0]) == NUM_SHADER_TYPES);
 	assert(sizeof(shaderTypeNames) / sizeof(shaderTypeNames[0])== NUM_SHADER_TYPES);
@@ -68,17 +130,23 @@ Shader::loadFromFile(const string &name, ShaderType shader_type,
       ERRT("Tipo de shader desconocido");
   }
 
-  Strings ss;
-  if (loadTextFile(name, ss)) {
-    Strings preprocessed = preprocessShader(ss);
-    std::shared_ptr<Shader> result =
-        loadFromMemory(preprocessed, shader_type, transTable);
-    result->filename = name;
-    result->modificationTime = PGUPV::getFileModificationTime(name);
-      
-    return result;
-  } else
+  auto file = readSourceFile(name);
+  if (!file)
     ERRT("No se ha podido cargar el fichero " + name);
+
+  std::shared_ptr<Shader> result = std::shared_ptr<Shader>(new Shader());
+  result->filename = name;
+  result->type = shader_type;
+  result->preprocessShader(name, file->lines);
+
+  // Las sustituciones pueden convertir una línea en varias: se actualiza el origen de cada una
+  std::vector<size_t> origin;
+  result->src = expandText(transTable, result->src, &origin);
+  std::vector<SourceLine> lines(origin.size());
+  for (size_t i = 0; i < origin.size(); i++)
+    lines[i] = result->lineMap[origin[i]];
+  result->lineMap.swap(lines);
+  return result;
 }
 
 std::shared_ptr<Shader>
@@ -103,44 +171,94 @@ int Shader::check_extension(const string &filename) {
   return -1;
 }
 
-// Preprocesa el código fuente del shader cuyo código fuente está en src
-Strings Shader::preprocessShader(const Strings &src) {
-  Strings input = src;
-  Strings output;
-  for (uint include_level = 0; include_level < MAX_INCLUDE_LEVELS;
-       include_level++) {
-    bool any_include = false;
-    output.clear();
-    for (Strings::const_iterator i = input.begin(); i != input.end(); ++i) {
-      if (PGUPV::starts_with(*i, INCLUDE_STRING)) {
-        processInclude(*i, output);
-        any_include = true;
-      } else
-        output.push_back(*i);
+void Shader::preprocessShader(const std::string &name, const Strings &source) {
+  src.clear();
+  lineMap.clear();
+  includes.clear();
+  sourceFiles.assign(1, name);
+  modificationTime = PGUPV::getFileModificationTime(name);
+
+  std::vector<std::string> canonical{ PGUPV::getCanonicalPath(name) };
+  std::set<std::string> includedOnce;
+  // Ficheros que se están procesando (índices en sourceFiles), para detectar los ciclos
+  std::vector<unsigned int> stack{ 0 };
+
+  // Una sola pasada: cada $include se sustituye recursivamente por el fichero
+  std::function<void(const Strings &, unsigned int)> process = [&](const Strings &lines, unsigned int file) {
+    for (unsigned int i = 0; i < lines.size(); i++) {
+      const std::string &line = lines[i];
+      if (PGUPV::starts_with(line, INCLUDE_STRING)) {
+        std::string name = includedFilename(line);
+        std::string where = sourceFiles[file] + ":" + std::to_string(i + 1);
+        if (stack.size() > MAX_INCLUDE_LEVELS)
+          ERRT("No se permiten más de " + std::to_string(MAX_INCLUDE_LEVELS) +
+            " niveles de anidamiento en los $include (" + where + ")");
+        auto f = readSourceFile(name);
+        if (!f)
+          ERRT("No se ha podido cargar el fichero " + name + " (incluido en " + where + ")");
+        includes.emplace_back(sourceFiles[file], name);
+
+        auto path = PGUPV::getCanonicalPath(name);
+        if (f->pragmaOnce && !includedOnce.insert(path).second)
+          continue;
+        auto it = std::find(canonical.begin(), canonical.end(), path);
+        unsigned int idx = static_cast<unsigned int>(it - canonical.begin());
+        if (it == canonical.end()) {
+          canonical.push_back(path);
+          sourceFiles.push_back(name);
+        }
+        else if (std::find(stack.begin(), stack.end(), idx) != stack.end())
+          ERRT("Inclusión circular del fichero " + name + " en " + where);
+        modificationTime = std::max(modificationTime, f->stamp.mtimeNs / 1000000000LL);
+
+        stack.push_back(idx);
+        process(f->lines, idx);
+        stack.pop_back();
+      }
+      else if (!isPragmaOnce(line)) {
+        src.push_back(line);
+        lineMap.push_back(SourceLine{ file, i + 1 });
+      }
     }
-    if (!any_include)
-      return output;
-    input = output;
+  };
+  process(source, 0);
+}
+
+std::string Shader::getSourceLocation(unsigned int line) const {
+  if (line == 0 || line > lineMap.size())
+    return filename + ":" + std::to_string(line);
+  const SourceLine &l = lineMap[line - 1];
+  return sourceFiles[l.file] + ":" + std::to_string(l.line);
+}
+
+std::string Shader::annotateErrors(const std::string &log) const {
+  if (lineMap.empty())
+    return log;
+  // Formatos habituales: "0(12) : error ..." (NVIDIA), "ERROR: 0:12: ..." (AMD, Intel),
+  // "0:12(5): error: ..." (Mesa). La línea es la del código fuente compilado
+  static const std::regex errorLine("^\\s*(?:ERROR:\\s*|WARNING:\\s*)?\\d+[:(](\\d+)");
+  std::istringstream is(log);
+  std::ostringstream os;
+  std::string line;
+  std::smatch m;
+  while (std::getline(is, line)) {
+    os << line;
+    if (std::regex_search(line, m, errorLine))
+      os << "  [" << getSourceLocation(static_cast<unsigned int>(std::stoul(m[1].str()))) << "]";
+    os << "\n";
   }
-  ERRT("No se permiten más de " + std::to_string(MAX_INCLUDE_LEVELS) +
-       " niveles de anidamiento en los $include");
+  return os.str();
 }
 
-void Shader::processInclude(const std::string &line, Strings &dst) {
-  // line follows the format $include "<nombre de fichero>"
-  std::string::size_type spos = line.find_first_of('\"');
-  if (spos != std::string::npos) {
-    std::string::size_type epos = line.find_last_of('\"');
-    std::string filename = line.substr(spos + 1, epos - spos - 1);
-    Strings ss;
-    if (!loadTextFile(filename, ss))
-      ERRT("No se ha podido cargar el fichero " + filename);
-    for (Strings::const_iterator i = ss.begin(); i != ss.end(); ++i) {
-      dst.push_back(*i);
-    }
-  } else
-    ERRT("Error en la directiva $include. La sintaxis es: $include "
-         "\"<fichero>\"");
+void Shader::clearFileCache() {
+  std::lock_guard<std::mutex> lock(fileCacheMutex);
+  fileCache().clear();
+}
+
+void Shader::invalidateCachedFile(const std::string &filename) {
+  auto key = PGUPV::getCanonicalPath(filename);
+  std::lock_guard<std::mutex> lock(fileCacheMutex);
+  fileCache().erase(key);
 }
 
 std::string Shader::getDefaultShaderExtension(ShaderType type) {
@@ -167,12 +285,20 @@ void Shader::printSrc(std::ostream &os, bool printHeader,
 
 GLuint Shader::compile() {
   INFO("Compilando " + filename);
-  errorMsg.clear();
 
   if (shaderId != 0) {
     INFO("El shader ya estaba compilado");
     return shaderId;
   }
+  startCompile();
+  return finishCompile();
+}
+
+void Shader::startCompile() {
+  errorMsg.clear();
+  if (shaderId != 0)
+    return;
+
   Strings srccopy;
   srccopy = src;
 
@@ -197,6 +323,19 @@ GLuint Shader::compile() {
     ERRT("Error ejecutando glShaderSource");
 
   glCompileShader(shaderId);
+}
+
+bool Shader::isCompileDone() const {
+  if (shaderId == 0 || !isParallelCompileSupported())
+    return true;
+  GLint done = GL_TRUE;
+  glGetShaderiv(shaderId, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
+
+GLuint Shader::finishCompile() {
+  if (shaderId == 0)
+    return 0;
   GLint compiled;
   glGetShaderiv(shaderId, GL_COMPILE_STATUS, &compiled);
 
@@ -206,7 +345,7 @@ GLuint Shader::compile() {
     glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &length);
     log = new GLchar[length];
     glGetShaderInfoLog(shaderId, length, &length, log);
-    errorMsg = std::string("Error compilando el shader:") + log;
+    errorMsg = std::string("Error compilando el shader:") + annotateErrors(log);
     delete[] log;
     deleteShaderObject();
   }
@@ -214,6 +353,10 @@ GLuint Shader::compile() {
   return shaderId;
 }
 
+bool Shader::isParallelCompileSupported() {
+  return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
 std::string Shader::getErrorMessage() const {
   return errorMsg;
 }
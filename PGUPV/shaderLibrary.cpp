@@ -1,19 +1,38 @@
 
 #include <algorithm>
+#include <sstream>
+#include <thread>
 
 #include "shaderLibrary.h"
 #include "program.h"
+#include "fileWatcher.h"
+#include "utils.h"
 #include "log.h"
 #include "model.h"
 
 using PGUPV::ShaderLibrary;
 using PGUPV::Program;
 using PGUPV::Mesh;
+using PGUPV::FileWatcher;
 
-ShaderLibrary::ShaderLibrary() {
+namespace {
+	std::string programName(const Program *p) {
+		auto deps = p->getDependencies();
+		return deps.empty() ? std::string("(memoria)") : deps.front();
+	}
+
+	float msSince(std::chrono::steady_clock::time_point t) {
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t).count();
+	}
+};
+
+ShaderLibrary::ShaderLibrary() : hotReload(false), compilerThreads(0xFFFFFFFF) {
 
 }
 
+ShaderLibrary::~ShaderLibrary() {
+}
+
 
 void ShaderLibrary::add(Program *shader) {
 	library.push_back(shader);
@@ -27,6 +46,8 @@ void ShaderLibrary::remove(Program *shader) {
 	else {
 		library.erase(it);
 	}
+	reloading.erase(std::remove(reloading.begin(), reloading.end(), shader), reloading.end());
+	dirty.erase(std::remove(dirty.begin(), dirty.end(), shader), dirty.end());
 }
 
 
@@ -46,3 +67,209 @@ void ShaderLibrary::printInfoShaders(std::ostream &os, bool verbose) {
 		library[i]->printInfo(os);
 	}
 }
+
+void ShaderLibrary::setHotReload(bool enable) {
+	hotReload = enable;
+	if (enable) {
+		if (!watcher)
+			watcher.reset(new FileWatcher());
+		refreshWatchList();
+		INFO(std::string("Recarga automática de shaders activada") +
+			(watcher->usesNotifications() ? "" : " (comprobando las fechas de los ficheros)"));
+	}
+	else {
+		watcher.reset();
+		dirty.clear();
+	}
+}
+
+void ShaderLibrary::refreshWatchList() {
+	// Los programas se crean y destruyen durante la ejecución, y sus $include pueden cambiar:
+	// se reconstruye la lista, como mucho dos veces por segundo
+	lastWatchRefresh = std::chrono::steady_clock::now();
+	auto old = watcher->getWatchedFiles();
+	std::vector<std::string> now;
+	for (auto p : library) {
+		for (const auto &f : p->getDependencies())
+			now.push_back(PGUPV::getCanonicalPath(f));
+	}
+	for (const auto &f : old)
+		if (std::find(now.begin(), now.end(), f) == now.end())
+			watcher->unwatch(f);
+	for (const auto &f : now)
+		watcher->watch(f);
+}
+
+void ShaderLibrary::update() {
+	if (!hotReload)
+		return;
+
+	if (std::chrono::steady_clock::now() - lastWatchRefresh > std::chrono::milliseconds(500))
+		refreshWatchList();
+
+	auto changed = watcher->poll();
+	if (!changed.empty()) {
+		for (auto p : library) {
+			for (const auto &f : p->getDependencies()) {
+				if (std::find(changed.begin(), changed.end(), PGUPV::getCanonicalPath(f)) != changed.end()) {
+					if (std::find(dirty.begin(), dirty.end(), p) == dirty.end())
+						dirty.push_back(p);
+					break;
+				}
+			}
+		}
+	}
+
+	// Los programas que ya se están recargando esperan a que termine la recarga actual
+	for (auto it = dirty.begin(); it != dirty.end(); ) {
+		Program *p = *it;
+		if (p->isReloading()) {
+			++it;
+			continue;
+		}
+		if (p->startReload())
+			reloading.push_back(p);
+		it = dirty.erase(it);
+	}
+
+	// Los programas se sustituyen aquí, al principio del frame, y nunca a mitad de dibujarlo
+	for (auto it = reloading.begin(); it != reloading.end(); ) {
+		Program *p = *it;
+		std::string errors;
+		auto result = p->pollReload(&errors);
+		if (result == Program::ReloadResult::PENDING) {
+			++it;
+			continue;
+		}
+		auto name = programName(p);
+		if (result == Program::ReloadResult::DONE)
+			INFO("Programa " + name + " recargado");
+		else if (result == Program::ReloadResult::FAILED)
+			ERR("No se ha podido recargar el programa " + name + ". Se sigue usando el anterior:\n" + errors);
+		it = reloading.erase(it);
+	}
+}
+
+size_t ShaderLibrary::compileAll() {
+	enum class Step { COMPILING, LINKING, DONE };
+	struct Job {
+		Program *p;
+		Step step;
+		bool cache;
+		std::string key;
+		GLuint link;
+		std::chrono::steady_clock::time_point linkStart;
+		CompileTiming timing;
+	};
+
+	timings.clear();
+	std::vector<Job> jobs;
+	for (auto p : library) {
+		if (p->getId() == 0 && p->getNumShaders() > 0 && !p->isReloading())
+			jobs.push_back(Job{ p, Step::COMPILING, false, std::string(), 0, {}, CompileTiming{ programName(p), 0.0f, 0.0f, false, false } });
+	}
+	if (jobs.empty())
+		return 0;
+
+	if (Shader::isParallelCompileSupported()) {
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(compilerThreads);
+		else
+			glMaxShaderCompilerThreadsARB(compilerThreads);
+	}
+
+	// Primero se mandan a compilar todos los shaders, para que el driver tenga trabajo para
+	// todos sus hilos
+	auto start = std::chrono::steady_clock::now();
+	for (auto &j : jobs) {
+		if (j.p->loadCached(j.cache, j.key)) {
+			j.timing.cached = j.timing.ok = true;
+			j.step = Step::DONE;
+			continue;
+		}
+		for (auto &s : j.p->shaders)
+			s.second->startCompile();
+	}
+
+	// Después, se avanza cada programa en cuanto el driver termina lo que tenía pendiente (los
+	// que se han cargado de la caché ya están terminados)
+	size_t pending = std::count_if(jobs.begin(), jobs.end(), [](const Job &j) { return j.step != Step::DONE; });
+	while (pending > 0) {
+		bool progress = false;
+		for (auto &j : jobs) {
+			if (j.step == Step::COMPILING) {
+				bool ready = std::all_of(j.p->shaders.begin(), j.p->shaders.end(),
+					[](const std::pair<const Shader::ShaderType, std::shared_ptr<Shader>> &s) { return s.second->isCompileDone(); });
+				if (!ready)
+					continue;
+				progress = true;
+				j.timing.compileMs = msSince(start);
+				PGUPV::Uints tolink;
+				for (auto &s : j.p->shaders) {
+					GLuint sid = s.second->finishCompile();
+					if (sid == 0) {
+						ERR("Error compilando " + j.timing.name + ":\n" + s.second->getErrorMessage());
+						break;
+					}
+					tolink.push_back(sid);
+				}
+				if (tolink.size() != j.p->shaders.size()) {
+					j.step = Step::DONE;
+					pending--;
+					continue;
+				}
+				j.link = j.p->startLink(tolink, j.cache);
+				j.linkStart = std::chrono::steady_clock::now();
+				j.step = Step::LINKING;
+			}
+			if (j.step == Step::LINKING) {
+				if (!Program::isLinkDone(j.link))
+					continue;
+				progress = true;
+				std::ostringstream err;
+				if (Program::finishLink(j.link, err)) {
+					j.p->programId = j.link;
+					try {
+						j.p->afterLink(j.cache, j.key);
+						j.timing.ok = true;
+					}
+					catch (std::exception &e) {
+						ERR(e.what());
+						j.p->release();
+					}
+				}
+				else {
+					ERR("Error enlazando " + j.timing.name + ":\n" + err.str());
+				}
+				j.timing.linkMs = msSince(j.linkStart);
+				j.step = Step::DONE;
+				pending--;
+			}
+		}
+		if (!progress)
+			std::this_thread::yield();
+	}
+
+	size_t failed = 0;
+	std::ostringstream os;
+	os << "Compilados " << jobs.size() << " programas en " << msSince(start) << " ms";
+	if (Shader::isParallelCompileSupported())
+		os << " (en paralelo)";
+	os << ":\n";
+	for (const auto &j : jobs) {
+		const auto &t = j.timing;
+		os << "  " << t.name << ": ";
+		if (!t.ok)
+			os << "ERROR";
+		else if (t.cached)
+			os << "caché";
+		else
+			os << "compilación " << t.compileMs << " ms, enlace " << t.linkMs << " ms";
+		os << "\n";
+		if (!t.ok)
+			failed++;
+		timings.push_back(t);
+	}
+	INFO(os.str());
+	return failed;
+}
@@ -0,0 +1,372 @@
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "staticBatch.h"
+#include "mesh.h"
+#include "node.h"
+#include "program.h"
+#include "baseMaterial.h"
+#include "drawCommand.h"
+#include "bufferObject.h"
+#include "bindingPoint.h"
+#include "indexedBindingPoint.h"
+#include "vertexArrayObject.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::StaticBatch;
+using PGUPV::Mesh;
+using PGUPV::Node;
+using PGUPV::Program;
+using PGUPV::BaseMaterial;
+using PGUPV::BufferObject;
+using PGUPV::VertexArrayObject;
+using PGUPV::DrawCommand;
+using PGUPV::DrawArrays;
+using PGUPV::DrawElements;
+using PGUPV::MultiDrawElementsIndirect;
+using PGUPV::RenderQueue;
+using PGUPV::GLRenderBackend;
+
+namespace {
+	// Atributos estándar que se copian a los lotes, en el orden de StaticBatch::VertexFormat
+	const uint BATCH_ATTRIBUTES[] = {
+		Mesh::VERTICES, Mesh::NORMALS, Mesh::COLORS, Mesh::TEX_COORD0, Mesh::TEX_COORD1,
+		Mesh::TEX_COORD2, Mesh::TEX_COORD3, Mesh::TANGENTS };
+	const uint N_BATCH_ATTRIBUTES = sizeof(BATCH_ATTRIBUTES) / sizeof(BATCH_ATTRIBUTES[0]);
+
+	int slotOf(GLint attribute) {
+		for (uint i = 0; i < N_BATCH_ATTRIBUTES; i++)
+			if (BATCH_ATTRIBUTES[i] == (uint)attribute)
+				return i;
+		return -1;
+	}
+
+	// Formato de las órdenes de glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// Datos de cada dibujo en el shader storage buffer (std430, ver StaticBatch::definition)
+	struct BatchDraw {
+		glm::mat4 modelMatrix;
+		glm::mat4 normalMatrix;
+		GLuint materialIndex;
+		GLuint pad[3];
+	};
+	static_assert(sizeof(BatchDraw) == 144, "BatchDraw debe coincidir con el bloque std430");
+
+	// Un dibujo pendiente de copiar a un grupo
+	struct PendingDraw {
+		Mesh *mesh;
+		BaseMaterial *material;
+		GLuint materialIndex;
+		glm::mat4 modelMatrix;
+	};
+
+	// Dónde ha quedado una malla dentro de los buffers de su grupo
+	struct MeshRange {
+		GLuint firstIndex;
+		GLuint count;
+		GLint baseVertex;
+	};
+
+	std::shared_ptr<BufferObject> buildBuffer(PGUPV::BindingPoint &bp, const void *data, size_t size, const std::string &label) {
+		auto bo = BufferObject::build(size, GL_STATIC_DRAW);
+		bo->setGlDebugLabel(label);
+		bp.bind(bo);
+		bp.write(data);
+		return bo;
+	}
+};
+
+// Los buffers y las órdenes de dibujo de un formato de vértice
+struct StaticBatch::Group {
+	VertexArrayObject vao;
+	std::vector<std::shared_ptr<BufferObject>> vbos;
+	std::shared_ptr<BufferObject> indices, commands;
+	// Un glMultiDrawElementsIndirect por cada material
+	struct MaterialRange {
+		BaseMaterial *material;
+		std::unique_ptr<MultiDrawElementsIndirect> draw;
+	};
+	std::vector<MaterialRange> ranges;
+};
+
+const std::string StaticBatch::blockName{ "StaticBatch" };
+
+const Strings StaticBatch::definition{
+"struct BatchDraw {",
+"  mat4 modelMatrix;",
+"  mat4 normalMatrix;",
+"  uint materialIndex;",
+"};",
+"layout (std430, binding=" + std::to_string(SSBO_STATIC_BATCH_BINDING_INDEX) + ") readonly buffer StaticBatch {",
+"  BatchDraw batchDraws[];",
+"};",
+};
+
+void StaticBatch::prepareProgram(Program &program) {
+	program.replaceString("$" + blockName, definition);
+	program.addAttributeLocation(DRAW_ID_ATTRIBUTE, "batchDrawId");
+}
+
+bool StaticBatch::isSupported() {
+	return GLEW_VERSION_4_3 != 0;
+}
+
+StaticBatch::StaticBatch() : builtRoot(nullptr), builtVersion(0), builtMatrix(1.0f) {
+}
+
+StaticBatch::~StaticBatch() {
+}
+
+void StaticBatch::clear() {
+	groups.clear();
+	drawData.reset();
+	materials.clear();
+	leftovers.clear();
+	builtRoot = nullptr;
+	builtVersion = 0;
+	builtMeshes.clear();
+	stats = Stats();
+}
+
+bool StaticBatch::isUpToDate(const Node &root, const glm::mat4 &modelMatrix) const {
+	if (builtRoot != &root || builtVersion != root.getVersion() || builtMatrix != modelMatrix)
+		return false;
+	for (const auto &m : builtMeshes) {
+		if (m.first->getVersion() != m.second)
+			return false;
+	}
+	return true;
+}
+
+bool StaticBatch::getVertexFormat(Mesh &mesh, VertexFormat &format) {
+	format.fill(0);
+	if (mesh.bones || mesh.skeleton || mesh.n_vertices == 0 || mesh.drawCommands.empty() ||
+		!mesh.drawsOnlyTriangles())
+		return false;
+	// Sólo estas órdenes saben devolver sus triángulos (ver Mesh::getTriangleList)
+	for (auto d : mesh.drawCommands) {
+		if (!dynamic_cast<DrawArrays *>(d) && !dynamic_cast<DrawElements *>(d))
+			return false;
+	}
+	for (uint a = 0; a < mesh.vbos.size(); a++) {
+		if (!mesh.vbos[a] || a == Mesh::INDICES)
+			continue;
+		int slot = slotOf(a);
+		if (slot < 0 || !mesh.hasCpuCopy(a))
+			return false;
+		size_t bytes = mesh.cpuCopies[a].size();
+		size_t ncomponents = bytes / (mesh.n_vertices * sizeof(float));
+		if (ncomponents < 1 || ncomponents > 4 || ncomponents * mesh.n_vertices * sizeof(float) != bytes)
+			return false;
+		format[slot] = static_cast<uint>(ncomponents);
+	}
+	// Los valores estáticos se convierten en un atributo más
+	for (const auto &s : mesh.staticAttrValues) {
+		int slot = slotOf(s.attrIndex);
+		if (slot < 0)
+			return false;
+		if (format[slot] == 0)
+			format[slot] = 4;
+	}
+	return format[0] > 0;
+}
+
+void StaticBatch::appendAttribute(const Mesh &mesh, uint attribute, uint ncomponents, std::vector<float> &dst) {
+	if (attribute < mesh.vbos.size() && mesh.vbos[attribute]) {
+		auto p = reinterpret_cast<const float *>(mesh.cpuCopies[attribute].data());
+		dst.insert(dst.end(), p, p + mesh.n_vertices * ncomponents);
+		return;
+	}
+	glm::vec4 value(0.0f);
+	for (const auto &s : mesh.staticAttrValues) {
+		if (s.attrIndex == (GLint)attribute)
+			value = s.value;
+	}
+	for (size_t i = 0; i < mesh.n_vertices; i++)
+		dst.insert(dst.end(), &value.x, &value.x + ncomponents);
+}
+
+void StaticBatch::build(Node &root, const glm::mat4 &modelMatrix) {
+	clear();
+
+	RenderQueue all;
+	Program *current = Program::getCurrentProgram();
+	all.collect(root, current, modelMatrix);
+
+	// Los nodos y las mallas que no se pueden agrupar se dibujarán con el programa actual,
+	// salvo que tengan uno propio (Node::setProgram)
+	auto ownProgram = [current](Program *p) { return p == current ? nullptr : p; };
+	for (const auto &n : all.getNodes())
+		leftovers.addNode(ownProgram(n.program), n.node, n.modelMatrix);
+
+	std::map<VertexFormat, std::vector<PendingDraw>> pending;
+	std::unordered_map<BaseMaterial *, GLuint> materialIndices;
+	std::unordered_set<const Mesh *> seen;
+	for (const auto &p : all.getPackets()) {
+		if (seen.insert(p.mesh).second)
+			builtMeshes.push_back(std::make_pair(p.mesh, p.mesh->getVersion()));
+		VertexFormat format;
+		if (p.program != current || !getVertexFormat(*p.mesh, format)) {
+			leftovers.add(ownProgram(p.program), p.material, p.mesh, p.node, p.modelMatrix);
+			continue;
+		}
+		auto m = materialIndices.find(p.material);
+		if (m == materialIndices.end()) {
+			m = materialIndices.insert(std::make_pair(p.material, static_cast<GLuint>(materials.size()))).first;
+			materials.push_back(p.material);
+		}
+		pending[format].push_back(PendingDraw{ p.mesh, p.material, m->second, p.modelMatrix });
+	}
+	stats.leftoverDraws = leftovers.size();
+	stats.leftoverNodes = all.getNodes().size();
+
+	// Datos de todos los dibujos de todos los grupos. El atributo batchDrawId es
+	// baseInstance, que es la posición del dibujo en este vector
+	std::vector<BatchDraw> draws;
+	for (auto &entry : pending) {
+		const VertexFormat &format = entry.first;
+		auto &groupDraws = entry.second;
+		std::stable_sort(groupDraws.begin(), groupDraws.end(),
+			[](const PendingDraw &a, const PendingDraw &b) { return a.materialIndex < b.materialIndex; });
+
+		std::vector<float> attributes[N_BATCH_ATTRIBUTES];
+		std::vector<GLuint> indices;
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::unordered_map<Mesh *, MeshRange> meshes;
+		GLint nVertices = 0;
+
+		for (const auto &d : groupDraws) {
+			auto it = meshes.find(d.mesh);
+			if (it == meshes.end()) {
+				auto tris = d.mesh->getTriangleList();
+				MeshRange range{ static_cast<GLuint>(indices.size()), static_cast<GLuint>(tris.size()), nVertices };
+				indices.insert(indices.end(), tris.begin(), tris.end());
+				for (uint i = 0; i < N_BATCH_ATTRIBUTES; i++) {
+					if (format[i])
+						appendAttribute(*d.mesh, BATCH_ATTRIBUTES[i], format[i], attributes[i]);
+				}
+				nVertices += static_cast<GLint>(d.mesh->n_vertices);
+				it = meshes.insert(std::make_pair(d.mesh, range)).first;
+			}
+			const MeshRange &range = it->second;
+			commands.push_back(DrawElementsIndirectCommand{ range.count, 1, range.firstIndex, range.baseVertex,
+				static_cast<GLuint>(draws.size()) });
+
+			BatchDraw bd;
+			bd.modelMatrix = d.modelMatrix;
+			bd.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(d.modelMatrix))));
+			bd.materialIndex = d.materialIndex;
+			bd.pad[0] = bd.pad[1] = bd.pad[2] = 0;
+			draws.push_back(bd);
+		}
+		if (indices.empty())
+			continue;
+
+		std::unique_ptr<Group> group(new Group());
+		group->vao.bind();
+		for (uint i = 0; i < N_BATCH_ATTRIBUTES; i++) {
+			if (!format[i])
+				continue;
+			auto bo = buildBuffer(gl_array_buffer, attributes[i].data(), attributes[i].size() * sizeof(float),
+				"StaticBatch attrib " + std::to_string(BATCH_ATTRIBUTES[i]));
+			glEnableVertexAttribArray(BATCH_ATTRIBUTES[i]);
+			glVertexAttribPointer(BATCH_ATTRIBUTES[i], format[i], GL_FLOAT, GL_FALSE, 0, 0);
+			group->vbos.push_back(bo);
+			stats.bytes += bo->getSize();
+		}
+		group->indices = buildBuffer(gl_element_array_buffer, indices.data(), indices.size() * sizeof(GLuint),
+			"StaticBatch indices");
+		group->commands = buildBuffer(gl_draw_indirect_buffer, commands.data(),
+			commands.size() * sizeof(DrawElementsIndirectCommand), "StaticBatch commands");
+		stats.bytes += group->indices->getSize() + group->commands->getSize();
+
+		// Una orden de dibujo por cada material (los dibujos están ordenados por material)
+		size_t first = 0;
+		for (size_t i = 1; i <= groupDraws.size(); i++) {
+			if (i < groupDraws.size() && groupDraws[i].material == groupDraws[first].material)
+				continue;
+			Group::MaterialRange range;
+			range.material = groupDraws[first].material;
+			range.draw.reset(new MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				reinterpret_cast<const void *>(first * sizeof(DrawElementsIndirectCommand)),
+				static_cast<GLsizei>(i - first)));
+			group->ranges.push_back(std::move(range));
+			first = i;
+		}
+
+		stats.batchedMeshes += meshes.size();
+		stats.vertices += nVertices;
+		stats.indices += indices.size();
+		stats.multiDraws += group->ranges.size();
+		groups.push_back(std::move(group));
+	}
+
+	if (!draws.empty()) {
+		// Identificador de cada dibujo, compartido por todos los VAO: con divisor 1, cada
+		// dibujo lee el elemento baseInstance
+		std::vector<GLuint> ids(draws.size());
+		for (size_t i = 0; i < ids.size(); i++)
+			ids[i] = static_cast<GLuint>(i);
+		auto idBuffer = buildBuffer(gl_array_buffer, ids.data(), ids.size() * sizeof(GLuint), "StaticBatch draw ids");
+		for (auto &g : groups) {
+			g->vao.bind();
+			gl_array_buffer.bind(idBuffer);
+			glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+			glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, 0);
+			glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+			g->vbos.push_back(idBuffer);
+		}
+		drawData = buildBuffer(gl_shader_storage_buffer, draws.data(), draws.size() * sizeof(BatchDraw), "StaticBatch draws");
+		stats.bytes += idBuffer->getSize() + drawData->getSize();
+	}
+	if (!groups.empty())
+		groups.back()->vao.unbind();
+	gl_array_buffer.unbind();
+	gl_draw_indirect_buffer.unbind();
+	CHECK_GL();
+
+	stats.groups = groups.size();
+	stats.batchedDraws = draws.size();
+	builtRoot = &root;
+	builtVersion = root.getVersion();
+	builtMatrix = modelMatrix;
+	INFO("StaticBatch: " + std::to_string(stats.batchedDraws) + " dibujos en " + std::to_string(stats.multiDraws) +
+		" órdenes indirectas (" + std::to_string(stats.leftoverDraws) + " mallas sin agrupar)");
+}
+
+void StaticBatch::render() {
+	if (!groups.empty()) {
+		Program *prev = nullptr;
+		if (batchProgram)
+			prev = batchProgram->use();
+		gl_shader_storage_buffer.bindBufferBase(drawData, SSBO_STATIC_BATCH_BINDING_INDEX);
+		for (auto &g : groups) {
+			g->vao.bind();
+			gl_draw_indirect_buffer.bind(g->commands);
+			for (auto &r : g->ranges) {
+				if (r.material)
+					r.material->use();
+				r.draw->render();
+			}
+		}
+		gl_draw_indirect_buffer.unbind();
+		if (batchProgram && prev)
+			prev->use();
+	}
+	if (leftovers.size() > 0 || stats.leftoverNodes > 0) {
+		if (!glBackend)
+			glBackend = std::make_shared<GLRenderBackend>();
+		leftovers.submit(*glBackend);
+	}
+}
@@ -37,8 +37,13 @@ void TextOverlay::setMaxWidth(unsigned int maxW) {
 }
 
 void TextOverlay::setup() {
+  // build deja vinculadas las matrices nuevas: las de la aplicacin tienen que seguir
+  // siendo las vinculadas
+  auto bo = gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX);
   mats = GLMatrices::build();
   mats->setMatrix(GLMatrices::PROJ_MATRIX, glm::ortho(-0.6f, 0.6f, -0.6f, 0.6f));
+  if (auto prevMats = std::dynamic_pointer_cast<GLMatrices>(bo))
+    prevMats->bind();
 }
 
 void TextOverlay::render() {
@@ -67,7 +72,8 @@ void TextOverlay::render() {
   glDisable(GL_DEPTH_TEST);
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-  auto bo = gl_uniform_buffer.bindBufferBase(mats, UBO_GL_MATRICES_BINDING_INDEX);
+  auto bo = gl_uniform_buffer.getBound(UBO_GL_MATRICES_BINDING_INDEX);
+  mats->bind();
   
   auto prevProg = PGUPV::ConstantIllumProgram::use();
   background->render();
@@ -85,7 +91,9 @@ void TextOverlay::render() {
 
   if (prevProg != nullptr) 
     prevProg->use();
-  gl_uniform_buffer.bind(bo);
+  mats->flush();
+  if (auto prevMats = std::dynamic_pointer_cast<GLMatrices>(bo))
+    prevMats->bind();
 
   polygonMode.restore();
   attrib.restore();
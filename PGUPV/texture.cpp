@@ -1,9 +1,11 @@
 #include "app.h"
 #include "utils.h"
 #include "texture.h"
+#include "textureCache.h"
 #include "log.h"
 
 using PGUPV::Texture;
+using PGUPV::TextureCache;
 using PGUPV::App;
 using std::string;
 
@@ -15,6 +17,10 @@ Texture::Texture(GLenum texture_type, GLenum minfilter, GLenum magfilter,
       _compareMode(GL_NONE), _compareFunc(GL_LEQUAL), _internalFormat(GL_NONE),
       _bordercolor(bordercolor) {}
 
+Texture::~Texture() {
+  TextureCache::forget(this);
+}
+
 void Texture::setMinFilter(GLenum filter) {
 
   setTexParam(GL_TEXTURE_MIN_FILTER, filter);
@@ -4,9 +4,11 @@
 #include "utils.h"
 #include "log.h"
 #include "image.h"
+#include "textureCache.h"
 
 using PGUPV::Texture2DGeneric;
 using PGUPV::Image;
+using PGUPV::TextureCache;
 
 Texture2DGeneric::Texture2DGeneric(GLenum texture_type, GLenum minfilter,
 	GLenum magfilter, GLenum wrap_s,
@@ -31,6 +33,7 @@ Texture2DGeneric::Texture2DGeneric(GLenum texture_type, GLenum minfilter,
 
 // Allocates memory for a texture with the given size and format
 void Texture2DGeneric::allocate(uint width, uint height, GLint internalformat) {
+	TextureCache::forget(this);
 	glBindTexture(_texture_type, _texId);
 	setParams();
 	if (internalformat == GL_RED || internalformat == GL_RG || internalformat == GL_RGB
@@ -81,6 +84,7 @@ void Texture2DGeneric::loadImageFromMemory(void *pixels, uint width,
 	uint height, GLenum pixels_format, GLenum pixels_type,
 	GLint internalformat) {
 	_ready = false;
+	TextureCache::forget(this);
 	/* Create and load textures to OpenGL */
 	glBindTexture(_texture_type, this->_texId);
 	setParams();
@@ -97,6 +101,7 @@ void Texture2DGeneric::loadImageFromMemory(void *pixels, uint width,
 void Texture2DGeneric::updateImageFromMemory(void *pixels, uint width, uint height, GLenum pixels_format,
 	GLenum pixels_type) {
 
+	TextureCache::forget(this);
 	glBindTexture(_texture_type, _texId);
 	glTexSubImage2D(_texture_type, 0, 0, 0, width, height, pixels_format, pixels_type, pixels);
 
@@ -120,9 +125,59 @@ void Texture2DGeneric::updateImage(const Image &image) {
 
 
 bool Texture2DGeneric::loadImage(const std::string &filename, GLenum internalFormat) {
-	PGUPV::Image image(filename);
+	return loadFile(filename, internalFormat, nullptr);
+}
+
+bool Texture2DGeneric::loadImage(const std::string &filename, const Image &decoded, GLenum internalFormat) {
+	return loadFile(filename, internalFormat, &decoded);
+}
+
+bool Texture2DGeneric::loadFile(const std::string &filename, GLenum internalFormat, const Image *decoded) {
 	_name = PGUPV::getFilenameFromPath(filename);
-	return loadImage(image, internalFormat);
+	if (_texture_type != GL_TEXTURE_2D && _texture_type != GL_TEXTURE_RECTANGLE) {
+		if (decoded)
+			return loadImage(*decoded, internalFormat);
+		PGUPV::Image image(filename);
+		return loadImage(image, internalFormat);
+	}
+
+	// Si otra textura ya tiene la imagen, se copia en la GPU sin leer el fichero
+	std::vector<std::string> files{ filename };
+	TextureCache::forget(this);
+	TextureCache::Source src;
+	if (TextureCache::find(files, _texture_type, internalFormat, false, src)) {
+		allocate(src.width, src.height, src.internalFormat);
+		glCopyImageSubData(src.texture->getId(), src.texture->getTextureType(), 0, 0, 0, 0,
+			_texId, _texture_type, 0, 0, 0, 0, src.width, src.height, 1);
+		CHECK_GL2("Error copiando la imagen de la textura " + src.texture->getName());
+	}
+	else if (decoded)
+		loadImage(*decoded, internalFormat);
+	else {
+		PGUPV::Image image(filename);
+		loadImage(image, internalFormat);
+	}
+	if (_ready)
+		TextureCache::add(*this, files, internalFormat, false, _width, _height, _internalFormat);
+	return _ready;
+}
+
+void Texture2DGeneric::loadMipmaps(const std::vector<std::unique_ptr<Image>> &levels) {
+	if (!_ready)
+		ERRT("Hay que cargar el nivel 0 de la textura antes que sus mipmaps");
+	glBindTexture(_texture_type, _texId);
+	// Las filas de las imágenes creadas en memoria no están alineadas a 4 bytes
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t i = 0; i < levels.size(); i++) {
+		const Image &l = *levels[i];
+		glTexImage2D(_texture_type, static_cast<GLint>(i + 1), _internalFormat, l.getWidth(), l.getHeight(), 0,
+			l.getGLFormatType(), l.getGLPixelBaseType(), l.getPixels());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	glTexParameteri(_texture_type, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size()));
+	CHECK_GL2("Error cargando los mipmaps de la textura " + _name);
 }
 
 void saveBoundTexture(const std::string &filename, uint32_t width, uint32_t height, uint32_t bpp) {
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+
+#include "textureCache.h"
+#include "texture2D.h"
+#include "textureCubeMap.h"
+#include "imageLoader.h"
+#include "image.h"
+#include "utils.h"
+#include "log.h"
+
+using PGUPV::TextureCache;
+using PGUPV::Texture;
+using PGUPV::Texture2D;
+using PGUPV::TextureCubeMap;
+using PGUPV::ImageLoader;
+
+namespace {
+	struct FileKey {
+		std::string path;	// rutas canónicas de los ficheros
+		long long mtime;	// la fecha de modificación más reciente
+		GLenum target;
+		GLenum internalFormat;
+		bool flipV;
+		bool operator<(const FileKey &o) const {
+			return std::tie(path, mtime, target, internalFormat, flipV) <
+				std::tie(o.path, o.mtime, o.target, o.internalFormat, o.flipV);
+		}
+	};
+
+	struct Entry {
+		Texture *texture;
+		// Sólo si la textura se ha creado con getTexture2D o getTextureCubeMap
+		std::weak_ptr<Texture> shared;
+		bool mipmap;
+		GLsizei width, height;
+		GLenum actualFormat;
+	};
+
+	struct Cache {
+		std::map<FileKey, std::vector<Entry>> entries;
+		std::unordered_map<const Texture *, FileKey> keys;
+		TextureCache::Stats stats;
+	};
+
+	/*
+	Formato y tipo de los píxeles para reservar (sin datos) una textura con ese formato interno.
+	Tienen que ser compatibles: los formatos enteros necesitan un formato *_INTEGER, y los de
+	profundidad, uno de profundidad. Si no, glTexImage2D falla con GL_INVALID_OPERATION
+	*/
+	void transferFormat(GLenum internalFormat, GLenum &format, GLenum &type) {
+		switch (internalFormat) {
+		case GL_R8I: case GL_R16I: case GL_R32I:
+		case GL_RG8I: case GL_RG16I: case GL_RG32I:
+		case GL_RGB8I: case GL_RGB16I: case GL_RGB32I:
+		case GL_RGBA8I: case GL_RGBA16I: case GL_RGBA32I:
+			format = GL_RGBA_INTEGER;
+			type = GL_INT;
+			break;
+		case GL_R8UI: case GL_R16UI: case GL_R32UI:
+		case GL_RG8UI: case GL_RG16UI: case GL_RG32UI:
+		case GL_RGB8UI: case GL_RGB16UI: case GL_RGB32UI:
+		case GL_RGBA8UI: case GL_RGBA16UI: case GL_RGBA32UI:
+		case GL_RGB10_A2UI:
+			format = GL_RGBA_INTEGER;
+			type = GL_UNSIGNED_INT;
+			break;
+		case GL_DEPTH_COMPONENT: case GL_DEPTH_COMPONENT16:
+		case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32: case GL_DEPTH_COMPONENT32F:
+			format = GL_DEPTH_COMPONENT;
+			type = GL_FLOAT;
+			break;
+		case GL_DEPTH_STENCIL: case GL_DEPTH24_STENCIL8:
+			format = GL_DEPTH_STENCIL;
+			type = GL_UNSIGNED_INT_24_8;
+			break;
+		case GL_DEPTH32F_STENCIL8:
+			format = GL_DEPTH_STENCIL;
+			type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+			break;
+		default:
+			format = GL_RGBA;
+			type = GL_UNSIGNED_BYTE;
+			break;
+		}
+	}
+
+	// No se destruye nunca, para que las texturas globales puedan salir de la caché al destruirse
+	Cache &cache() {
+		static Cache *c = new Cache();
+		return *c;
+	}
+
+	bool makeKey(const std::vector<std::string> &files, GLenum target, GLenum internalFormat,
+		bool flipV, FileKey &key) {
+		key.path.clear();
+		key.mtime = 0;
+		for (const auto &f : files) {
+			if (!PGUPV::fileExists(f))
+				return false;
+			key.path += PGUPV::getCanonicalPath(f) + '\n';
+			key.mtime = std::max(key.mtime, PGUPV::getFileModificationTime(f));
+		}
+		key.target = target;
+		key.internalFormat = internalFormat;
+		key.flipV = flipV;
+		return true;
+	}
+
+	Entry *findEntry(const Texture *texture) {
+		auto k = cache().keys.find(texture);
+		if (k == cache().keys.end())
+			return nullptr;
+		for (auto &e : cache().entries[k->second]) {
+			if (e.texture == texture)
+				return &e;
+		}
+		return nullptr;
+	}
+
+	// Busca una textura compartida con los parámetros indicados
+	std::shared_ptr<Texture> findShared(const FileKey &key, GLenum minfilter, GLenum magfilter,
+		GLenum wrap_s, GLenum wrap_t, bool mipmap) {
+		auto it = cache().entries.find(key);
+		if (it == cache().entries.end())
+			return std::shared_ptr<Texture>();
+		for (const auto &e : it->second) {
+			auto t = e.shared.lock();
+			if (t && e.mipmap == mipmap && t->getMinFilter() == minfilter &&
+				t->getMagFilter() == magfilter && t->getWrapS() == wrap_s && t->getWrapT() == wrap_t) {
+				cache().stats.hits++;
+				return t;
+			}
+		}
+		return std::shared_ptr<Texture>();
+	}
+
+	void share(const std::shared_ptr<Texture> &texture, bool mipmap) {
+		Entry *e = findEntry(texture.get());
+		if (e) {
+			e->shared = texture;
+			e->mipmap = mipmap;
+		}
+	}
+};
+
+std::shared_ptr<Texture2D> TextureCache::getTexture2D(const std::string &filename,
+	GLenum minfilter, GLenum magfilter, GLenum wrap_s, GLenum wrap_t, bool mipmap,
+	GLenum internalFormat, const ImageLoader *images) {
+	FileKey key;
+	if (makeKey({ filename }, GL_TEXTURE_2D, internalFormat, false, key)) {
+		auto t = findShared(key, minfilter, magfilter, wrap_s, wrap_t, mipmap);
+		if (t)
+			return std::static_pointer_cast<Texture2D>(t);
+	}
+
+	// Texture2DGeneric::loadImage registra la textura en la caché
+	auto t = std::make_shared<Texture2D>(minfilter, magfilter, wrap_s, wrap_t);
+	const ImageLoader::Decoded *decoded = images ? images->get(filename) : nullptr;
+	if (decoded && decoded->image)
+		t->loadImage(filename, *decoded->image, internalFormat);
+	else
+		t->loadImage(filename, internalFormat);
+	if (mipmap) {
+		if (decoded && !decoded->mipmapLevels.empty())
+			t->loadMipmaps(decoded->mipmapLevels);
+		else
+			t->generateMipmap();
+	}
+	share(t, mipmap);
+	return t;
+}
+
+std::shared_ptr<TextureCubeMap> TextureCache::getTextureCubeMap(const std::string &filename,
+	bool flipV, GLenum minfilter, GLenum magfilter, GLenum wrap_s, GLenum wrap_t) {
+	FileKey key;
+	if (makeKey(TextureCubeMap::getFaceFilenames(filename), GL_TEXTURE_CUBE_MAP, 0, flipV, key)) {
+		auto t = findShared(key, minfilter, magfilter, wrap_s, wrap_t, false);
+		if (t)
+			return std::static_pointer_cast<TextureCubeMap>(t);
+	}
+
+	auto t = std::make_shared<TextureCubeMap>(minfilter, magfilter, wrap_s, wrap_t);
+	t->loadImages(filename, flipV);
+	share(t, false);
+	return t;
+}
+
+bool TextureCache::find(const std::vector<std::string> &files, GLenum target, GLenum internalFormat,
+	bool flipV, Source &src) {
+	FileKey key;
+	if (!(GLEW_VERSION_4_3 || GLEW_ARB_copy_image) ||
+		!makeKey(files, target, internalFormat, flipV, key)) {
+		cache().stats.misses++;
+		return false;
+	}
+	auto it = cache().entries.find(key);
+	if (it == cache().entries.end() || it->second.empty()) {
+		cache().stats.misses++;
+		return false;
+	}
+	const Entry &e = it->second.front();
+	src.texture = e.texture;
+	src.width = e.width;
+	src.height = e.height;
+	src.internalFormat = e.actualFormat;
+	transferFormat(src.internalFormat, src.format, src.type);
+	cache().stats.copies++;
+	return true;
+}
+
+bool TextureCache::contains(const std::vector<std::string> &files, GLenum target, GLenum internalFormat,
+	bool flipV) {
+	FileKey key;
+	if (!makeKey(files, target, internalFormat, flipV, key))
+		return false;
+	auto it = cache().entries.find(key);
+	return it != cache().entries.end() && !it->second.empty();
+}
+
+void TextureCache::add(Texture &texture, const std::vector<std::string> &files, GLenum internalFormat,
+	bool flipV, GLsizei width, GLsizei height, GLenum actualFormat) {
+	forget(&texture);
+	FileKey key;
+	if (!makeKey(files, texture.getTextureType(), internalFormat, flipV, key))
+		return;
+	Entry e;
+	e.texture = &texture;
+	e.mipmap = false;
+	e.width = width;
+	e.height = height;
+	e.actualFormat = actualFormat;
+	cache().entries[key].push_back(e);
+	cache().keys[&texture] = key;
+}
+
+void TextureCache::forget(const Texture *texture) {
+	auto &c = cache();
+	auto k = c.keys.find(texture);
+	if (k == c.keys.end())
+		return;
+	auto it = c.entries.find(k->second);
+	if (it != c.entries.end()) {
+		auto &v = it->second;
+		v.erase(std::remove_if(v.begin(), v.end(), [texture](const Entry &e) { return e.texture == texture; }), v.end());
+		if (v.empty())
+			c.entries.erase(it);
+	}
+	c.keys.erase(k);
+}
+
+void TextureCache::clear() {
+	cache().entries.clear();
+	cache().keys.clear();
+}
+
+TextureCache::Stats TextureCache::getStats() {
+	Stats s = cache().stats;
+	s.entries = cache().keys.size();
+	return s;
+}
+
+void TextureCache::resetStats() {
+	cache().stats = Stats();
+}
@@ -2,6 +2,8 @@
 #include "textureCubeMap.h"
 #include "log.h"
 #include "image.h"
+#include "textureCache.h"
+#include "imageLoader.h"
 
 #ifdef _WIN32
 #pragma warning(push)
@@ -21,6 +23,8 @@
 
 using PGUPV::TextureCubeMap;
 using PGUPV::Image;
+using PGUPV::TextureCache;
+using PGUPV::ImageLoader;
 
 using std::string;
 
@@ -32,13 +36,20 @@ TextureCubeMap::TextureCubeMap(GLenum minfilter, GLenum magfilter,
 
 bool TextureCubeMap::loadImage(GLenum face, std::string filename, bool flipV,
 	std::ostream * /* error_output */) {
-	_ready = false;
-
 	Image image(filename);
 
 	if (flipV)
 		image.flipV();
 
+	loadImage(face, image);
+	_name = PGUPV::getFilenameFromPath(filename);
+	return _ready;
+}
+
+bool TextureCubeMap::loadImage(GLenum face, const Image &image) {
+	_ready = false;
+	TextureCache::forget(this);
+
 	glBindTexture(GL_TEXTURE_CUBE_MAP, _texId);
 	/* Create and load textures to OpenGL */
 	glTexImage2D(face, 0, image.getSuggestedGLInternalFormatType(), image.getWidth(), image.getHeight(), 0,
@@ -71,8 +82,6 @@ bool TextureCubeMap::loadImage(GLenum face, std::string filename, bool flipV,
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, _wrap_t);
 		_ready = true;
 	}
-
-	_name = PGUPV::getFilenameFromPath(filename);
 	return _ready;
 }
 
@@ -80,6 +89,7 @@ bool TextureCubeMap::loadDDS(std::string filename, std::ostream * /*error_output
 	gli::texture Texture = gli::load(filename);
 	if (Texture.empty())
 		return false;
+	TextureCache::forget(this);
 
 	gli::gl GL(gli::gl::PROFILE_GL33);
 	gli::gl::format const Format = GL.translate(Texture.format(), Texture.swizzles());
@@ -128,10 +138,7 @@ bool TextureCubeMap::loadDDS(std::string filename, std::ostream * /*error_output
 	return _ready;
 }
 
-bool TextureCubeMap::loadImages(string filename, bool flipV,
-	std::ostream *error_output) {
-	CHECK_GL();
-
+std::vector<std::string> TextureCubeMap::getFaceFilenames(const std::string &filename) {
 	string::size_type dot = filename.find_last_of('.');
 	string::size_type slash = filename.find_first_of('/');
 	if (slash == string::npos)
@@ -143,17 +150,62 @@ bool TextureCubeMap::loadImages(string filename, bool flipV,
 
 	string extension = filename.substr(dot);
 	string basename = filename.substr(0, dot);
+	return std::vector<std::string> {
+		basename + "posx" + extension, basename + "negx" + extension,
+		basename + "posy" + extension, basename + "negy" + extension,
+		basename + "posz" + extension, basename + "negz" + extension
+	};
+}
 
-	loadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X, basename + "posx" + extension,
-		flipV, error_output);
-	loadImage(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, basename + "negx" + extension,
-		flipV, error_output);
-	loadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, basename + "posy" + extension,
-		flipV, error_output);
-	loadImage(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, basename + "negy" + extension,
-		flipV, error_output);
-	loadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, basename + "posz" + extension,
-		flipV, error_output);
-	return loadImage(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
-		basename + "negz" + extension, flipV, error_output);
+bool TextureCubeMap::loadImages(string filename, bool flipV,
+	std::ostream *error_output) {
+	CHECK_GL();
+
+	auto files = getFaceFilenames(filename);
+
+	// Si otro mapa cúbico ya tiene las imágenes, se copian en la GPU sin leer los ficheros
+	TextureCache::forget(this);
+	TextureCache::Source src;
+	if (TextureCache::find(files, GL_TEXTURE_CUBE_MAP, 0, flipV, src)) {
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _texId);
+		for (GLenum face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, src.internalFormat, src.width, src.height,
+				0, src.format, src.type, nullptr);
+		glCopyImageSubData(src.texture->getId(), GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+			_texId, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, src.width, src.height, 6);
+		CHECK_GL2("Error copiando las imágenes del mapa cúbico " + src.texture->getName());
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, _magfilter);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, _minfilter);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, _wrap_s);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, _wrap_t);
+		loadedFaces = 63;
+		_name = PGUPV::getFilenameFromPath(files.back());
+		_ready = true;
+	}
+	else {
+		// Las seis caras se decodifican en paralelo
+		ImageLoader images;
+		for (const auto &f : files)
+			images.add(f, flipV);
+		images.decode();
+		for (GLenum face = 0; face < 6; face++) {
+			auto decoded = images.get(files[face], flipV);
+			if (decoded->image)
+				loadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, *decoded->image);
+			else
+				loadImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, files[face], flipV, error_output);
+		}
+		_name = PGUPV::getFilenameFromPath(files.back());
+	}
+
+	if (_ready) {
+		GLint width, height, format;
+		glBindTexture(GL_TEXTURE_CUBE_MAP, _texId);
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+		_internalFormat = format;
+		TextureCache::add(*this, files, 0, flipV, width, height, format);
+	}
+	return _ready;
 }
@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "threadPool.h"
+
+using PGUPV::ThreadPool;
+
+// Indica si el hilo actual es uno de los trabajadores de algún pool
+static thread_local bool isWorkerThread = false;
+
+ThreadPool &ThreadPool::getInstance() {
+	static ThreadPool instance;
+	return instance;
+}
+
+ThreadPool::ThreadPool(unsigned int nthreads) : stopping(false) {
+	if (nthreads == 0) {
+		nthreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned int i = 0; i < nthreads; i++) {
+		workers.emplace_back([this]() { workerLoop(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (auto &w : workers)
+		w.join();
+}
+
+void ThreadPool::workerLoop() {
+	isWorkerThread = true;
+	for (;;) {
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task) {
+	std::packaged_task<void()> pt(std::move(task));
+	auto f = pt.get_future();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push(std::move(pt));
+	}
+	cv.notify_one();
+	return f;
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)> &f,
+	size_t minChunk) {
+	if (end <= begin)
+		return;
+
+	size_t n = end - begin;
+	size_t nchunks = std::min<size_t>(workers.size() + 1, (n + minChunk - 1) / std::max<size_t>(minChunk, 1));
+	// Si el rango es pequeño, o nos llaman desde un trabajador (podríamos bloquear el
+	// pool esperando a tareas que nadie va a ejecutar), lo hacemos todo en este hilo
+	if (nchunks <= 1 || isWorkerThread) {
+		f(begin, end);
+		return;
+	}
+
+	size_t chunkSize = (n + nchunks - 1) / nchunks;
+	std::vector<std::future<void>> pending;
+	pending.reserve(nchunks - 1);
+	for (size_t b = begin + chunkSize; b < end; b += chunkSize) {
+		size_t e = std::min(end, b + chunkSize);
+		pending.push_back(submit([&f, b, e]() { f(b, e); }));
+	}
+	// Hay que esperar a todos los trozos antes de relanzar una excepción, porque las
+	// tareas tienen una referencia a f
+	std::exception_ptr error;
+	try {
+		f(begin, std::min(end, begin + chunkSize));
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+	for (auto &p : pending) {
+		try {
+			p.get();
+		}
+		catch (...) {
+			if (!error) error = std::current_exception();
+		}
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
@@ -0,0 +1,111 @@
+#include <cstring>
+
+#include "uniformStream.h"
+#include "bufferObject.h"
+#include "bindingPoint.h"
+#include "indexedBindingPoint.h"
+#include "log.h"
+
+using PGUPV::UniformStream;
+using PGUPV::BufferObject;
+
+std::shared_ptr<UniformStream> UniformStream::current;
+
+namespace {
+	size_t alignUp(size_t v, size_t alignment) {
+		return (v + alignment - 1) / alignment * alignment;
+	}
+	// Tiempo máximo de cada espera a una valla (en nanosegundos)
+	const GLuint64 FENCE_TIMEOUT = 1000000000;
+};
+
+bool UniformStream::isSupported() {
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+std::shared_ptr<UniformStream> UniformStream::build(size_t bytesPerFrame, uint nFrames) {
+	if (!isSupported())
+		ERRT("UniformStream necesita OpenGL 4.4 o GL_ARB_buffer_storage");
+	if (nFrames < 2)
+		ERRT("UniformStream necesita al menos dos regiones");
+	return std::shared_ptr<UniformStream>(new UniformStream(bytesPerFrame, nFrames));
+}
+
+void UniformStream::setCurrent(std::shared_ptr<UniformStream> stream) {
+	current = stream;
+}
+
+UniformStream::UniformStream(size_t bytesPerFrame, uint nFrames) :
+	mapped(nullptr), head(0), nRegions(nFrames), region(0), fences(nFrames, nullptr), generation(0) {
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment <= 0)
+		alignment = 256;
+	regionSize = alignUp(bytesPerFrame, alignment);
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	buffer = BufferObject::buildImmutable(regionSize * nRegions, flags);
+	buffer->setGlDebugLabel("UniformStream");
+	auto prev = gl_copy_write_buffer.bind(buffer);
+	mapped = static_cast<unsigned char *>(gl_copy_write_buffer.map(0, buffer->getSize(), flags));
+	gl_copy_write_buffer.bind(prev);
+	if (!mapped)
+		ERRT("UniformStream: no se ha podido mapear el buffer");
+	INFO("UniformStream creado: " + std::to_string(nRegions) + " regiones de " + std::to_string(regionSize) + " bytes");
+}
+
+UniformStream::~UniformStream() {
+	for (auto f : fences) {
+		if (f)
+			glDeleteSync(f);
+	}
+	// Al destruir el buffer se deshace el mapeo
+}
+
+GLintptr UniformStream::write(const void *data, size_t size) {
+	if (size > regionSize)
+		ERRT("UniformStream: el bloque (" + std::to_string(size) + " bytes) no cabe en una región");
+	if (head + size > regionSize) {
+		stats.overflows++;
+		nextRegion();
+	}
+	GLintptr offset = static_cast<GLintptr>(region * regionSize + head);
+	memcpy(mapped + offset, data, size);
+	head = alignUp(head + size, alignment);
+	stats.bytesWritten += size;
+	stats.writes++;
+	return offset;
+}
+
+void UniformStream::bind(std::shared_ptr<BufferObject> owner, GLuint index, const void *data, size_t size) {
+	GLintptr offset = write(data, size);
+	gl_uniform_buffer.bindBufferRange(owner, index, buffer, offset, size);
+}
+
+void UniformStream::endFrame() {
+	if (head > 0)
+		nextRegion();
+}
+
+void UniformStream::nextRegion() {
+	if (fences[region])
+		glDeleteSync(fences[region]);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region = (region + 1) % nRegions;
+	head = 0;
+	generation++;
+
+	GLsync &fence = fences[region];
+	if (!fence)
+		return;
+	GLenum r = glClientWaitSync(fence, 0, 0);
+	if (r == GL_TIMEOUT_EXPIRED) {
+		stats.stalls++;
+		do {
+			r = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+		} while (r == GL_TIMEOUT_EXPIRED);
+	}
+	if (r == GL_WAIT_FAILED)
+		WARN("UniformStream: error esperando a la GPU");
+	glDeleteSync(fence);
+	fence = nullptr;
+}
@@ -18,6 +18,7 @@
 #include <regex>
 #include <string>
 #include <cstdio>
+#include <cstdlib>
 #ifdef _WIN32
 #include <direct.h>
 #else
@@ -236,6 +237,37 @@ long long PGUPV::getFileModificationTime(const std::string &pathname) {
 #endif
 }
 
+bool PGUPV::getFileStamp(const std::string &pathname, FileStamp &stamp) {
+  struct stat st;
+  if (stat(pathname.c_str(), &st) == -1)
+    return false;
+#ifdef _WIN32
+  stamp.mtimeNs = static_cast<long long>(st.st_mtime) * 1000000000LL;
+#elif defined(__APPLE__)
+  stamp.mtimeNs = static_cast<long long>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  stamp.mtimeNs = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+  stamp.size = static_cast<long long>(st.st_size);
+  return true;
+}
+
+std::string PGUPV::getCanonicalPath(const std::string &pathname) {
+#ifdef _WIN32
+  char full[_MAX_PATH];
+  if (!fileExists(pathname) || _fullpath(full, pathname.c_str(), _MAX_PATH) == nullptr)
+    return pathname;
+  return std::string(full);
+#else
+  char *full = realpath(pathname.c_str(), nullptr);
+  if (full == nullptr)
+    return pathname;
+  std::string result(full);
+  free(full);
+  return result;
+#endif
+}
+
 
 std::string PGUPV::getCurrentDateTimeString() {
 
@@ -417,8 +449,10 @@ std::pair<size_t, size_t> searchVariable(const std::string &line) {
 }
 
 Strings PGUPV::expandText(const std::map<std::string, Strings> &transTable,
-  const Strings &org) {
+  const Strings &org, std::vector<size_t> *origin) {
   Strings dst;
+  if (origin)
+    origin->clear();
 
   Strings::size_type otam = org.size();
   for (uint i = 0; i < otam; i++) {
@@ -451,6 +485,8 @@ Strings PGUPV::expandText(const std::map<std::string, Strings> &transTable,
           dst.push_back(suffix);
       }
     }
+    if (origin)
+      origin->resize(dst.size(), i);
   }
   return dst;
 }
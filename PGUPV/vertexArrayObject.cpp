@@ -4,15 +4,19 @@
 
 using PGUPV::VertexArrayObject;
 
-VertexArrayObject::VertexArrayObject() {
-	glGenVertexArrays(1, &vao);
+// El VAO se crea al vincularlo por primera vez, así que se pueden construir mallas (y grafos
+// de escena) sin contexto OpenGL
+VertexArrayObject::VertexArrayObject() : vao(0) {
 }
 
 VertexArrayObject::~VertexArrayObject() {
-	glDeleteVertexArrays(1, &vao);
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
 }
 
 void VertexArrayObject::bind() {
+	if (!vao)
+		glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 }
 
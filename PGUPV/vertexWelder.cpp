@@ -0,0 +1,171 @@
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "vertexWelder.h"
+#include "log.h"
+
+using PGUPV::VertexWelder;
+
+namespace {
+	struct CellKey {
+		int64_t x, y, z;
+		bool operator==(const CellKey &o) const { return x == o.x && y == o.y && z == o.z; }
+	};
+
+	const uint NONE = std::numeric_limits<uint>::max();
+
+	/*
+	Tabla hash de direccionamiento abierto (sondeo lineal) de celda -> último vértice
+	insertado en la celda. Nunca se borra nada y el tamaño se conoce de antemano, así
+	que es mucho más sencilla (y rápida) que un std::unordered_map
+	*/
+	class CellTable {
+	public:
+		explicit CellTable(size_t n) {
+			size_t cap = 16;
+			while (cap < 2 * n) cap <<= 1;
+			mask = cap - 1;
+			keys.resize(cap);
+			heads.assign(cap, NONE);
+		}
+		// Devuelve el primer vértice de la celda, o NONE si está vacía
+		uint find(const CellKey &k) const {
+			for (size_t i = hash(k) & mask;; i = (i + 1) & mask) {
+				if (heads[i] == NONE) return NONE;
+				if (keys[i] == k) return heads[i];
+			}
+		}
+		// Inserta el vértice v en la celda, y devuelve el que era el primero (o NONE)
+		uint insert(const CellKey &k, uint v) {
+			for (size_t i = hash(k) & mask;; i = (i + 1) & mask) {
+				if (heads[i] == NONE) {
+					keys[i] = k;
+					heads[i] = v;
+					return NONE;
+				}
+				if (keys[i] == k) {
+					uint prev = heads[i];
+					heads[i] = v;
+					return prev;
+				}
+			}
+		}
+	private:
+		static size_t hash(const CellKey &k) {
+			uint64_t h = static_cast<uint64_t>(k.x) * 73856093ULL;
+			h ^= static_cast<uint64_t>(k.y) * 19349663ULL;
+			h ^= static_cast<uint64_t>(k.z) * 83492791ULL;
+			// Mezclamos los bits altos con los bajos, que son los que usa la máscara
+			h ^= h >> 29;
+			h *= 0xbf58476d1ce4e5b9ULL;
+			h ^= h >> 32;
+			return static_cast<size_t>(h);
+		}
+		size_t mask;
+		std::vector<CellKey> keys;
+		std::vector<uint> heads;
+	};
+
+	// Busca la raíz del conjunto (con compresión de caminos)
+	uint findRoot(std::vector<uint> &parent, uint a) {
+		uint root = a;
+		while (parent[root] != root)
+			root = parent[root];
+		while (parent[a] != root) {
+			uint next = parent[a];
+			parent[a] = root;
+			a = next;
+		}
+		return root;
+	}
+
+	// Une dos conjuntos. La raíz es siempre el índice menor, para que el representante
+	// de cada grupo sea su primer vértice
+	void join(std::vector<uint> &parent, uint a, uint b) {
+		uint ra = findRoot(parent, a);
+		uint rb = findRoot(parent, b);
+		if (ra == rb) return;
+		if (ra < rb) parent[rb] = ra;
+		else parent[ra] = rb;
+	}
+};
+
+VertexWelder::VertexWelder(float epsilon) : epsilon(epsilon) {
+	if (epsilon <= 0.0f)
+		ERRT("VertexWelder: epsilon tiene que ser mayor que cero");
+}
+
+std::vector<uint> VertexWelder::weld(const float *vertices, uint ncomponents, size_t n) const {
+	if (ncomponents < 1 || ncomponents > 4)
+		ERRT("VertexWelder: los vértices tienen que tener entre 1 y 4 componentes");
+	if (n >= NONE)
+		ERRT("VertexWelder: demasiados vértices");
+
+	std::vector<uint> parent(n);
+	for (size_t i = 0; i < n; i++)
+		parent[i] = static_cast<uint>(i);
+
+	const uint dims = ncomponents < 3 ? ncomponents : 3;
+	// Con celdas de lado 2*epsilon, un vértice a menos de epsilon sólo puede estar en la
+	// misma celda o en la vecina del lado de la celda más cercano: 8 celdas en vez de 27
+	const float invCell = 0.5f / epsilon;
+	const float eps2 = epsilon * epsilon;
+
+	auto coord = [vertices, ncomponents, dims](size_t i, uint c) {
+		return c < dims ? vertices[i * ncomponents + c] : 0.0f;
+	};
+
+	// Cada celda guarda el último vértice insertado, y cada vértice el anterior de su
+	// celda (listas enlazadas sobre un único vector, sin reservas de memoria por celda)
+	CellTable cells(n);
+	std::vector<uint> next(n, NONE);
+
+	for (size_t i = 0; i < n; i++) {
+		float p[3] = { coord(i, 0), coord(i, 1), coord(i, 2) };
+		int64_t c[3];
+		int64_t side[3];
+		for (int k = 0; k < 3; k++) {
+			float g = p[k] * invCell;
+			float fl = std::floor(g);
+			c[k] = static_cast<int64_t>(fl);
+			side[k] = (g - fl < 0.5f) ? -1 : 1;
+		}
+
+		// Buscamos vértices ya insertados en la celda del vértice y en sus vecinas
+		bool exactCopy = false;
+		for (int64_t dx = 0; dx <= 1; dx++) {
+			for (int64_t dy = 0; dy <= 1; dy++) {
+				for (int64_t dz = 0; dz <= 1; dz++) {
+					uint head = cells.find(CellKey{ c[0] + dx * side[0], c[1] + dy * side[1], c[2] + dz * side[2] });
+					for (uint j = head; j != NONE && !exactCopy; j = next[j]) {
+						if (findRoot(parent, j) == findRoot(parent, static_cast<uint>(i)))
+							continue;
+						float d0 = p[0] - coord(j, 0), d1 = p[1] - coord(j, 1), d2 = p[2] - coord(j, 2);
+						if (d0 * d0 + d1 * d1 + d2 * d2 < eps2) {
+							join(parent, static_cast<uint>(i), j);
+							exactCopy = d0 == 0.0f && d1 == 0.0f && d2 == 0.0f;
+						}
+					}
+				}
+			}
+		}
+
+		// Si ya hay un vértice en la misma posición exacta, éste no aporta nada nuevo a la
+		// rejilla (cualquier vértice cercano a él lo será también al otro)
+		if (!exactCopy)
+			next[i] = cells.insert(CellKey{ c[0], c[1], c[2] }, static_cast<uint>(i));
+	}
+
+	for (size_t i = 0; i < n; i++)
+		parent[i] = findRoot(parent, static_cast<uint>(i));
+	return parent;
+}
+
+size_t VertexWelder::countGroups(const std::vector<uint> &representatives) {
+	size_t count = 0;
+	for (size_t i = 0; i < representatives.size(); i++) {
+		if (representatives[i] == i) count++;
+	}
+	return count;
+}
@@ -16,6 +16,8 @@
 #include "utils.h"
 #include "logConsole.h"
 #include "guipg.h"
+#include "uniformStream.h"
+#include "frameCapture.h"
 
 using PGUPV::Window;
 using PGUPV::Renderer;
@@ -47,6 +49,8 @@ Window::~Window() {
 }
 
 void Window::destroy() {
+	// Se escriben las capturas pendientes mientras aún existe el contexto OpenGL
+	frameCapture.reset();
 	deregisterEventHandlers();
 	renderers.clear();
 	window.reset();
@@ -262,6 +266,7 @@ void Window::draw() {
 	}
 
 	glstats.endFrame();
+	GLMatrices::endFrame();
 
 	if (!renderers.empty() && _showBuffer != Window::COLOR_BUFFER) {
 		_bufferRenderer->showBuffer();
@@ -273,6 +278,10 @@ void Window::draw() {
 
 	if (_showHelp)
 		_helpOverlay->render();
+
+	// Lo que queda del frame en el stream de uniforms no se reutilizará hasta que la GPU lo haya leído
+	if (auto stream = UniformStream::getCurrent())
+		stream->endFrame();
 }
 
 void Window::drawGUIandStats() {
@@ -345,6 +354,8 @@ void Window::drawGUIandStats() {
 
 void Window::swapBuffers() {
 	window->swapBuffers();
+	if (frameCapture)
+		frameCapture->update();
 }
 
 void Window::resizeRenderer(std::shared_ptr<Renderer> r) {
@@ -498,6 +509,21 @@ bool Window::saveColorBuffer(const std::string &filename, GLint framebuffer) {
 	return true;
 }
 
+bool Window::captureColorBuffer(const std::string &filename, GLint framebuffer) {
+	return getFrameCapture().capture(filename, 0, 0, _width, _height, framebuffer);
+}
+
+PGUPV::FrameCapture &Window::getFrameCapture() {
+	if (!frameCapture)
+		frameCapture.reset(new FrameCapture());
+	return *frameCapture;
+}
+
+void Window::flushCaptures() {
+	if (frameCapture)
+		frameCapture->flush();
+}
+
 uint Window::getStencilSize() {
 	assert(window != nullptr);
 	int bpp;
@@ -0,0 +1,24 @@
+#ifndef _CHECK_H
+#define _CHECK_H 2022
+
+#include <iostream>
+
+/*
+Comprobaciones mínimas para las pruebas: CHECK escribe las que fallan y cuenta los
+fallos, y el main de cada prueba devuelve CHECK_RESULT()
+*/
+
+namespace {
+	int checkFailures = 0;
+};
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		std::cerr << __FILE__ << ":" << __LINE__ << ": falla " << #cond << std::endl; \
+		checkFailures++; \
+	} \
+} while (0)
+
+#define CHECK_RESULT() (checkFailures == 0 ? 0 : 1)
+
+#endif
@@ -0,0 +1,193 @@
+#include <memory>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "check.h"
+#include "testScene.h"
+#include "boundingVolumes.h"
+#include "cullVisitor.h"
+#include "group.h"
+#include "transform.h"
+#include "program.h"
+
+using PGUPV::Frustum;
+using PGUPV::BoundingBox;
+using PGUPV::BoundingSphere;
+using PGUPV::CullVisitor;
+using PGUPV::Group;
+using PGUPV::Transform;
+using PGUPV::Program;
+
+/*
+Comprueba, sin GPU, la clasificación de cajas respecto al volumen de la vista
+(Frustum::classify) y el recorrido de CullVisitor
+*/
+
+namespace {
+	// Bits de los planos (ver Frustum::set)
+	const uint LEFT = 1, RIGHT = 2, NEAR_PLANE = 16;
+
+	BoundingBox box(const glm::vec3 &min, const glm::vec3 &max) {
+		return BoundingBox(min, max);
+	}
+
+	Frustum::Result classify(const Frustum &f, const BoundingBox &bb, uint &mask, uint &plane,
+		size_t *tests = nullptr) {
+		mask = Frustum::ALL_PLANES;
+		return f.classify(bb, BoundingSphere(), mask, plane, tests);
+	}
+
+	// Volumen de la vista [-1, 1]^3
+	void testOrtho() {
+		Frustum f(glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
+		uint mask, plane = 0;
+
+		CHECK(classify(f, box(glm::vec3(-0.5f), glm::vec3(0.5f)), mask, plane) == Frustum::Result::INSIDE);
+		CHECK(mask == 0);
+
+		// Sólo corta el plano derecho: es el único que les queda a sus descendientes
+		CHECK(classify(f, box(glm::vec3(0.5f, -0.5f, -0.5f), glm::vec3(1.5f, 0.5f, 0.5f)), mask, plane) ==
+			Frustum::Result::INTERSECTS);
+		CHECK(mask == RIGHT);
+
+		// Fuera por la derecha: devuelve el plano que la descarta
+		plane = 0;
+		size_t tests = 0;
+		BoundingBox right = box(glm::vec3(2.0f, -0.5f, -0.5f), glm::vec3(3.0f, 0.5f, 0.5f));
+		CHECK(classify(f, right, mask, plane, &tests) == Frustum::Result::OUTSIDE);
+		CHECK(plane == 1);
+		CHECK(tests == 2);
+		// Empezando por ese plano, basta una comprobación
+		tests = 0;
+		CHECK(classify(f, right, mask, plane, &tests) == Frustum::Result::OUTSIDE);
+		CHECK(tests == 1);
+
+		// Sin planos que comprobar, se acepta sin comprobar nada
+		mask = 0;
+		tests = 0;
+		CHECK(f.classify(right, BoundingSphere(), mask, plane, &tests) == Frustum::Result::INSIDE);
+		CHECK(tests == 0);
+
+		// Sólo se comprueban los planos de la máscara
+		mask = LEFT;
+		CHECK(f.classify(right, BoundingSphere(), mask, plane) == Frustum::Result::INSIDE);
+
+		// La esfera descarta sin mirar la caja
+		mask = Frustum::ALL_PLANES;
+		plane = 0;
+		CHECK(f.classify(box(glm::vec3(-0.5f), glm::vec3(0.5f)), BoundingSphere(glm::vec3(5.0f, 0.0f, 0.0f), 1.0f),
+			mask, plane) == Frustum::Result::OUTSIDE);
+	}
+
+	// Cámara en el origen mirando hacia -Z, con el plano cercano a 1 y el lejano a 100
+	void testPerspective() {
+		glm::mat4 pv = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 100.0f) *
+			glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum f(pv);
+		uint mask, plane = 0;
+		CHECK(classify(f, box(glm::vec3(-1.0f, -1.0f, -51.0f), glm::vec3(1.0f, 1.0f, -49.0f)), mask, plane) ==
+			Frustum::Result::INSIDE);
+		CHECK(classify(f, box(glm::vec3(-1.0f, -1.0f, 9.0f), glm::vec3(1.0f, 1.0f, 11.0f)), mask, plane) ==
+			Frustum::Result::OUTSIDE);
+		// Entre la cámara y el plano cercano
+		plane = 0;
+		CHECK(classify(f, box(glm::vec3(-0.1f, -0.1f, -0.6f), glm::vec3(0.1f, 0.1f, -0.4f)), mask, plane) ==
+			Frustum::Result::OUTSIDE);
+		CHECK(plane == 4);
+		// Corta el plano cercano
+		CHECK(classify(f, box(glm::vec3(-0.1f, -0.1f, -2.0f), glm::vec3(0.1f, 0.1f, -0.5f)), mask, plane) ==
+			Frustum::Result::INTERSECTS);
+		CHECK(mask == NEAR_PLANE);
+
+		// classify descarta exactamente las cajas que intersects descarta
+		std::mt19937 rng(2022);
+		std::uniform_real_distribution<float> pos(-120.0f, 120.0f), size(0.0f, 20.0f);
+		int mismatches = 0;
+		for (int i = 0; i < 10000; i++) {
+			glm::vec3 min(pos(rng), pos(rng), pos(rng));
+			BoundingBox bb = box(min, min + glm::vec3(size(rng), size(rng), size(rng)));
+			plane = static_cast<uint>(i % 6);
+			bool outside = classify(f, bb, mask, plane) == Frustum::Result::OUTSIDE;
+			if (outside == f.intersects(bb))
+				mismatches++;
+		}
+		CHECK(mismatches == 0);
+	}
+
+	// CullVisitor sólo devuelve las hojas dentro de la vista, y recuerda el plano que
+	// descartó cada nodo
+	void testCullVisitor() {
+		auto mesh = std::make_shared<TestMesh>(glm::vec3(-0.5f), glm::vec3(0.5f));
+		auto root = Group::build();
+		auto inside = buildGeode(mesh);
+		auto moved = Transform::build(glm::translate(glm::mat4(1.0f), glm::vec3(5.0f, 0.0f, 0.0f)));
+		auto outside = buildGeode(mesh);
+		auto hidden = buildGeode(mesh);
+		// Con ésta, la raíz corta los planos izquierdo y derecho
+		auto left = buildGeode(std::make_shared<TestMesh>(glm::vec3(-5.5f, -0.5f, -0.5f), glm::vec3(-4.5f, 0.5f, 0.5f)));
+		root->addChild(left);
+		root->addChild(inside);
+		root->addChild(moved);
+		moved->addChild(outside);
+		root->addChild(hidden);
+		hidden->setVisible(false);
+
+		glm::mat4 ortho = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+		CullVisitor cull;
+		cull.cull(*root, ortho);
+		CHECK(cull.getVisible().size() == 1);
+		if (!cull.getVisible().empty())
+			CHECK(cull.getVisible()[0].node == inside.get());
+		CHECK(cull.getCounters().culled == 2);
+		CHECK(cull.getCounters().invisible == 1);
+		size_t firstTests = cull.getCounters().planeTests;
+
+		// El Transform se descarta ahora con una sola comprobación (antes, dos)
+		cull.cull(*root, ortho);
+		CHECK(cull.getCounters().planeTests + 1 == firstTests);
+
+		// Moviendo la vista, el Transform queda dentro y su hoja lleva su matriz
+		cull.cull(*root, ortho * glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f, 0.0f, 0.0f)));
+		CHECK(cull.getVisible().size() == 1);
+		if (!cull.getVisible().empty()) {
+			CHECK(cull.getVisible()[0].node == outside.get());
+			CHECK(cull.getVisible()[0].modelMatrix == moved->getTransform());
+		}
+	}
+
+	// Cada hoja visible lleva el programa del nodo más cercano que tenga uno, aunque sea un
+	// antecesor
+	void testCullProgram() {
+		auto pt = std::make_shared<Program>(), pg = std::make_shared<Program>();
+		auto mesh = std::make_shared<TestMesh>(glm::vec3(-0.5f), glm::vec3(0.5f));
+		auto root = Group::build();
+		auto plain = buildGeode(mesh);
+		auto t = Transform::build(glm::mat4(1.0f));
+		t->setProgram(pt);
+		auto child = buildGeode(mesh);
+		auto own = buildGeode(mesh);
+		own->setProgram(pg);
+		root->addChild(plain);
+		root->addChild(t);
+		t->addChild(child);
+		t->addChild(own);
+
+		CullVisitor cull;
+		cull.cull(*root, glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
+		const auto &visible = cull.getVisible();
+		CHECK(visible.size() == 3);
+		if (visible.size() == 3) {
+			CHECK(visible[0].node == plain.get() && visible[0].program == nullptr);
+			CHECK(visible[1].node == child.get() && visible[1].program == pt.get());
+			CHECK(visible[2].node == own.get() && visible[2].program == pg.get());
+		}
+	}
+};
+
+int main() {
+	testOrtho();
+	testPerspective();
+	testCullVisitor();
+	testCullProgram();
+	return CHECK_RESULT();
+}
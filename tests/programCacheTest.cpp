@@ -0,0 +1,83 @@
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "program.h"
+#include "programCache.h"
+
+using PGUPV::Program;
+using PGUPV::ProgramCache;
+
+/*
+Comprueba, sin GPU, que la clave con la que se guarda un programa en ProgramCache
+(Program::cacheKey) cambia con todo lo que cambia su binario, y sólo con eso
+*/
+
+namespace {
+	const std::vector<std::string> VS = {
+		"#version 330",
+		"$GLMatrices",
+		"in vec4 position;",
+		"void main() { gl_Position = position; }" };
+	const std::vector<std::string> FS = {
+		"#version 330",
+		"out vec4 color;",
+		"void main() { color = vec4($COLOR); }" };
+
+	// Programa de referencia: cada prueba cambia una sola cosa
+	struct Setup {
+		std::vector<std::string> vs = VS, fs = FS;
+		std::string matrices = "uniform mat4 mvp;";
+		std::string color = "1.0";
+		unsigned int positionLoc = 0;
+		std::vector<std::string> varyings;
+	};
+
+	std::string keyOf(const Setup &s) {
+		Program p;
+		p.replaceString("$GLMatrices", s.matrices);
+		p.replaceString("$COLOR", s.color);
+		p.addAttributeLocation(s.positionLoc, "position");
+		if (!s.varyings.empty())
+			p.setTransformFeedbackVaryings(s.varyings, true);
+		p.loadStrings(s.vs, s.fs);
+		return p.cacheKey();
+	}
+};
+
+int main() {
+	// La caché está desactivada por defecto
+	CHECK(!ProgramCache::isEnabled());
+
+	const std::string base = keyOf(Setup());
+	// Dos programas iguales comparten la clave
+	CHECK(keyOf(Setup()) == base);
+
+	Setup source;
+	source.fs[2] = "void main() { color = vec4(0.5); }";
+	CHECK(keyOf(source) != base);
+
+	// Las sustituciones se aplican antes de calcular la clave
+	Setup replaced;
+	replaced.color = "0.5";
+	CHECK(keyOf(replaced) != base);
+	Setup block;
+	block.matrices = "uniform mat4 mvp; uniform mat4 model;";
+	CHECK(keyOf(block) != base);
+
+	Setup location;
+	location.positionLoc = 3;
+	CHECK(keyOf(location) != base);
+
+	Setup varyings;
+	varyings.varyings = { "position" };
+	CHECK(keyOf(varyings) != base);
+
+	// Un shader de otro tipo con el mismo código es otro programa
+	Setup swapped;
+	swapped.vs = FS;
+	swapped.fs = VS;
+	CHECK(keyOf(swapped) != base);
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,148 @@
+#include <memory>
+#include <vector>
+
+#include "check.h"
+#include "testScene.h"
+#include "renderQueue.h"
+#include "program.h"
+#include "group.h"
+#include "transform.h"
+
+using PGUPV::RenderQueue;
+using PGUPV::RecordingRenderBackend;
+using PGUPV::DrawPacket;
+using PGUPV::Program;
+using PGUPV::BaseMaterial;
+using PGUPV::Mesh;
+using PGUPV::Group;
+using PGUPV::Transform;
+
+/*
+Comprueba, sin GPU, el orden en el que RenderQueue envía los paquetes a un
+RecordingRenderBackend y los cambios de estado que provoca. La cola no accede a los
+programas, materiales ni mallas, así que no hace falta compilarlos ni subirlos a la GPU
+*/
+
+namespace {
+	// Los materiales sólo se usan como identificadores
+	BaseMaterial *material(int i) {
+		static char storage[4];
+		return reinterpret_cast<BaseMaterial *>(&storage[i]);
+	}
+
+	// La cola agrupa por programa, luego por material y luego por malla, y sólo cambia el
+	// estado cuando hace falta
+	void testSortAndStateChanges() {
+		Program p0, p1;
+		TestMesh m0, m1;
+		glm::mat4 id(1.0f);
+
+		RenderQueue queue;
+		queue.setInstancing(false);
+		queue.add(&p0, material(0), &m0, nullptr, id);
+		queue.add(&p1, material(1), &m1, nullptr, id);
+		queue.add(&p0, material(1), &m0, nullptr, id);
+		queue.add(&p1, material(1), &m0, nullptr, id);
+		queue.add(&p0, material(0), &m1, nullptr, id);
+		queue.add(&p0, material(0), &m0, nullptr, glm::mat4(2.0f));
+
+		RecordingRenderBackend backend;
+		queue.submit(backend);
+
+		const auto &drawn = backend.getDrawn();
+		CHECK(drawn.size() == 6);
+		// Orden esperado (orden de aparición de cada programa, material y malla)
+		struct { Program *p; BaseMaterial *m; Mesh *v; } expected[] = {
+			{ &p0, material(0), &m0 }, { &p0, material(0), &m0 }, { &p0, material(0), &m1 },
+			{ &p0, material(1), &m0 }, { &p1, material(1), &m0 }, { &p1, material(1), &m1 } };
+		for (size_t i = 0; i < drawn.size() && i < 6; i++) {
+			CHECK(drawn[i].program == expected[i].p);
+			CHECK(drawn[i].material == expected[i].m);
+			CHECK(drawn[i].mesh == expected[i].v);
+		}
+
+		const auto &c = backend.getCounters();
+		CHECK(c.programChanges == 2);
+		// Al cambiar de programa se vuelve a establecer el material
+		CHECK(c.materialChanges == 3);
+		// El cambio de programa no obliga a volver a vincular la malla
+		CHECK(c.meshChanges == 4);
+		CHECK(c.draws == 6);
+		CHECK(c.instancedDraws == 0);
+		// La matriz sólo cambia en el segundo paquete y al volver a la identidad
+		CHECK(c.matrixChanges == 3);
+	}
+
+	// Con el instanciado activado, los paquetes con el mismo estado se envían juntos
+	void testInstancing() {
+		Program p0;
+		TestMesh m0, m1;
+		RenderQueue queue;
+		for (int i = 0; i < 3; i++) {
+			queue.add(&p0, material(0), &m0, nullptr, glm::mat4(float(i + 1)));
+			queue.add(&p0, material(0), &m1, nullptr, glm::mat4(1.0f));
+		}
+		RecordingRenderBackend backend;
+		queue.submit(backend);
+		const auto &c = backend.getCounters();
+		CHECK(c.draws == 2);
+		CHECK(c.instancedDraws == 2);
+		CHECK(c.instances == 6);
+		CHECK(c.meshChanges == 2);
+		CHECK(backend.getDrawn().size() == 6);
+	}
+
+	// collect asigna a cada malla el programa del nodo más cercano que tenga uno
+	void testCollectPerNodeProgram() {
+		Program current;
+		auto pb = std::make_shared<Program>(), pc = std::make_shared<Program>();
+		auto mesh = std::make_shared<TestMesh>();
+
+		auto root = Group::build();
+		auto g1 = buildGeode(mesh);
+		auto t = Transform::build(glm::mat4(1.0f));
+		t->setProgram(pb);
+		auto g2 = buildGeode(mesh);
+		auto g3 = buildGeode(mesh);
+		g3->setProgram(pc);
+		auto g4 = buildGeode(mesh);
+		root->addChild(g1);
+		root->addChild(t);
+		t->addChild(g2);
+		t->addChild(g3);
+		root->addChild(g4);
+
+		RenderQueue queue;
+		queue.setInstancing(false);
+		queue.collect(*root, &current);
+		CHECK(queue.size() == 4);
+
+		RecordingRenderBackend backend;
+		queue.submit(backend);
+		const auto &drawn = backend.getDrawn();
+		CHECK(drawn.size() == 4);
+		if (drawn.size() == 4) {
+			CHECK(drawn[0].program == &current && drawn[0].node == g1.get());
+			CHECK(drawn[1].program == &current && drawn[1].node == g4.get());
+			CHECK(drawn[2].program == pb.get() && drawn[2].node == g2.get());
+			CHECK(drawn[3].program == pc.get() && drawn[3].node == g3.get());
+		}
+		CHECK(backend.getCounters().programChanges == 3);
+
+		// Un nodo invisible no aporta paquetes, y ocultarlo cambia la versión de la raíz (ver
+		// StaticBatch::isUpToDate)
+		uint64_t version = root->getVersion();
+		t->setVisible(false);
+		CHECK(root->getVersion() != version);
+		queue.clear();
+		queue.collect(*root, &current);
+		CHECK(queue.size() == 2);
+	}
+};
+
+int main() {
+	testSortAndStateChanges();
+	testInstancing();
+	testCollectPerNodeProgram();
+	return CHECK_RESULT();
+}
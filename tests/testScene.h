@@ -0,0 +1,32 @@
+#ifndef _TEST_SCENE_H
+#define _TEST_SCENE_H 2022
+
+#include <memory>
+#include <glm/vec3.hpp>
+
+#include "mesh.h"
+#include "model.h"
+#include "geode.h"
+
+/*
+Piezas para construir grafos de escena sin contexto OpenGL: las mallas no tienen datos en
+la GPU, sólo volúmenes de inclusión
+*/
+
+namespace {
+	class TestMesh : public PGUPV::Mesh {
+	public:
+		TestMesh(const glm::vec3 &min = glm::vec3(-1.0f), const glm::vec3 &max = glm::vec3(1.0f)) {
+			bb = PGUPV::BoundingBox(min, max);
+			bs = PGUPV::BoundingSphere(bb.getCenter(), glm::length(max - min) / 2.0f);
+		}
+	};
+
+	std::shared_ptr<PGUPV::Geode> buildGeode(std::shared_ptr<PGUPV::Mesh> mesh) {
+		auto model = std::make_shared<PGUPV::Model>();
+		model->addMesh(mesh);
+		return PGUPV::Geode::build(model);
+	}
+};
+
+#endif